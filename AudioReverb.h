@@ -0,0 +1,571 @@
+#pragma once
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include "ReverbCommon.h"
+#include "DelayArena.h"
+#include "MultistageReverb.h"
+#include "MultiStageReverbPair.h"
+#include "StageStereoizer.h"
+#include "TailTracker.h"
+#include "ParameterQueue.h"
+#include "HalfBandResampler.h"
+#include "ReverbProfiler.h"
+
+namespace project {
+    namespace multistage {
+
+        // One complete reverb: the compile-time engine followed by the stereoizer.
+        // This is what a single Griffin_Reverb voice runs.
+        //
+        // By default the engine and the stereoizer allocate their delay arenas on
+        // construction. A voice pool instead constructs the reverb with
+        // ownDelayMemory = false (or calls detachDelayMemory()) and lends it
+        // getDelayMemorySize() floats with attachDelayMemory(); while no memory
+        // is attached the reverb must not be processed.
+        //
+        // process() sleeps through silence (see TailTracker): once input and
+        // output have been below the silence threshold for longer than a sound
+        // takes to cross the graph, the state is cleared and further silent
+        // blocks just write zeros. The first block with signal wakes it.
+        // processBlock() always runs the engine.
+        //
+        // Parameters can be changed from any thread with setParameter(), from
+        // several at once: changes go through a wait-free queue, are picked up at
+        // the start of the next process() call and ramp to their new value over
+        // setParameterRampSeconds(), one step per controlInterval samples (all
+        // but size, which jumps). The
+        // engine's coefficients are only recomputed for parameters that moved.
+        // The update...() calls below apply a value at once and, like
+        // processBlock(), belong to the audio thread (or to a stopped reverb).
+        //
+        // Eco mode (setProcessingRate()) runs the engine and the stereoizer at
+        // half or a quarter of the host rate: the mono input is decimated with
+        // a half-band filter, the delays and LFOs simply follow the lower rate
+        // (they are in ms), and both outputs are interpolated back up. The
+        // reverb then has no content above about 0.2 of the processing rate
+        // (9.6 kHz at a quarter of 96 kHz) and lags the dry signal by
+        // getLatencySamples() (63 host samples at half rate, 189 at a quarter).
+        // The reverb cannot tell the host about that itself: a plug-in using eco
+        // mode adds getLatencySamples() to the latency it reports (JUCE:
+        // AudioProcessor::setLatencySamples()) after prepare().
+        //
+        // Channels (setChannels()): by default the engine reverbs the mono sum
+        // of the input and the stereoizer's two allpasses make it wide. The
+        // two-tank modes run a second, decorrelated engine next to the first
+        // (MultiStageReverbPair, with CrossFeed between them) and skip the
+        // stereoizer: dual mono feeds the mono sum into both tanks, true
+        // stereo the left input into the left tank and the right into the
+        // right, so the reverb keeps where a sound came from.
+        //
+        // Built with GRIFFIN_PROFILING=1 the reverb owns a ReverbProfiler
+        // (getProfiler()) wired to its engines by prepare(): each block is
+        // timed, split into the LFOs, the stages, the stereoizer and the
+        // resampler, and published with the node levels for another thread
+        // to drain.
+        enum class ReverbParameter { Size, Feedback, Density, SvfCutoff, SvfGain, NumParameters };
+
+        // Rate the reverb runs at, as a fraction of the host rate.
+        enum class ReverbRate { Full = 1, Half = 2, Quarter = 4 };
+
+        // How the input channels reach the engine (see setChannels()).
+        enum class ReverbChannels { Stereoizer, DualMono, TrueStereo };
+
+        template <typename Config, typename CrossFeed = NoCrossFeed>
+        class AudioReverb {
+        public:
+            using Engine = MultiStageReverb<Config>;
+            using Engines = MultiStageReverbPair<Config, CrossFeed>;
+            using Stereoizer = StageStereoizer<typename Engine::Storage, typename Engine::Interpolation>;
+
+            static constexpr size_t NumParameters = static_cast<size_t>(ReverbParameter::NumParameters);
+
+            // Samples per parameter ramp step.
+            static constexpr int controlInterval = 64;
+
+            explicit AudioReverb(bool ownDelayMemory = true)
+                : sampleRate(44100.0),
+                engines(ownDelayMemory, false),
+                stereoizer(ownDelayMemory),
+                hasMemory(ownDelayMemory),
+                ownsMemory(ownDelayMemory)
+            {
+                // The engine starts at size, feedback and density 1. The shelves
+                // keep their StageConfig settings until the cutoff is first set.
+                parameters[index(ReverbParameter::Size)].snapTo(1.f);
+                parameters[index(ReverbParameter::Feedback)].snapTo(1.f);
+                parameters[index(ReverbParameter::Density)].snapTo(1.f);
+                // A parameter with no value yet (the shelf's) records NaN, so that
+                // a resync after dropped changes leaves it at its StageConfig
+                // setting instead of applying a made-up target.
+                for (size_t i = 0; i < NumParameters; ++i)
+                {
+                    parameters[i].advance(0);
+                    latestValues[i].store(parameters[i].hasValue() ? parameters[i].getTarget() : unsetValue, std::memory_order_relaxed);
+                }
+            }
+
+            void prepare(double sr)
+            {
+                sampleRate = sr;
+                rateReducer.setFactor(static_cast<int>(processingRate));
+                const float reverbRate = static_cast<float>(sampleRate / rateReducer.getFactor());
+                engines.prepare(reverbRate);
+                stereoizer.prepare(reverbRate);
+#if GRIFFIN_PROFILING
+                engines.setProfiler(&profiler);
+                profiler.reset();
+#endif
+                stereoizer.setGlobalLfoOutputsPointer(engines.left().globalLfoValues.data());
+                stereoizer.setGlobalLfoBlockPointers(engines.left().globalLfoBlockPtrs.data());
+                stereoizer.setGlobalLfoDepths(engines.left().globalLfoDepths.data());
+                setParameterRampSeconds(rampSeconds);
+                takeParameterChanges();
+                applyParameters(0, false);
+                // The stages' prepare() put their shelves back to the StageConfig.
+                applySvf();
+                updateTail();
+                tail.wake();
+            }
+
+            void reset()
+            {
+                engines.reset();
+                stereoizer.reset();
+                rateReducer.reset();
+                tail.wake();
+            }
+
+            // Eco mode: the rate the reverb runs at from the next prepare() on.
+            void setProcessingRate(ReverbRate rate) { processingRate = rate; }
+            ReverbRate getProcessingRate() const { return processingRate; }
+
+            // Host-rate samples the reverb lags its input by on top of its own
+            // delays: the resampling filters' in eco mode, else 0.
+            int getLatencySamples() const { return rateReducer.getLatencySamples(); }
+
+            // Delay memory of the engine and the stereoizer together, in floats,
+            // plus the second tank's for the two-tank modes.
+            static constexpr size_t getDelayMemorySize(ReverbChannels forChannels = ReverbChannels::Stereoizer)
+            {
+                return Engine::DelayMemorySize + Stereoizer::DelayMemorySize
+                    + (usesTwoTanks(forChannels) ? Engine::DelayMemorySize : 0);
+            }
+
+            // Runs on `memory` (getDelayMemorySize(getChannels()) floats) from
+            // now on, cleared, and starts from a clean state.
+            void attachDelayMemory(float* memory)
+            {
+                memory = engines.left().attachDelayMemory(memory);
+                memory = stereoizer.attachDelayMemory(memory);
+                if (usesTwoTanks(channels))
+                {
+                    engines.right().attachDelayMemory(memory);
+                    rightHasMemory = true;
+                }
+                reset();
+                hasMemory = true;
+            }
+
+            void detachDelayMemory()
+            {
+                engines.detachDelayMemory();
+                stereoizer.detachDelayMemory();
+                hasMemory = false;
+                rightHasMemory = false;
+            }
+
+            // Stereoizer (the default), DualMono or TrueStereo. Not for the
+            // audio thread: the first switch to a two-tank mode allocates the
+            // second tank's memory if the reverb owns its memory. A reverb on
+            // lent memory is detached instead, and needs
+            // getDelayMemorySize(newChannels) floats from attachDelayMemory().
+            // Starts from a clean state.
+            void setChannels(ReverbChannels newChannels)
+            {
+                channels = newChannels;
+                if (usesTwoTanks(channels) && !rightHasMemory)
+                {
+                    if (ownsMemory)
+                    {
+                        rightArena.allocate(Engine::DelayMemorySize);
+                        engines.right().attachDelayMemory(rightArena.data());
+                        rightHasMemory = true;
+                    }
+                    else if (hasMemory)
+                    {
+                        detachDelayMemory();
+                    }
+                }
+                reset();
+                updateTail();
+            }
+
+            ReverbChannels getChannels() const { return channels; }
+
+            // Decorrelation of the second tank (see MultiStageReverbPair): how far
+            // its delays are shortened (at once) and how far ahead its LFOs
+            // start, in cycles (from the next prepare() or reset()).
+            void setTankDecorrelation(float detune, float lfoPhaseOffset)
+            {
+                engines.setDetune(detune);
+                engines.setLfoPhaseOffset(lfoPhaseOffset);
+                updateTail();
+            }
+
+            bool hasDelayMemory() const { return hasMemory; }
+
+            // Process a block of samples.
+            void process(float* leftChannelData, float* rightChannelData, int numSamples)
+            {
+                const ScopedNoDenormals noDenormals(denormalGuard);
+                takeParameterChanges();
+                const float inputPeak = TailTracker::getPeak(leftChannelData, rightChannelData, numSamples);
+                if (!tail.wantsBlock(inputPeak))
+                {
+                    // Nothing to hear, so nothing to ramp.
+                    applyParameters(0, false);
+                    std::fill(leftChannelData, leftChannelData + numSamples, 0.f);
+                    std::fill(rightChannelData, rightChannelData + numSamples, 0.f);
+                    return;
+                }
+
+                float* left = leftChannelData;
+                float* right = rightChannelData;
+                const int total = numSamples;
+                while (numSamples > 0)
+                {
+                    // Sub-blocks of controlInterval while a ramp is running.
+                    const int n = std::min(numSamples, smoothing ? controlInterval : project::maxBlockSize);
+                    if (smoothing || parametersChanged)
+                        applyParameters(n, true);
+
+                    processBlock(leftChannelData, rightChannelData, leftChannelData, rightChannelData, n);
+
+                    leftChannelData += n;
+                    rightChannelData += n;
+                    numSamples -= n;
+                }
+
+                // Asleep from now on: clear what is left in the lines (all below
+                // the threshold) so waking up starts from silence.
+                if (tail.blockProcessed(inputPeak, TailTracker::getPeak(left, right, total), total))
+                {
+                    engines.reset();
+                    stereoizer.reset();
+                    rateReducer.reset();
+                }
+            }
+
+            // True while process() is skipping silent blocks. An owner lending
+            // delay memory can take it back now (the next attachDelayMemory()
+            // clears it anyway).
+            bool isSleeping() const { return tail.isSleeping(); }
+
+            // True if process() would skip a block whose input peaks at
+            // inputPeak (asleep, input silent) and only write zeros. An owner
+            // running many reverbs (ReverbScheduler) can skip the call instead;
+            // parameter changes then wait for the next block that runs.
+            bool canSkipBlock(float inputPeak) const { return tail.isSleeping() && inputPeak <= tail.getThreshold(); }
+
+            // Input and output level (peak, linear) below which a block counts
+            // as silent. TailTracker::defaultThreshold is about -100 dB.
+            void setSilenceThreshold(float threshold) { tail.setThreshold(threshold); }
+
+            // How long the output rings after the input stops, until it falls
+            // below the silence threshold, for the current parameters.
+            double getTailSeconds() const { return tail.getTailSamples() / sampleRate; }
+
+            // The same, from the level of the last block (0 while asleep).
+            double getRemainingTailSeconds() const { return tail.getRemainingTailSamples() / sampleRate; }
+
+            // Process a stereo block: the mono sum, or each channel into its own
+            // tank in TrueStereo. numSamples must not exceed project::maxBlockSize;
+            // outL may alias inL and outR inR.
+            void processBlock(const float* inL, const float* inR, float* outL, float* outR, int numSamples)
+            {
+                GRIFFIN_PROFILE_BLOCK(&profiler, numSamples);
+                if (channels == ReverbChannels::TrueStereo)
+                {
+                    processTanks(inL, inR, outL, outR, numSamples);
+                    return;
+                }
+                for (int i = 0; i < numSamples; ++i)
+                    monoBuffer[i] = 0.5f * (inL[i] + inR[i]);
+                processBlock(monoBuffer.data(), outL, outR, numSamples);
+            }
+
+            // Process a mono block into stereo (into both tanks in the two-tank
+            // modes). numSamples must not exceed project::maxBlockSize; in may
+            // alias outL.
+            void processBlock(const float* in, float* outL, float* outR, int numSamples)
+            {
+                const ScopedNoDenormals noDenormals(denormalGuard);
+                GRIFFIN_PROFILE_BLOCK(&profiler, numSamples);
+                if (channels != ReverbChannels::Stereoizer)
+                {
+                    if (in != monoBuffer.data())
+                    {
+                        std::copy(in, in + numSamples, monoBuffer.data());
+                        in = monoBuffer.data();
+                    }
+                    processTanks(in, in, outL, outR, numSamples);
+                    return;
+                }
+                // Pass through the reverb engine, then let the stereoizer use the
+                // LFO block the engine just rendered.
+                Engine& engine = engines.left();
+                if (rateReducer.getFactor() == 1)
+                {
+                    engine.processBlock(in, outL, numSamples);
+                    GRIFFIN_PROFILE_SPAN(&profiler, ProfileSpan::Stereoizer);
+                    stereoizer.processBlock(outL, outL, outR, numSamples);
+                    return;
+                }
+                int numReduced;
+                {
+                    GRIFFIN_PROFILE_SPAN(&profiler, ProfileSpan::Resampler);
+                    numReduced = rateReducer.down(in, numSamples, reducedLeft.data());
+                }
+                engine.processBlock(reducedLeft.data(), reducedLeft.data(), numReduced);
+                {
+                    GRIFFIN_PROFILE_SPAN(&profiler, ProfileSpan::Stereoizer);
+                    stereoizer.processBlock(reducedLeft.data(), reducedLeft.data(), reducedRight.data(), numReduced);
+                }
+                GRIFFIN_PROFILE_SPAN(&profiler, ProfileSpan::Resampler);
+                rateReducer.up(reducedLeft.data(), reducedRight.data(), numReduced);
+                rateReducer.pull(outL, outR, numSamples);
+            }
+
+#if GRIFFIN_PROFILING
+            // The reverb's profiler: pop() its frames from one other thread.
+            // setFrameLength() belongs to the audio thread, like processing.
+            typename Engine::Profiler& getProfiler() { return profiler; }
+#endif
+
+            // Flush-to-zero around processing (see MultiStageReverb::setDenormalGuard).
+            void setDenormalGuard(bool enabled) {
+                denormalGuard = enabled;
+                engines.setDenormalGuard(enabled);
+            }
+
+            // Queues a parameter change for the audio thread. Wait-free, from any
+            // number of threads (a host may automate from the audio thread while
+            // the UI moves a knob). Values are in the units of the matching
+            // update...() call (SvfCutoff in Hz, SvfGain in dB).
+            void setParameter(ReverbParameter parameter, float value)
+            {
+                const size_t i = index(parameter);
+                latestValues[i].store(value, std::memory_order_relaxed);
+                // The queue has one producer side: whoever holds producerBusy.
+                // A thread that finds it taken does not wait; like a full queue,
+                // that only loses the ordering, and the audio thread rereads
+                // every latest value instead.
+                bool queued = false;
+                if (!producerBusy.test_and_set(std::memory_order_acquire))
+                {
+                    queued = pendingChanges.push({ i, value });
+                    producerBusy.clear(std::memory_order_release);
+                }
+                if (!queued)
+                    changesDropped.store(true, std::memory_order_release);
+            }
+
+            // Length of the ramp that follows a setParameter() change. Audio
+            // thread, or before prepare(). Size does not ramp: a delay change is a
+            // jump of every read position, and a stepped ramp turns one jump into
+            // a burst of them, so size changes land whole at a block boundary.
+            void setParameterRampSeconds(double seconds)
+            {
+                rampSeconds = seconds;
+                const int samples = static_cast<int>(seconds * sampleRate + 0.5);
+                for (size_t i = 0; i < NumParameters; ++i)
+                    parameters[i].setRampLength(i == index(ReverbParameter::Size) ? 0 : samples);
+            }
+
+            // Drains the queue and finishes any ramp, without processing. For an
+            // owner that skips process() while the reverb is idle.
+            void applyPendingParameters()
+            {
+                takeParameterChanges();
+                applyParameters(0, false);
+            }
+
+            // Update global delay (size) parameter.
+            void updateGlobalSizeParameter(float newSize) {
+                setNow(ReverbParameter::Size, newSize);
+            }
+
+            // Update global feedback parameter (which scales connections flagged for feedback).
+            void updateFeedbackParameter(float newFeedback) {
+                setNow(ReverbParameter::Feedback, newFeedback);
+            }
+
+            // Update global density parameter (scales coefficients for stages flagged for density scaling).
+            void updateGlobalDensityParameter(float newDensity) {
+                setNow(ReverbParameter::Density, newDensity);
+            }
+
+            // Update global SVF parameters for stages that have attached SVF settings.
+            void updateGlobalSVFParameters(float cutoff, float dbGain) {
+                latestValues[index(ReverbParameter::SvfCutoff)].store(cutoff, std::memory_order_relaxed);
+                latestValues[index(ReverbParameter::SvfGain)].store(dbGain, std::memory_order_relaxed);
+                parameters[index(ReverbParameter::SvfCutoff)].snapTo(cutoff);
+                parameters[index(ReverbParameter::SvfGain)].snapTo(dbGain);
+                applyParameters(0, false);
+            }
+
+        private:
+            double sampleRate;
+            Engines engines;                    // The left tank is the engine of the stereoizer mode.
+            Stereoizer stereoizer;
+            bool hasMemory;
+            bool ownsMemory;
+            bool rightHasMemory = false;
+            DelayArena rightArena;              // The right tank's, once an owning reverb needs it.
+#if GRIFFIN_PROFILING
+            typename Engine::Profiler profiler;
+#endif
+            ReverbChannels channels = ReverbChannels::Stereoizer;
+            bool denormalGuard = true;
+            TailTracker tail;
+            std::array<float, project::maxBlockSize> monoBuffer{};
+            ReverbRate processingRate = ReverbRate::Full;
+            RateReducer rateReducer;
+            std::array<float, project::maxBlockSize> reducedLeft{};
+            std::array<float, project::maxBlockSize> reducedRight{};
+
+            struct ParameterChange {
+                size_t index;
+                float value;
+            };
+            SpscQueue<ParameterChange, 64> pendingChanges;
+            std::atomic_flag producerBusy = ATOMIC_FLAG_INIT;   // Held while a producer pushes.
+            std::array<std::atomic<float>, NumParameters> latestValues;
+            std::atomic<bool> changesDropped{ false };
+            std::array<SmoothedParameter, NumParameters> parameters;
+            double rampSeconds = 0.05;
+            bool smoothing = false;
+            bool parametersChanged = false;     // Taken from the queue, not yet applied.
+
+            // latestValues entry of a parameter nobody has set.
+            static constexpr float unsetValue = std::numeric_limits<float>::quiet_NaN();
+
+            static constexpr size_t index(ReverbParameter p) { return static_cast<size_t>(p); }
+
+            // Audio thread: new targets from the queue.
+            void takeParameterChanges()
+            {
+                ParameterChange change;
+                while (pendingChanges.pop(change))
+                {
+                    parameters[change.index].setTarget(change.value);
+                    parametersChanged = true;
+                }
+                if (changesDropped.exchange(false, std::memory_order_acquire))
+                {
+                    for (size_t i = 0; i < NumParameters; ++i)
+                    {
+                        const float latest = latestValues[i].load(std::memory_order_relaxed);
+                        if (!std::isnan(latest))
+                            parameters[i].setTarget(latest);
+                    }
+                    parametersChanged = true;
+                }
+                smoothing = false;
+                for (const auto& p : parameters)
+                    smoothing = smoothing || p.isSmoothing();
+            }
+
+            // Advances every ramp by numSamples (or ends it, without ramp) and
+            // hands the engine only the values that moved.
+            void applyParameters(int numSamples, bool ramp)
+            {
+                bool changed[NumParameters];
+                smoothing = false;
+                parametersChanged = false;
+                for (size_t i = 0; i < NumParameters; ++i)
+                {
+                    changed[i] = ramp ? parameters[i].advance(numSamples) : parameters[i].skip();
+                    smoothing = smoothing || parameters[i].isSmoothing();
+                }
+
+                if (changed[index(ReverbParameter::Size)])
+                    engines.updateGlobalSizeParameter(value(ReverbParameter::Size));
+                if (changed[index(ReverbParameter::Feedback)])
+                    engines.updateFeedbackParameter(value(ReverbParameter::Feedback));
+                if (changed[index(ReverbParameter::Density)])
+                    engines.updateGlobalDensityParameter(value(ReverbParameter::Density));
+                if (changed[index(ReverbParameter::SvfCutoff)] || changed[index(ReverbParameter::SvfGain)])
+                    applySvf();
+
+                if (changed[index(ReverbParameter::Size)] || changed[index(ReverbParameter::Feedback)]
+                    || changed[index(ReverbParameter::Density)])
+                    updateTail();
+            }
+
+            float value(ReverbParameter p) const { return parameters[index(p)].getCurrent(); }
+
+            // A gain without a cutoff means nothing yet; a cutoff alone runs at 0 dB.
+            void applySvf()
+            {
+                if (parameters[index(ReverbParameter::SvfCutoff)].hasValue())
+                    engines.updateGlobalSVFParameters(value(ReverbParameter::SvfCutoff), value(ReverbParameter::SvfGain));
+            }
+
+            void setNow(ReverbParameter p, float newValue)
+            {
+                latestValues[index(p)].store(newValue, std::memory_order_relaxed);
+                parameters[index(p)].snapTo(newValue);
+                applyParameters(0, false);
+            }
+
+            static constexpr bool usesTwoTanks(ReverbChannels c) { return c != ReverbChannels::Stereoizer; }
+
+            // Both tanks at once, each channel into its own. in may be the same
+            // buffer for both (dual mono); outL may alias inL and outR inR.
+            void processTanks(const float* inL, const float* inR, float* outL, float* outR, int numSamples)
+            {
+                const ScopedNoDenormals noDenormals(denormalGuard);
+                if (rateReducer.getFactor() == 1)
+                {
+                    engines.processBlock(inL, inR, outL, outR, numSamples);
+                    return;
+                }
+                int numReduced;
+                {
+                    GRIFFIN_PROFILE_SPAN(&profiler, ProfileSpan::Resampler);
+                    numReduced = rateReducer.down(inL, numSamples, reducedLeft.data(), 0);
+                    if (inR == inL)
+                        std::copy(reducedLeft.begin(), reducedLeft.begin() + numReduced, reducedRight.begin());
+                    else
+                        rateReducer.down(inR, numSamples, reducedRight.data(), 1);
+                }
+                engines.processBlock(reducedLeft.data(), reducedRight.data(), reducedLeft.data(), reducedRight.data(), numReduced);
+                GRIFFIN_PROFILE_SPAN(&profiler, ProfileSpan::Resampler);
+                rateReducer.up(reducedLeft.data(), reducedRight.data(), numReduced);
+                rateReducer.pull(outL, outR, numSamples);
+            }
+
+            // The stereoizer sits after the engine: its delay and ring time add on.
+            // The two-tank modes have no stereoizer but two tanks that may feed
+            // each other (Engines takes the slower). Everything runs at the
+            // reduced rate in eco mode; the tracker counts host samples.
+            void updateTail()
+            {
+                const float factor = static_cast<float>(rateReducer.getFactor());
+                const float latency = static_cast<float>(rateReducer.getLatencySamples());
+                if (usesTwoTanks(channels))
+                {
+                    tail.setTail(factor * engines.getDecay60Samples(), factor * engines.getLongestPathSamples() + latency);
+                    return;
+                }
+                tail.setTail(factor * (engines.left().getDecay60Samples() + stereoizer.getRingSamples()),
+                    factor * (engines.left().getLongestPathSamples() + stereoizer.getTotalDelaySamples()) + latency);
+            }
+        };
+
+    } // namespace multistage
+} // namespace project
@@ -0,0 +1,52 @@
+#pragma once
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+namespace project {
+
+    //==============================================================
+    // DelayArena: one zeroed, 64-byte aligned block of floats that a reverb
+    // carves all its delay lines out of. The size is known at compile time
+    // (see delayArenaFloats), so the arena is allocated once on construction
+    // of its owner and never again on prepare() or a sample-rate change.
+    //==============================================================
+    class DelayArena {
+    public:
+        static constexpr size_t alignmentBytes = 64;
+
+        DelayArena() = default;
+        explicit DelayArena(size_t numFloats) { allocate(numFloats); }
+
+        DelayArena(const DelayArena&) = delete;
+        DelayArena& operator=(const DelayArena&) = delete;
+
+        void allocate(size_t numFloats)
+        {
+            const size_t padFloats = alignmentBytes / sizeof(float);
+            storage.reset(new float[numFloats + padFloats]());
+            const auto address = reinterpret_cast<std::uintptr_t>(storage.get());
+            const size_t skip = ((alignmentBytes - address % alignmentBytes) % alignmentBytes) / sizeof(float);
+            aligned = storage.get() + skip;
+            size = numFloats;
+        }
+
+        // Frees the memory (for owners that switch to borrowed memory).
+        void release()
+        {
+            storage.reset();
+            aligned = nullptr;
+            size = 0;
+        }
+
+        float* data() { return aligned; }
+        size_t getSize() const { return size; }
+
+    private:
+        std::unique_ptr<float[]> storage;
+        float* aligned = nullptr;
+        size_t size = 0;
+    };
+
+} // namespace project
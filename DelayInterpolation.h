@@ -0,0 +1,165 @@
+#pragma once
+#include <type_traits>
+#include "ReverbSimd.h"
+
+namespace project {
+
+    //==============================================================
+    // Fractional delay read policies for the modulated allpass kernels.
+    //
+    //   NoInterpolation        nearest sample. One read, no maths. Picked
+    //                          automatically for APs without an LFO (noLfo)
+    //                          and for APs whose LFO has zero depth.
+    //   LinearInterpolation    two reads (the default, and the original sound).
+    //   AllpassInterpolation   first-order Thiran allpass: flat magnitude, but
+    //                          recursive, so the block path runs it per sample.
+    //   CubicInterpolation     4-point, 3rd-order Lagrange. Four reads.
+    //
+    // A stage picks one with `using Interpolation = ...;` in its StageConfig, a
+    // whole engine with the same line in its Config (see InterpolationOf).
+    //
+    // `delay` is in samples, measured from the write index before the current
+    // sample is stored: a delay of 1 reads the previous input. The kernels clamp
+    // it to at least minDelay, the shortest delay a policy can read without
+    // touching the slot about to be written. The newest sample a read touches
+    // is floor(delay) - readAhead samples old; the vector kernel sizes its
+    // chunks by that. Each policy provides:
+    //   State                         per-line interpolator state (empty unless recursive)
+    //   read<Storage>(buf, mask, writeIndex, delay, state)
+    //   readVec<Storage>(buf, mask, writeIndices, delay)   if vectorizable
+    // All reads are branch-free.
+    //==============================================================
+
+    struct NoInterpolation {
+        struct State {};
+        static constexpr float minDelay = 0.f;
+        static constexpr int readAhead = 0;
+        static constexpr bool vectorizable = true;
+
+        template <typename Storage>
+        static JUCE_FORCEINLINE float read(const typename Storage::Sample* buf, int mask, int writeIndex, float delay, State&)
+        {
+            return Storage::load(buf, (writeIndex - static_cast<int>(delay + 0.5f)) & mask);
+        }
+
+        template <typename Storage>
+        static JUCE_FORCEINLINE simd::FloatVec readVec(const typename Storage::Sample* buf, simd::IntVec mask,
+            simd::IntVec writeIndices, simd::FloatVec delay)
+        {
+            const simd::IntVec d = simd::IntVec::truncate(delay + simd::FloatVec::broadcast(0.5f));
+            return Storage::gather(buf, (writeIndices - d) & mask);
+        }
+    };
+
+    // index0 = w - d_int - 1 weighted by d_frac, index0 + 1 by 1 - d_frac. For a
+    // whole delay this weights index0 by exactly 0, so no branch is needed, and
+    // the result is bit-identical to the original branchy read.
+    struct LinearInterpolation {
+        struct State {};
+        static constexpr float minDelay = 0.f;
+        static constexpr int readAhead = 0;
+        static constexpr bool vectorizable = true;
+
+        template <typename Storage>
+        static JUCE_FORCEINLINE float read(const typename Storage::Sample* buf, int mask, int writeIndex, float delay, State&)
+        {
+            const int dInt = static_cast<int>(delay);
+            const float frac = 1.f - (delay - static_cast<float>(dInt));
+            const int index0 = (writeIndex - dInt - 1) & mask;
+            return (1.f - frac) * Storage::load(buf, index0) + frac * Storage::load(buf, (index0 + 1) & mask);
+        }
+
+        template <typename Storage>
+        static JUCE_FORCEINLINE simd::FloatVec readVec(const typename Storage::Sample* buf, simd::IntVec mask,
+            simd::IntVec writeIndices, simd::FloatVec delay)
+        {
+            const simd::FloatVec one = simd::FloatVec::broadcast(1.f);
+            const simd::IntVec oneI = simd::IntVec::broadcast(1);
+            const simd::IntVec dInt = simd::IntVec::truncate(delay);
+            const simd::FloatVec frac = one - (delay - dInt.toFloat());
+            const simd::IntVec idx0 = (writeIndices - dInt - oneI) & mask;
+            const simd::IntVec idx1 = (idx0 + oneI) & mask;
+            return (one - frac) * Storage::gather(buf, idx0) + frac * Storage::gather(buf, idx1);
+        }
+    };
+
+    // y[n] = eta * (x[n-N] - y[n-1]) + x[n-N-1], eta = (1 - D) / (1 + D), with
+    // the integer part N chosen so that the fraction D stays in [0.5, 1.5),
+    // where the group delay is flattest. The read depends on the previous
+    // read, so there is no vector version.
+    struct AllpassInterpolation {
+        struct State { float previous = 0.f; };
+        static constexpr float minDelay = 1.5f;
+        static constexpr int readAhead = 0;
+        static constexpr bool vectorizable = false;
+
+        template <typename Storage>
+        static JUCE_FORCEINLINE float read(const typename Storage::Sample* buf, int mask, int writeIndex, float delay, State& state)
+        {
+            const int n = static_cast<int>(delay - 0.5f);
+            const float d = delay - static_cast<float>(n);
+            const float eta = (1.f - d) / (1.f + d);
+            const int index0 = (writeIndex - n) & mask;
+            const float y = eta * (Storage::load(buf, index0) - state.previous) + Storage::load(buf, (index0 - 1) & mask);
+            state.previous = y;
+            return y;
+        }
+    };
+
+    // Lagrange through the samples at delays d_int - 1 .. d_int + 2, evaluated
+    // at d_int + f.
+    struct CubicInterpolation {
+        struct State {};
+        static constexpr float minDelay = 2.f;
+        static constexpr int readAhead = 1;
+        static constexpr bool vectorizable = true;
+
+        template <typename T>
+        static JUCE_FORCEINLINE T lagrange(T f, T xm1, T x0, T x1, T x2, T one, T two, T half, T sixth)
+        {
+            const T fm1 = f - one;
+            const T fm2 = f - two;
+            const T fp1 = f + one;
+            const T a = fm1 * fm2;      // (f - 1)(f - 2)
+            const T b = fp1 * f;        // (f + 1) f
+            return sixth * (b * fm1 * x2 - f * a * xm1) + half * (fp1 * a * x0 - b * fm2 * x1);
+        }
+
+        template <typename Storage>
+        static JUCE_FORCEINLINE float read(const typename Storage::Sample* buf, int mask, int writeIndex, float delay, State&)
+        {
+            const int dInt = static_cast<int>(delay);
+            const float f = delay - static_cast<float>(dInt);
+            const int i0 = writeIndex - dInt;
+            return lagrange(f, Storage::load(buf, (i0 + 1) & mask), Storage::load(buf, i0 & mask),
+                Storage::load(buf, (i0 - 1) & mask), Storage::load(buf, (i0 - 2) & mask),
+                1.f, 2.f, 0.5f, 1.f / 6.f);
+        }
+
+        template <typename Storage>
+        static JUCE_FORCEINLINE simd::FloatVec readVec(const typename Storage::Sample* buf, simd::IntVec mask,
+            simd::IntVec writeIndices, simd::FloatVec delay)
+        {
+            using simd::FloatVec;
+            using simd::IntVec;
+            const IntVec oneI = IntVec::broadcast(1);
+            const IntVec dInt = IntVec::truncate(delay);
+            const FloatVec f = delay - dInt.toFloat();
+            const IntVec i0 = writeIndices - dInt;
+            return lagrange(f, Storage::gather(buf, (i0 + oneI) & mask), Storage::gather(buf, i0 & mask),
+                Storage::gather(buf, (i0 - oneI) & mask), Storage::gather(buf, (i0 - oneI - oneI) & mask),
+                FloatVec::broadcast(1.f), FloatVec::broadcast(2.f), FloatVec::broadcast(0.5f), FloatVec::broadcast(1.f / 6.f));
+        }
+    };
+
+    // T::Interpolation if T declares one, else Default.
+    template <typename T, typename Default, typename = void>
+    struct InterpolationSelector { using type = Default; };
+
+    template <typename T, typename Default>
+    struct InterpolationSelector<T, Default, std::void_t<typename T::Interpolation>> { using type = typename T::Interpolation; };
+
+    template <typename T, typename Default = LinearInterpolation>
+    using InterpolationOf = typename InterpolationSelector<T, Default>::type;
+
+} // namespace project
@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace project {
+
+    //==============================================================
+    // DelayMemoryPool: a fixed number of equally sized delay-memory slots that
+    // voices borrow while they sound.
+    //
+    // prepare() is the only call that allocates (message thread). claim() and
+    // release() just scan a handful of slots, so they are safe on the audio
+    // thread. Slots start on 64-byte boundaries.
+    //
+    // When every slot is taken, claim() steals the slot that was claimed the
+    // longest ago and calls onDelayMemoryStolen() on its owner first, so the
+    // owner can drop its pointer before the memory is reused.
+    //==============================================================
+    template <typename Owner>
+    class DelayMemoryPool {
+    public:
+        static constexpr size_t alignmentFloats = 64 / sizeof(float);
+
+        void prepare(size_t floatsPerSlot, int numSlots)
+        {
+            slotStride = (floatsPerSlot + alignmentFloats - 1) / alignmentFloats * alignmentFloats;
+            storage.assign(slotStride * static_cast<size_t>(numSlots) + alignmentFloats, 0.f);
+
+            // Align the first slot; every stride is a multiple of 64 bytes.
+            const auto address = reinterpret_cast<std::uintptr_t>(storage.data());
+            const size_t skip = ((64 - address % 64) % 64) / sizeof(float);
+            float* base = storage.data() + skip;
+
+            slots.assign(static_cast<size_t>(numSlots), Slot{});
+            for (int i = 0; i < numSlots; ++i)
+                slots[static_cast<size_t>(i)].memory = base + slotStride * static_cast<size_t>(i);
+            claimCounter = 0;
+        }
+
+        // Memory for `owner`: a free slot if there is one, else the oldest claimed
+        // slot. Returns nullptr only if the pool has no slots at all.
+        float* claim(Owner* owner)
+        {
+            Slot* pick = nullptr;
+            for (auto& s : slots)
+            {
+                if (s.owner == nullptr) { pick = &s; break; }
+                if (pick == nullptr || s.claimedAt < pick->claimedAt)
+                    pick = &s;
+            }
+            if (pick == nullptr)
+                return nullptr;
+
+            if (pick->owner != nullptr)
+                pick->owner->onDelayMemoryStolen();
+
+            pick->owner = owner;
+            pick->claimedAt = ++claimCounter;
+            return pick->memory;
+        }
+
+        void release(const float* memory)
+        {
+            for (auto& s : slots)
+            {
+                if (s.memory == memory) { s.owner = nullptr; return; }
+            }
+        }
+
+        // Forget every owner (after the owners themselves have let go).
+        void releaseAll()
+        {
+            for (auto& s : slots)
+                s.owner = nullptr;
+        }
+
+        int getNumSlots() const { return static_cast<int>(slots.size()); }
+
+        int getNumClaimed() const
+        {
+            int count = 0;
+            for (const auto& s : slots)
+                count += (s.owner != nullptr) ? 1 : 0;
+            return count;
+        }
+
+        size_t getSlotSize() const { return slotStride; }
+
+    private:
+        struct Slot {
+            float* memory = nullptr;
+            Owner* owner = nullptr;
+            std::uint64_t claimedAt = 0;
+        };
+
+        std::vector<float> storage;
+        std::vector<Slot> slots;
+        size_t slotStride = 0;
+        std::uint64_t claimCounter = 0;
+    };
+
+} // namespace project
@@ -0,0 +1,213 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "ReverbSimd.h"
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace project {
+
+    //==============================================================
+    // Delay-line storage policies. A policy decides the sample type of the
+    // allpass delay buffers and how values are converted on the way in and
+    // out; the allpass maths always run in float.
+    //
+    //   FloatDelayStorage     32-bit float, exact (the default).
+    //   HalfDelayStorage      IEEE 754 binary16: half the memory, ~11 bits of
+    //                         mantissa. Uses F16C for the stores when the target
+    //                         has it (-mf16c / -march=haswell and later).
+    //   Int16DelayStorage<H>  16-bit fixed point, full scale 2^H, TPDF dithered
+    //                         on the way in. Values beyond full scale clip.
+    //
+    // Pick one per engine with `using DelayStorage = ...;` in the Config (see
+    // DelayStorageOf). Every policy provides:
+    //   Sample                             buffer element type
+    //   load(buf, i) / store(buf, i, v, dither)
+    //   gather(buf, IntVec) / storeVec(buf, FloatVec, dither)
+    // `dither` is the caller's random state; only Int16DelayStorage uses it.
+    //
+    // The 16-bit AVX2 gathers read 32 bits per lane, i.e. up to 2 bytes past the
+    // addressed sample. Delay lines carved from a DelayArena always have that
+    // much readable memory behind them.
+    //==============================================================
+
+    namespace storage_detail {
+        template <typename To, typename From>
+        JUCE_FORCEINLINE To bitCast(From x)
+        {
+            static_assert(sizeof(To) == sizeof(From), "bitCast needs equal sizes");
+            To r;
+            std::memcpy(&r, &x, sizeof(To));
+            return r;
+        }
+
+        // Spills the indices and loads lane by lane through Policy::load.
+        template <typename Policy>
+        JUCE_FORCEINLINE simd::FloatVec gatherScalar(const typename Policy::Sample* buf, simd::IntVec idx)
+        {
+            alignas(32) std::int32_t i[simd::FloatVec::width];
+            alignas(32) float f[simd::FloatVec::width];
+            idx.store(i);
+            for (int k = 0; k < simd::FloatVec::width; ++k)
+                f[k] = Policy::load(buf, i[k]);
+            return simd::FloatVec::load(f);
+        }
+
+        template <typename Policy>
+        JUCE_FORCEINLINE void storeScalar(typename Policy::Sample* buf, simd::FloatVec v, std::uint32_t& dither)
+        {
+            alignas(32) float f[simd::FloatVec::width];
+            v.store(f);
+            for (int k = 0; k < simd::FloatVec::width; ++k)
+                Policy::store(buf, k, f[k], dither);
+        }
+
+#if GRIFFIN_SIMD_AVX2
+        // 8 x 16-bit values, zero-extended into 32-bit lanes.
+        JUCE_FORCEINLINE __m256i gather16(const void* buf, simd::IntVec idx)
+        {
+            return _mm256_i32gather_epi32(static_cast<const int*>(buf), idx.v, 2);
+        }
+#endif
+    } // namespace storage_detail
+
+    struct FloatDelayStorage {
+        using Sample = float;
+
+        static JUCE_FORCEINLINE float load(const Sample* buf, int i) { return buf[i]; }
+        static JUCE_FORCEINLINE void store(Sample* buf, int i, float v, std::uint32_t&) { buf[i] = v; }
+        static JUCE_FORCEINLINE simd::FloatVec gather(const Sample* buf, simd::IntVec idx) { return simd::gather(buf, idx); }
+        static JUCE_FORCEINLINE void storeVec(Sample* buf, simd::FloatVec v, std::uint32_t&) { v.store(buf); }
+    };
+
+    struct HalfDelayStorage {
+        using Sample = std::uint16_t;
+
+        // Exact for every finite half (normals and subnormals): the 15 magnitude
+        // bits are moved into float position and the exponent rebiased by a
+        // multiply with 2^112.
+        static JUCE_FORCEINLINE float toFloat(std::uint16_t h)
+        {
+#if defined(__F16C__)
+            return _cvtsh_ss(h);
+#else
+            const std::uint32_t sign = static_cast<std::uint32_t>(h & 0x8000u) << 16;
+            const float mag = storage_detail::bitCast<float>(static_cast<std::uint32_t>(h & 0x7fffu) << 13) * 5.192296858534828e33f;
+            return storage_detail::bitCast<float>(storage_detail::bitCast<std::uint32_t>(mag) | sign);
+#endif
+        }
+
+        // Round to nearest even; values beyond the half range saturate to +-65504.
+        static JUCE_FORCEINLINE std::uint16_t fromFloat(float f)
+        {
+#if defined(__F16C__)
+            return static_cast<std::uint16_t>(_cvtss_sh(std::fmax(-65504.f, std::fmin(65504.f, f)), 0));
+#else
+            std::uint32_t x = storage_detail::bitCast<std::uint32_t>(f);
+            const std::uint32_t sign = x & 0x80000000u;
+            x ^= sign;
+            std::uint32_t o;
+            if (x >= (143u << 23)) {
+                o = 0x7bffu;
+            }
+            else if (x < (113u << 23)) {
+                // Subnormal half: let the float adder do the rounding.
+                const std::uint32_t denormMagic = 126u << 23;
+                const float sum = storage_detail::bitCast<float>(x) + storage_detail::bitCast<float>(denormMagic);
+                o = storage_detail::bitCast<std::uint32_t>(sum) - denormMagic;
+            }
+            else {
+                const std::uint32_t mantOdd = (x >> 13) & 1u;
+                x += (static_cast<std::uint32_t>(15 - 127) << 23) + 0xfffu;
+                x += mantOdd;
+                o = x >> 13;
+                if (o > 0x7bffu)
+                    o = 0x7bffu;
+            }
+            return static_cast<std::uint16_t>(o | (sign >> 16));
+#endif
+        }
+
+        static JUCE_FORCEINLINE float load(const Sample* buf, int i) { return toFloat(buf[i]); }
+        static JUCE_FORCEINLINE void store(Sample* buf, int i, float v, std::uint32_t&) { buf[i] = fromFloat(v); }
+
+        static JUCE_FORCEINLINE simd::FloatVec gather(const Sample* buf, simd::IntVec idx)
+        {
+#if GRIFFIN_SIMD_AVX2
+            const __m256i raw = storage_detail::gather16(buf, idx);
+            const __m256i sign = _mm256_slli_epi32(_mm256_and_si256(raw, _mm256_set1_epi32(0x8000)), 16);
+            const __m256i mag = _mm256_slli_epi32(_mm256_and_si256(raw, _mm256_set1_epi32(0x7fff)), 13);
+            const __m256 f = _mm256_mul_ps(_mm256_castsi256_ps(mag), _mm256_set1_ps(5.192296858534828e33f));
+            return { _mm256_or_ps(f, _mm256_castsi256_ps(sign)) };
+#else
+            return storage_detail::gatherScalar<HalfDelayStorage>(buf, idx);
+#endif
+        }
+
+        static JUCE_FORCEINLINE void storeVec(Sample* buf, simd::FloatVec v, std::uint32_t& dither)
+        {
+#if GRIFFIN_SIMD_AVX2 && defined(__F16C__)
+            (void)dither;   // Rounds to nearest: no dither on this path.
+            const __m256 limit = _mm256_set1_ps(65504.f);
+            const __m256 clipped = _mm256_max_ps(_mm256_sub_ps(_mm256_setzero_ps(), limit), _mm256_min_ps(limit, v.v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(buf), _mm256_cvtps_ph(clipped, _MM_FROUND_TO_NEAREST_INT));
+#else
+            storage_detail::storeScalar<HalfDelayStorage>(buf, v, dither);
+#endif
+        }
+    };
+
+    template <int HeadroomBits = 2>
+    struct Int16DelayStorage {
+        using Sample = std::int16_t;
+
+        static constexpr float fullScale = static_cast<float>(1 << HeadroomBits);
+        static constexpr float toInt = 32768.f / fullScale;
+        static constexpr float toFloatScale = fullScale / 32768.f;
+
+        static JUCE_FORCEINLINE float load(const Sample* buf, int i) { return static_cast<float>(buf[i]) * toFloatScale; }
+
+        // TPDF dither of +-1 LSB (two uniform draws from a 32-bit LCG), round, clip.
+        static JUCE_FORCEINLINE void store(Sample* buf, int i, float v, std::uint32_t& dither)
+        {
+            dither = dither * 1664525u + 1013904223u;
+            const float r1 = static_cast<float>(dither >> 8) * (1.f / 16777216.f);
+            dither = dither * 1664525u + 1013904223u;
+            const float r2 = static_cast<float>(dither >> 8) * (1.f / 16777216.f);
+            float q = v * toInt + (r1 - r2);
+            q = (q > 32767.f) ? 32767.f : ((q < -32768.f) ? -32768.f : q);
+            // Biased truncation is a floor here and avoids a libm call.
+            buf[i] = static_cast<Sample>(static_cast<int>(q + 32768.5f) - 32768);
+        }
+
+        static JUCE_FORCEINLINE simd::FloatVec gather(const Sample* buf, simd::IntVec idx)
+        {
+#if GRIFFIN_SIMD_AVX2
+            const __m256i raw = storage_detail::gather16(buf, idx);
+            const __m256i value = _mm256_srai_epi32(_mm256_slli_epi32(raw, 16), 16);
+            return { _mm256_mul_ps(_mm256_cvtepi32_ps(value), _mm256_set1_ps(toFloatScale)) };
+#else
+            return storage_detail::gatherScalar<Int16DelayStorage>(buf, idx);
+#endif
+        }
+
+        static JUCE_FORCEINLINE void storeVec(Sample* buf, simd::FloatVec v, std::uint32_t& dither)
+        {
+            storage_detail::storeScalar<Int16DelayStorage>(buf, v, dither);
+        }
+    };
+
+    // Config::DelayStorage if the config declares one, else FloatDelayStorage.
+    template <typename Config, typename = void>
+    struct DelayStorageSelector { using type = FloatDelayStorage; };
+
+    template <typename Config>
+    struct DelayStorageSelector<Config, std::void_t<typename Config::DelayStorage>> { using type = typename Config::DelayStorage; };
+
+    template <typename Config>
+    using DelayStorageOf = typename DelayStorageSelector<Config>::type;
+
+} // namespace project
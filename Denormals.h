@@ -0,0 +1,112 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+
+#ifndef JUCE_FORCEINLINE
+#if defined(_MSC_VER)
+#define JUCE_FORCEINLINE __forceinline
+#else
+#define JUCE_FORCEINLINE inline __attribute__((always_inline))
+#endif
+#endif
+
+//==============================================================
+// Denormal safety.
+//
+// Every recursive part of the engine (allpass delay lines, the self-feedback
+// loops, the shelf filter's state) decays exponentially once the input
+// stops, and would end up in subnormal floats, which many CPUs handle in
+// microcode at 10-100x the cost of a normal operation. Two defences:
+//
+//   ScopedNoDenormals  sets flush-to-zero / denormals-are-zero for the
+//                      current thread and restores the previous mode on
+//                      destruction. The block paths hold one.
+//                      x86 (SSE MXCSR) and ARM (FPCR / FPSCR FZ bit).
+//   flushDenormal()    snaps values below denormalFlushLevel to zero. The
+//                      allpass kernels apply it to every value they write and
+//                      the shelf to its feedback state, so a tail can never
+//                      reach the subnormal range, whatever the FPU mode. It
+//                      compiles to nothing unless GRIFFIN_SOFTWARE_DENORMAL_FLUSH
+//                      is 1, which is the default where no FTZ control exists.
+//                      The vector version lives in ReverbSimd.h.
+//==============================================================
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define GRIFFIN_FTZ_SSE 1
+#define GRIFFIN_HAS_FTZ_CONTROL 1
+#include <xmmintrin.h>
+#elif (defined(__aarch64__) || defined(__arm__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(__SOFTFP__)
+#define GRIFFIN_HAS_FTZ_CONTROL 1
+#else
+#define GRIFFIN_HAS_FTZ_CONTROL 0
+#endif
+
+#ifndef GRIFFIN_SOFTWARE_DENORMAL_FLUSH
+#define GRIFFIN_SOFTWARE_DENORMAL_FLUSH (!GRIFFIN_HAS_FTZ_CONTROL)
+#endif
+
+namespace project {
+
+    // About -300 dB: far below anything audible, far above the subnormal range.
+    static constexpr float denormalFlushLevel = 1.0e-15f;
+
+    JUCE_FORCEINLINE float flushDenormal(float x)
+    {
+#if GRIFFIN_SOFTWARE_DENORMAL_FLUSH
+        return (std::fabs(x) >= denormalFlushLevel) ? x : 0.f;
+#else
+        return x;
+#endif
+    }
+
+    class ScopedNoDenormals {
+    public:
+        // With enable = false the guard does nothing (for hosts that already
+        // run the audio thread with FTZ on).
+        explicit ScopedNoDenormals(bool enable = true) noexcept
+            : active(enable && GRIFFIN_HAS_FTZ_CONTROL)
+        {
+            if (active)
+            {
+                saved = read();
+                write(saved | flushBits);
+            }
+        }
+
+        ~ScopedNoDenormals() noexcept
+        {
+            if (active)
+                write(saved);
+        }
+
+        ScopedNoDenormals(const ScopedNoDenormals&) = delete;
+        ScopedNoDenormals& operator=(const ScopedNoDenormals&) = delete;
+
+        static constexpr bool isSupported() { return GRIFFIN_HAS_FTZ_CONTROL != 0; }
+
+    private:
+#if GRIFFIN_FTZ_SSE
+        using Register = unsigned int;
+        static constexpr Register flushBits = 0x8040;  // FTZ (bit 15) | DAZ (bit 6).
+        static Register read() { return _mm_getcsr(); }
+        static void write(Register r) { _mm_setcsr(r); }
+#elif GRIFFIN_HAS_FTZ_CONTROL && defined(__aarch64__)
+        using Register = std::uint64_t;
+        static constexpr Register flushBits = Register(1) << 24;  // FPCR.FZ
+        static Register read() { Register r; asm volatile("mrs %0, fpcr" : "=r"(r)); return r; }
+        static void write(Register r) { asm volatile("msr fpcr, %0" : : "r"(r)); }
+#elif GRIFFIN_HAS_FTZ_CONTROL
+        using Register = std::uint32_t;
+        static constexpr Register flushBits = Register(1) << 24;  // FPSCR.FZ
+        static Register read() { Register r; asm volatile("vmrs %0, fpscr" : "=r"(r)); return r; }
+        static void write(Register r) { asm volatile("vmsr fpscr, %0" : : "r"(r)); }
+#else
+        using Register = unsigned int;
+        static constexpr Register flushBits = 0;
+        static Register read() { return 0; }
+        static void write(Register) {}
+#endif
+        Register saved = 0;
+        bool active;
+    };
+
+} // namespace project
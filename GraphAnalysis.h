@@ -0,0 +1,254 @@
+#pragma once
+#include <array>
+#include "RoutingSchedule.h"
+
+namespace project {
+    namespace multistage {
+
+        // Compile-time analysis of a Config's connection graph.
+        //
+        // In MultiStageReverb every stage reads its sources from the previous
+        // sample, and the output node sums the current sample. That means a stage
+        // only has to be run sample-interleaved with other stages if they are on a
+        // common cycle. Everything else can be run stage-major: one stage over a
+        // whole block, then the next, so each stage's delay lines stay hot in L1.
+        //
+        // The analysis works on the live connections of RoutingSchedule and finds:
+        //   - dead nodes: stages that never reach the output node (skipped),
+        //   - self loops: a stage feeding itself (stage-major, but sample by sample
+        //     inside the stage),
+        //   - cycles between several stages (sample-interleaved group),
+        //   - pass-through links: a stage whose only input is one constant 1.0
+        //     connection reads its source's block directly, no gather pass. When the
+        //     source feeds nothing else the two stages are a fusable chain and are
+        //     scheduled back to back.
+        //
+        // The result is an execution plan: stage nodes in topological order, grouped
+        // into steps of one of the kinds below.
+        template <typename Config>
+        struct GraphAnalysis
+        {
+            using Routing = RoutingSchedule<Config>;
+            static constexpr size_t NumNodes = Config::NumNodes;
+            static constexpr size_t NumStages = Config::NumStages;
+            static constexpr size_t NumConnections = Routing::NumConnections;
+            static constexpr size_t OutputNode = NumNodes - 1;
+
+            using Matrix = std::array<std::array<bool, NumNodes>, NumNodes>;
+
+            // Transitive closure of the live connection graph: reach[a][b] is true
+            // if a path of one or more connections leads from a to b.
+            static constexpr Matrix buildReach()
+            {
+                Matrix r{};
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    if (Routing::isLive(i))
+                        r[Config::connections[i].src][Config::connections[i].dst] = true;
+                }
+                for (size_t k = 0; k < NumNodes; ++k)
+                    for (size_t a = 0; a < NumNodes; ++a)
+                        if (r[a][k])
+                            for (size_t b = 0; b < NumNodes; ++b)
+                                if (r[k][b])
+                                    r[a][b] = true;
+                return r;
+            }
+
+            static constexpr Matrix reach = buildReach();
+
+            static constexpr bool isStage(size_t node) { return node >= 1 && node <= NumStages; }
+
+            static constexpr bool reachesOutput(size_t node) { return node == OutputNode || reach[node][OutputNode]; }
+            static constexpr bool isDead(size_t node) { return isStage(node) && !reachesOutput(node); }
+            static constexpr bool isOnCycle(size_t node) { return reach[node][node]; }
+            static constexpr bool sameCycle(size_t a, size_t b) { return a == b || (reach[a][b] && reach[b][a]); }
+
+            static constexpr bool hasSelfLoop(size_t node)
+            {
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    if (Routing::isLive(i) && Config::connections[i].src == node && Config::connections[i].dst == node)
+                        return true;
+                }
+                return false;
+            }
+
+            // A stage on a cycle with at least one other stage.
+            static constexpr bool isInterleaved(size_t node)
+            {
+                for (size_t m = 1; m <= NumStages; ++m)
+                {
+                    if (m != node && sameCycle(node, m))
+                        return true;
+                }
+                return false;
+            }
+
+            // Anything reading the output node closes a loop through the output sum,
+            // which the stage-major plan cannot express; such configs keep the fully
+            // sample-interleaved block path.
+            static constexpr bool outputFeedsBack()
+            {
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    if (Routing::isLive(i) && Config::connections[i].src == OutputNode)
+                        return true;
+                }
+                return false;
+            }
+
+            static constexpr size_t numLiveOutputs(size_t node)
+            {
+                size_t count = 0;
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    if (Routing::isLive(i) && Config::connections[i].src == node)
+                        ++count;
+                }
+                return count;
+            }
+
+            // Single live input of exactly 1.0 that the feedback parameter never
+            // touches: the stage's input block is its source's block, unchanged.
+            static constexpr bool isPassThrough(size_t node)
+            {
+                if (!isStage(node) || Routing::numInputs(node) != 1)
+                    return false;
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    const auto& c = Config::connections[i];
+                    if (Routing::isLive(i) && c.dst == node)
+                        return c.baseWeight == 1.f && !c.scaleFeedback && c.src != node;
+                }
+                return false;
+            }
+
+            static constexpr size_t passThroughSource(size_t node)
+            {
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    if (Routing::isLive(i) && Config::connections[i].dst == node)
+                        return Config::connections[i].src;
+                }
+                return 0;
+            }
+
+            // src -> node is a 1.0 link between two stages with nothing else on
+            // either side: the pair behaves like one longer StageReverb.
+            static constexpr bool isFusableChainLink(size_t node)
+            {
+                if (!isPassThrough(node) || isOnCycle(node))
+                    return false;
+                const size_t src = passThroughSource(node);
+                return isStage(src) && !isOnCycle(src) && numLiveOutputs(src) == 1;
+            }
+
+            enum class StepKind { Block, SelfLoop, Interleaved };
+
+            struct Step {
+                size_t begin;   // First entry in Plan::order.
+                size_t count;   // Number of stage nodes in this step.
+                StepKind kind;
+            };
+
+            struct Plan {
+                std::array<size_t, NumStages> order{};
+                std::array<Step, NumStages> steps{};
+                size_t numOrdered = 0;
+                size_t numSteps = 0;
+            };
+
+            // Topological order over the cycle-condensed graph, dead stages left out.
+            static constexpr Plan buildPlan()
+            {
+                Plan p{};
+                std::array<bool, NumNodes> done{};
+                done[0] = true;
+                for (size_t n = 1; n <= NumStages; ++n)
+                    done[n] = isDead(n);
+
+                size_t lastScheduled = 0;
+                for (size_t pass = 0; pass < NumStages; ++pass)
+                {
+                    // Prefer continuing a fusable chain from the last stage placed.
+                    size_t pick = 0;
+                    for (size_t n = 1; n <= NumStages && pick == 0; ++n)
+                    {
+                        if (!done[n] && isReady(n, done) && isFusableChainLink(n) && passThroughSource(n) == lastScheduled)
+                            pick = n;
+                    }
+                    for (size_t n = 1; n <= NumStages && pick == 0; ++n)
+                    {
+                        if (!done[n] && isReady(n, done))
+                            pick = n;
+                    }
+                    if (pick == 0)
+                        break;
+
+                    Step step{ p.numOrdered, 0, StepKind::Block };
+                    if (isInterleaved(pick))
+                    {
+                        step.kind = StepKind::Interleaved;
+                        for (size_t m = 1; m <= NumStages; ++m)
+                        {
+                            if (sameCycle(pick, m))
+                            {
+                                p.order[p.numOrdered++] = m;
+                                done[m] = true;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        step.kind = hasSelfLoop(pick) ? StepKind::SelfLoop : StepKind::Block;
+                        p.order[p.numOrdered++] = pick;
+                        done[pick] = true;
+                    }
+                    step.count = p.numOrdered - step.begin;
+                    p.steps[p.numSteps++] = step;
+                    lastScheduled = pick;
+                }
+                return p;
+            }
+
+            static constexpr Plan plan = buildPlan();
+            static constexpr size_t NumSteps = plan.numSteps;
+
+            static constexpr size_t numDeadStages()
+            {
+                size_t count = 0;
+                for (size_t n = 1; n <= NumStages; ++n)
+                    count += isDead(n) ? 1 : 0;
+                return count;
+            }
+
+            // Every live stage made it into the plan (checked by MultiStageReverb).
+            static constexpr bool planIsComplete()
+            {
+                return outputFeedsBack() || plan.numOrdered + numDeadStages() == NumStages;
+            }
+
+        private:
+            // All sources outside node's own cycle are already scheduled.
+            static constexpr bool isReady(size_t node, const std::array<bool, NumNodes>& done)
+            {
+                for (size_t m = 1; m <= NumStages; ++m)
+                {
+                    if (!sameCycle(node, m) && !done[m])
+                    {
+                        // Does m (or its cycle) feed node?
+                        for (size_t i = 0; i < NumConnections; ++i)
+                        {
+                            const auto& c = Config::connections[i];
+                            if (Routing::isLive(i) && c.src == m && sameCycle(node, c.dst))
+                                return false;
+                        }
+                    }
+                }
+                return true;
+            }
+        };
+
+    } // namespace multistage
+} // namespace project
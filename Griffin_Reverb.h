@@ -6,6 +6,9 @@
 #include "src/StageReverb.h"
 #include "src/StageStereoizer.h"
 #include "src/ReverbCommon.h"
+#include "src/AudioReverb.h"
+#include "src/DelayMemoryPool.h"
+#include "src/TailTracker.h"
 
 namespace project {
 
@@ -17,8 +20,10 @@ namespace project {
 
         static constexpr bool isModNode() { return false; }
         static constexpr bool isPolyphonic() { return NV > 1; }
-        static constexpr bool hasTail() { return false; }
-        static constexpr bool isSuspendedOnSilence() { return false; }
+        // The reverb rings on after its input stops (see getTailSeconds()), and
+        // it puts itself to sleep once input and output are silent.
+        static constexpr bool hasTail() { return true; }
+        static constexpr bool isSuspendedOnSilence() { return true; }
         static constexpr int getFixChannelAmount() { return 2; }
 
         static constexpr int NumTables = 0;
@@ -28,97 +33,95 @@ namespace project {
         static constexpr int NumDisplayBuffers = 0;
 
         //---------------------------------------------
-        // Our compile-time engine plus stereoizer
+        // Our compile-time engine plus stereoizer. The voices run at the host
+        // rate: eco mode (AudioReverb::setProcessingRate) adds latency, and a
+        // node has no way to report it to the host, so it is not exposed here.
         using MyEngine = multistage::MultiStageReverb<multistage::MyReverbConfig>;
+        using AudioReverb = multistage::AudioReverb<multistage::MyReverbConfig>;
 
-        class AudioReverb {
-        public:
-            AudioReverb()
-                : sampleRate(44100.0),
-                reverbEngine(),
-                stereoizer()
-            {
-            }
+        //---------------------------------------------
+        // Per-voice state. Each voice has its own engine, but its delay lines
+        // live in a slot borrowed from delayPool only while the voice sounds:
+        // when the reverb's tail tracker puts it to sleep the slot goes back.
+        struct Voice {
+            AudioReverb reverb{ false };
+            DelayMemoryPool<Voice>* pool = nullptr;
+            float* memory = nullptr;
 
-            void prepare(double sr)
-            {
-                sampleRate = sr;
-                reverbEngine.prepare(static_cast<float>(sampleRate));
-                stereoizer.prepare(static_cast<float>(sampleRate));
-            }
+            bool isActive() const { return memory != nullptr; }
 
-            void reset()
+            void activate()
             {
-                reverbEngine.reset();
-                stereoizer.reset();
+                if (memory == nullptr && pool != nullptr)
+                {
+                    memory = pool->claim(this);
+                    if (memory != nullptr)
+                        reverb.attachDelayMemory(memory);
+                }
             }
 
-            // Process a block of samples.
-            void process(float* leftChannelData, float* rightChannelData, int numSamples)
+            void deactivate()
             {
-                for (int i = 0; i < numSamples; ++i)
+                if (memory != nullptr)
                 {
-                    // Build a mono input.
-                    float mono = 0.5f * (leftChannelData[i] + rightChannelData[i]);
-
-                    // Pass through the reverb engine.
-                    float outMono = reverbEngine.processSample(mono);
-
-                    // Let the stereoizer use the global LFO outputs.
-                    stereoizer.setGlobalLfoOutputsPointer(reverbEngine.globalLfoValues.data());
-
-                    // Process into stereo.
-                    float l, r;
-                    stereoizer.processSample(outMono, l, r);
-
-                    leftChannelData[i] = l;
-                    rightChannelData[i] = r;
+                    reverb.detachDelayMemory();
+                    pool->release(memory);
+                    memory = nullptr;
                 }
             }
 
-            // Update global delay (size) parameter.
-            void updateGlobalSizeParameter(float newSize) {
-                reverbEngine.updateGlobalSizeParameter(newSize);
-            }
-
-            // Update global feedback parameter (which scales connections flagged for feedback).
-            void updateFeedbackParameter(float newFeedback) {
-                reverbEngine.updateFeedbackParameter(newFeedback);
-            }
-
-            // Update global density parameter (scales coefficients for stages flagged for density scaling).
-            void updateGlobalDensityParameter(float newDensity) {
-                reverbEngine.updateGlobalDensityParameter(newDensity);
+            // Called by the pool when a newer voice takes this voice's slot.
+            void onDelayMemoryStolen()
+            {
+                reverb.detachDelayMemory();
+                memory = nullptr;
             }
+        };
 
-            // Update global SVF parameters for stages that have attached SVF settings.
-            void updateGlobalSVFParameters(float cutoff, float dbGain) {
-                reverbEngine.updateGlobalSVFParameters(cutoff, dbGain);
-            }
+        // At most this many voices hold delay memory at once; beyond that the
+        // oldest sounding voice is stolen.
+        static constexpr int NumDelaySlots = NV < 16 ? NV : 16;
 
-        private:
-            double sampleRate;
-            MyEngine reverbEngine;
-            multistage::StageStereoizer stereoizer;
-        };
+        // Input and output level below which a voice counts as silent (about
+        // -100 dB). A silent voice sleeps and returns its memory to the pool.
+        static constexpr float silenceThreshold = TailTracker::defaultThreshold;
 
         //---------------------------------------------
         // Our node usage
-        AudioReverb monoReverb;
-        float globalSizeParam = 1.0f;       // Default global size parameter.
-        float globalFeedbackParam = 1.0f;   // Default global feedback parameter.
-        float globalDensityParam = 1.0f;    // Default global density parameter.
-        float globalSVFCutoff = 1000.0f;      // Default SVF cutoff (Hz).
-        float globalSVFDb = -3.0f;            // Default SVF dB gain.
+        PolyData<Voice, NV> voices;
+        DelayMemoryPool<Voice> delayPool;
+        // HISE may call setParameter<P>() from the UI thread and the audio
+        // thread at once (a knob moved during automation), so the cached values
+        // are atomic; AudioReverb::setParameter() takes any number of producers.
+        std::atomic<float> globalSizeParam{ 1.0f };       // Default global size parameter.
+        std::atomic<float> globalFeedbackParam{ 1.0f };   // Default global feedback parameter.
+        std::atomic<float> globalDensityParam{ 1.0f };    // Default global density parameter.
+        std::atomic<float> globalSVFCutoff{ 1000.0f };      // Default SVF cutoff (Hz).
+        std::atomic<float> globalSVFDb{ -3.0f };            // Default SVF dB gain.
 
         void prepare(PrepareSpecs specs)
         {
-            monoReverb.prepare(specs.sampleRate);
+            voices.prepare(specs);
+
+            // The pool is sized for the active voices, not for NV.
+            delayPool.releaseAll();
+            for (auto& v : voices)
+                v.reverb.detachDelayMemory();
+            delayPool.prepare(AudioReverb::getDelayMemorySize(), NumDelaySlots);
+
+            for (auto& v : voices)
+            {
+                v.pool = &delayPool;
+                v.memory = nullptr;
+                v.reverb.setSilenceThreshold(silenceThreshold);
+                v.reverb.prepare(specs.sampleRate);
+            }
         }
 
         void reset()
         {
-            monoReverb.reset();
+            for (auto& v : voices)
+                v.reverb.reset();
         }
 
         // Process each audio block.
@@ -131,39 +134,75 @@ namespace project {
             auto* rightChannelData = audioBlock.getChannelPointer(1);
             int blockSize = data.getNumSamples();
 
-            monoReverb.process(leftChannelData, rightChannelData, blockSize);
+            auto& v = voices.get();
+
+            // Claim memory lazily: the first block with signal starts the voice.
+            if (!v.isActive() && TailTracker::getPeak(leftChannelData, rightChannelData, blockSize) > silenceThreshold)
+                v.activate();
+
+            if (!v.isActive())
+            {
+                v.reverb.applyPendingParameters();
+                std::fill(leftChannelData, leftChannelData + blockSize, 0.f);
+                std::fill(rightChannelData, rightChannelData + blockSize, 0.f);
+                return;
+            }
+
+            v.reverb.process(leftChannelData, rightChannelData, blockSize);
+
+            // Hand the memory back once the tail has died away.
+            if (v.reverb.isSleeping())
+                v.deactivate();
+        }
+
+        // Tail of the current voice for the current parameters: how long it
+        // keeps ringing after the input stops.
+        double getTailSeconds()
+        {
+            return voices.get().reverb.getTailSeconds();
         }
 
         // Parameter handling.
         // We add new parameters:
         // indices 4: global size, 5: feedback, 6: density,
         // 7: SVF cutoff, 8: SVF dB gain.
+        // Nothing here touches an engine: each voice gets the change through its
+        // wait-free queue and ramps to it on its next block (see AudioReverb).
+        // Safe from any thread, from several at once.
         template <int P>
         void setParameter(double v)
         {
+            using Parameter = multistage::ReverbParameter;
             if (P == 4) {
-                globalSizeParam = static_cast<float>(v);
-                monoReverb.updateGlobalSizeParameter(globalSizeParam);
+                globalSizeParam.store(static_cast<float>(v), std::memory_order_relaxed);
+                sendToVoices(Parameter::Size, static_cast<float>(v));
             }
             else if (P == 5) {
-                globalFeedbackParam = static_cast<float>(v);
-                monoReverb.updateFeedbackParameter(globalFeedbackParam);
+                globalFeedbackParam.store(static_cast<float>(v), std::memory_order_relaxed);
+                sendToVoices(Parameter::Feedback, static_cast<float>(v));
             }
             else if (P == 6) {
-                globalDensityParam = static_cast<float>(v);
-                monoReverb.updateGlobalDensityParameter(globalDensityParam);
-            }
-            else if (P == 7) {
-                globalSVFCutoff = static_cast<float>(v);
-                monoReverb.updateGlobalSVFParameters(globalSVFCutoff, globalSVFDb);
-            }
-            else if (P == 8) {
-                globalSVFDb = static_cast<float>(v);
-                monoReverb.updateGlobalSVFParameters(globalSVFCutoff, globalSVFDb);
+                globalDensityParam.store(static_cast<float>(v), std::memory_order_relaxed);
+                sendToVoices(Parameter::Density, static_cast<float>(v));
+            }
+            else if (P == 7 || P == 8) {
+                // The shelf takes both together; an unchanged value costs nothing.
+                if (P == 7)
+                    globalSVFCutoff.store(static_cast<float>(v), std::memory_order_relaxed);
+                else
+                    globalSVFDb.store(static_cast<float>(v), std::memory_order_relaxed);
+                sendToVoices(Parameter::SvfCutoff, globalSVFCutoff.load(std::memory_order_relaxed));
+                sendToVoices(Parameter::SvfGain, globalSVFDb.load(std::memory_order_relaxed));
             }
             // Additional parameters for other indices could be handled here.
         }
 
+        void sendToVoices(multistage::ReverbParameter parameter, float value)
+        {
+            for (auto& voice : voices)
+                voice.reverb.setParameter(parameter, value);
+        }
+
         void createParameters(ParameterDataList& data)
         {
             {
@@ -201,7 +240,12 @@ namespace project {
             }
         }
 
-        void handleHiseEvent(HiseEvent& e) {}
+        // A note starts its voice straight away, before any signal arrives.
+        void handleHiseEvent(HiseEvent& e)
+        {
+            if (e.isNoteOn())
+                voices.get().activate();
+        }
         template <typename FrameDataType>
         void processFrame(FrameDataType& data) {}
     };
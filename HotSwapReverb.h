@@ -0,0 +1,277 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <string>
+#include "RuntimeReverb.h"
+
+namespace project {
+    namespace multistage {
+
+        // Parameters a preset can bring along; applied when its swap starts.
+        struct ReverbSettings {
+            float size = 1.f;
+            float feedback = 1.f;
+            float density = 1.f;
+            float svfCutoff = 1000.f;
+            float svfGain = 0.f;
+        };
+
+        //==============================================================
+        // HotSwapReverb: two RuntimeReverb slots and a crossfade between them,
+        // for changing topology (or size) while audio is running.
+        //
+        //   message thread   loadPreset() loads the new topology into the slot
+        //                    the audio thread is not using (all allocation and
+        //                    clearing happens here) and publishes it.
+        //   audio thread     processBlock() picks the published slot up at the
+        //                    next block, hands it the current parameters and
+        //                    crossfades from the old slot over the crossfade
+        //                    length, both engines running on the input. When
+        //                    the fade ends the old slot is marked free: nothing
+        //                    is freed, so the audio thread never blocks or
+        //                    deallocates, and the message thread may load into
+        //                    it again.
+        //
+        // The fade is equal-power (the two reverbs are uncorrelated), its gains
+        // a rotating phasor so it costs a few multiplies per sample while it
+        // runs. With two slots only one swap can be in flight: loadPreset()
+        // returns false while the previous one is still pending or fading.
+        //
+        // prepare() and the parameter updates follow the engines' rules:
+        // prepare() while not processing, updates on the audio thread.
+        //==============================================================
+        template <typename Storage = FloatDelayStorage, typename Interp = LinearInterpolation>
+        class HotSwapReverb {
+        public:
+            using Engine = RuntimeReverb<Storage, Interp>;
+
+            void prepare(float sampleRate)
+            {
+                currentSampleRate = sampleRate;
+                for (auto& slot : slots)
+                    slot.engine.prepare(sampleRate);
+                setCrossfadeSeconds(crossfadeSeconds);
+            }
+
+            void reset()
+            {
+                finishFade();
+                if (active >= 0)
+                    slots[static_cast<size_t>(active)].engine.reset();
+            }
+
+            void setCrossfadeSeconds(double seconds)
+            {
+                crossfadeSeconds = seconds;
+                crossfadeSamples = std::max(0, static_cast<int>(seconds * currentSampleRate + 0.5));
+            }
+
+            // Message thread. False with `error` if the topology is invalid or
+            // the previous swap has not finished yet (try again later).
+            bool loadPreset(const Topology& topology, std::string& error)
+            {
+                return loadInto(topology, nullptr, error);
+            }
+
+            // The same, and the preset's parameters replace the current ones
+            // when the swap starts.
+            bool loadPreset(const Topology& topology, const ReverbSettings& presetSettings, std::string& error)
+            {
+                return loadInto(topology, &presetSettings, error);
+            }
+
+            // True from a successful loadPreset() until its crossfade has ended.
+            bool isSwapping() const
+            {
+                return pendingSlot.load(std::memory_order_acquire) >= 0
+                    || slots[0].state.load(std::memory_order_acquire) == SlotState::FadingOut
+                    || slots[1].state.load(std::memory_order_acquire) == SlotState::FadingOut;
+            }
+
+            // Mono in, mono out; in place is fine. Silence until a preset is loaded.
+            void processBlock(const float* input, float* output, int numSamples)
+            {
+                const ScopedNoDenormals noDenormals(denormalGuard);
+                takePendingSlot();
+                if (active < 0)
+                {
+                    std::fill(output, output + numSamples, 0.f);
+                    return;
+                }
+
+                while (numSamples > 0)
+                {
+                    const int n = std::min(numSamples, maxBlockSize);
+                    if (fadingOut < 0)
+                    {
+                        slots[static_cast<size_t>(active)].engine.processBlock(input, output, n);
+                    }
+                    else
+                    {
+                        // The old engine first: output may alias input.
+                        const int f = std::min(n, crossfadeSamples - fadePosition);
+                        slots[static_cast<size_t>(fadingOut)].engine.processBlock(input, fadeBuffer.data(), f);
+                        slots[static_cast<size_t>(active)].engine.processBlock(input, output, n);
+                        for (int i = 0; i < f; ++i)
+                        {
+                            output[i] = fadeIn * output[i] + fadeOut * fadeBuffer[static_cast<size_t>(i)];
+                            const float nextIn = fadeIn * rotationCos + fadeOut * rotationSin;
+                            fadeOut = fadeOut * rotationCos - fadeIn * rotationSin;
+                            fadeIn = nextIn;
+                        }
+                        fadePosition += f;
+                        if (fadePosition >= crossfadeSamples)
+                            finishFade();
+                    }
+                    input += n;
+                    output += n;
+                    numSamples -= n;
+                }
+            }
+
+            void setDenormalGuard(bool enabled)
+            {
+                denormalGuard = enabled;
+                for (auto& slot : slots)
+                    slot.engine.setDenormalGuard(enabled);
+            }
+
+            // Parameter updates (audio thread) go to the engines that are running.
+            void updateGlobalSizeParameter(float value) { settings.size = value; forRunning([&](Engine& e) { e.updateGlobalSizeParameter(value); }); }
+            void updateFeedbackParameter(float value) { settings.feedback = value; forRunning([&](Engine& e) { e.updateFeedbackParameter(value); }); }
+            void updateGlobalDensityParameter(float value) { settings.density = value; forRunning([&](Engine& e) { e.updateGlobalDensityParameter(value); }); }
+            void updateGlobalSVFParameters(float cutoff, float dbGain)
+            {
+                settings.svfCutoff = cutoff;
+                settings.svfGain = dbGain;
+                forRunning([&](Engine& e) { e.updateGlobalSVFParameters(cutoff, dbGain); });
+            }
+
+            const ReverbSettings& getSettings() const { return settings; }
+
+        private:
+            enum class SlotState { Free, Loading, Pending, Active, FadingOut };
+
+            struct Slot {
+                Engine engine;
+                std::atomic<SlotState> state{ SlotState::Free };
+                ReverbSettings presetSettings;      // Written before publishing.
+                bool hasPresetSettings = false;
+            };
+
+            std::array<Slot, 2> slots;
+            std::atomic<int> pendingSlot{ -1 };
+
+            // Audio thread only.
+            int active = -1;
+            int fadingOut = -1;
+            int fadePosition = 0;
+            float fadeIn = 0.f, fadeOut = 1.f;
+            float rotationCos = 1.f, rotationSin = 0.f;
+            ReverbSettings settings;
+            std::array<float, maxBlockSize> fadeBuffer{};
+
+            float currentSampleRate = 44100.f;
+            double crossfadeSeconds = 0.1;
+            int crossfadeSamples = 4410;
+            bool denormalGuard = true;
+
+            bool loadInto(const Topology& topology, const ReverbSettings* presetSettings, std::string& error)
+            {
+                // One published slot at a time: the audio thread takes it first.
+                Slot* target = nullptr;
+                for (size_t i = 0; i < slots.size() && pendingSlot.load(std::memory_order_acquire) < 0; ++i)
+                {
+                    auto& slot = slots[i];
+                    SlotState expected = SlotState::Free;
+                    if (slot.state.compare_exchange_strong(expected, SlotState::Loading, std::memory_order_acquire))
+                    {
+                        target = &slot;
+                        break;
+                    }
+                }
+                if (target == nullptr)
+                {
+                    error = "a preset swap is still in progress";
+                    return false;
+                }
+
+                if (!target->engine.load(topology, error))
+                {
+                    target->state.store(SlotState::Free, std::memory_order_release);
+                    return false;
+                }
+                target->engine.setDenormalGuard(denormalGuard);
+                target->engine.reset();
+                target->hasPresetSettings = presetSettings != nullptr;
+                if (presetSettings != nullptr)
+                    target->presetSettings = *presetSettings;
+
+                target->state.store(SlotState::Pending, std::memory_order_relaxed);
+                pendingSlot.store(static_cast<int>(target - slots.data()), std::memory_order_release);
+                return true;
+            }
+
+            // Starts the swap to a published slot, unless one is still fading.
+            void takePendingSlot()
+            {
+                if (fadingOut >= 0 || pendingSlot.load(std::memory_order_acquire) < 0)
+                    return;
+                const int next = pendingSlot.exchange(-1, std::memory_order_acq_rel);
+                Slot& slot = slots[static_cast<size_t>(next)];
+                if (slot.hasPresetSettings)
+                    settings = slot.presetSettings;
+                applySettings(slot.engine);
+                slot.state.store(SlotState::Active, std::memory_order_relaxed);
+
+                if (active >= 0 && crossfadeSamples > 0)
+                {
+                    // The old slot keeps its parameters: the fade is between the
+                    // two sounds as they were set.
+                    fadingOut = active;
+                    slots[static_cast<size_t>(fadingOut)].state.store(SlotState::FadingOut, std::memory_order_relaxed);
+                    fadePosition = 0;
+                    fadeIn = 0.f;
+                    fadeOut = 1.f;
+                    const double step = 1.5707963267948966 / static_cast<double>(crossfadeSamples);
+                    rotationCos = static_cast<float>(std::cos(step));
+                    rotationSin = static_cast<float>(std::sin(step));
+                }
+                else if (active >= 0)
+                {
+                    slots[static_cast<size_t>(active)].state.store(SlotState::Free, std::memory_order_release);
+                }
+                active = next;
+            }
+
+            // Releases the old slot to the message thread.
+            void finishFade()
+            {
+                if (fadingOut < 0)
+                    return;
+                slots[static_cast<size_t>(fadingOut)].state.store(SlotState::Free, std::memory_order_release);
+                fadingOut = -1;
+            }
+
+            void applySettings(Engine& engine) const
+            {
+                engine.updateGlobalSizeParameter(settings.size);
+                engine.updateFeedbackParameter(settings.feedback);
+                engine.updateGlobalDensityParameter(settings.density);
+                engine.updateGlobalSVFParameters(settings.svfCutoff, settings.svfGain);
+            }
+
+            template <typename Function>
+            void forRunning(Function&& function)
+            {
+                if (active >= 0)
+                    function(slots[static_cast<size_t>(active)].engine);
+                if (fadingOut >= 0)
+                    function(slots[static_cast<size_t>(fadingOut)].engine);
+            }
+        };
+
+    } // namespace multistage
+} // namespace project
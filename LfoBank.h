@@ -0,0 +1,209 @@
+#pragma once
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include "ReverbCommon.h"
+
+namespace project {
+
+    //==============================================================
+    // LfoBank: all global LFOs evaluated together, one LFO per SIMD lane.
+    //
+    // At full rate (decimation 1) each lane computes exactly what
+    // SimpleLFO::update() does - same phase accumulation, same parabolic sine -
+    // so swapping a std::array<SimpleLFO> for a bank does not change the output.
+    //
+    // With setControlRateDecimation(N > 1) the LFOs are only evaluated every N
+    // samples (stepping the phase by N increments) and the samples in between
+    // are linearly interpolated. Interpolated values never leave the range of
+    // the two end points, so the modulation depth bound still holds.
+    //
+    // The phase is wrapped with one subtraction per step, so a step has to
+    // stay below a cycle: increments are clamped to [0, 0.5] (nothing above
+    // Nyquist) and the decimation to the largest N with increment * N < 1
+    // for the fastest LFO.
+    //==============================================================
+    template <size_t NumLFOs>
+    class LfoBank {
+    public:
+        static constexpr int W = simd::FloatVec::width;
+        static constexpr size_t NumVecs = (NumLFOs + W - 1) / W;
+        static constexpr size_t Lanes = NumVecs * W;
+
+        LfoBank() {
+            phases.fill(0.f);
+            startPhases.fill(0.f);
+            increments.fill(0.f);
+            amplitudes.fill(0.f);
+            frequencies.fill(0.f);
+            currentValues.fill(0.f);
+            targetValues.fill(0.f);
+        }
+
+        void setLfo(size_t i, float freq, float amp) {
+            amplitudes[i] = amp;
+            setFrequency(i, freq);
+        }
+
+        void prepare(float sr) {
+            sampleRate = sr;
+            for (size_t i = 0; i < NumLFOs; ++i) {
+                increments[i] = incrementFor(frequencies[i]);
+            }
+            updateDecimation();
+            reset();
+        }
+
+        // Back to the start phases. The control-rate path starts from their values.
+        void reset() {
+            phases = startPhases;
+            stepLanes(targetValues.data(), 0.f);
+            currentValues = targetValues;
+            segmentPos = 0;
+        }
+
+        // Phase (in cycles, 0..1) LFO i starts from on reset(); 0 by default.
+        void setStartPhase(size_t i, float phase) { startPhases[i] = phase - std::floor(phase); }
+
+        void setAmplitude(size_t i, float amp) { amplitudes[i] = amp; }
+        void setFrequency(size_t i, float freq) {
+            frequencies[i] = freq;
+            increments[i] = incrementFor(freq);
+            updateDecimation();
+        }
+        float getAmplitude(size_t i) const { return amplitudes[i]; }
+
+        // 1 evaluates every sample; N > 1 evaluates every N samples and
+        // interpolates. Capped so the fastest LFO moves less than a cycle per
+        // step; getControlRateDecimation() is the N in use.
+        void setControlRateDecimation(int n) {
+            requestedDecimation = std::max(1, n);
+            updateDecimation();
+            segmentPos = 0;
+        }
+        int getControlRateDecimation() const { return decimation; }
+
+        // One sample of every LFO into out[0..NumLFOs).
+        JUCE_FORCEINLINE void processSample(float* out) {
+            std::array<float*, NumLFOs> ptrs;
+            for (size_t i = 0; i < NumLFOs; ++i) {
+                ptrs[i] = out + i;
+            }
+            processBlock(ptrs.data(), 1);
+        }
+
+        // numSamples values of LFO i into out[i][0..numSamples).
+        void processBlock(float* const* out, int numSamples) {
+            if (decimation == 1)
+                renderFullRate(out, numSamples, std::integral_constant<size_t, NumLFOs>{});
+            else
+                renderControlRate(out, numSamples, std::integral_constant<size_t, NumLFOs>{});
+        }
+
+        // The same for the first numOutputs LFOs only: a bank sized for the most
+        // LFOs a preset may use skips the lanes it leaves empty.
+        void processBlock(float* const* out, int numSamples, size_t numOutputs) {
+            if (decimation == 1)
+                renderFullRate(out, numSamples, numOutputs);
+            else
+                renderControlRate(out, numSamples, numOutputs);
+        }
+
+    private:
+        alignas(32) std::array<float, Lanes> phases;
+        alignas(32) std::array<float, Lanes> startPhases;
+        alignas(32) std::array<float, Lanes> increments;
+        alignas(32) std::array<float, Lanes> amplitudes;
+        alignas(32) std::array<float, Lanes> currentValues;
+        alignas(32) std::array<float, Lanes> targetValues;
+        std::array<float, Lanes> frequencies;
+        float sampleRate = 44100.f;
+        int requestedDecimation = 1;
+        int decimation = 1;
+        int segmentPos = 0; // Samples already emitted from the current control segment.
+
+        float incrementFor(float freq) const { return std::min(0.5f, std::max(0.f, freq / sampleRate)); }
+
+        // The requested decimation, capped so that increment * N < 1 for
+        // every LFO: one subtraction then brings the phase back into [0, 1).
+        void updateDecimation() {
+            float fastest = 0.f;
+            for (size_t i = 0; i < NumLFOs; ++i) {
+                fastest = std::max(fastest, increments[i]);
+            }
+            int n = requestedDecimation;
+            if (fastest > 0.f && 1.f / fastest <= static_cast<float>(n)) {
+                n = std::max(1, static_cast<int>(std::ceil(1.f / fastest)) - 1);
+            }
+            if (n != decimation) {
+                decimation = n;
+                segmentPos = 0;
+            }
+        }
+
+        // Advances every lane by `steps` increments and evaluates the sine.
+        JUCE_FORCEINLINE void stepLanes(float* values, float steps) {
+            using V = simd::FloatVec;
+            const V one = V::broadcast(1.f);
+            const V half = V::broadcast(0.5f);
+            const V eight = V::broadcast(8.f);
+            const V sixteen = V::broadcast(16.f);
+            const V stepV = V::broadcast(steps);
+            for (size_t v = 0; v < NumVecs; ++v) {
+                const size_t o = v * W;
+                V ph = V::load(phases.data() + o) + V::load(increments.data() + o) * stepV;
+                ph = ph - V::whereGE(ph, one, one);
+                ph.store(phases.data() + o);
+                const V shifted = half - ph;
+                (V::load(amplitudes.data() + o) * (shifted * (eight - sixteen * V::abs(shifted)))).store(values + o);
+            }
+        }
+
+        // Blocks go to the runtime-dispatched kernel (ReverbDispatch.h) when it
+        // is compiled in; single samples (processSample) stay inline.
+        template <typename Count>
+        void renderFullRate(float* const* out, int numSamples, Count numOutputs) {
+#if GRIFFIN_RUNTIME_DISPATCH
+            if (numSamples > 1) {
+                const auto& kernels = dispatch::kernels();
+                const auto render = (NumLFOs <= dispatch::narrowLfoLanes) ? kernels.lfoFullRateNarrow : kernels.lfoFullRate;
+                render(phases.data(), increments.data(), amplitudes.data(), static_cast<int>(NumLFOs),
+                    out, static_cast<int>(numOutputs), numSamples);
+                return;
+            }
+#endif
+            alignas(32) float values[Lanes];
+            for (int s = 0; s < numSamples; ++s) {
+                stepLanes(values, 1.f);
+                for (size_t i = 0; i < numOutputs; ++i) {
+                    out[i][s] = values[i];
+                }
+            }
+        }
+
+        template <typename Count>
+        void renderControlRate(float* const* out, int numSamples, Count numOutputs) {
+            const float invN = 1.f / static_cast<float>(decimation);
+            int s = 0;
+            while (s < numSamples) {
+                if (segmentPos == 0) {
+                    currentValues = targetValues;
+                    stepLanes(targetValues.data(), static_cast<float>(decimation));
+                }
+                const int n = std::min(decimation - segmentPos, numSamples - s);
+                for (size_t i = 0; i < numOutputs; ++i) {
+                    const float a = currentValues[i];
+                    const float d = targetValues[i] - a;
+                    float* o = out[i] + s;
+                    for (int k = 0; k < n; ++k) {
+                        o[k] = a + d * (static_cast<float>(segmentPos + k + 1) * invN);
+                    }
+                }
+                s += n;
+                segmentPos = (segmentPos + n) % decimation;
+            }
+        }
+    };
+
+} // namespace project
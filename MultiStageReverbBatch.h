@@ -0,0 +1,481 @@
+#pragma once
+#include <array>
+#include <tuple>
+#include <vector>
+#include <type_traits>
+#include "ReverbCommon.h"
+#include "ReverbSvf.h"
+#include "RoutingSchedule.h"
+#include "StageReverb.h"
+
+namespace project {
+    namespace multistage {
+
+        //==============================================================
+        // MultiStageReverbBatch: Lanes independent MultiStageReverb<Config>
+        // instances advanced together, one instance per vector lane.
+        //
+        // Every piece of state is stored structure-of-arrays with the lane as the
+        // innermost index: LFO phases, AP delay lines (interleaved, sample-major:
+        // buffer[pos * Lanes + lane]), shelf filter state, node state and the
+        // effective connection weights. All lanes share the compile-time topology
+        // and the write position of each delay line; parameters (size, density,
+        // feedback, shelf) and inputs are per lane. The per-lane inner loops are
+        // fixed-length and branch-free so the compiler turns them into 4/8-wide
+        // vector code (the delay reads become gathers where the ISA has them).
+        //
+        // Each lane computes what MultiStageReverb<Config>::processSample computes
+        // for the same parameters and input, with linear interpolation: the
+        // batch ignores Config::Interpolation, and unmodulated (noLfo) APs read
+        // through the linear path with zero modulation.
+        //==============================================================
+        template <int Lanes>
+        using LaneArray = std::array<float, static_cast<size_t>(Lanes)>;
+
+        // Lane counts that are a multiple of the native vector width use explicit
+        // SIMD; anything else falls back to plain per-lane loops.
+        template <int Lanes>
+        static constexpr bool useLaneVectors = (Lanes % simd::FloatVec::width) == 0;
+
+        static constexpr int log2Lanes(int lanes)
+        {
+            int bits = 0;
+            while ((1 << bits) < lanes)
+                ++bits;
+            return bits;
+        }
+
+        //--------------------------------------------------------------
+        // Allpass with one interleaved delay line for all lanes.
+        template <int Lanes>
+        class BatchAP {
+        public:
+            // Allocates the delay line, sized like SimpleAP's for every supported rate.
+            void init(float delayMs, float coeff, size_t lfoIdx, bool scaleDelayFlag, bool scaleCoeffFlag) {
+                baseDelayMs = delayMs;
+                originalCoefficient = coeff;
+                lfoIndex = lfoIdx;
+                scaleDelay = scaleDelayFlag;
+                scaleCoefficient = scaleCoeffFlag;
+                delayScale.fill(1.f);
+                effectiveCoefficient.fill(coeff);
+                const int size = delayBufferSize(delayMs, scaleDelay);
+                indexMask = size - 1;
+                delayBuffer.assign(static_cast<size_t>(size) * Lanes, 0.f);
+                prepare(44100.f);
+            }
+
+            // Converts the delay to samples at this rate; never allocates.
+            void prepare(float sampleRate) {
+                originalBaseDelay = msToSamples(baseDelayMs, std::min(sampleRate, maxSupportedSampleRate));
+                for (int l = 0; l < Lanes; ++l)
+                    effectiveBaseDelay[l] = originalBaseDelay * delayScale[l];
+                indexMask = delayBufferSize(baseDelayMs, scaleDelay, sampleRate) - 1;
+                reset();
+            }
+
+            void reset() {
+                std::fill(delayBuffer.begin(), delayBuffer.end(), 0.f);
+                writeIndex = 0;
+            }
+
+            void updateDelayTime(int lane, float globalSize) {
+                if (scaleDelay) {
+                    delayScale[lane] = globalSize;
+                    effectiveBaseDelay[lane] = originalBaseDelay * globalSize;
+                }
+            }
+
+            void updateCoefficientScaling(int lane, float globalDensity) {
+                if (scaleCoefficient)
+                    effectiveCoefficient[lane] = originalCoefficient * globalDensity;
+            }
+
+            // x holds one sample per lane and is replaced by the output.
+            JUCE_FORCEINLINE void processSample(LaneArray<Lanes>& x, const LaneArray<Lanes>& lfo) {
+                float* buf = delayBuffer.data();
+                const int w = writeIndex;
+                const int mask = indexMask;
+                if constexpr (useLaneVectors<Lanes> && (Lanes & (Lanes - 1)) == 0) {
+                    using V = simd::FloatVec;
+                    using I = simd::IntVec;
+                    const V zero = V::broadcast(0.f);
+                    const V one = V::broadcast(1.f);
+                    const I maskV = I::broadcast(mask);
+                    const I wV = I::broadcast(w - 1);
+                    const I oneI = I::broadcast(1);
+                    for (int l = 0; l < Lanes; l += V::width) {
+                        const V target = V::max(V::load(effectiveBaseDelay.data() + l) + V::load(lfo.data() + l), zero);
+                        const I dInt = I::truncate(target);
+                        const V frac = one - (target - dInt.toFloat());
+                        const I i0 = (wV - dInt) & maskV;
+                        const I i1 = (i0 + oneI) & maskV;
+                        const I laneV = I::ramp(l);
+                        const V d0 = simd::gather(buf, i0.shiftLeft(log2Lanes(Lanes)) + laneV);
+                        const V d1 = simd::gather(buf, i1.shiftLeft(log2Lanes(Lanes)) + laneV);
+                        const V delayedV = (one - frac) * d0 + frac * d1;
+                        const V g = V::load(effectiveCoefficient.data() + l);
+                        const V v = simd::flushDenormal(V::load(x.data() + l) - g * delayedV);
+                        (g * v + delayedV).store(x.data() + l);
+                        v.store(buf + w * Lanes + l);
+                    }
+                    writeIndex = (w + 1) & mask;
+                    return;
+                }
+                for (int l = 0; l < Lanes; ++l) {
+                    float targetDelay = effectiveBaseDelay[l] + lfo[l];
+                    targetDelay = (targetDelay < 0.f) ? 0.f : targetDelay;
+                    const int dInt = static_cast<int>(targetDelay);
+                    // Branch-free form of SimpleAP's interpolation (see simd::allpassBlockLongDelay).
+                    const float frac = 1.f - (targetDelay - static_cast<float>(dInt));
+                    const int i0 = (w - dInt - 1) & mask;
+                    const int i1 = (i0 + 1) & mask;
+                    const float delayedV = (1.f - frac) * buf[i0 * Lanes + l] + frac * buf[i1 * Lanes + l];
+                    const float g = effectiveCoefficient[l];
+                    const float v = flushDenormal(x[l] - g * delayedV);
+                    x[l] = g * v + delayedV;
+                    buf[w * Lanes + l] = v;
+                }
+                writeIndex = (w + 1) & mask;
+            }
+
+            size_t getLfoIndex() const { return lfoIndex; }
+
+        private:
+            alignas(32) LaneArray<Lanes> effectiveBaseDelay{};
+            alignas(32) LaneArray<Lanes> effectiveCoefficient{};
+            LaneArray<Lanes> delayScale{};
+            std::vector<float> delayBuffer;
+            int writeIndex = 0;
+            int indexMask = 0;
+            float baseDelayMs = 0.f;
+            float originalBaseDelay = 0.f;    // In samples at the current rate.
+            float originalCoefficient = 0.f;
+            size_t lfoIndex = 0;
+            bool scaleDelay = false;
+            bool scaleCoefficient = false;
+        };
+
+        //--------------------------------------------------------------
+        // LexiconShelvingFilter, one set of coefficients and state per lane.
+        template <int Lanes>
+        class BatchShelvingFilter {
+        public:
+            void setParameters(int lane, float cutoff, float dBgain, float sampleRate) {
+                LexiconShelvingFilter f;
+                f.setParameters(cutoff, dBgain, sampleRate);
+                f.getCoefficients(b0[lane], b1[lane], a1[lane]);
+            }
+
+            void reset() {
+                x1.fill(0.f);
+                y1.fill(0.f);
+            }
+
+            JUCE_FORCEINLINE void processSample(LaneArray<Lanes>& x) {
+                if constexpr (useLaneVectors<Lanes>) {
+                    using V = simd::FloatVec;
+                    for (int l = 0; l < Lanes; l += V::width) {
+                        const V xv = V::load(x.data() + l);
+                        const V y = simd::flushDenormal(V::load(b0.data() + l) * xv + V::load(b1.data() + l) * V::load(x1.data() + l)
+                            - V::load(a1.data() + l) * V::load(y1.data() + l));
+                        xv.store(x1.data() + l);
+                        y.store(y1.data() + l);
+                        y.store(x.data() + l);
+                    }
+                    return;
+                }
+                for (int l = 0; l < Lanes; ++l) {
+                    const float y = flushDenormal(b0[l] * x[l] + b1[l] * x1[l] - a1[l] * y1[l]);
+                    x1[l] = x[l];
+                    y1[l] = y;
+                    x[l] = y;
+                }
+            }
+
+        private:
+            alignas(32) LaneArray<Lanes> b0{}, b1{}, a1{}, x1{}, y1{};
+        };
+
+        //--------------------------------------------------------------
+        template <typename StageConfig, int Lanes>
+        class BatchStage {
+        public:
+            static_assert(isFlatAllpassStage<StageConfig>(), "MultiStageReverbBatch runs allpass stages without nesting only");
+            static constexpr size_t numAPs = std::tuple_size<decltype(StageConfig::aps)>::value;
+
+            BatchStage() {
+                for (size_t i = 0; i < numAPs; ++i) {
+                    aps[i].init(StageConfig::aps[i].delayMs, StageConfig::aps[i].coefficient,
+                        StageConfig::aps[i].lfoIndex, StageConfig::scaleDelay, StageConfig::scaleCoeff);
+                }
+            }
+
+            void prepare(float sampleRate) {
+                currentSampleRate = sampleRate;
+                if constexpr (StageConfig::enableSVF) {
+                    for (int l = 0; l < Lanes; ++l)
+                        svfFilter.setParameters(l, StageConfig::svfCutoff, StageConfig::svfGain, sampleRate);
+                }
+                for (auto& ap : aps)
+                    ap.prepare(sampleRate);
+            }
+
+            void reset() {
+                svfFilter.reset();
+                for (auto& ap : aps)
+                    ap.reset();
+            }
+
+            // lfo[k] holds LFO k's value for every lane.
+            JUCE_FORCEINLINE void processSample(LaneArray<Lanes>& x, const LaneArray<Lanes>* lfo) {
+                if constexpr (StageConfig::enableSVF) {
+                    svfFilter.processSample(x);
+                }
+                processAPs(x, lfo, std::make_index_sequence<numAPs>{});
+            }
+
+            void updateDelayTimes(int lane, float globalSize) {
+                for (auto& ap : aps)
+                    ap.updateDelayTime(lane, globalSize);
+            }
+
+            void updateCoefficientScaling(int lane, float globalDensity) {
+                for (auto& ap : aps)
+                    ap.updateCoefficientScaling(lane, globalDensity);
+            }
+
+            void updateSVFParameters(int lane, float cutoff, float dbGain) {
+                if constexpr (StageConfig::enableSVF && StageConfig::attachSVF) {
+                    svfFilter.setParameters(lane, cutoff, dbGain, currentSampleRate);
+                }
+            }
+
+        private:
+            std::array<BatchAP<Lanes>, numAPs> aps;
+            BatchShelvingFilter<Lanes> svfFilter;
+            LaneArray<Lanes> noModulation{};   // For APs with lfoIndex == noLfo.
+            float currentSampleRate = 44100.f;
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE void processAPs(LaneArray<Lanes>& x, const LaneArray<Lanes>* lfo, std::index_sequence<Is...>) {
+                ((aps[Is].processSample(x, (StageConfig::aps[Is].lfoIndex == noLfo) ? noModulation : lfo[StageConfig::aps[Is].lfoIndex])), ...);
+            }
+        };
+
+        //--------------------------------------------------------------
+        template <typename Config, int Lanes>
+        class MultiStageReverbBatch
+        {
+        public:
+            static_assert(Lanes >= 1, "MultiStageReverbBatch needs at least one lane");
+
+            static constexpr size_t NumStages = Config::NumStages;
+            static constexpr size_t NumNodes = Config::NumNodes;
+            static constexpr size_t NumGlobalLFOs = Config::NumGlobalLFOs;
+            static constexpr size_t NumConnections = Config::connections.size();
+            static constexpr int NumLanes = Lanes;
+
+            using Routing = RoutingSchedule<Config>;
+
+            template <std::size_t I>
+            using SingleStage = BatchStage<std::tuple_element_t<I, typename Config::StageTuple>, Lanes>;
+
+            template <std::size_t... Is>
+            static constexpr auto buildStageTuple(std::index_sequence<Is...>)
+            {
+                return std::tuple<SingleStage<Is>...>{};
+            }
+
+            MultiStageReverbBatch()
+            {
+                for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                {
+                    lfoPhases[i].fill(0.f);
+                }
+                for (int l = 0; l < Lanes; ++l)
+                    updateFeedbackParameter(l, 1.f);
+                for (auto& n : nodeState)
+                    n.fill(0.f);
+            }
+
+            void prepare(float sampleRate)
+            {
+                for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                {
+                    lfoIncrements[i] = Config::lfoFrequencies[i] / sampleRate;
+                    lfoAmplitudes[i] = msToSamples(Config::lfoDepthsMs[i], std::min(sampleRate, maxSupportedSampleRate));
+                }
+                prepareStages(sampleRate, std::make_index_sequence<NumStages>{});
+                reset();
+            }
+
+            void reset()
+            {
+                for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                    lfoPhases[i] = lfoStartPhases[i];
+                resetStages(std::make_index_sequence<NumStages>{});
+                for (auto& n : nodeState)
+                    n.fill(0.f);
+            }
+
+            // in[lane] / out[lane] are planar buffers of numSamples each. In place is fine.
+            void processBlock(const float* const* in, float* const* out, int numSamples)
+            {
+                const ScopedNoDenormals noDenormals(denormalGuard);
+                for (int s = 0; s < numSamples; ++s)
+                {
+                    // 1) LFOs, all lanes at once.
+                    std::array<LaneArray<Lanes>, NumGlobalLFOs> lfo;
+                    for (size_t k = 0; k < NumGlobalLFOs; ++k)
+                    {
+                        const float inc = lfoIncrements[k];
+                        const float amp = lfoAmplitudes[k];
+                        if constexpr (useLaneVectors<Lanes>)
+                        {
+                            using V = simd::FloatVec;
+                            const V one = V::broadcast(1.f);
+                            const V half = V::broadcast(0.5f);
+                            const V eight = V::broadcast(8.f);
+                            const V sixteen = V::broadcast(16.f);
+                            for (int l = 0; l < Lanes; l += V::width)
+                            {
+                                V ph = V::load(lfoPhases[k].data() + l) + V::broadcast(inc);
+                                ph = ph - V::whereGE(ph, one, one);
+                                ph.store(lfoPhases[k].data() + l);
+                                const V shifted = half - ph;
+                                (V::broadcast(amp) * (shifted * (eight - sixteen * V::abs(shifted)))).store(lfo[k].data() + l);
+                            }
+                            continue;
+                        }
+                        for (int l = 0; l < Lanes; ++l)
+                        {
+                            float ph = lfoPhases[k][l] + inc;
+                            ph = (ph >= 1.f) ? ph - 1.f : ph;
+                            lfoPhases[k][l] = ph;
+                            const float shifted = 0.5f - ph;
+                            lfo[k][l] = amp * (shifted * (8.f - 16.f * std::fabs(shifted)));
+                        }
+                    }
+
+                    // 2) Stage inputs from the previous sample, then the stages.
+                    std::array<LaneArray<Lanes>, NumStages> stageInputs;
+                    gatherStageInputs(stageInputs, std::make_index_sequence<NumStages>{});
+
+                    for (int l = 0; l < Lanes; ++l)
+                        nodeState[0][l] = in[l][s];
+
+                    runStages(stageInputs, lfo.data(), std::make_index_sequence<NumStages>{});
+
+                    // 3) Output node from the current sample.
+                    gatherLanes<NumNodes - 1>(nodeState[NumNodes - 1],
+                        std::make_index_sequence<Routing::numInputs(NumNodes - 1)>{});
+                    for (int l = 0; l < Lanes; ++l)
+                        out[l][s] = nodeState[NumNodes - 1][l];
+                }
+            }
+
+            //----------------------------------------------------------
+            // Per-lane parameters, same meaning as on MultiStageReverb.
+            void updateFeedbackParameter(int lane, float feedbackParam)
+            {
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    effectiveWeights[i][lane] = Config::connections[i].scaleFeedback
+                        ? Config::connections[i].baseWeight * feedbackParam
+                        : Config::connections[i].baseWeight;
+                }
+            }
+
+            void updateGlobalSizeParameter(int lane, float globalSize)
+            {
+                std::apply([&](auto&... st) { (st.updateDelayTimes(lane, globalSize), ...); }, stages);
+            }
+
+            void updateGlobalDensityParameter(int lane, float density)
+            {
+                std::apply([&](auto&... st) { (st.updateCoefficientScaling(lane, density), ...); }, stages);
+            }
+
+            void updateGlobalSVFParameters(int lane, float cutoff, float dbGain)
+            {
+                std::apply([&](auto&... st) { (st.updateSVFParameters(lane, cutoff, dbGain), ...); }, stages);
+            }
+
+            // Start phase (0..1) of one LFO in one lane, applied on reset/prepare.
+            void setLfoStartPhase(int lane, size_t lfoIndex, float phase)
+            {
+                lfoStartPhases[lfoIndex][lane] = phase - std::floor(phase);
+            }
+
+            // See MultiStageReverb::setDenormalGuard.
+            void setDenormalGuard(bool enabled)
+            {
+                denormalGuard = enabled;
+            }
+
+        private:
+            decltype(buildStageTuple(std::make_index_sequence<NumStages>{})) stages;
+            bool denormalGuard = true;
+
+            alignas(32) std::array<LaneArray<Lanes>, NumGlobalLFOs> lfoPhases{};
+            alignas(32) std::array<LaneArray<Lanes>, NumGlobalLFOs> lfoStartPhases{};
+            std::array<float, NumGlobalLFOs> lfoIncrements{};
+            std::array<float, NumGlobalLFOs> lfoAmplitudes{};
+
+            alignas(32) std::array<LaneArray<Lanes>, NumNodes> nodeState{};
+            alignas(32) std::array<LaneArray<Lanes>, NumConnections> effectiveWeights{};
+
+            // sum[l] = sum over the live inputs of Dst of state[src][l] * w[conn][l].
+            template <size_t Dst, size_t... Ks>
+            JUCE_FORCEINLINE void gatherLanes(LaneArray<Lanes>& sum, std::index_sequence<Ks...>) const
+            {
+                if constexpr (useLaneVectors<Lanes>)
+                {
+                    using V = simd::FloatVec;
+                    for (int l = 0; l < Lanes; l += V::width)
+                    {
+                        V acc = V::broadcast(0.f);
+                        ((acc = acc + V::load(nodeState[Routing::template inputSource<Dst, Ks>].data() + l)
+                            * V::load(effectiveWeights[Routing::template inputConnection<Dst, Ks>].data() + l)), ...);
+                        acc.store(sum.data() + l);
+                    }
+                    return;
+                }
+                for (int l = 0; l < Lanes; ++l)
+                {
+                    float acc = 0.f;
+                    ((acc += nodeState[Routing::template inputSource<Dst, Ks>][l]
+                        * effectiveWeights[Routing::template inputConnection<Dst, Ks>][l]), ...);
+                    sum[l] = acc;
+                }
+            }
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE void gatherStageInputs(std::array<LaneArray<Lanes>, NumStages>& inputs, std::index_sequence<Is...>) const
+            {
+                (gatherLanes<Is + 1>(inputs[Is], std::make_index_sequence<Routing::numInputs(Is + 1)>{}), ...);
+            }
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE void runStages(std::array<LaneArray<Lanes>, NumStages>& inputs,
+                const LaneArray<Lanes>* lfo, std::index_sequence<Is...>)
+            {
+                ((std::get<Is>(stages).processSample(inputs[Is], lfo), nodeState[Is + 1] = inputs[Is]), ...);
+            }
+
+            template <size_t... Is>
+            void prepareStages(float sr, std::index_sequence<Is...>)
+            {
+                ((std::get<Is>(stages).prepare(sr)), ...);
+            }
+
+            template <size_t... Is>
+            void resetStages(std::index_sequence<Is...>)
+            {
+                ((std::get<Is>(stages).reset()), ...);
+            }
+        };
+
+    } // namespace multistage
+} // namespace project
@@ -0,0 +1,539 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include "ReverbCommon.h"
+#include "LfoBank.h"
+#include "MultistageReverb.h"
+
+namespace project {
+    namespace multistage {
+
+        // Cross-feed of a MultiStageReverbPair: none, the two tanks only share
+        // their LFO bank. (Its own element type, so this header does not need
+        // a config's Connection.)
+        struct NoCrossFeed {
+            struct Link {
+                size_t src;
+                size_t dst;
+                float baseWeight;
+                bool scaleFeedback;
+            };
+            inline static constexpr std::array<Link, 0> connections{};
+        };
+
+        // A cross-feed list seen as a config of its own, so RoutingSchedule can
+        // resolve it like Config::connections.
+        template <typename Config, typename CrossFeed>
+        struct CrossFeedRouting {
+            static constexpr size_t NumNodes = Config::NumNodes;
+            inline static constexpr auto connections = CrossFeed::connections;
+        };
+
+        // Step of the execution plan node runs in (GraphAnalysis::NumSteps if none).
+        template <typename Graph>
+        constexpr size_t planStepOf(size_t node)
+        {
+            for (size_t s = 0; s < Graph::plan.numSteps; ++s)
+            {
+                const auto& step = Graph::plan.steps[s];
+                for (size_t k = step.begin; k < step.begin + step.count; ++k)
+                {
+                    if (Graph::plan.order[k] == node)
+                        return s;
+                }
+            }
+            return Graph::NumSteps;
+        }
+
+        // True if cross-feed connection i links two stages of the same
+        // per-sample step (a cycle and its twin): it adds loop gain.
+        template <typename Config, typename CrossFeed>
+        constexpr bool crossFeedClosesLoop(size_t i)
+        {
+            using Graph = GraphAnalysis<Config>;
+            const auto& c = CrossFeed::connections[i];
+            return Graph::isStage(c.src) && Graph::isStage(c.dst)
+                && planStepOf<Graph>(c.src) == planStepOf<Graph>(c.dst);
+        }
+
+        // Every live cross-feed connection reads something the other tank has
+        // already computed when its destination runs: the input node, a stage
+        // of an earlier step, or a stage of the same per-sample step. The
+        // output node can take anything but cannot be read.
+        template <typename Config, typename CrossFeed>
+        constexpr bool crossFeedIsSchedulable()
+        {
+            using Graph = GraphAnalysis<Config>;
+            using CrossRouting = RoutingSchedule<CrossFeedRouting<Config, CrossFeed>>;
+            for (size_t i = 0; i < CrossFeed::connections.size(); ++i)
+            {
+                if (!CrossRouting::isLive(i))
+                    continue;
+                const auto& c = CrossFeed::connections[i];
+                if (Graph::outputFeedsBack() || c.src == Graph::OutputNode || Graph::isDead(c.src) || Graph::isDead(c.dst))
+                    return false;
+                if (c.dst == Graph::OutputNode || c.src == 0)
+                    continue;
+                const size_t srcStep = planStepOf<Graph>(c.src);
+                const size_t dstStep = planStepOf<Graph>(c.dst);
+                if (srcStep < dstStep)
+                    continue;
+                if (srcStep == dstStep && Graph::plan.steps[dstStep].kind != Graph::StepKind::Block)
+                    continue;
+                return false;
+            }
+            return true;
+        }
+
+        //==============================================================
+        // MultiStageReverbPair: two copies ("tanks") of MultiStageReverb<Config>
+        // run as one stereo engine, for true stereo (left input into the left
+        // tank, right into the right) and dual mono (one input into both).
+        //
+        // The left tank is the plain engine. The right one is decorrelated
+        // from it: its delays are detuned (setDetune, 3 % by default) and its
+        // LFOs start a quarter cycle ahead of the left tank's (setLfoPhaseOffset).
+        //
+        // Two tanks cost less than two engines:
+        //   - one LfoBank renders the LFOs of both, the right tank's in the
+        //     lanes after the left tank's: one vector pass instead of two,
+        //   - the block steps of the plan (GraphAnalysis) run per tank,
+        //     vectorised along time as in MultiStageReverb,
+        //   - the per-sample steps (self loops and interleaved cycles), whose
+        //     cost is the latency of the recursion rather than its arithmetic,
+        //     advance both tanks in the same loop: two independent dependency
+        //     chains the core overlaps, so there the second tank comes almost
+        //     for free.
+        //
+        // CrossFeed (NoCrossFeed by default) holds Connection-style links
+        // between the tanks:
+        //   struct MyCrossFeed {
+        //       inline static constexpr std::array<Connection, 1> connections = { {
+        //           { 2, 2, 0.05f, true }     // Node 2 of each tank into node 2 of the other.
+        //       } };
+        //   };
+        // feeds weight * node src of each tank into node dst of the other,
+        // both ways, from the previous sample like every connection (the
+        // current sample into the output node); scaleFeedback ties the weight
+        // to the feedback parameter. The plan has to allow it: src must be the
+        // input node, a stage of an earlier step or one of the same per-sample
+        // step (a cycle feeding its twin). Anything else would need the two
+        // graphs fully interleaved and does not compile. Cross-feed into a
+        // cycle adds to its loop gain: keep the sum of a node's weights below 1.
+        //
+        // processBlock produces exactly what processSample does when neither
+        // path is contracted into FMAs (no FMA target, or -ffp-contract=off);
+        // with contraction they can differ in the last bits.
+        //==============================================================
+        template <typename Config, typename CrossFeed = NoCrossFeed>
+        class MultiStageReverbPair
+        {
+        public:
+            using Engine = MultiStageReverb<Config>;
+            using Graph = typename Engine::Graph;
+            using Routing = typename Engine::Routing;
+            using CrossRouting = RoutingSchedule<CrossFeedRouting<Config, CrossFeed>>;
+
+            static constexpr size_t NumStages = Config::NumStages;
+            static constexpr size_t NumNodes = Config::NumNodes;
+            static constexpr size_t NumGlobalLFOs = Config::NumGlobalLFOs;
+            static constexpr size_t NumCrossConnections = CrossFeed::connections.size();
+            static constexpr size_t OutputNode = NumNodes - 1;
+
+            static constexpr float defaultDetune = 0.03f;
+            static constexpr float defaultLfoPhaseOffset = 0.25f;
+
+            static_assert(crossFeedIsSchedulable<Config, CrossFeed>(),
+                "a cross-feed connection reads a node the other tank has not computed yet (or the output node)");
+
+            // ownDelayMemory as for MultiStageReverb, for both tanks.
+            explicit MultiStageReverbPair(bool ownDelayMemory = true)
+                : MultiStageReverbPair(ownDelayMemory, ownDelayMemory)
+            {
+            }
+
+            // The same, per tank: an owner that only sometimes needs the right
+            // tank can lend it memory later.
+            MultiStageReverbPair(bool ownLeftDelayMemory, bool ownRightDelayMemory)
+                : leftTank(ownLeftDelayMemory), rightTank(ownRightDelayMemory)
+            {
+                for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                {
+                    lfos.setLfo(i, Config::lfoFrequencies[i], 0.f);
+                    lfos.setLfo(NumGlobalLFOs + i, Config::lfoFrequencies[i], 0.f);
+                }
+                setLfoPhaseOffset(defaultLfoPhaseOffset);
+                setDetune(defaultDetune);
+                updateFeedbackParameter(1.f);
+            }
+
+            void prepare(float sampleRate)
+            {
+                leftTank.prepare(sampleRate);
+                rightTank.prepare(sampleRate);
+                for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                {
+                    lfos.setAmplitude(i, leftTank.globalLFOs.getAmplitude(i));
+                    lfos.setAmplitude(NumGlobalLFOs + i, rightTank.globalLFOs.getAmplitude(i));
+                    lfoBlockWritePtrs[i] = leftTank.globalLfoBlocks[i].data();
+                    lfoBlockWritePtrs[NumGlobalLFOs + i] = rightTank.globalLfoBlocks[i].data();
+                }
+                lfos.prepare(sampleRate);
+            }
+
+            void reset()
+            {
+                leftTank.reset();
+                rightTank.reset();
+                lfos.reset();
+            }
+
+            Engine& left() { return leftTank; }
+            Engine& right() { return rightTank; }
+            const Engine& left() const { return leftTank; }
+            const Engine& right() const { return rightTank; }
+
+            // Delay memory of both tanks, in floats: the left tank's slice first.
+            static constexpr size_t getDelayMemorySize()
+            {
+                return 2 * Engine::DelayMemorySize;
+            }
+
+            float* attachDelayMemory(float* memory)
+            {
+                return rightTank.attachDelayMemory(leftTank.attachDelayMemory(memory));
+            }
+
+            void detachDelayMemory()
+            {
+                leftTank.detachDelayMemory();
+                rightTank.detachDelayMemory();
+            }
+
+            // How far the right tank's delays are shortened, each by its own
+            // factor in (1 - amount, 1]. Keeps the state; takes effect at once.
+            void setDetune(float amount)
+            {
+                rightTank.detuneDelays(amount, detuneSeed);
+            }
+
+            // Phase (in cycles) the right tank's LFOs start ahead of the left
+            // tank's, from the next prepare() or reset().
+            void setLfoPhaseOffset(float cycles)
+            {
+                for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                    lfos.setStartPhase(NumGlobalLFOs + i, cycles);
+            }
+
+            // See MultiStageReverb::setLfoControlRate.
+            void setLfoControlRate(int decimation)
+            {
+                lfos.setControlRateDecimation(decimation);
+            }
+
+            // See MultiStageReverb::setDenormalGuard. Covers both tanks, also
+            // when the left one runs on its own.
+            void setDenormalGuard(bool enabled)
+            {
+                denormalGuard = enabled;
+                leftTank.setDenormalGuard(enabled);
+                rightTank.setDenormalGuard(enabled);
+            }
+
+            // One sample of each channel.
+            JUCE_FORCEINLINE void processSample(float inL, float inR, float& outL, float& outR)
+            {
+                GRIFFIN_PROFILE_BLOCK(leftTank.profiler, 1);
+                // 1) Both tanks' LFOs in one pass.
+                alignas(32) float values[2 * NumGlobalLFOs];
+                {
+                    GRIFFIN_PROFILE_SPAN(leftTank.profiler, ProfileSpan::Lfo);
+                    lfos.processSample(values);
+                }
+                std::copy(values, values + NumGlobalLFOs, leftTank.globalLfoValues.begin());
+                std::copy(values + NumGlobalLFOs, values + 2 * NumGlobalLFOs, rightTank.globalLfoValues.begin());
+
+                // 2) Every stage from the previous sample of both tanks.
+                std::array<float, NumNodes> newL = leftTank.nodeState;
+                std::array<float, NumNodes> newR = rightTank.nodeState;
+                newL[0] = inL;
+                newR[0] = inR;
+                processStages(newL, newR, std::make_index_sequence<NumStages>{});
+
+                // 3) The outputs from the current sample.
+                newL[OutputNode] = nodeInput<OutputNode>(newL, leftTank, newR);
+                newR[OutputNode] = nodeInput<OutputNode>(newR, rightTank, newL);
+                leftTank.nodeState = newL;
+                rightTank.nodeState = newR;
+#if GRIFFIN_PROFILING
+                if (leftTank.profiler != nullptr)
+                {
+                    leftTank.profiler->addNodeValues(newL);
+                    leftTank.profiler->addNodeValues(newR);
+                }
+#endif
+                outL = newL[OutputNode];
+                outR = newR[OutputNode];
+            }
+
+            // A block of each channel; outL may alias inL and outR inR.
+            void processBlock(const float* inL, const float* inR, float* outL, float* outR, int numSamples)
+            {
+                const ScopedNoDenormals noDenormals(denormalGuard);
+                GRIFFIN_PROFILE_BLOCK(leftTank.profiler, numSamples);
+                while (numSamples > 0)
+                {
+                    const int n = std::min(numSamples, maxBlockSize);
+
+                    {
+                        GRIFFIN_PROFILE_SPAN(leftTank.profiler, ProfileSpan::Lfo);
+                        lfos.processBlock(lfoBlockWritePtrs.data(), n);
+                    }
+
+                    if constexpr (Graph::outputFeedsBack())
+                    {
+                        leftTank.processChunkInterleaved(inL, outL, n);
+                        rightTank.processChunkInterleaved(inR, outR, n);
+                    }
+                    else
+                    {
+                        processChunkStageMajor(inL, inR, outL, outR, n);
+                    }
+
+                    for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                    {
+                        leftTank.globalLfoValues[i] = leftTank.globalLfoBlocks[i][n - 1];
+                        rightTank.globalLfoValues[i] = rightTank.globalLfoBlocks[i][n - 1];
+                    }
+
+                    inL += n;
+                    inR += n;
+                    outL += n;
+                    outR += n;
+                    numSamples -= n;
+                }
+            }
+
+#if GRIFFIN_PROFILING
+            // One profiler for both tanks: each stage's span covers it in both,
+            // the node levels both tanks' nodes.
+            void setProfiler(typename Engine::Profiler* profiler)
+            {
+                leftTank.setProfiler(profiler);
+                rightTank.setProfiler(profiler);
+            }
+#endif
+
+            //----------------------------------------------------------
+            // Parameters, for both tanks (see MultiStageReverb).
+            void updateFeedbackParameter(float feedbackParam)
+            {
+                std::array<float, NumNodes> loopInput{};
+                for (size_t i = 0; i < NumCrossConnections; ++i)
+                {
+                    const auto& c = CrossFeed::connections[i];
+                    crossWeights[i] = c.scaleFeedback ? c.baseWeight * feedbackParam : c.baseWeight;
+                    if (CrossRouting::isLive(i) && crossFeedClosesLoop<Config, CrossFeed>(i))
+                        loopInput[c.dst] += std::fabs(crossWeights[i]);
+                }
+                leftTank.externalLoopInput = loopInput;
+                rightTank.externalLoopInput = loopInput;
+                leftTank.updateFeedbackParameter(feedbackParam);
+                rightTank.updateFeedbackParameter(feedbackParam);
+            }
+
+            void updateGlobalSizeParameter(float globalSize)
+            {
+                leftTank.updateGlobalSizeParameter(globalSize);
+                rightTank.updateGlobalSizeParameter(globalSize);
+            }
+
+            void updateGlobalDensityParameter(float density)
+            {
+                leftTank.updateGlobalDensityParameter(density);
+                rightTank.updateGlobalDensityParameter(density);
+            }
+
+            void updateGlobalSVFParameters(float cutoff, float dbGain)
+            {
+                leftTank.updateGlobalSVFParameters(cutoff, dbGain);
+                rightTank.updateGlobalSVFParameters(cutoff, dbGain);
+            }
+
+            // Tail estimates of the slower tank (cross-feed into a cycle counts
+            // as loop gain of both).
+            float getDecay60Samples() const
+            {
+                return std::max(leftTank.getDecay60Samples(), rightTank.getDecay60Samples());
+            }
+
+            float getLongestPathSamples() const
+            {
+                return std::max(leftTank.getLongestPathSamples(), rightTank.getLongestPathSamples());
+            }
+
+        private:
+            using NodeColumn = typename Engine::NodeColumn;
+
+            // Any fixed seed will do; it only has to be the same every run.
+            static constexpr std::uint32_t detuneSeed = 0x9e3779b9u;
+
+            Engine leftTank;
+            Engine rightTank;
+            project::LfoBank<2 * NumGlobalLFOs> lfos;
+            std::array<float*, 2 * NumGlobalLFOs> lfoBlockWritePtrs{};
+            std::array<float, NumCrossConnections> crossWeights{};
+            bool denormalGuard = true;
+
+            // Input of node Node of a tank: its own sources from `own`, the
+            // other tank's cross-fed ones from `other` (state arrays or block
+            // columns alike).
+            template <size_t Node, typename State>
+            JUCE_FORCEINLINE float nodeInput(const State& own, const Engine& tank, const State& other) const
+            {
+                const float sum = Routing::template gather<Node>(own, tank.effectiveWeights);
+                if constexpr (CrossRouting::numInputs(Node) == 0)
+                {
+                    (void)other;
+                    return sum;
+                }
+                else
+                {
+                    return sum + CrossRouting::template gather<Node>(other, crossWeights);
+                }
+            }
+
+            template <size_t I>
+            JUCE_FORCEINLINE void processStage(std::array<float, NumNodes>& newL, std::array<float, NumNodes>& newR)
+            {
+                GRIFFIN_PROFILE_SPAN(leftTank.profiler, ProfileSpan::stage(I));
+                newL[I + 1] = std::get<I>(leftTank.stages).processSample(
+                    nodeInput<I + 1>(leftTank.nodeState, leftTank, rightTank.nodeState));
+                newR[I + 1] = std::get<I>(rightTank.stages).processSample(
+                    nodeInput<I + 1>(rightTank.nodeState, rightTank, leftTank.nodeState));
+            }
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE void processStages(std::array<float, NumNodes>& newL, std::array<float, NumNodes>& newR,
+                std::index_sequence<Is...>)
+            {
+                (processStage<Is>(newL, newR), ...);
+            }
+
+            // MultiStageReverb::processChunkStageMajor for both tanks at once.
+            void processChunkStageMajor(const float* inL, const float* inR, float* outL, float* outR, int n)
+            {
+                for (size_t node = 0; node < NumNodes; ++node)
+                {
+                    leftTank.nodeBlocks[node][0] = leftTank.nodeState[node];
+                    rightTank.nodeBlocks[node][0] = rightTank.nodeState[node];
+                }
+                std::copy(inL, inL + n, leftTank.nodeBlocks[0].data() + 1);
+                std::copy(inR, inR + n, rightTank.nodeBlocks[0].data() + 1);
+
+                runSteps(n, std::make_index_sequence<Graph::NumSteps>{});
+
+                for (int s = 0; s < n; ++s)
+                {
+                    const NodeColumn l{ leftTank.nodeBlocks, s + 1 };
+                    const NodeColumn r{ rightTank.nodeBlocks, s + 1 };
+                    outL[s] = nodeInput<OutputNode>(l, leftTank, r);
+                    outR[s] = nodeInput<OutputNode>(r, rightTank, l);
+                }
+#if GRIFFIN_PROFILING
+                if (leftTank.profiler != nullptr)
+                {
+                    for (size_t node = 0; node < NumNodes - 1; ++node)
+                    {
+                        if (!Graph::isDead(node))
+                        {
+                            leftTank.profiler->addNodeLevels(node, leftTank.nodeBlocks[node].data() + 1, n);
+                            leftTank.profiler->addNodeLevels(node, rightTank.nodeBlocks[node].data() + 1, n);
+                        }
+                    }
+                    leftTank.profiler->addNodeLevels(OutputNode, outL, n);
+                    leftTank.profiler->addNodeLevels(OutputNode, outR, n);
+                }
+#endif
+
+                for (size_t node = 0; node < NumNodes - 1; ++node)
+                {
+                    if (!Graph::isDead(node))
+                    {
+                        leftTank.nodeState[node] = leftTank.nodeBlocks[node][n];
+                        rightTank.nodeState[node] = rightTank.nodeBlocks[node][n];
+                    }
+                }
+                leftTank.nodeState[OutputNode] = outL[n - 1];
+                rightTank.nodeState[OutputNode] = outR[n - 1];
+            }
+
+            template <size_t... Ss>
+            JUCE_FORCEINLINE void runSteps(int n, std::index_sequence<Ss...>)
+            {
+                (runStep<Ss>(n), ...);
+            }
+
+            template <size_t S>
+            JUCE_FORCEINLINE void runStep(int n)
+            {
+                constexpr auto step = Graph::plan.steps[S];
+                GRIFFIN_PROFILE_SPAN(leftTank.profiler, Engine::template stepSpans<S>);
+                if constexpr (step.kind == Graph::StepKind::Block)
+                {
+                    constexpr size_t node = Graph::plan.order[step.begin];
+                    runBlockStep<node>(leftTank, rightTank, n);
+                    runBlockStep<node>(rightTank, leftTank, n);
+                }
+                else
+                {
+                    runPairedStep<S>(n, std::make_index_sequence<step.count>{});
+                }
+            }
+
+            // One stage over the whole chunk, as MultiStageReverb::runStep.
+            template <size_t Node>
+            JUCE_FORCEINLINE void runBlockStep(Engine& tank, const Engine& other, int n)
+            {
+                auto& stage = std::get<Node - 1>(tank.stages);
+                float* out = tank.nodeBlocks[Node].data() + 1;
+                if constexpr (Graph::isPassThrough(Node) && CrossRouting::numInputs(Node) == 0)
+                {
+                    stage.processBlock(tank.nodeBlocks[Graph::passThroughSource(Node)].data(), out, n);
+                }
+                else
+                {
+                    for (int s = 0; s < n; ++s)
+                    {
+                        out[s] = nodeInput<Node>(NodeColumn{ tank.nodeBlocks, s }, tank, NodeColumn{ other.nodeBlocks, s });
+                    }
+                    stage.processBlock(out, out, n);
+                }
+            }
+
+            // A self loop or a cycle, sample by sample, both tanks in the same
+            // iteration: every input from the previous sample first, then
+            // every stage.
+            template <size_t S, size_t... Ks>
+            JUCE_FORCEINLINE void runPairedStep(int n, std::index_sequence<Ks...>)
+            {
+                constexpr auto step = Graph::plan.steps[S];
+                for (int s = 0; s < n; ++s)
+                {
+                    const NodeColumn l{ leftTank.nodeBlocks, s };
+                    const NodeColumn r{ rightTank.nodeBlocks, s };
+                    const float inputsL[] = { nodeInput<Graph::plan.order[step.begin + Ks]>(l, leftTank, r)... };
+                    const float inputsR[] = { nodeInput<Graph::plan.order[step.begin + Ks]>(r, rightTank, l)... };
+                    ((leftTank.nodeBlocks[Graph::plan.order[step.begin + Ks]][s + 1] =
+                        std::get<Graph::plan.order[step.begin + Ks] - 1>(leftTank.stages).processSampleInBlock(inputsL[Ks], s)), ...);
+                    ((rightTank.nodeBlocks[Graph::plan.order[step.begin + Ks]][s + 1] =
+                        std::get<Graph::plan.order[step.begin + Ks] - 1>(rightTank.stages).processSampleInBlock(inputsR[Ks], s)), ...);
+                }
+            }
+        };
+
+    } // namespace multistage
+} // namespace project
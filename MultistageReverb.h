@@ -3,11 +3,39 @@
 #include <tuple>
 #include <type_traits>
 #include "ReverbCommon.h"
+#include "LfoBank.h"
+#include "DelayArena.h"
 #include "StageReverb.h"
+#include "StageFdn.h"
+#include "RoutingSchedule.h"
+#include "GraphAnalysis.h"
+#include "ReverbProfiler.h"
 
 namespace project {
     namespace multistage {
 
+        // Arena floats for every stage of a config, known at compile time.
+        template <typename Config, size_t... Is>
+        constexpr size_t configDelayMemorySize(std::index_sequence<Is...>)
+        {
+            return (size_t(0) + ... + StageOf<std::tuple_element_t<Is, typename Config::StageTuple>, DelayStorageOf<Config>>::DelayMemorySize);
+        }
+
+        // The delay headroom of every line has to cover the deepest modulation.
+        template <typename Config>
+        constexpr bool lfoDepthsFitHeadroom()
+        {
+            for (size_t i = 0; i < Config::NumGlobalLFOs; ++i)
+            {
+                if (Config::lfoDepthsMs[i] > delayHeadroomMs || -Config::lfoDepthsMs[i] > delayHeadroomMs)
+                    return false;
+            }
+            return true;
+        }
+
+        template <typename Config, typename CrossFeed>
+        class MultiStageReverbPair;
+
         template <typename Config>
         class MultiStageReverb
         {
@@ -17,13 +45,37 @@ namespace project {
             static constexpr size_t NumGlobalLFOs = Config::NumGlobalLFOs;
             static constexpr size_t NumConnections = Config::connections.size();
 
-            // Global LFO array and output storage.
-            std::array<project::SimpleLFO, NumGlobalLFOs> globalLFOs;
+            // Delay buffer format: Config::DelayStorage if declared, else float.
+            using Storage = DelayStorageOf<Config>;
+            // Fractional delay read: Config::Interpolation if declared, else linear.
+            // A StageConfig can override it for its own APs.
+            using Interpolation = InterpolationOf<Config>;
+
+            // Per-destination source lists, resolved at compile time.
+            using Routing = RoutingSchedule<Config>;
+            // Dead nodes, cycles and the stage-major execution plan for processBlock.
+            using Graph = GraphAnalysis<Config>;
+            static_assert(Graph::planIsComplete(), "GraphAnalysis failed to schedule every live stage");
+
+            // Span and level collector for GRIFFIN_PROFILING builds (ReverbProfiler.h).
+            using Profiler = ReverbProfiler<NumStages, NumNodes>;
+
+            // Global LFO bank (all LFOs in parallel lanes) and output storage.
+            project::LfoBank<NumGlobalLFOs> globalLFOs;
             std::array<float, NumGlobalLFOs> globalLfoValues{};
 
-            // Build a tuple of StageReverb objects.
+            // Per-block LFO outputs for processBlock (globalLfoBlocks[lfo][sample]),
+            // plus the pointer table handed to the stages and the stereoizer.
+            std::array<std::array<float, maxBlockSize>, NumGlobalLFOs> globalLfoBlocks{};
+            std::array<const float*, NumGlobalLFOs> globalLfoBlockPtrs{};
+
+            // Peak absolute output of each global LFO (its amplitude in samples).
+            std::array<float, NumGlobalLFOs> globalLfoDepths{};
+
+            // Build a tuple of stages: StageReverb, or whatever StageKind a StageConfig names.
             template <std::size_t I>
-            using SingleStage = StageReverb<std::tuple_element_t<I, typename Config::StageTuple>>;
+            using SingleStage = StageOf<std::tuple_element_t<I, typename Config::StageTuple>, Storage,
+                InterpolationOf<std::tuple_element_t<I, typename Config::StageTuple>, Interpolation>>;
 
             template <std::size_t... Is>
             static constexpr auto buildStageTuple(std::index_sequence<Is...>)
@@ -33,57 +85,104 @@ namespace project {
 
             decltype(buildStageTuple(std::make_index_sequence<NumStages>{})) stages;
 
+            // Delay memory of the whole config in floats, for the highest supported rate.
+            static constexpr size_t DelayMemorySize = configDelayMemorySize<Config>(std::make_index_sequence<NumStages>{});
+            static_assert(lfoDepthsFitHeadroom<Config>(), "an LFO depth exceeds delayHeadroomMs");
+
             // Node state array.
             std::array<float, NumNodes> nodeState;
 
             // Effective connection weights (updated on feedback parameter changes).
             std::array<float, NumConnections> effectiveWeights;
 
-            MultiStageReverb()
+            // With ownDelayMemory false no arena is allocated and the engine must
+            // be given memory with attachDelayMemory() before processing.
+            explicit MultiStageReverb(bool ownDelayMemory = true)
             {
                 nodeState.fill(0.f);
-                // Initialize LFOs.
+                // All delay lines live in one arena, allocated here once.
+                if (ownDelayMemory)
+                {
+                    delayArena.allocate(DelayMemorySize);
+                    attachStagesDelayMemory(delayArena.data(), std::make_index_sequence<NumStages>{});
+                }
+                // Initialize LFOs (depths are set in samples by prepare()).
                 for (size_t i = 0; i < NumGlobalLFOs; ++i)
                 {
-                    float freq = Config::lfoFrequencies[i];
-                    float amp = Config::lfoAmplitudes[i];
-                    globalLFOs[i] = project::SimpleLFO(freq, amp);
+                    globalLFOs.setLfo(i, Config::lfoFrequencies[i], 0.f);
                 }
                 // Initialize effective weights using default feedback parameter = 1.0.
                 for (size_t i = 0; i < NumConnections; ++i)
                 {
                     effectiveWeights[i] = Config::connections[i].baseWeight;
                 }
+                updateTailEstimate();
             }
 
             void prepare(float sampleRate)
             {
-                // Prepare LFOs.
-                for (auto& l : globalLFOs) {
-                    l.prepare(sampleRate);
+                currentSampleRate = sampleRate;
+#if GRIFFIN_RUNTIME_DISPATCH
+                // Pick the block kernels for this CPU (or a forced ISA).
+                dispatch::select();
+#endif
+                // Prepare LFOs, with the depths converted from ms at this rate.
+                for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                {
+                    const float amp = msToSamples(Config::lfoDepthsMs[i], std::min(sampleRate, maxSupportedSampleRate));
+                    globalLFOs.setAmplitude(i, amp);
+                    globalLfoDepths[i] = std::fabs(amp);
                 }
+                globalLFOs.prepare(sampleRate);
                 // Prepare stages.
                 prepareStages(sampleRate, std::make_index_sequence<NumStages>{});
+                for (size_t i = 0; i < NumGlobalLFOs; ++i) {
+                    globalLfoBlockPtrs[i] = globalLfoBlocks[i].data();
+                    lfoBlockWritePtrs[i] = globalLfoBlocks[i].data();
+                }
                 setStageGlobalLfoPointers(std::make_index_sequence<NumStages>{});
                 nodeState.fill(0.f);
+                updateTailEstimate();
             }
 
             void reset()
             {
-                for (auto& l : globalLFOs) {
-                    l.reset();
-                }
+                globalLFOs.reset();
                 resetStages(std::make_index_sequence<NumStages>{});
                 nodeState.fill(0.f);
             }
 
+            // Total delay memory of all stages, in floats. By default the engine
+            // carves its delay lines out of its own arena of this size; a voice
+            // pool can instead lend it one slice with attachDelayMemory() and
+            // take it back with detachDelayMemory().
+            static constexpr size_t getDelayMemorySize()
+            {
+                return DelayMemorySize;
+            }
+
+            // Runs every stage on `memory` (cleared), freeing the own arena, and
+            // returns the first float past it.
+            float* attachDelayMemory(float* memory)
+            {
+                delayArena.release();
+                return attachStagesDelayMemory(memory, std::make_index_sequence<NumStages>{});
+            }
+
+            void detachDelayMemory()
+            {
+                delayArena.release();
+                detachStagesDelayMemory(std::make_index_sequence<NumStages>{});
+            }
+
             // Process one sample.
             JUCE_FORCEINLINE float processSample(float input)
             {
+                GRIFFIN_PROFILE_BLOCK(profiler, 1);
                 // 1) Update LFO outputs.
-                for (size_t i = 0; i < NumGlobalLFOs; ++i)
                 {
-                    globalLfoValues[i] = globalLFOs[i].update();
+                    GRIFFIN_PROFILE_SPAN(profiler, ProfileSpan::Lfo);
+                    globalLFOs.processSample(globalLfoValues.data());
                 }
                 // 2) Copy current state and set input.
                 std::array<float, NumNodes> newState = nodeState;
@@ -93,24 +192,81 @@ namespace project {
                 processStages(newState, nodeState, std::make_index_sequence<NumStages>{});
 
                 // 4) Compute final output (node NumNodes-1) from new state.
+                newState[NumNodes - 1] = Routing::template gather<NumNodes - 1>(newState, effectiveWeights);
+
+                // 5) Update node state and return final output.
+                nodeState = newState;
+#if GRIFFIN_PROFILING
+                if (profiler != nullptr)
+                    profiler->addNodeValues(newState);
+#endif
+                return newState[NumNodes - 1];
+            }
+
+            // Process a block (in place is fine). Produces exactly the same output as
+            // calling processSample for each sample when neither path is contracted
+            // into FMAs (no FMA target, or -ffp-contract=off); with contraction, as
+            // under -march=native, they can differ in the last bits. Long blocks are
+            // split into chunks of maxBlockSize; afterwards globalLfoBlocks holds the
+            // LFO values of the last chunk, so callers pairing this with the
+            // stereoizer's processBlock should pass at most maxBlockSize samples at
+            // a time.
+            void processBlock(const float* input, float* output, int numSamples)
+            {
+                const ScopedNoDenormals noDenormals(denormalGuard);
+                GRIFFIN_PROFILE_BLOCK(profiler, numSamples);
+                while (numSamples > 0)
                 {
-                    float sum = 0.f;
-                    for (size_t i = 0; i < NumConnections; ++i)
+                    const int n = std::min(numSamples, maxBlockSize);
+
+                    // 1) Render the LFOs for the whole chunk.
                     {
-                        if (Config::connections[i].dst == NumNodes - 1)
-                        {
-                            size_t src = Config::connections[i].src;
-                            sum += newState[src] * effectiveWeights[i];
-                        }
+                        GRIFFIN_PROFILE_SPAN(profiler, ProfileSpan::Lfo);
+                        globalLFOs.processBlock(lfoBlockWritePtrs.data(), n);
+                    }
+
+                    // 2) Run the graph, stage-major wherever GraphAnalysis allows it.
+                    if constexpr (Graph::outputFeedsBack())
+                        processChunkInterleaved(input, output, n);
+                    else
+                        processChunkStageMajor(input, output, n);
+
+                    // 3) Leave the per-sample LFO outputs where processSample would.
+                    for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                    {
+                        globalLfoValues[i] = globalLfoBlocks[i][n - 1];
                     }
-                    newState[NumNodes - 1] = sum;
+
+                    input += n;
+                    output += n;
+                    numSamples -= n;
                 }
+            }
 
-                // 5) Update node state and return final output.
-                nodeState = newState;
-                return newState[NumNodes - 1];
+            // processBlock() runs with flush-to-zero on (ScopedNoDenormals) unless
+            // this is switched off, e.g. because the host already does it.
+            // processSample() never touches the FPU mode: per-sample callers
+            // should hold their own ScopedNoDenormals around the loop.
+            void setDenormalGuard(bool enabled)
+            {
+                denormalGuard = enabled;
+            }
+
+            // Evaluate the LFOs every `decimation` samples and interpolate in between
+            // (1 = every sample, the default). The modulation is a few samples deep
+            // at around 1 Hz, so 16-64 is inaudible and takes the LFOs off the profile.
+            void setLfoControlRate(int decimation)
+            {
+                globalLFOs.setControlRateDecimation(decimation);
             }
 
+#if GRIFFIN_PROFILING
+            // Where the spans and node levels go; null (the default) collects
+            // nothing. The profiler must outlive the engine's processing.
+            void setProfiler(Profiler* newProfiler) { profiler = newProfiler; }
+            Profiler* getProfiler() const { return profiler; }
+#endif
+
             // Update feedback parameter: for connections flagged with scaleFeedback,
             // effectiveWeight = baseWeight * feedbackParam; others remain unchanged.
             void updateFeedbackParameter(float feedbackParam)
@@ -122,18 +278,21 @@ namespace project {
                     else
                         effectiveWeights[i] = Config::connections[i].baseWeight;
                 }
+                updateTailEstimate();
             }
 
             // Update global size parameter for delays (passes to stages).
             void updateGlobalSizeParameter(float globalSize)
             {
                 updateStagesDelayTimes(globalSize, std::make_index_sequence<NumStages>{});
+                updateTailEstimate();
             }
 
             // Update global density parameter for coefficient scaling (passes to stages).
             void updateGlobalDensityParameter(float density)
             {
                 updateStagesCoefficientScaling(density, std::make_index_sequence<NumStages>{});
+                updateTailEstimate();
             }
 
             // Update global SVF parameters for stages that have attached SVF filter settings.
@@ -142,23 +301,309 @@ namespace project {
                 updateStagesSVFParameters(cutoff, dbGain, std::make_index_sequence<NumStages>{});
             }
 
+            // Shortens the delays of every stage, each by its own factor in
+            // (1 - amount, 1] drawn from seed (see StageReverb::detuneDelays):
+            // a copy of the engine that no longer shares its echo times. 0 puts
+            // the nominal delays back. Survives prepare() and size changes.
+            void detuneDelays(float amount, std::uint32_t seed)
+            {
+                detuneStagesDelays(amount, seed, std::make_index_sequence<NumStages>{});
+                updateTailEstimate();
+            }
+
+            // Phase (in cycles) LFO i starts from on prepare() and reset(); 0 by default.
+            void setLfoStartPhase(size_t i, float phase)
+            {
+                globalLFOs.setStartPhase(i, phase);
+            }
+
+            // Loops that never decay (gain >= 1) report a tail of this length.
+            static constexpr float maxTailSeconds = 60.f;
+
+            // Samples the output keeps ringing after the input stops, to -60 dB,
+            // for the current parameters. Kept up to date by prepare() and the
+            // size, feedback and density updates.
+            float getDecay60Samples() const { return decay60Samples; }
+
+            // The longest a sound can take to reach the output once, in samples.
+            // Output silence shorter than this does not mean the graph is empty.
+            float getLongestPathSamples() const { return longestPathSamples; }
+
         private:
+            // Runs two engines side by side and feeds them into each other.
+            template <typename, typename>
+            friend class MultiStageReverbPair;
+
+            DelayArena delayArena;
+            std::array<float*, NumGlobalLFOs> lfoBlockWritePtrs{};
+            float currentSampleRate = 44100.f;
+            bool denormalGuard = true;
+            float decay60Samples = 0.f;
+            float longestPathSamples = 0.f;
+            // Sum of |weights| reaching each node from another engine on the
+            // same cycle (MultiStageReverbPair's cross-feed): more loop gain.
+            std::array<float, NumNodes> externalLoopInput{};
+#if GRIFFIN_PROFILING
+            Profiler* profiler = nullptr;
+
+            // The stage spans step S is charged to: its stage, or every stage
+            // of a cycle, which share the step's time evenly.
+            template <size_t S, size_t... Ks>
+            static constexpr std::array<size_t, sizeof...(Ks)> makeStepSpans(std::index_sequence<Ks...>)
+            {
+                return { ProfileSpan::stage(Graph::plan.order[Graph::plan.steps[S].begin + Ks] - 1)... };
+            }
+
+            template <size_t S>
+            static constexpr auto stepSpans = makeStepSpans<S>(std::make_index_sequence<Graph::plan.steps[S].count>{});
+#endif
+
+            // Every live stage adds its ring time and its delay. Every cycle adds
+            // the time its loop needs to lose 60 dB: one pass takes the cycle's
+            // total delay (the mean group delay of its allpasses) plus the sample
+            // each edge adds, and loses at least the largest sum of |weights|
+            // feeding a node of the cycle from inside it. Allpasses pass energy
+            // unchanged and the shelves only cut, so that sum bounds the loop gain.
+            //
+            // The mean group delay is not the slowest one: near an allpass's
+            // poles a pass takes up to (1 + |c|) / (1 - |c|) times its delay, so
+            // the last modes to die out decay slower than the mean pass says.
+            // Bounding every pass by that would put most tails at the cap, so
+            // the loop term carries loopDecayMargin instead. Over feedback
+            // 0-0.99, size 0.5-2 and density 0.3-1 (MyReverbConfig, noise in)
+            // the real loop decay took up to 1.72 times the unmargined term.
+            static constexpr float loopDecayMargin = 2.0f;
+
+            void updateTailEstimate()
+            {
+                std::array<float, NumNodes> ring{};
+                std::array<float, NumNodes> delay{};
+                collectStageTimes(ring, delay, std::make_index_sequence<NumStages>{});
+
+                std::array<float, NumNodes> loopInput = externalLoopInput;
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    const auto& c = Config::connections[i];
+                    if (Routing::isLive(i) && Graph::isOnCycle(c.dst) && Graph::sameCycle(c.src, c.dst))
+                        loopInput[c.dst] += std::fabs(effectiveWeights[i]);
+                }
+
+                float decay = 0.f;
+                float longest = 0.f;
+                for (size_t n = 1; n <= NumStages; ++n)
+                {
+                    if (Graph::isDead(n))
+                        continue;
+                    decay += ring[n];
+                    longest += delay[n];
+                }
+
+                const float maxSamples = maxTailSeconds * currentSampleRate;
+                for (size_t n = 1; n < NumNodes; ++n)
+                {
+                    bool firstOfCycle = Graph::isOnCycle(n);
+                    for (size_t m = 1; m < n && firstOfCycle; ++m)
+                        firstOfCycle = !Graph::sameCycle(n, m);
+                    if (!firstOfCycle)
+                        continue;
+
+                    float gain = 0.f;
+                    float pass = 0.f;
+                    for (size_t m = n; m < NumNodes; ++m)
+                    {
+                        if (Graph::sameCycle(n, m))
+                        {
+                            gain = std::max(gain, loopInput[m]);
+                            pass += delay[m] + 1.f;
+                        }
+                    }
+                    decay = std::min(maxSamples, decay + loopDecayMargin * loopDecaySamples(pass, gain, maxSamples));
+                }
+
+                decay60Samples = decay;
+                longestPathSamples = longest;
+            }
+
+            template <size_t... Is>
+            void collectStageTimes(std::array<float, NumNodes>& ring, std::array<float, NumNodes>& delay, std::index_sequence<Is...>) const
+            {
+                ((ring[Is + 1] = std::get<Is>(stages).getRingSamples()), ...);
+                ((delay[Is + 1] = std::get<Is>(stages).getTotalDelaySamples()), ...);
+            }
+
+            // Per-node sample blocks for the stage-major schedule. Slot 0 holds the
+            // node's value from the sample before the chunk, slots 1..n the chunk,
+            // so slot s is exactly what a stage reads at chunk sample s.
+            using NodeBlocks = std::array<std::array<float, maxBlockSize + 1>, NumNodes>;
+            NodeBlocks nodeBlocks{};
+
+            struct NodeColumn {
+                const NodeBlocks& blocks;
+                int index;
+                JUCE_FORCEINLINE float operator[](size_t node) const { return blocks[node][index]; }
+            };
+
+            void processChunkStageMajor(const float* input, float* output, int n)
+            {
+                for (size_t node = 0; node < NumNodes; ++node)
+                {
+                    nodeBlocks[node][0] = nodeState[node];
+                }
+                std::copy(input, input + n, nodeBlocks[0].data() + 1);
+
+                runSteps(n, std::make_index_sequence<Graph::NumSteps>{});
+
+                // The output node sums the current sample of its sources.
+                mixInputs<NumNodes - 1>(output, 1, n);
+#if GRIFFIN_PROFILING
+                if (profiler != nullptr)
+                {
+                    for (size_t node = 0; node < NumNodes - 1; ++node)
+                    {
+                        if (!Graph::isDead(node))
+                            profiler->addNodeLevels(node, nodeBlocks[node].data() + 1, n);
+                    }
+                    profiler->addNodeLevels(NumNodes - 1, output, n);
+                }
+#endif
+
+                for (size_t node = 0; node < NumNodes - 1; ++node)
+                {
+                    if (!Graph::isDead(node))
+                        nodeState[node] = nodeBlocks[node][n];
+                }
+                nodeState[NumNodes - 1] = output[n - 1];
+            }
+
+            template <size_t... Ss>
+            JUCE_FORCEINLINE void runSteps(int n, std::index_sequence<Ss...>)
+            {
+                (runStep<Ss>(n), ...);
+            }
+
+            template <size_t S>
+            JUCE_FORCEINLINE void runStep(int n)
+            {
+                constexpr auto step = Graph::plan.steps[S];
+                GRIFFIN_PROFILE_SPAN(profiler, stepSpans<S>);
+                if constexpr (step.kind == Graph::StepKind::Interleaved)
+                {
+                    runInterleavedStep<S>(n, std::make_index_sequence<step.count>{});
+                }
+                else
+                {
+                    constexpr size_t node = Graph::plan.order[step.begin];
+                    auto& stage = std::get<node - 1>(stages);
+                    float* out = nodeBlocks[node].data() + 1;
+
+                    if constexpr (step.kind == Graph::StepKind::SelfLoop)
+                    {
+                        // Reads its own previous output, so sample by sample.
+                        for (int s = 0; s < n; ++s)
+                        {
+                            out[s] = stage.processSampleInBlock(
+                                Routing::template gather<node>(NodeColumn{ nodeBlocks, s }, effectiveWeights), s);
+                        }
+                    }
+                    else if constexpr (Graph::isPassThrough(node))
+                    {
+                        stage.processBlock(nodeBlocks[Graph::passThroughSource(node)].data(), out, n);
+                    }
+                    else
+                    {
+                        mixInputs<node>(out, 0, n);
+                        stage.processBlock(out, out, n);
+                    }
+                }
+            }
+
+            // out[s] = the weighted sum of node's sources at slot first + s of
+            // their blocks, s < n: gather over a block, through the
+            // runtime-dispatched kernel (ReverbDispatch.h) when compiled in.
+            template <size_t node>
+            JUCE_FORCEINLINE void mixInputs(float* out, int first, int n)
+            {
+#if GRIFFIN_RUNTIME_DISPATCH
+                mixInputs<node>(out, first, n, std::make_index_sequence<Routing::numInputs(node)>{});
+#else
+                for (int s = 0; s < n; ++s)
+                {
+                    out[s] = Routing::template gather<node>(NodeColumn{ nodeBlocks, first + s }, effectiveWeights);
+                }
+#endif
+            }
+
+#if GRIFFIN_RUNTIME_DISPATCH
+            template <size_t node, size_t... Ks>
+            JUCE_FORCEINLINE void mixInputs(float* out, int first, int n, std::index_sequence<Ks...>)
+            {
+                if constexpr (sizeof...(Ks) == 0)
+                {
+                    std::fill(out, out + n, 0.f);
+                }
+                else
+                {
+                    const float* const sources[] = { nodeBlocks[Routing::template inputSource<node, Ks>].data() + first... };
+                    const float weights[] = { effectiveWeights[Routing::template inputConnection<node, Ks>]... };
+                    dispatch::kernels().mix(out, sources, weights, static_cast<int>(sizeof...(Ks)), n);
+                }
+            }
+#endif
+
+            // Stages sharing a cycle: gather all their inputs from the previous
+            // sample, then advance each of them by one sample.
+            template <size_t S, size_t... Ks>
+            JUCE_FORCEINLINE void runInterleavedStep(int n, std::index_sequence<Ks...>)
+            {
+                constexpr auto step = Graph::plan.steps[S];
+                for (int s = 0; s < n; ++s)
+                {
+                    const float inputs[] = { Routing::template gather<Graph::plan.order[step.begin + Ks]>(
+                        NodeColumn{ nodeBlocks, s }, effectiveWeights)... };
+                    ((nodeBlocks[Graph::plan.order[step.begin + Ks]][s + 1] =
+                        std::get<Graph::plan.order[step.begin + Ks] - 1>(stages).processSampleInBlock(inputs[Ks], s)), ...);
+                }
+            }
+
+            // Fallback for configs whose output node feeds back into the graph:
+            // the whole graph advances one sample at a time. Every stage reads its
+            // sources from the previous sample, so all stage inputs are gathered
+            // before any node is overwritten - no state copy.
+            void processChunkInterleaved(const float* input, float* output, int n)
+            {
+                std::array<float, NumNodes> state = nodeState;
+                for (int s = 0; s < n; ++s)
+                {
+                    for (size_t i = 0; i < NumGlobalLFOs; ++i)
+                    {
+                        globalLfoValues[i] = globalLfoBlocks[i][s];
+                    }
+
+                    std::array<float, NumStages> stageInputs;
+                    gatherStageInputs(stageInputs, state, std::make_index_sequence<NumStages>{});
+
+                    state[0] = input[s];
+                    runStages(state, stageInputs, std::make_index_sequence<NumStages>{});
+
+                    const float sum = Routing::template gather<NumNodes - 1>(state, effectiveWeights);
+                    state[NumNodes - 1] = sum;
+                    output[s] = sum;
+#if GRIFFIN_PROFILING
+                    if (profiler != nullptr)
+                        profiler->addNodeValues(state);
+#endif
+                }
+                nodeState = state;
+            }
+
             // Helper: process a single stage.
             template <size_t I>
             JUCE_FORCEINLINE void processStage(std::array<float, NumNodes>& newState,
                 const std::array<float, NumNodes>& oldState)
             {
                 constexpr size_t dest = I + 1;
-                float sum = 0.f;
-                for (size_t j = 0; j < NumConnections; ++j)
-                {
-                    // FIX: Check for connections with destination equal to the current stage's node.
-                    if (Config::connections[j].dst == dest)
-                    {
-                        size_t src = Config::connections[j].src;
-                        sum += oldState[src] * effectiveWeights[j];
-                    }
-                }
+                const float sum = Routing::template gather<dest>(oldState, effectiveWeights);
+                GRIFFIN_PROFILE_SPAN(profiler, ProfileSpan::stage(I));
                 newState[dest] = std::get<I>(stages).processSample(sum);
             }
 
@@ -171,12 +616,55 @@ namespace project {
                 (processStage<Is>(newState, oldState), ...);
             }
 
+            // Helper: sum the (previous-sample) sources feeding stage I.
+            template <size_t I>
+            JUCE_FORCEINLINE float gatherStageInput(const std::array<float, NumNodes>& state) const
+            {
+                return Routing::template gather<I + 1>(state, effectiveWeights);
+            }
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE void gatherStageInputs(std::array<float, NumStages>& inputs,
+                const std::array<float, NumNodes>& state,
+                std::index_sequence<Is...>) const
+            {
+                ((inputs[Is] = gatherStageInput<Is>(state)), ...);
+            }
+
+            template <size_t I>
+            JUCE_FORCEINLINE void runStage(std::array<float, NumNodes>& state, float input)
+            {
+                GRIFFIN_PROFILE_SPAN(profiler, ProfileSpan::stage(I));
+                state[I + 1] = std::get<I>(stages).processSample(input);
+            }
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE void runStages(std::array<float, NumNodes>& state,
+                const std::array<float, NumStages>& inputs,
+                std::index_sequence<Is...>)
+            {
+                (runStage<Is>(state, inputs[Is]), ...);
+            }
+
             template <size_t... Is>
             JUCE_FORCEINLINE void prepareStages(float sr, std::index_sequence<Is...>)
             {
                 ((std::get<Is>(stages).prepare(sr)), ...);
             }
 
+            template <size_t... Is>
+            float* attachStagesDelayMemory(float* memory, std::index_sequence<Is...>)
+            {
+                ((memory = std::get<Is>(stages).attachDelayMemory(memory)), ...);
+                return memory;
+            }
+
+            template <size_t... Is>
+            void detachStagesDelayMemory(std::index_sequence<Is...>)
+            {
+                ((std::get<Is>(stages).detachDelayMemory()), ...);
+            }
+
             template <size_t... Is>
             JUCE_FORCEINLINE void resetStages(std::index_sequence<Is...>)
             {
@@ -187,6 +675,8 @@ namespace project {
             JUCE_FORCEINLINE void setStageGlobalLfoPointers(std::index_sequence<Is...>)
             {
                 ((std::get<Is>(stages).setGlobalLfoOutputsPointer(globalLfoValues.data())), ...);
+                ((std::get<Is>(stages).setGlobalLfoBlockPointers(globalLfoBlockPtrs.data())), ...);
+                ((std::get<Is>(stages).setGlobalLfoDepths(globalLfoDepths.data())), ...);
             }
 
             template <size_t... Is>
@@ -201,6 +691,12 @@ namespace project {
                 ((std::get<Is>(stages).updateCoefficientScaling(globalDensity)), ...);
             }
 
+            template <size_t... Is>
+            void detuneStagesDelays(float amount, std::uint32_t& seed, std::index_sequence<Is...>)
+            {
+                ((std::get<Is>(stages).detuneDelays(amount, seed)), ...);
+            }
+
             template <size_t... Is>
             JUCE_FORCEINLINE void updateStagesSVFParameters(float cutoff, float dbGain, std::index_sequence<Is...>)
             {
@@ -1,121 +1,131 @@
-#pragma once
-#include <array>
-#include <tuple>
-#include "ReverbCommon.h"
-
-// To do:
-// // 1) in routing have input and output labelled, rather than numbered, infact can we use names for all? 
-// 2) Allow routing to unique stereo stages as final outputs
-// 3) Create svf filter stages (routable)
-// 5) Higher order (nested) allpass types support
-// 6) FDN support + classic multichannel matrix types built in
-
-namespace project {
-    namespace multistage {
-
-        // Define a connection structure.
-        struct Connection {
-            size_t src;         // Source node index.
-            size_t dst;         // Destination node index.
-            float baseWeight;   // Base connection weight.
-            bool scaleFeedback; // If true, weight is scaled by a runtime feedback parameter.
-        };
-
-        struct MyReverbConfig
-        {
-            // LFO definitions.
-            static constexpr size_t NumGlobalLFOs = 3;
-            inline static constexpr auto lfoFrequencies = ms_make_array(0.9128f, 1.1341f, 1.0f);
-            inline static constexpr auto lfoAmplitudes = ms_make_array(11.0f, 9.0f, 10.0f);
-
-            // Stage1
-            struct StageConfig0 {
-                static constexpr bool scaleDelay = false; // Delay times scaling
-                static constexpr bool scaleCoeff = true;   // Coefficient scaling
-                // SVF filter parameters for this stage:
-                static constexpr bool enableSVF = false;
-                static constexpr float svfCutoff = 0.0f;  // Hz
-                static constexpr float svfGain = 0.0f;       // dB (negative for high-frequency attenuation)
-                static constexpr bool attachSVF = false;      // SVF parameters not attached to user parameters
-                struct AP {
-                    float baseDelay;
-                    float coefficient;
-                    size_t lfoIndex;
-                };
-                inline static constexpr auto aps = ms_make_array(
-                    AP{ 80.0f, 1.0f, 1 },
-                    AP{ 120.0f, 1.0f, 2 },
-                    AP{ 200.0f, 1.0f, 0 },
-                    AP{ 280.0f, 1.0f, 1 },
-                    AP{ 440.0f, 1.0f, 2 }
-                );
-            };
-
-            // Stage2
-            struct StageConfig1 {
-                static constexpr bool scaleDelay = true;
-                static constexpr bool scaleCoeff = true;
-                // SVF filter enabled for this stage.
-                static constexpr bool enableSVF = true;
-                static constexpr float svfCutoff = 0.0f;
-                static constexpr float svfGain = 0.0f;
-                static constexpr bool attachSVF = true;       // Attach SVF filter settings to user parameters
-                struct AP {
-                    float baseDelay;
-                    float coefficient;
-                    size_t lfoIndex;
-                };
-                inline static constexpr auto aps = ms_make_array(
-                    AP{ 300.0f, 0.9f, 0 },
-                    AP{ 700.0f, 0.9f, 1 },
-                    AP{ 1100.0f, 0.9f, 2 },
-                    AP{ 1900.0f, 0.9f, 0 },
-                    AP{ 2300.0f, 0.9f, 1 },
-                    AP{ 2900.0f, 0.9f, 2 }
-                );
-            };
-
-            // Stage3
-            struct StageConfig2 {
-                static constexpr bool scaleDelay = true;
-                static constexpr bool scaleCoeff = true;
-                // SVF filter parameters for this stage:
-                static constexpr bool enableSVF = true;
-                static constexpr float svfCutoff = 0.0f; 
-                static constexpr float svfGain = 0.0f;      
-                static constexpr bool attachSVF = true;     
-                struct AP {
-                    float baseDelay;
-                    float coefficient;
-                    size_t lfoIndex;
-                };
-                inline static constexpr auto aps = ms_make_array(
-                    AP{ 400.0f, 0.9f, 2 },
-                    AP{ 600.0f, 0.9f, 1 },
-                    AP{ 1000.0f, 0.9f, 0 },
-                    AP{ 1400.0f, 0.9f, 2 },
-                    AP{ 2200.0f, 0.9f, 1 }
-                );
-            };
-
-            // Combine: 3 stages => 5 nodes (node 0: input, nodes 1-3: stages, node 4: output)
-            using StageTuple = std::tuple<StageConfig0, StageConfig1, StageConfig2>;
-            inline static constexpr StageTuple stages = { StageConfig0{}, StageConfig1{}, StageConfig2{} };
-
-            static constexpr size_t NumStages = std::tuple_size<StageTuple>::value;
-            static constexpr size_t NumNodes = NumStages + 2;
-
-            // Instead of a routing matrix, define a list-of-connections.
-            // source, send, amount, connect to feedback parameter
-            inline static constexpr std::array<Connection, 6> connections = { {
-                { 0, 1, 1.0f, false },
-                { 1, 2, 1.0f, false },
-                { 1, 3, 1.0f, false },
-                { 2, 2, 0.9f, true },
-                { 2, 4, 1.0f, false },
-                { 3, 4, 0.8f, false }
-            } };
-        };
-
-    } // namespace multistage
-} // namespace project
+#pragma once
+#include <array>
+#include <tuple>
+#include "ReverbCommon.h"
+
+// To do:
+// // 1) in routing have input and output labelled, rather than numbered, infact can we use names for all? 
+// 2) Allow routing to unique stereo stages as final outputs
+// 3) Create svf filter stages (routable)
+
+namespace project {
+    namespace multistage {
+
+        // Define a connection structure.
+        struct Connection {
+            size_t src;         // Source node index.
+            size_t dst;         // Destination node index.
+            float baseWeight;   // Base connection weight.
+            bool scaleFeedback; // If true, weight is scaled by a runtime feedback parameter.
+        };
+
+        struct MyReverbConfig
+        {
+            // All times are in ms (the original tuning was 48 kHz samples / 48).
+            // LFO definitions.
+            static constexpr size_t NumGlobalLFOs = 3;
+            inline static constexpr auto lfoFrequencies = ms_make_array(0.9128f, 1.1341f, 1.0f);
+            // Depths in ms (peak delay deviation), at most delayHeadroomMs.
+            inline static constexpr auto lfoDepthsMs = ms_make_array(0.2292f, 0.1875f, 0.2083f);
+
+            // Stage1
+            struct StageConfig0 {
+                static constexpr bool scaleDelay = false; // Delay times scaling
+                static constexpr bool scaleCoeff = true;   // Coefficient scaling
+                // SVF filter parameters for this stage:
+                static constexpr bool enableSVF = false;
+                static constexpr float svfCutoff = 0.0f;  // Hz
+                static constexpr float svfGain = 0.0f;       // dB (negative for high-frequency attenuation)
+                static constexpr bool attachSVF = false;      // SVF parameters not attached to user parameters
+                struct AP {
+                    float delayMs;      // Nominal delay in ms (scaled by sample rate).
+                    float coefficient;
+                    size_t lfoIndex;
+                };
+                inline static constexpr auto aps = ms_make_array(
+                    AP{ 1.6667f, 1.0f, 1 },
+                    AP{ 2.5f, 1.0f, 2 },
+                    AP{ 4.1667f, 1.0f, 0 },
+                    AP{ 5.8333f, 1.0f, 1 },
+                    AP{ 9.1667f, 1.0f, 2 }
+                );
+            };
+
+            // Stage2
+            struct StageConfig1 {
+                static constexpr bool scaleDelay = true;
+                static constexpr bool scaleCoeff = true;
+                // SVF filter enabled for this stage.
+                static constexpr bool enableSVF = true;
+                static constexpr float svfCutoff = 0.0f;
+                static constexpr float svfGain = 0.0f;
+                static constexpr bool attachSVF = true;       // Attach SVF filter settings to user parameters
+                struct AP {
+                    float delayMs;      // Nominal delay in ms (scaled by sample rate).
+                    float coefficient;
+                    size_t lfoIndex;
+                };
+                inline static constexpr auto aps = ms_make_array(
+                    AP{ 6.25f, 0.9f, 0 },
+                    AP{ 14.5833f, 0.9f, 1 },
+                    AP{ 22.9167f, 0.9f, 2 },
+                    AP{ 39.5833f, 0.9f, 0 },
+                    AP{ 47.9167f, 0.9f, 1 },
+                    AP{ 60.4167f, 0.9f, 2 }
+                );
+            };
+
+            // Stage3
+            struct StageConfig2 {
+                static constexpr bool scaleDelay = true;
+                static constexpr bool scaleCoeff = true;
+                // SVF filter parameters for this stage:
+                static constexpr bool enableSVF = true;
+                static constexpr float svfCutoff = 0.0f; 
+                static constexpr float svfGain = 0.0f;      
+                static constexpr bool attachSVF = true;     
+                struct AP {
+                    float delayMs;      // Nominal delay in ms (scaled by sample rate).
+                    float coefficient;
+                    size_t lfoIndex;
+                };
+                inline static constexpr auto aps = ms_make_array(
+                    AP{ 8.3333f, 0.9f, 2 },
+                    AP{ 12.5f, 0.9f, 1 },
+                    AP{ 20.8333f, 0.9f, 0 },
+                    AP{ 29.1667f, 0.9f, 2 },
+                    AP{ 45.8333f, 0.9f, 1 }
+                );
+            };
+
+            // Combine: 3 stages => 5 nodes (node 0: input, nodes 1-3: stages, node 4: output)
+            using StageTuple = std::tuple<StageConfig0, StageConfig1, StageConfig2>;
+            inline static constexpr StageTuple stages = { StageConfig0{}, StageConfig1{}, StageConfig2{} };
+
+            static constexpr size_t NumStages = std::tuple_size<StageTuple>::value;
+            static constexpr size_t NumNodes = NumStages + 2;
+
+            // Instead of a routing matrix, define a list-of-connections.
+            // source, send, amount, connect to feedback parameter
+            inline static constexpr std::array<Connection, 6> connections = { {
+                { 0, 1, 1.0f, false },
+                { 1, 2, 1.0f, false },
+                { 1, 3, 1.0f, false },
+                { 2, 2, 0.9f, true },
+                { 2, 4, 1.0f, false },
+                { 3, 4, 0.8f, false }
+            } };
+        };
+
+        // Links between the two tanks of a true-stereo MyReverbConfig
+        // (AudioReverb<MyReverbConfig, MyReverbCrossFeed>): a little of each
+        // tank's feedback stage into the other's, scaled with the feedback.
+        struct MyReverbCrossFeed
+        {
+            inline static constexpr std::array<Connection, 1> connections = { {
+                { 2, 2, 0.05f, true }
+            } };
+        };
+
+    } // namespace multistage
+} // namespace project
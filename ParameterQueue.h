@@ -0,0 +1,138 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace project {
+
+    //==============================================================
+    // SpscQueue: a fixed-capacity, wait-free single-producer single-consumer
+    // ring. push() and pop() never block, never allocate and touch only the
+    // two position counters and one slot, so the producer can be a UI or
+    // host parameter thread and the consumer the audio thread.
+    //
+    // Exactly one thread may push and exactly one may pop at any time.
+    // push() returns false when the ring is full; the caller decides what
+    // gets dropped.
+    //==============================================================
+    template <typename T, size_t Capacity>
+    class SpscQueue {
+    public:
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+        bool push(const T& item) noexcept
+        {
+            const size_t w = writePos.load(std::memory_order_relaxed);
+            if (w - readPos.load(std::memory_order_acquire) == Capacity)
+                return false;
+            items[w & (Capacity - 1)] = item;
+            writePos.store(w + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T& item) noexcept
+        {
+            const size_t r = readPos.load(std::memory_order_relaxed);
+            if (r == writePos.load(std::memory_order_acquire))
+                return false;
+            item = items[r & (Capacity - 1)];
+            readPos.store(r + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side: true if nothing is waiting.
+        bool empty() const noexcept
+        {
+            return readPos.load(std::memory_order_relaxed) == writePos.load(std::memory_order_acquire);
+        }
+
+    private:
+        // Producer and consumer counters on their own cache lines.
+        alignas(64) std::atomic<size_t> writePos{ 0 };
+        alignas(64) std::atomic<size_t> readPos{ 0 };
+        std::array<T, Capacity> items{};
+    };
+
+    //==============================================================
+    // SmoothedParameter: a linear ramp advanced at control rate.
+    //
+    // The owner calls advance() once per sub-block with the sub-block's
+    // length; it returns true only when the value moved, so coefficients
+    // are recomputed during a ramp and never while the value stands still.
+    // A ramp covers rampSamples whatever the distance; a new target
+    // mid-ramp starts a fresh ramp from the current value. The first value
+    // ever given is taken at once: there is nothing to ramp from.
+    //==============================================================
+    class SmoothedParameter {
+    public:
+        void setRampLength(int samples) { rampSamples = samples > 0 ? samples : 0; }
+
+        void setTarget(float newTarget)
+        {
+            if (!valueSet || rampSamples == 0)
+            {
+                snapTo(newTarget);
+                return;
+            }
+            if (newTarget == target)
+                return;
+            target = newTarget;
+            remaining = rampSamples;
+            step = (target - current) / static_cast<float>(rampSamples);
+        }
+
+        // Jump straight to `value`. The next advance() reports the change.
+        void snapTo(float value)
+        {
+            pending = pending || !valueSet || value != current;
+            current = target = value;
+            remaining = 0;
+            valueSet = true;
+        }
+
+        // Moves the value on by numSamples. True if it changed.
+        bool advance(int numSamples)
+        {
+            if (remaining <= 0)
+            {
+                const bool changed = pending;
+                pending = false;
+                return changed;
+            }
+            remaining -= numSamples;
+            if (remaining <= 0)
+                current = target;
+            else
+                current += step * static_cast<float>(numSamples);
+            pending = false;
+            return true;
+        }
+
+        // Finishes the ramp now. True if the value changed.
+        bool skip()
+        {
+            if (remaining > 0)
+            {
+                current = target;
+                remaining = 0;
+                pending = true;
+            }
+            return advance(0);
+        }
+
+        float getCurrent() const { return current; }
+        float getTarget() const { return target; }
+        bool isSmoothing() const { return remaining > 0; }
+        bool hasValue() const { return valueSet; }
+
+    private:
+        float current = 0.f;
+        float target = 0.f;
+        float step = 0.f;
+        int rampSamples = 0;
+        int remaining = 0;
+        bool pending = false;   // Changed outside a ramp, not yet reported.
+        bool valueSet = false;
+    };
+
+} // namespace project
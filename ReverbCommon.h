@@ -1,187 +1,383 @@
-#pragma once
-#include <array>
-#include <cmath>
-#include <algorithm>
-#include <vector>
-#include <utility>
-
-#ifndef JUCE_FORCEINLINE
-#if defined(_MSC_VER)
-#define JUCE_FORCEINLINE __forceinline
-#else
-#define JUCE_FORCEINLINE inline __attribute__((always_inline))
-#endif
-#endif
-
-// Build a std::array at compile time from variadic arguments
-template <typename T, typename... Ts>
-constexpr std::array<typename std::common_type<T, Ts...>::type, 1 + sizeof...(Ts)>
-ms_make_array(T t, Ts... ts)
-{
-    return { t, ts... };
-}
-
-namespace project {
-
-    //==============================================================
-    // SimpleLFO: now has amplitude for global depth
-    //==============================================================
-    class SimpleLFO {
-    public:
-        SimpleLFO() : frequency(1.f), amplitude(1.f), phase(0.f), sampleRate(44100.f), increment(0.f) {}
-        SimpleLFO(float freq, float amp)
-            : frequency(freq), amplitude(amp), phase(0.f), sampleRate(44100.f), increment(0.f)
-        {
-        }
-
-        void prepare(float sr) {
-            sampleRate = sr;
-            phase = 0.f;
-            increment = frequency / sampleRate;
-        }
-
-        void reset() {
-            phase = 0.f;
-        }
-
-        // Returns amplitude * approximate sine
-        JUCE_FORCEINLINE float update() {
-            phase += increment;
-            if (phase >= 1.f) {
-                phase -= 1.f;
-            }
-            return amplitude * parSin(phase);
-        }
-
-        // Set amplitude or frequency at runtime
-        void setAmplitude(float newAmp) { amplitude = newAmp; }
-        void setFrequency(float newFreq) {
-            frequency = newFreq;
-            increment = frequency / sampleRate;
-        }
-
-    private:
-        float frequency;
-        float amplitude;
-        float phase;
-        float sampleRate;
-        float increment;
-
-        JUCE_FORCEINLINE float parSin(float ph) const {
-            float shifted = 0.5f - ph;
-            return shifted * (8.f - 16.f * std::fabs(shifted));
-        }
-    };
-
-    //==============================================================
-    // SimpleAP: uses baseDelay + lfoValue and supports precomputed scaling.
-    // Now allocates the maximum delay buffer size from the start,
-    // assuming the global size will only ever go up to 2.
-    //==============================================================
-    class SimpleAP {
-    public:
-        SimpleAP()
-            : originalBaseDelay(0.f), effectiveBaseDelay(0.f),
-            originalCoefficient(0.f), effectiveCoefficient(0.f),
-            lfoIndex(0), sampleRate(44100.f), writeIndex(0),
-            powerBufferSize(0), indexMask(0), scaleDelay(false), scaleCoefficient(false)
-        {
-        }
-
-        // Constructor with scale flags for delay and coefficient (density)
-        SimpleAP(float baseD, float coeff, size_t lfoIdx, bool scaleDelayFlag, bool scaleCoeffFlag)
-            : originalBaseDelay(baseD), effectiveBaseDelay(baseD),
-            originalCoefficient(coeff), effectiveCoefficient(coeff),
-            lfoIndex(lfoIdx), sampleRate(44100.f), writeIndex(0),
-            scaleDelay(scaleDelayFlag), scaleCoefficient(scaleCoeffFlag)
-        {
-            maxDelay = effectiveBaseDelay + 50.f;
-        }
-
-        void prepare(float sr) {
-            sampleRate = sr;
-            writeIndex = 0;
-            // Allocate maximum needed delay buffer size, assuming globalSize can be up to 2.
-            float maxExpectedDelay = originalBaseDelay * 2.f + 50.f;
-            int reqSize = static_cast<int>(std::ceil(maxExpectedDelay)) + 4;
-            powerBufferSize = nextPow2(reqSize);
-            indexMask = powerBufferSize - 1;
-            delayBuffer.assign(powerBufferSize, 0.f);
-        }
-
-        void reset() {
-            std::fill(delayBuffer.begin(), delayBuffer.end(), 0.f);
-            writeIndex = 0;
-        }
-
-        // Update effective delay based on the global size parameter if scaling is enabled.
-        // Since the delay buffer was allocated for the maximum delay, no reallocation is needed.
-        void updateDelayTime(float globalSize) {
-            if (scaleDelay) {
-                effectiveBaseDelay = originalBaseDelay * globalSize;
-                maxDelay = effectiveBaseDelay + 50.f;
-            }
-        }
-
-        // Update effective coefficient based on the global density parameter if scaling is enabled.
-        void updateCoefficientScaling(float globalDensity) {
-            if (scaleCoefficient) {
-                effectiveCoefficient = originalCoefficient * globalDensity;
-            }
-        }
-
-        JUCE_FORCEINLINE float processSample(float x, float lfoValue) {
-            float targetDelay = effectiveBaseDelay + lfoValue;
-            if (targetDelay < 0.f) {
-                targetDelay = 0.f;
-            }
-
-            int d_int = static_cast<int>(targetDelay);
-            float d_frac = targetDelay - static_cast<float>(d_int);
-
-            bool hasFraction = (d_frac > 0.f);
-            int offset = hasFraction ? 1 : 0;
-            int index0 = (writeIndex - d_int - offset) & indexMask;
-            float frac = hasFraction ? (1.f - d_frac) : 0.f;
-            int index1 = (index0 + 1) & indexMask;
-
-            float delayedV = (1.f - frac) * delayBuffer[index0]
-                + (frac)*delayBuffer[index1];
-
-                float v = x - effectiveCoefficient * delayedV;
-                float y = effectiveCoefficient * v + delayedV;
-
-                delayBuffer[writeIndex] = v;
-                writeIndex = (writeIndex + 1) & indexMask;
-                return y;
-        }
-
-        size_t getLfoIndex() const { return lfoIndex; }
-
-    private:
-        static int nextPow2(int x) {
-            x--;
-            x |= x >> 1;
-            x |= x >> 2;
-            x |= x >> 4;
-            x |= x >> 8;
-            x |= x >> 16;
-            return x + 1;
-        }
-
-        float originalBaseDelay;
-        float effectiveBaseDelay;
-        float maxDelay;
-        float originalCoefficient;
-        float effectiveCoefficient;
-        size_t lfoIndex;
-        float sampleRate;
-        std::vector<float> delayBuffer;
-        int writeIndex;
-        int powerBufferSize;
-        int indexMask;
-        bool scaleDelay;
-        bool scaleCoefficient;
-    };
-
-} // namespace project
+#pragma once
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#ifndef JUCE_FORCEINLINE
+#if defined(_MSC_VER)
+#define JUCE_FORCEINLINE __forceinline
+#else
+#define JUCE_FORCEINLINE inline __attribute__((always_inline))
+#endif
+#endif
+
+#include "ReverbSimd.h"
+#include "DelayStorage.h"
+#include "DelayInterpolation.h"
+#include "ReverbDispatch.h"
+
+// Build a std::array at compile time from variadic arguments
+template <typename T, typename... Ts>
+constexpr std::array<typename std::common_type<T, Ts...>::type, 1 + sizeof...(Ts)>
+ms_make_array(T t, Ts... ts)
+{
+    return { t, ts... };
+}
+
+namespace project {
+
+    // Largest block handled in one pass by the processBlock() paths.
+    // Longer host buffers are split into chunks of at most this size.
+    static constexpr int maxBlockSize = 512;
+
+    //==============================================================
+    // Delay memory sizing. Delay times are given in milliseconds and turned
+    // into samples in prepare(), so a config sounds the same at any rate.
+    // Every delay line is sized once for the highest supported rate and the
+    // largest global size, so prepare() never has to allocate.
+    //==============================================================
+    static constexpr float maxSupportedSampleRate = 192000.f;
+    static constexpr float maxGlobalSize = 2.f;     // Upper end of the Global Size parameter.
+    static constexpr float delayHeadroomMs = 1.f;   // On top of the longest delay; covers LFO modulation.
+    static constexpr int delayLineAlignment = 16;   // Floats per cache line: lines start 64-byte aligned.
+
+    constexpr float msToSamples(float ms, float sampleRate)
+    {
+        return ms * 0.001f * sampleRate;
+    }
+
+    constexpr int constexprNextPow2(int x)
+    {
+        int p = 1;
+        while (p < x)
+            p <<= 1;
+        return p;
+    }
+
+    // Power-of-two buffer length for a delay line whose nominal delay is delayMs.
+    // Allocation uses the maximum rate; at lower rates only the first
+    // delayBufferSize(..., rate) samples are used as the ring, so the memory a
+    // line sweeps through (and keeps in cache) follows the actual rate.
+    constexpr int delayBufferSize(float delayMs, bool scaleDelay, float sampleRate = maxSupportedSampleRate)
+    {
+        const float longest = msToSamples(delayMs * (scaleDelay ? maxGlobalSize : 1.f) + delayHeadroomMs,
+            (sampleRate < maxSupportedSampleRate) ? sampleRate : maxSupportedSampleRate);
+        int samples = static_cast<int>(longest);
+        if (static_cast<float>(samples) < longest)
+            ++samples;
+        return constexprNextPow2(samples + 4);
+    }
+
+    // Floats a delay line takes in an arena, padded to whole cache lines.
+    // 16-bit storage policies need half as many.
+    template <typename Storage = FloatDelayStorage>
+    constexpr size_t delayArenaFloats(float delayMs, bool scaleDelay)
+    {
+        const size_t bytes = static_cast<size_t>(delayBufferSize(delayMs, scaleDelay)) * sizeof(typename Storage::Sample);
+        const size_t floats = (bytes + sizeof(float) - 1) / sizeof(float);
+        return (floats + delayLineAlignment - 1) / delayLineAlignment * delayLineAlignment;
+    }
+
+    // Factor in (1 - amount, 1] for one delay of a detuned copy of a stage,
+    // drawn from seed (advanced). Only ever shortens: the lines are sized for
+    // the nominal delays.
+    inline float delayDetuneFactor(float amount, std::uint32_t& seed)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return 1.f - amount * static_cast<float>(seed >> 8) * (1.f / 16777216.f);
+    }
+
+    //==============================================================
+    // SimpleLFO: now has amplitude for global depth
+    //==============================================================
+    class SimpleLFO {
+    public:
+        SimpleLFO() : frequency(1.f), amplitude(1.f), phase(0.f), sampleRate(44100.f), increment(0.f) {}
+        SimpleLFO(float freq, float amp)
+            : frequency(freq), amplitude(amp), phase(0.f), sampleRate(44100.f), increment(0.f)
+        {
+        }
+
+        void prepare(float sr) {
+            sampleRate = sr;
+            phase = 0.f;
+            increment = frequency / sampleRate;
+        }
+
+        void reset() {
+            phase = 0.f;
+        }
+
+        // Returns amplitude * approximate sine
+        JUCE_FORCEINLINE float update() {
+            phase += increment;
+            if (phase >= 1.f) {
+                phase -= 1.f;
+            }
+            return amplitude * parSin(phase);
+        }
+
+        // Fill a block with consecutive update() values.
+        JUCE_FORCEINLINE void processBlock(float* out, int numSamples) {
+            float ph = phase;
+            const float inc = increment;
+            const float amp = amplitude;
+            for (int i = 0; i < numSamples; ++i) {
+                ph += inc;
+                if (ph >= 1.f) {
+                    ph -= 1.f;
+                }
+                out[i] = amp * parSin(ph);
+            }
+            phase = ph;
+        }
+
+        // Set amplitude or frequency at runtime
+        void setAmplitude(float newAmp) { amplitude = newAmp; }
+        void setFrequency(float newFreq) {
+            frequency = newFreq;
+            increment = frequency / sampleRate;
+        }
+
+    private:
+        float frequency;
+        float amplitude;
+        float phase;
+        float sampleRate;
+        float increment;
+
+        JUCE_FORCEINLINE float parSin(float ph) const {
+            float shifted = 0.5f - ph;
+            return shifted * (8.f - 16.f * std::fabs(shifted));
+        }
+    };
+
+    //==============================================================
+    // Modulated allpass kernels on a power-of-two circular buffer. They hold
+    // no state of their own, so SimpleAP and the packed per-stage AP state in
+    // StageReverb run exactly the same maths. Storage is the buffer format
+    // (DelayStorage.h); dither is its random state, unused for float. Interp
+    // is the fractional read (DelayInterpolation.h); interp is its per-line
+    // state, empty for everything but AllpassInterpolation.
+    //==============================================================
+
+    // Modulation depth to pass when the LFO range is not known.
+    static constexpr float unknownModDepth = 1.0e30f;
+    // Shortest chunk worth handing to the SIMD kernel.
+    static constexpr int allpassMinVectorChunk = 4 * simd::FloatVec::width;
+    // LFO index of an AP that is not modulated. Such APs read with
+    // NoInterpolation whatever their stage asks for.
+    static constexpr size_t noLfo = ~size_t(0);
+
+    // The two halves of allpassSample, for allpasses with something between
+    // the delay line and the feedback (nested allpasses, StageReverb.h):
+    // allpassRead is the delay line's output, allpassWrite takes the input and
+    // that (processed) output, writes the line and returns the allpass output.
+    template <typename Storage, typename Interp = LinearInterpolation>
+    JUCE_FORCEINLINE float allpassRead(const typename Storage::Sample* buf, int mask, int writeIndex,
+        float baseDelay, float lfoValue, typename Interp::State& interp) {
+        const float targetDelay = std::max(baseDelay + lfoValue, Interp::minDelay);
+        return Interp::template read<Storage>(buf, mask, writeIndex, targetDelay, interp);
+    }
+
+    template <typename Storage>
+    JUCE_FORCEINLINE float allpassWrite(typename Storage::Sample* buf, int mask, int& writeIndex,
+        float g, float x, float delayedV, std::uint32_t& dither) {
+        float v = flushDenormal(x - g * delayedV);
+        float y = g * v + delayedV;
+
+        Storage::store(buf, writeIndex, v, dither);
+        writeIndex = (writeIndex + 1) & mask;
+        return y;
+    }
+
+    template <typename Storage, typename Interp = LinearInterpolation>
+    JUCE_FORCEINLINE float allpassSample(typename Storage::Sample* buf, int mask, int& writeIndex,
+        float baseDelay, float g, float x, float lfoValue, std::uint32_t& dither, typename Interp::State& interp) {
+        const float delayedV = allpassRead<Storage, Interp>(buf, mask, writeIndex, baseDelay, lfoValue, interp);
+        return allpassWrite<Storage>(buf, mask, writeIndex, g, x, delayedV, dither);
+    }
+
+    // Block version (in place is fine). lfoValues holds one modulation value per
+    // sample, or nullptr; maxModDepth bounds |lfoValues|. Same maths as
+    // allpassSample, but the state lives in locals for the whole block.
+    //
+    // When the newest sample any read can touch (shortest delay minus the
+    // policy's readAhead) is at least a few vectors old, the SIMD kernel runs
+    // over chunks no longer than that, so every read in a chunk comes from
+    // before the chunk. Recursive policies always take the per-sample loop.
+    // Float delay lines with a linear or nearest-sample read take the
+    // runtime-dispatched kernel (ReverbDispatch.h) when it is compiled in.
+    template <typename Storage, typename Interp = LinearInterpolation>
+    JUCE_FORCEINLINE void allpassBlock(typename Storage::Sample* buf, int mask, int& writeIndex, float baseDelay, float g,
+        float maxModDepth, const float* in, float* out, const float* lfoValues, int numSamples, std::uint32_t& dither,
+        typename Interp::State& interp) {
+        if constexpr (Interp::vectorizable) {
+            const float minDelay = std::max(baseDelay - ((lfoValues != nullptr) ? maxModDepth : 0.f), Interp::minDelay);
+            const float newestRead = minDelay - static_cast<float>(Interp::readAhead);
+            if (newestRead >= static_cast<float>(std::min(numSamples, allpassMinVectorChunk))) {
+                const int chunk = static_cast<int>(std::min(newestRead, static_cast<float>(numSamples)));
+#if GRIFFIN_RUNTIME_DISPATCH
+                constexpr bool dispatched = std::is_same_v<Storage, FloatDelayStorage>
+                    && (std::is_same_v<Interp, LinearInterpolation> || std::is_same_v<Interp, NoInterpolation>);
+                if constexpr (dispatched) {
+                    const dispatch::DspKernels& kernels = dispatch::kernels();
+                    const auto kernel = std::is_same_v<Interp, LinearInterpolation> ? kernels.allpassLinear : kernels.allpassNearest;
+                    for (int start = 0; start < numSamples; start += chunk) {
+                        const int n = std::min(chunk, numSamples - start);
+                        writeIndex = kernel(buf, mask, writeIndex, baseDelay, g, in + start, out + start,
+                            (lfoValues != nullptr) ? lfoValues + start : nullptr, n);
+                    }
+                    return;
+                }
+#endif
+                for (int start = 0; start < numSamples; start += chunk) {
+                    const int n = std::min(chunk, numSamples - start);
+                    writeIndex = simd::allpassBlockLongDelay<Storage, Interp>(buf, mask, writeIndex,
+                        baseDelay, g, in + start, out + start,
+                        (lfoValues != nullptr) ? lfoValues + start : nullptr, n, dither);
+                }
+                return;
+            }
+        }
+
+        int w = writeIndex;
+        for (int i = 0; i < numSamples; ++i) {
+            float lfoValue = (lfoValues != nullptr) ? lfoValues[i] : 0.f;
+            out[i] = allpassSample<Storage, Interp>(buf, mask, w, baseDelay, g, in[i], lfoValue, dither, interp);
+        }
+        writeIndex = w;
+    }
+
+    //==============================================================
+    // SimpleAP: uses baseDelay + lfoValue and supports precomputed scaling.
+    // The base delay is given in ms. The AP owns no memory: its owner attaches
+    // getBufferSize() floats (see delayBufferSize) before processing, usually
+    // a slice of a DelayArena. The buffer covers every supported sample rate
+    // and a global size of up to maxGlobalSize. Storage picks the buffer format,
+    // Interp the fractional read.
+    //==============================================================
+    template <typename Storage = FloatDelayStorage, typename Interp = LinearInterpolation>
+    class SimpleAP {
+    public:
+        using Sample = typename Storage::Sample;
+
+        SimpleAP()
+            : baseDelayMs(0.f), delayScale(1.f), originalBaseDelay(0.f), effectiveBaseDelay(0.f),
+            originalCoefficient(0.f), effectiveCoefficient(0.f),
+            lfoIndex(0), sampleRate(44100.f), writeIndex(0),
+            powerBufferSize(0), indexMask(0), scaleDelay(false), scaleCoefficient(false),
+            maxModDepth(unknownModDepth)
+        {
+        }
+
+        // Constructor with scale flags for delay and coefficient (density)
+        SimpleAP(float delayMs, float coeff, size_t lfoIdx, bool scaleDelayFlag, bool scaleCoeffFlag)
+            : baseDelayMs(delayMs), delayScale(1.f),
+            originalCoefficient(coeff), effectiveCoefficient(coeff),
+            lfoIndex(lfoIdx), sampleRate(44100.f), writeIndex(0),
+            scaleDelay(scaleDelayFlag), scaleCoefficient(scaleCoeffFlag),
+            maxModDepth(unknownModDepth)
+        {
+            originalBaseDelay = msToSamples(baseDelayMs, sampleRate);
+            effectiveBaseDelay = originalBaseDelay;
+            powerBufferSize = delayBufferSize(baseDelayMs, scaleDelay);
+            indexMask = powerBufferSize - 1;
+        }
+
+        // Converts the delay to samples at the new rate and clears the buffer.
+        // Never allocates. Rates above maxSupportedSampleRate keep the delays
+        // of maxSupportedSampleRate so they still fit the buffer.
+        void prepare(float sr) {
+            sampleRate = sr;
+            originalBaseDelay = msToSamples(baseDelayMs, std::min(sr, maxSupportedSampleRate));
+            effectiveBaseDelay = originalBaseDelay * delayScale;
+            indexMask = delayBufferSize(baseDelayMs, scaleDelay, sr) - 1;
+            reset();
+        }
+
+        void reset() {
+            if (delayBuffer != nullptr) {
+                std::fill(delayBuffer, delayBuffer + indexMask + 1, Sample(0));
+            }
+            writeIndex = 0;
+            interpState = {};
+        }
+
+        // Number of samples in the delay buffer (fixed at construction).
+        int getBufferSize() const { return powerBufferSize; }
+
+        // Run on caller-owned memory of getBufferSize() samples from now on
+        // (delayArenaFloats<Storage> floats). The memory is cleared.
+        void attachBuffer(float* memory) {
+            delayBuffer = reinterpret_cast<Sample*>(memory);
+            reset();
+        }
+
+        // Drop the memory. The AP must not be processed until attachBuffer()
+        // is called again.
+        void detachBuffer() {
+            delayBuffer = nullptr;
+        }
+
+        // Update effective delay based on the global size parameter if scaling is enabled.
+        // Since the delay buffer was allocated for the maximum delay, no reallocation is needed.
+        void updateDelayTime(float globalSize) {
+            if (scaleDelay) {
+                delayScale = globalSize;
+                effectiveBaseDelay = originalBaseDelay * delayScale;
+            }
+        }
+
+        // Update effective coefficient based on the global density parameter if scaling is enabled.
+        void updateCoefficientScaling(float globalDensity) {
+            if (scaleCoefficient) {
+                effectiveCoefficient = originalCoefficient * globalDensity;
+            }
+        }
+
+        // Largest |lfoValue| this AP will be driven with. Lets processBlock take
+        // the vector path when the whole block reads from before the block.
+        // Until set, the depth is treated as unknown and only the scalar path runs.
+        void setModulationDepth(float depth) { maxModDepth = std::fabs(depth); }
+
+        JUCE_FORCEINLINE float processSample(float x, float lfoValue) {
+            return allpassSample<Storage, Interp>(delayBuffer, indexMask, writeIndex,
+                effectiveBaseDelay, effectiveCoefficient, x, lfoValue, ditherState, interpState);
+        }
+
+        // Process a block (in place is fine). lfoValues holds one modulation value
+        // per sample, or nullptr for no modulation.
+        JUCE_FORCEINLINE void processBlock(const float* in, float* out, const float* lfoValues, int numSamples) {
+            allpassBlock<Storage, Interp>(delayBuffer, indexMask, writeIndex, effectiveBaseDelay, effectiveCoefficient,
+                maxModDepth, in, out, lfoValues, numSamples, ditherState, interpState);
+        }
+
+        size_t getLfoIndex() const { return lfoIndex; }
+        float getDelaySamples() const { return effectiveBaseDelay; }
+        float getCoefficient() const { return effectiveCoefficient; }
+
+    private:
+        float baseDelayMs;
+        float delayScale;           // Global size, if scaleDelay.
+        float originalBaseDelay;    // In samples at the current rate.
+        float effectiveBaseDelay;
+        float originalCoefficient;
+        float effectiveCoefficient;
+        size_t lfoIndex;
+        float sampleRate;
+        Sample* delayBuffer = nullptr;
+        std::uint32_t ditherState = 1;
+        typename Interp::State interpState{};
+        int writeIndex;
+        int powerBufferSize;
+        int indexMask;
+        bool scaleDelay;
+        bool scaleCoefficient;
+        float maxModDepth;
+    };
+
+} // namespace project
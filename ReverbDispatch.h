@@ -0,0 +1,263 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include "Denormals.h"
+
+//==============================================================
+// Runtime ISA dispatch for the DSP kernels.
+//
+// ReverbSimd.h picks its vector width from the compiler's target flags, so a
+// binary built for the baseline x86-64 (what a plugin ships as) runs its
+// block kernels on SSE2 even on an AVX-512 machine. With
+// GRIFFIN_RUNTIME_DISPATCH the hottest block kernels are compiled once per
+// instruction set instead, from one source (ReverbKernelBody.h), and the best
+// variant the CPU and OS support is chosen at run time:
+//
+//   allpassLinear / allpassNearest  the modulated allpass over a block
+//                   (simd::allpassBlockLongDelay) for float delay lines,
+//                   linear or nearest-sample read. allpassBlock hands its
+//                   chunks to them; other storage formats and interpolations
+//                   keep the compile-time kernels.
+//   lfoFullRate     LfoBank's full-rate render; lfoFullRateNarrow is the
+//                   same kernel for small banks (see select()).
+//   shelf           LexiconShelvingFilter::processBlock. The recurrence is
+//                   serial; only its feed-forward half vectorises.
+//   mix             MultiStageReverb's routing mix-down, the weighted sum of
+//                   a node's input blocks (RoutingSchedule::gather).
+//
+// select() picks the variants, once, from CPUID; the engines call it in
+// prepare(). It is process-wide: the last select() holds for every engine.
+// The choice is per kernel: most take the best ISA, but two run slower on
+// wide vectors than on SSE4.1 (bench_isa_dispatch) and stay there:
+//   - the shelf, whose serial recurrence leaves only the feed-forward half to
+//     vectorise: about 1.0x of scalar on SSE4.1 and AVX2, 0.73-0.94x on
+//     AVX-512, where the wide loads cost more than they save,
+//   - LFO banks of up to narrowLfoLanes LFOs, one SSE register, which wider
+//     vectors only pad out: MyReverbConfig's three run at 1.25-1.37x of
+//     scalar on SSE4.1, 0.93-1.0x on AVX2 and 0.85-0.93x on AVX-512.
+// The variants are bit-identical (below), so mixing them changes only speed.
+// forceIsa() (or GRIFFIN_FORCE_ISA=scalar|sse4|avx2|avx512 in the
+// environment) caps the choice for testing; a forced ISA the CPU lacks falls
+// back to the best one it has. The per-sample paths (processSample) stay
+// inline and do not dispatch.
+//
+// Every variant does the same arithmetic in the same order as the inline
+// code, with FP contraction off, so the results do not depend on the ISA
+// picked: built for the baseline target, all variants and the inline paths
+// are bit-identical. A build that lets the compiler contract the inline code
+// into FMAs (-march=native) differs from the kernels in the last bit.
+//
+// On by default for x86-64 with GCC or Clang. Elsewhere, or with
+// GRIFFIN_RUNTIME_DISPATCH 0, the kernels are not compiled and every path
+// uses ReverbSimd.h as before.
+//==============================================================
+#ifndef GRIFFIN_RUNTIME_DISPATCH
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define GRIFFIN_RUNTIME_DISPATCH 1
+#else
+#define GRIFFIN_RUNTIME_DISPATCH 0
+#endif
+#endif
+
+#if GRIFFIN_RUNTIME_DISPATCH
+#include <immintrin.h>
+
+namespace project {
+    namespace dispatch {
+
+        enum class Isa : int { Scalar = 0, Sse4 = 1, Avx2 = 2, Avx512 = 3 };
+        static constexpr int numIsas = 4;
+
+        // The widest ISA select() uses for the shelf and for small LFO banks,
+        // and how many LFOs a bank may have to count as small.
+        static constexpr Isa narrowKernelIsa = Isa::Sse4;
+        static constexpr int narrowLfoLanes = 4;
+
+        inline const char* isaName(Isa isa)
+        {
+            switch (isa)
+            {
+            case Isa::Sse4: return "sse4";
+            case Isa::Avx2: return "avx2";
+            case Isa::Avx512: return "avx512";
+            default: return "scalar";
+            }
+        }
+
+        // "scalar", "sse4", "avx2" or "avx512"; false for anything else.
+        inline bool parseIsa(const char* name, Isa& isa)
+        {
+            for (int i = 0; i < numIsas; ++i)
+            {
+                if (name != nullptr && std::strcmp(name, isaName(static_cast<Isa>(i))) == 0)
+                {
+                    isa = static_cast<Isa>(i);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // One variant's kernels. See the top of this file; the maths of each
+        // is that of the inline code it replaces.
+        struct DspKernels {
+            Isa isa;
+            // Returns the new write index. Needs every read in the block to be
+            // at least numSamples old (see simd::allpassBlockLongDelay).
+            // lfoValues may be null. Works in place.
+            int (*allpassLinear)(float* buffer, int mask, int writeIndex, float baseDelay, float coefficient,
+                const float* in, float* out, const float* lfoValues, int numSamples);
+            int (*allpassNearest)(float* buffer, int mask, int writeIndex, float baseDelay, float coefficient,
+                const float* in, float* out, const float* lfoValues, int numSamples);
+            // Advances numLanes LFOs by numSamples and writes the first
+            // numOutputs of them to out[i][0..numSamples). lfoFullRateNarrow
+            // is the same for numLanes <= narrowLfoLanes (see select()).
+            void (*lfoFullRate)(float* phases, const float* increments, const float* amplitudes, int numLanes,
+                float* const* out, int numOutputs, int numSamples);
+            void (*lfoFullRateNarrow)(float* phases, const float* increments, const float* amplitudes, int numLanes,
+                float* const* out, int numOutputs, int numSamples);
+            // coefficients: b0, b1, a1; state: x[n-1], y[n-1], updated. Works in place.
+            void (*shelf)(const float* in, float* out, int numSamples, const float* coefficients, float* state);
+            // out[s] = 0 + sources[0][s] * weights[0] + sources[1][s] * weights[1] + ...
+            void (*mix)(float* out, const float* const* sources, const float* weights, int numSources, int numSamples);
+        };
+
+    } // namespace dispatch
+} // namespace project
+
+// The variants. Each function gets the variant's target and no FP contraction
+// (GCC would otherwise fuse multiply-adds as soon as AVX-512 is enabled).
+// Clang has no per-function switch for it: ReverbKernelBody.h turns it off
+// with #pragma clang fp contract around the whole body instead.
+#if defined(__clang__)
+#define GRIFFIN_KERNEL_ATTRIBUTES(isa) __attribute__((target(isa)))
+#else
+#define GRIFFIN_KERNEL_ATTRIBUTES(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+
+#define GRIFFIN_KERNEL_ISA 0
+#define GRIFFIN_KERNEL_NAMESPACE scalar
+#if defined(__clang__)
+#define GRIFFIN_KERNEL_TARGET
+#else
+#define GRIFFIN_KERNEL_TARGET __attribute__((optimize("fp-contract=off")))
+#endif
+#include "ReverbKernelBody.h"
+
+#define GRIFFIN_KERNEL_ISA 1
+#define GRIFFIN_KERNEL_NAMESPACE sse4
+#define GRIFFIN_KERNEL_TARGET GRIFFIN_KERNEL_ATTRIBUTES("sse4.1")
+#include "ReverbKernelBody.h"
+
+#define GRIFFIN_KERNEL_ISA 2
+#define GRIFFIN_KERNEL_NAMESPACE avx2
+#define GRIFFIN_KERNEL_TARGET GRIFFIN_KERNEL_ATTRIBUTES("avx2")
+#include "ReverbKernelBody.h"
+
+#define GRIFFIN_KERNEL_ISA 3
+#define GRIFFIN_KERNEL_NAMESPACE avx512
+#define GRIFFIN_KERNEL_TARGET GRIFFIN_KERNEL_ATTRIBUTES("avx512f")
+#include "ReverbKernelBody.h"
+
+#undef GRIFFIN_KERNEL_ATTRIBUTES
+
+namespace project {
+    namespace dispatch {
+
+        // The best ISA this CPU and OS support (AVX and AVX-512 need the OS to
+        // save their registers, which __builtin_cpu_supports checks).
+        inline Isa detectIsa()
+        {
+            static const Isa detected = [] {
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512f"))
+                    return Isa::Avx512;
+                if (__builtin_cpu_supports("avx2"))
+                    return Isa::Avx2;
+                if (__builtin_cpu_supports("sse4.1"))
+                    return Isa::Sse4;
+                return Isa::Scalar;
+            }();
+            return detected;
+        }
+
+        // Every kernel of one ISA: what the benchmark times.
+        inline const DspKernels& kernelsFor(Isa isa)
+        {
+            switch (isa)
+            {
+            case Isa::Sse4: return sse4::kernels;
+            case Isa::Avx2: return avx2::kernels;
+            case Isa::Avx512: return avx512::kernels;
+            default: return scalar::kernels;
+            }
+        }
+
+        // What select() installs for `isa`: every kernel from `isa`, but the
+        // shelf and small LFO banks from at most narrowKernelIsa. isa names
+        // the widest variant in the table.
+        inline const DspKernels& selectedKernelsFor(Isa isa)
+        {
+            static const auto tables = [] {
+                std::array<DspKernels, numIsas> t{};
+                for (int i = 0; i < numIsas; ++i)
+                {
+                    const DspKernels& narrow = kernelsFor(static_cast<Isa>(std::min(i, static_cast<int>(narrowKernelIsa))));
+                    t[i] = kernelsFor(static_cast<Isa>(i));
+                    t[i].lfoFullRateNarrow = narrow.lfoFullRate;
+                    t[i].shelf = narrow.shelf;
+                }
+                return t;
+            }();
+            return tables[static_cast<size_t>(isa)];
+        }
+
+        namespace detail {
+            inline std::atomic<int> forcedIsa{ -1 };
+            inline std::atomic<const DspKernels*> activeKernels{ nullptr };
+        }
+
+        // Caps the ISA the next select() may pick. Not real-time safe to
+        // combine with processing: call it, then prepare() the engines.
+        inline void forceIsa(Isa isa) { detail::forcedIsa.store(static_cast<int>(isa), std::memory_order_relaxed); }
+        inline void clearForcedIsa() { detail::forcedIsa.store(-1, std::memory_order_relaxed); }
+
+        // Picks the kernels: the detected ISA, capped by forceIsa() or else
+        // GRIFFIN_FORCE_ISA, with the per-kernel caps above. Returns the
+        // widest ISA in use. Not for the audio thread.
+        inline Isa select()
+        {
+            Isa isa = detectIsa();
+            Isa cap = isa;
+            const int forced = detail::forcedIsa.load(std::memory_order_relaxed);
+            if (forced >= 0)
+                cap = static_cast<Isa>(forced);
+            else
+                parseIsa(std::getenv("GRIFFIN_FORCE_ISA"), cap);
+            if (static_cast<int>(cap) < static_cast<int>(isa))
+                isa = cap;
+            detail::activeKernels.store(&selectedKernelsFor(isa), std::memory_order_release);
+            return isa;
+        }
+
+        // The kernels in use; selects them on first use if nothing has.
+        inline const DspKernels& kernels()
+        {
+            const DspKernels* k = detail::activeKernels.load(std::memory_order_acquire);
+            if (k == nullptr)
+            {
+                select();
+                k = detail::activeKernels.load(std::memory_order_acquire);
+            }
+            return *k;
+        }
+
+        inline Isa activeIsa() { return kernels().isa; }
+
+    } // namespace dispatch
+} // namespace project
+
+#endif // GRIFFIN_RUNTIME_DISPATCH
@@ -0,0 +1,418 @@
+// The kernels of ReverbDispatch.h, written once and compiled once per
+// instruction set. No include guard: ReverbDispatch.h includes this file once
+// per variant, with
+//   GRIFFIN_KERNEL_ISA        0 scalar, 1 SSE4.1, 2 AVX2, 3 AVX-512
+//   GRIFFIN_KERNEL_NAMESPACE  the variant's namespace
+//   GRIFFIN_KERNEL_TARGET     the attributes every function of it carries
+// and undefines them at the end. Include ReverbDispatch.h, not this.
+//
+// Each variant has two packs with the interface of simd::FloatVec / IntVec:
+// S, one lane, for remainders, and V, as wide as the ISA allows (V is S for
+// the scalar variant). The kernels run V over the bulk and S over the rest,
+// with the same operations in the same order, as the inline code does.
+
+// No FP contraction in the kernels. GCC takes optimize("fp-contract=off") on
+// every function (GRIFFIN_KERNEL_TARGET); Clang ignores that attribute and
+// contracts within an expression by default, so the body turns it off here
+// and the pop at the end restores the including file's setting.
+#if defined(__clang__)
+#pragma float_control(push)
+#pragma clang fp contract(off)
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define GRIFFIN_KERNEL_INLINE __forceinline GRIFFIN_KERNEL_TARGET
+#else
+#define GRIFFIN_KERNEL_INLINE inline __attribute__((always_inline)) GRIFFIN_KERNEL_TARGET
+#endif
+
+namespace project {
+    namespace dispatch {
+        namespace GRIFFIN_KERNEL_NAMESPACE {
+
+            struct SInt;
+
+            struct S {
+                using Int = SInt;
+                static constexpr int width = 1;
+                float v;
+
+                static GRIFFIN_KERNEL_INLINE S load(const float* p) { return { *p }; }
+                static GRIFFIN_KERNEL_INLINE S broadcast(float x) { return { x }; }
+                GRIFFIN_KERNEL_INLINE void store(float* p) const { *p = v; }
+
+                friend GRIFFIN_KERNEL_INLINE S operator+(S a, S b) { return { a.v + b.v }; }
+                friend GRIFFIN_KERNEL_INLINE S operator-(S a, S b) { return { a.v - b.v }; }
+                friend GRIFFIN_KERNEL_INLINE S operator*(S a, S b) { return { a.v * b.v }; }
+                static GRIFFIN_KERNEL_INLINE S max(S a, S b) { return { (a.v < b.v) ? b.v : a.v }; }
+                static GRIFFIN_KERNEL_INLINE S abs(S a) { return { (a.v < 0.f) ? -a.v : a.v }; }
+                static GRIFFIN_KERNEL_INLINE S whereGE(S a, S b, S x) { return { (a.v >= b.v) ? x.v : 0.f }; }
+                // x where a >= b, y elsewhere.
+                static GRIFFIN_KERNEL_INLINE S chooseGE(S a, S b, S x, S y) { return { (a.v >= b.v) ? x.v : y.v }; }
+                static GRIFFIN_KERNEL_INLINE S gather(const float* base, SInt idx);
+            };
+
+            struct SInt {
+                int v;
+
+                static GRIFFIN_KERNEL_INLINE SInt broadcast(int x) { return { x }; }
+                static GRIFFIN_KERNEL_INLINE SInt ramp(int start) { return { start }; }
+                static GRIFFIN_KERNEL_INLINE SInt truncate(S f) { return { static_cast<int>(f.v) }; }
+                GRIFFIN_KERNEL_INLINE S toFloat() const { return { static_cast<float>(v) }; }
+
+                friend GRIFFIN_KERNEL_INLINE SInt operator+(SInt a, SInt b) { return { a.v + b.v }; }
+                friend GRIFFIN_KERNEL_INLINE SInt operator-(SInt a, SInt b) { return { a.v - b.v }; }
+                friend GRIFFIN_KERNEL_INLINE SInt operator&(SInt a, SInt b) { return { a.v & b.v }; }
+            };
+
+            GRIFFIN_KERNEL_INLINE S S::gather(const float* base, SInt idx) { return { base[idx.v] }; }
+
+#if GRIFFIN_KERNEL_ISA == 0
+            using V = S;
+
+#elif GRIFFIN_KERNEL_ISA == 1
+            struct VInt;
+
+            struct V {
+                using Int = VInt;
+                static constexpr int width = 4;
+                __m128 v;
+
+                static GRIFFIN_KERNEL_INLINE V load(const float* p) { return { _mm_loadu_ps(p) }; }
+                static GRIFFIN_KERNEL_INLINE V broadcast(float x) { return { _mm_set1_ps(x) }; }
+                GRIFFIN_KERNEL_INLINE void store(float* p) const { _mm_storeu_ps(p, v); }
+
+                friend GRIFFIN_KERNEL_INLINE V operator+(V a, V b) { return { _mm_add_ps(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE V operator-(V a, V b) { return { _mm_sub_ps(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE V operator*(V a, V b) { return { _mm_mul_ps(a.v, b.v) }; }
+                static GRIFFIN_KERNEL_INLINE V max(V a, V b) { return { _mm_max_ps(a.v, b.v) }; }
+                static GRIFFIN_KERNEL_INLINE V abs(V a) { return { _mm_andnot_ps(_mm_set1_ps(-0.f), a.v) }; }
+                static GRIFFIN_KERNEL_INLINE V whereGE(V a, V b, V x) { return { _mm_and_ps(_mm_cmpge_ps(a.v, b.v), x.v) }; }
+                static GRIFFIN_KERNEL_INLINE V chooseGE(V a, V b, V x, V y) { return { _mm_blendv_ps(y.v, x.v, _mm_cmpge_ps(a.v, b.v)) }; }
+                static GRIFFIN_KERNEL_INLINE V gather(const float* base, VInt idx);
+            };
+
+            struct VInt {
+                __m128i v;
+
+                static GRIFFIN_KERNEL_INLINE VInt broadcast(int x) { return { _mm_set1_epi32(x) }; }
+                static GRIFFIN_KERNEL_INLINE VInt ramp(int start) { return { _mm_add_epi32(_mm_set1_epi32(start), _mm_setr_epi32(0, 1, 2, 3)) }; }
+                static GRIFFIN_KERNEL_INLINE VInt truncate(V f) { return { _mm_cvttps_epi32(f.v) }; }
+                GRIFFIN_KERNEL_INLINE V toFloat() const { return { _mm_cvtepi32_ps(v) }; }
+
+                friend GRIFFIN_KERNEL_INLINE VInt operator+(VInt a, VInt b) { return { _mm_add_epi32(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE VInt operator-(VInt a, VInt b) { return { _mm_sub_epi32(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE VInt operator&(VInt a, VInt b) { return { _mm_and_si128(a.v, b.v) }; }
+            };
+
+            // No hardware gather before AVX2: the lanes are extracted and loaded one by one.
+            GRIFFIN_KERNEL_INLINE V V::gather(const float* base, VInt idx)
+            {
+                return { _mm_setr_ps(base[_mm_cvtsi128_si32(idx.v)], base[_mm_extract_epi32(idx.v, 1)],
+                    base[_mm_extract_epi32(idx.v, 2)], base[_mm_extract_epi32(idx.v, 3)]) };
+            }
+
+#elif GRIFFIN_KERNEL_ISA == 2
+            struct VInt;
+
+            struct V {
+                using Int = VInt;
+                static constexpr int width = 8;
+                __m256 v;
+
+                static GRIFFIN_KERNEL_INLINE V load(const float* p) { return { _mm256_loadu_ps(p) }; }
+                static GRIFFIN_KERNEL_INLINE V broadcast(float x) { return { _mm256_set1_ps(x) }; }
+                GRIFFIN_KERNEL_INLINE void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+                friend GRIFFIN_KERNEL_INLINE V operator+(V a, V b) { return { _mm256_add_ps(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE V operator-(V a, V b) { return { _mm256_sub_ps(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE V operator*(V a, V b) { return { _mm256_mul_ps(a.v, b.v) }; }
+                static GRIFFIN_KERNEL_INLINE V max(V a, V b) { return { _mm256_max_ps(a.v, b.v) }; }
+                static GRIFFIN_KERNEL_INLINE V abs(V a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v) }; }
+                static GRIFFIN_KERNEL_INLINE V whereGE(V a, V b, V x) { return { _mm256_and_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ), x.v) }; }
+                static GRIFFIN_KERNEL_INLINE V chooseGE(V a, V b, V x, V y) { return { _mm256_blendv_ps(y.v, x.v, _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)) }; }
+                static GRIFFIN_KERNEL_INLINE V gather(const float* base, VInt idx);
+            };
+
+            struct VInt {
+                __m256i v;
+
+                static GRIFFIN_KERNEL_INLINE VInt broadcast(int x) { return { _mm256_set1_epi32(x) }; }
+                static GRIFFIN_KERNEL_INLINE VInt ramp(int start) { return { _mm256_add_epi32(_mm256_set1_epi32(start), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)) }; }
+                static GRIFFIN_KERNEL_INLINE VInt truncate(V f) { return { _mm256_cvttps_epi32(f.v) }; }
+                GRIFFIN_KERNEL_INLINE V toFloat() const { return { _mm256_cvtepi32_ps(v) }; }
+
+                friend GRIFFIN_KERNEL_INLINE VInt operator+(VInt a, VInt b) { return { _mm256_add_epi32(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE VInt operator-(VInt a, VInt b) { return { _mm256_sub_epi32(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE VInt operator&(VInt a, VInt b) { return { _mm256_and_si256(a.v, b.v) }; }
+            };
+
+            GRIFFIN_KERNEL_INLINE V V::gather(const float* base, VInt idx) { return { _mm256_i32gather_ps(base, idx.v, 4) }; }
+
+#elif GRIFFIN_KERNEL_ISA == 3
+            struct VInt;
+
+            // The all-lanes masked forms of max, the conversions and the gather:
+            // GCC 12 warns about the undefined pass-through of the plain ones
+            // inside target("avx512f") functions.
+            struct V {
+                using Int = VInt;
+                static constexpr int width = 16;
+                static constexpr __mmask16 all = 0xffff;
+                __m512 v;
+
+                static GRIFFIN_KERNEL_INLINE V load(const float* p) { return { _mm512_loadu_ps(p) }; }
+                static GRIFFIN_KERNEL_INLINE V broadcast(float x) { return { _mm512_set1_ps(x) }; }
+                GRIFFIN_KERNEL_INLINE void store(float* p) const { _mm512_storeu_ps(p, v); }
+
+                friend GRIFFIN_KERNEL_INLINE V operator+(V a, V b) { return { _mm512_add_ps(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE V operator-(V a, V b) { return { _mm512_sub_ps(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE V operator*(V a, V b) { return { _mm512_mul_ps(a.v, b.v) }; }
+                static GRIFFIN_KERNEL_INLINE V max(V a, V b) { return { _mm512_maskz_max_ps(all, a.v, b.v) }; }
+                static GRIFFIN_KERNEL_INLINE V abs(V a) { return { _mm512_abs_ps(a.v) }; }
+                static GRIFFIN_KERNEL_INLINE V whereGE(V a, V b, V x) { return { _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ), x.v) }; }
+                static GRIFFIN_KERNEL_INLINE V chooseGE(V a, V b, V x, V y) { return { _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ), y.v, x.v) }; }
+                static GRIFFIN_KERNEL_INLINE V gather(const float* base, VInt idx);
+            };
+
+            struct VInt {
+                __m512i v;
+
+                static GRIFFIN_KERNEL_INLINE VInt broadcast(int x) { return { _mm512_set1_epi32(x) }; }
+                static GRIFFIN_KERNEL_INLINE VInt ramp(int start)
+                {
+                    return { _mm512_add_epi32(_mm512_set1_epi32(start), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)) };
+                }
+                static GRIFFIN_KERNEL_INLINE VInt truncate(V f) { return { _mm512_maskz_cvttps_epi32(V::all, f.v) }; }
+                GRIFFIN_KERNEL_INLINE V toFloat() const { return { _mm512_maskz_cvtepi32_ps(V::all, v) }; }
+
+                friend GRIFFIN_KERNEL_INLINE VInt operator+(VInt a, VInt b) { return { _mm512_add_epi32(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE VInt operator-(VInt a, VInt b) { return { _mm512_sub_epi32(a.v, b.v) }; }
+                friend GRIFFIN_KERNEL_INLINE VInt operator&(VInt a, VInt b) { return { _mm512_and_si512(a.v, b.v) }; }
+            };
+
+            GRIFFIN_KERNEL_INLINE V V::gather(const float* base, VInt idx) { return { _mm512_mask_i32gather_ps(_mm512_setzero_ps(), all, idx.v, base, 4) }; }
+#endif
+
+            static constexpr int W = V::width;
+
+            // flushDenormal (Denormals.h) for any pack.
+            template <typename P>
+            GRIFFIN_KERNEL_INLINE P flush(P x)
+            {
+#if GRIFFIN_SOFTWARE_DENORMAL_FLUSH
+                return P::whereGE(P::abs(x), P::broadcast(denormalFlushLevel), x);
+#else
+                return x;
+#endif
+            }
+
+            //----------------------------------------------------------
+            // Allpass: simd::allpassBlockLongDelay for FloatDelayStorage, with
+            // LinearInterpolation's or NoInterpolation's read. Runs samples
+            // [i, numSamples) a pack at a time while a whole pack fits; returns
+            // where it stopped.
+            template <typename P, bool Linear>
+            GRIFFIN_KERNEL_INLINE P readDelay(const float* buffer, typename P::Int mask, typename P::Int writeIndices, P delay)
+            {
+                using I = typename P::Int;
+                if constexpr (Linear)
+                {
+                    const P one = P::broadcast(1.f);
+                    const I oneI = I::broadcast(1);
+                    const I dInt = I::truncate(delay);
+                    const P frac = one - (delay - dInt.toFloat());
+                    const I idx0 = (writeIndices - dInt - oneI) & mask;
+                    const I idx1 = (idx0 + oneI) & mask;
+                    return (one - frac) * P::gather(buffer, idx0) + frac * P::gather(buffer, idx1);
+                }
+                else
+                {
+                    const I d = I::truncate(delay + P::broadcast(0.5f));
+                    return P::gather(buffer, (writeIndices - d) & mask);
+                }
+            }
+
+            template <typename P, bool Linear>
+            GRIFFIN_KERNEL_INLINE int allpassRun(float* buffer, int mask, int writeIndex, float baseDelay, float coefficient,
+                const float* in, float* out, const float* lfoValues, int i, int numSamples)
+            {
+                using I = typename P::Int;
+                constexpr int N = P::width;
+                const P g = P::broadcast(coefficient);
+                const P base = P::broadcast(baseDelay);
+                const P minDelay = P::broadcast(0.f);
+                const I maskV = I::broadcast(mask);
+                for (; i + N <= numSamples; i += N)
+                {
+                    P target = (lfoValues != nullptr) ? base + P::load(lfoValues + i) : base;
+                    target = P::max(target, minDelay);
+                    const P delayedV = readDelay<P, Linear>(buffer, maskV, I::ramp(writeIndex + i), target);
+
+                    const P v = flush(P::load(in + i) - g * delayedV);
+                    (g * v + delayedV).store(out + i);
+
+                    const int w = (writeIndex + i) & mask;
+                    if (w + N <= mask + 1)
+                    {
+                        v.store(buffer + w);
+                    }
+                    else
+                    {
+                        alignas(64) float tmp[N];
+                        v.store(tmp);
+                        for (int k = 0; k < N; ++k)
+                            buffer[(w + k) & mask] = tmp[k];
+                    }
+                }
+                return i;
+            }
+
+            template <bool Linear>
+            GRIFFIN_KERNEL_INLINE int allpass(float* buffer, int mask, int writeIndex, float baseDelay, float coefficient,
+                const float* in, float* out, const float* lfoValues, int numSamples)
+            {
+                const int i = allpassRun<V, Linear>(buffer, mask, writeIndex, baseDelay, coefficient, in, out, lfoValues, 0, numSamples);
+                allpassRun<S, Linear>(buffer, mask, writeIndex, baseDelay, coefficient, in, out, lfoValues, i, numSamples);
+                return (writeIndex + numSamples) & mask;
+            }
+
+            GRIFFIN_KERNEL_TARGET inline int allpassLinear(float* buffer, int mask, int writeIndex, float baseDelay, float coefficient,
+                const float* in, float* out, const float* lfoValues, int numSamples)
+            {
+                return allpass<true>(buffer, mask, writeIndex, baseDelay, coefficient, in, out, lfoValues, numSamples);
+            }
+
+            GRIFFIN_KERNEL_TARGET inline int allpassNearest(float* buffer, int mask, int writeIndex, float baseDelay, float coefficient,
+                const float* in, float* out, const float* lfoValues, int numSamples)
+            {
+                return allpass<false>(buffer, mask, writeIndex, baseDelay, coefficient, in, out, lfoValues, numSamples);
+            }
+
+            //----------------------------------------------------------
+            // LFO bank at full rate: LfoBank::stepLanes with one step per
+            // sample. A pack of lanes at a time, its phases held in registers
+            // over the whole block; a last partial pack is padded with silent
+            // lanes. The phase recurrence bounds it (a bank of three LFOs runs
+            // no faster on wide packs), so the wrap picks between ph and
+            // ph - 1 instead of subtracting a masked 1 after the compare: the
+            // same values (ph - 0 is ph), one step less per sample. One wrap
+            // is enough: LfoBank keeps every increment within [0, 0.5].
+            template <typename P>
+            GRIFFIN_KERNEL_INLINE void lfoLanes(float* phases, const float* increments, const float* amplitudes, int lanes,
+                float* const* out, int outputs, int numSamples)
+            {
+                constexpr int N = P::width;
+                const P one = P::broadcast(1.f);
+                const P half = P::broadcast(0.5f);
+                const P eight = P::broadcast(8.f);
+                const P sixteen = P::broadcast(16.f);
+                alignas(64) float lane[3][N] = {};
+                for (int k = 0; k < lanes; ++k)
+                {
+                    lane[0][k] = phases[k];
+                    lane[1][k] = increments[k];
+                    lane[2][k] = amplitudes[k];
+                }
+                P ph = P::load(lane[0]);
+                const P inc = P::load(lane[1]);
+                const P amp = P::load(lane[2]);
+                alignas(64) float values[N];
+                for (int s = 0; s < numSamples; ++s)
+                {
+                    ph = ph + inc;
+                    ph = P::chooseGE(ph, one, ph - one, ph);
+                    const P shifted = half - ph;
+                    (amp * (shifted * (eight - sixteen * P::abs(shifted)))).store(values);
+                    for (int k = 0; k < outputs; ++k)
+                        out[k][s] = values[k];
+                }
+                ph.store(lane[0]);
+                for (int k = 0; k < lanes; ++k)
+                    phases[k] = lane[0][k];
+            }
+
+            GRIFFIN_KERNEL_TARGET inline void lfoFullRate(float* phases, const float* increments, const float* amplitudes, int numLanes,
+                float* const* out, int numOutputs, int numSamples)
+            {
+                for (int o = 0; o < numLanes; o += W)
+                {
+                    const int lanes = (numLanes - o < W) ? numLanes - o : W;
+                    const int outputs = (numOutputs - o < 0) ? 0 : (numOutputs - o < lanes) ? numOutputs - o : lanes;
+                    lfoLanes<V>(phases + o, increments + o, amplitudes + o, lanes, out + o, outputs, numSamples);
+                }
+            }
+
+            //----------------------------------------------------------
+            // Shelf: y[n] = b0 x[n] + b1 x[n-1] - a1 y[n-1]. The feed-forward
+            // sum is computed a pack at a time into a scratch chunk, then the
+            // recurrence subtracts the feedback term sample by sample: the same
+            // two roundings as ((b0 x + b1 x1) - a1 y1) in processBlock.
+            GRIFFIN_KERNEL_TARGET inline void shelf(const float* in, float* out, int numSamples, const float* coefficients, float* state)
+            {
+                constexpr int chunk = 64;
+                const float c0 = coefficients[0], c1 = coefficients[1], c2 = coefficients[2];
+                const V c0V = V::broadcast(c0), c1V = V::broadcast(c1);
+                float xm1 = state[0], ym1 = state[1];
+                alignas(64) float feedForward[chunk];
+                for (int start = 0; start < numSamples; start += chunk)
+                {
+                    const int n = (numSamples - start < chunk) ? numSamples - start : chunk;
+                    const float* x = in + start;
+                    feedForward[0] = c0 * x[0] + c1 * xm1;
+                    int i = 1;
+                    for (; i + W <= n; i += W)
+                        (c0V * V::load(x + i) + c1V * V::load(x + i - 1)).store(feedForward + i);
+                    for (; i < n; ++i)
+                        feedForward[i] = c0 * x[i] + c1 * x[i - 1];
+                    // Read before out (which may be in) is written.
+                    xm1 = x[n - 1];
+                    float* y = out + start;
+                    for (i = 0; i < n; ++i)
+                    {
+                        ym1 = flush(S::broadcast(feedForward[i] - c2 * ym1)).v;
+                        y[i] = ym1;
+                    }
+                }
+                state[0] = xm1;
+                state[1] = ym1;
+            }
+
+            //----------------------------------------------------------
+            // Mix-down: RoutingSchedule::gather over a block, sources summed
+            // in order from 0.
+            template <typename P>
+            GRIFFIN_KERNEL_INLINE int mixRun(float* out, const float* const* sources, const float* weights, int numSources, int s, int numSamples)
+            {
+                constexpr int N = P::width;
+                for (; s + N <= numSamples; s += N)
+                {
+                    P sum = P::broadcast(0.f);
+                    for (int k = 0; k < numSources; ++k)
+                        sum = sum + P::load(sources[k] + s) * P::broadcast(weights[k]);
+                    sum.store(out + s);
+                }
+                return s;
+            }
+
+            GRIFFIN_KERNEL_TARGET inline void mix(float* out, const float* const* sources, const float* weights, int numSources, int numSamples)
+            {
+                const int s = mixRun<V>(out, sources, weights, numSources, 0, numSamples);
+                mixRun<S>(out, sources, weights, numSources, s, numSamples);
+            }
+
+            inline constexpr DspKernels kernels{ static_cast<Isa>(GRIFFIN_KERNEL_ISA), &allpassLinear, &allpassNearest,
+                &lfoFullRate, &lfoFullRate, &shelf, &mix };
+
+        } // namespace GRIFFIN_KERNEL_NAMESPACE
+    } // namespace dispatch
+} // namespace project
+
+#if defined(__clang__)
+#pragma float_control(pop)
+#endif
+
+#undef GRIFFIN_KERNEL_INLINE
+#undef GRIFFIN_KERNEL_TARGET
+#undef GRIFFIN_KERNEL_NAMESPACE
+#undef GRIFFIN_KERNEL_ISA
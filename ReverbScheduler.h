@@ -0,0 +1,524 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "DelayArena.h"
+#include "TailTracker.h"
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace project {
+
+    //==============================================================
+    // ReverbScheduler: runs many reverbs - one per stream, hundreds on a
+    // server - on a fixed pool of threads, one period (a block of every
+    // stream) at a time.
+    //
+    // The thread that calls processPeriod() is worker 0; prepare() starts
+    // numThreads - 1 more, pinned one per core on Linux. Each period:
+    //
+    //   - Idle streams are skipped: streams set inactive, and streams whose
+    //     reverb is asleep with silent input (Reverb::canSkipBlock). Their
+    //     output is zeros, which is what process() would have written.
+    //     Inactive streams are skipped before the period starts; the silence
+    //     test needs a scan of the input, so it runs in the stream's job, on
+    //     whichever worker takes it.
+    //   - Every active stream is one job. Stream i's home is worker
+    //     i % numThreads, so its reverb stays in the same core's cache from
+    //     period to period. A worker runs its own jobs, then steals from the
+    //     other workers' queues. A queue is a range of jobs with one atomic
+    //     cursor that owner and thieves advance alike, so no job runs twice.
+    //   - The deadline barrier: processPeriod() returns once every job has
+    //     run or been dropped. No reverb starts processing after the deadline
+    //     (the period's length by default, see setDeadlineFraction()); a
+    //     dropped stream outputs silence for the period and counts as missed,
+    //     unless it was idle anyway. A job that has started always finishes,
+    //     so a period overruns by at most one job.
+    //
+    // After a period the workers spin for setSpinMicroseconds() and then
+    // sleep on a condition variable: periods that follow each other closely
+    // never wait for a wake-up, and an idle server does not burn its cores.
+    //
+    // Each period's wall time goes into a ring; getLatencyStats() reads the
+    // percentiles off it.
+    //
+    // Reverb needs a default constructor, prepare(double),
+    // process(float*, float*, int) and canSkipBlock(float), as AudioReverb
+    // has. prepare() allocates everything and starts the threads.
+    // processPeriod() neither allocates nor waits on a lock, except to wake
+    // workers that have gone to sleep. Everything else - setting up the
+    // instances, the stream buffers and flags, getLatencyStats() - belongs to
+    // the thread that calls processPeriod(), between periods.
+    // The exception is setParameter() on an AudioReverb, which any number
+    // of threads may call at any time, periods running or not.
+    //==============================================================
+    template <typename Reverb>
+    class ReverbScheduler {
+    public:
+        // Job positions are packed into 16 bits of a queue's cursor.
+        static constexpr int maxInstances = 0xffff;
+
+        struct PeriodStats {
+            int jobs = 0;          // Streams processed or dropped.
+            int skipped = 0;       // Idle streams: inactive, or asleep with silent input.
+            int missed = 0;        // Streams dropped at the deadline (output silenced).
+            int stolen = 0;        // Jobs, skipped ones too, run by a worker other than their home.
+            double seconds = 0.0;  // Wall time of processPeriod().
+        };
+
+        // Percentiles of the period wall times in the history, in seconds.
+        struct LatencyStats {
+            int periods = 0;
+            double p50 = 0.0;
+            double p90 = 0.0;
+            double p99 = 0.0;
+            double p999 = 0.0;
+            double max = 0.0;
+        };
+
+        ReverbScheduler() = default;
+        ~ReverbScheduler() { stopWorkers(); }
+
+        ReverbScheduler(const ReverbScheduler&) = delete;
+        ReverbScheduler& operator=(const ReverbScheduler&) = delete;
+
+        // Before prepare(): pin worker t to core (firstCore + t) modulo the
+        // number of cores. Worker 0 is the caller's thread and is not pinned
+        // here; see pinCurrentThread().
+        void setThreadPinning(bool enabled, int firstCore = 0)
+        {
+            pinThreads = enabled;
+            pinFirstCore = firstCore;
+        }
+
+        // How long an idle worker polls for the next period before it sleeps.
+        void setSpinMicroseconds(double microseconds) { spinSeconds = std::max(0.0, microseconds * 1.0e-6); }
+
+        // The deadline as a fraction of the period, from the start of
+        // processPeriod(). 0 or less: no deadline, every job runs.
+        void setDeadlineFraction(double fraction) { deadlineFraction = fraction; }
+
+        // Before prepare(): how many periods getLatencyStats() looks back on.
+        void setLatencyHistory(int periods) { latencyCapacity = static_cast<size_t>(std::max(1, periods)); }
+
+        // numThreads counts the caller; 0 or less means one per hardware
+        // thread. Not real-time safe: builds and prepares the instances,
+        // allocates the stream buffers and (re)starts the workers.
+        void prepare(int numInstances, int numThreads, double newSampleRate, int newMaxPeriodSamples)
+        {
+            stopWorkers();
+
+            numInstances = std::min(std::max(0, numInstances), maxInstances);
+            if (numThreads <= 0)
+                numThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+            threadCount = std::min(numThreads, std::max(1, numInstances));
+            sampleRate = newSampleRate;
+            maxPeriodSamples = std::max(1, newMaxPeriodSamples);
+
+            instances.clear();
+            instances.reserve(static_cast<size_t>(numInstances));
+            for (int i = 0; i < numInstances; ++i)
+            {
+                instances.push_back(std::make_unique<Reverb>());
+                instances.back()->prepare(sampleRate);
+            }
+
+            // Each channel starts on its own cache line, so two workers never
+            // write to the same line.
+            constexpr size_t lineFloats = DelayArena::alignmentBytes / sizeof(float);
+            channelStride = (static_cast<size_t>(maxPeriodSamples) + lineFloats - 1) / lineFloats * lineFloats;
+            buffers.allocate(2 * channelStride * static_cast<size_t>(numInstances));
+            active.assign(static_cast<size_t>(numInstances), 1);
+
+            pending.assign(static_cast<size_t>(numInstances), 0);
+            jobs.assign(static_cast<size_t>(numInstances), 0);
+            homeCounts.assign(static_cast<size_t>(threadCount), 0);
+            queues.reset(new Queue[static_cast<size_t>(threadCount)]);
+
+            latencies.assign(latencyCapacity, 0.0);
+            latencyScratch.assign(latencyCapacity, 0.0);
+            latencyCount = 0;
+            latencyWrite = 0;
+
+            period = 0;
+            wakeEpoch.store(0, std::memory_order_relaxed);
+            quit.store(false, std::memory_order_relaxed);
+            const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+            for (int t = 1; t < threadCount; ++t)
+            {
+                workers.emplace_back([this, t] { workerLoop(t); });
+                if (pinThreads)
+                    pinThread(workers.back().native_handle(), static_cast<int>((pinFirstCore + t) % static_cast<int>(cores)));
+            }
+        }
+
+        // Input of stream i before processPeriod(), its output after: in place,
+        // getMaxPeriodSamples() floats per channel, 64-byte aligned.
+        float* getLeft(int i) { return buffers.data() + 2 * channelStride * static_cast<size_t>(i); }
+        float* getRight(int i) { return getLeft(i) + channelStride; }
+
+        Reverb& getInstance(int i) { return *instances[static_cast<size_t>(i)]; }
+
+        // An inactive stream is skipped and outputs silence; its reverb keeps
+        // its state for when the stream comes back.
+        void setStreamActive(int i, bool shouldBeActive) { active[static_cast<size_t>(i)] = shouldBeActive ? 1 : 0; }
+        bool isStreamActive(int i) const { return active[static_cast<size_t>(i)] != 0; }
+
+        int getNumInstances() const { return static_cast<int>(instances.size()); }
+        int getNumThreads() const { return threadCount; }
+        int getMaxPeriodSamples() const { return maxPeriodSamples; }
+
+        // Runs one period of numSamples (at most getMaxPeriodSamples()) for
+        // every stream, on all the workers, and returns when it is done.
+        PeriodStats processPeriod(int numSamples)
+        {
+            const auto start = Clock::now();
+            PeriodStats stats;
+            numSamples = std::min(std::max(0, numSamples), maxPeriodSamples);
+            const int numInstances = getNumInstances();
+
+            // Count the active streams per home worker, zero the rest.
+            std::fill(homeCounts.begin(), homeCounts.end(), 0);
+            int queued = 0;
+            for (int i = 0; i < numInstances; ++i)
+            {
+                pending[static_cast<size_t>(i)] = active[static_cast<size_t>(i)];
+                if (!isStreamActive(i))
+                {
+                    std::fill(getLeft(i), getLeft(i) + numSamples, 0.f);
+                    std::fill(getRight(i), getRight(i) + numSamples, 0.f);
+                    ++stats.skipped;
+                    continue;
+                }
+                ++homeCounts[static_cast<size_t>(i % threadCount)];
+                ++queued;
+            }
+
+            if (queued > 0)
+            {
+                ++period;
+                placeJobs();
+
+                const double periodSeconds = numSamples / sampleRate;
+                periodSamples.store(numSamples, std::memory_order_relaxed);
+                deadlineTicks.store(deadlineFraction > 0.0 && periodSeconds > 0.0
+                    ? toTicks(start) + static_cast<std::int64_t>(deadlineFraction * periodSeconds * 1.0e9)
+                    : std::numeric_limits<std::int64_t>::max(), std::memory_order_relaxed);
+                missedCount.store(0, std::memory_order_relaxed);
+                skippedCount.store(0, std::memory_order_relaxed);
+                stolenCount.store(0, std::memory_order_relaxed);
+                remaining.store(queued, std::memory_order_relaxed);
+                publishQueues();
+                wakeWorkers();
+
+                runJobs(0, period);
+                for (int spins = 1; remaining.load(std::memory_order_acquire) > 0; ++spins)
+                    cpuRelax(spins);
+
+                const int skippedJobs = skippedCount.load(std::memory_order_relaxed);
+                stats.jobs = queued - skippedJobs;
+                stats.skipped += skippedJobs;
+                stats.missed = missedCount.load(std::memory_order_relaxed);
+                stats.stolen = stolenCount.load(std::memory_order_relaxed);
+            }
+
+            stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            latencies[latencyWrite] = stats.seconds;
+            latencyWrite = (latencyWrite + 1) % latencies.size();
+            latencyCount = std::min(latencyCount + 1, latencies.size());
+            return stats;
+        }
+
+        // Percentiles of the last setLatencyHistory() periods. Does not
+        // allocate; from the thread that calls processPeriod().
+        LatencyStats getLatencyStats()
+        {
+            LatencyStats stats;
+            stats.periods = static_cast<int>(latencyCount);
+            if (latencyCount == 0)
+                return stats;
+            const auto first = latencyScratch.begin();
+            const auto last = first + static_cast<std::ptrdiff_t>(latencyCount);
+            std::copy(latencies.begin(), latencies.begin() + static_cast<std::ptrdiff_t>(latencyCount), first);
+            const auto percentile = [&](double q) {
+                const auto nth = first + static_cast<std::ptrdiff_t>(std::min(latencyCount - 1, static_cast<size_t>(q * static_cast<double>(latencyCount))));
+                std::nth_element(first, nth, last);
+                return *nth;
+            };
+            stats.p50 = percentile(0.5);
+            stats.p90 = percentile(0.9);
+            stats.p99 = percentile(0.99);
+            stats.p999 = percentile(0.999);
+            stats.max = *std::max_element(first, last);
+            return stats;
+        }
+
+        void resetLatencyStats()
+        {
+            latencyCount = 0;
+            latencyWrite = 0;
+        }
+
+        // Pins the calling thread (the one that will call processPeriod()) to
+        // a core. Linux only; false where it is not supported or fails.
+        static bool pinCurrentThread(int core)
+        {
+#if defined(__linux__)
+            return pinThread(pthread_self(), core);
+#else
+            (void)core;
+            return false;
+#endif
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        // A worker's jobs for the current period: positions [next, end) of
+        // jobs, packed with the period number into one word so that a worker
+        // still looking at last period's queues can never take a job from
+        // this one. end is only written while no period is running.
+        struct alignas(64) Queue {
+            std::atomic<std::uint64_t> cursor{ 0 };
+            std::uint32_t end = 0;
+        };
+
+        static std::int64_t toTicks(Clock::time_point t)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        }
+
+        // One round of a spin-wait. Every 64th round yields, so that a pool
+        // with more threads than free cores still makes progress.
+        static void cpuRelax(int spins)
+        {
+            if ((spins & 63) == 0)
+            {
+                std::this_thread::yield();
+                return;
+            }
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+            _mm_pause();
+#endif
+        }
+
+#if defined(__linux__)
+        static bool pinThread(pthread_t thread, int core)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(core, &set);
+            return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+        }
+#else
+        template <typename Handle>
+        static bool pinThread(Handle, int) { return false; }
+#endif
+
+        // Lays the pending streams out in jobs, grouped by home worker, and
+        // sets each queue's end.
+        void placeJobs()
+        {
+            std::uint32_t begin = 0;
+            for (int t = 0; t < threadCount; ++t)
+            {
+                const auto count = static_cast<std::uint32_t>(homeCounts[static_cast<size_t>(t)]);
+                homeCounts[static_cast<size_t>(t)] = static_cast<int>(begin);
+                queues[static_cast<size_t>(t)].end = begin + count;
+                begin += count;
+            }
+            for (int i = 0; i < getNumInstances(); ++i)
+            {
+                if (pending[static_cast<size_t>(i)] != 0)
+                    jobs[static_cast<size_t>(homeCounts[static_cast<size_t>(i % threadCount)]++)] = i;
+            }
+        }
+
+        // Opens the queues for this period. The release stores publish the
+        // jobs and the period's settings to whoever takes a job.
+        void publishQueues()
+        {
+            std::uint32_t begin = 0;
+            for (int t = 0; t < threadCount; ++t)
+            {
+                Queue& q = queues[static_cast<size_t>(t)];
+                q.cursor.store(pack(period, begin, q.end), std::memory_order_release);
+                begin = q.end;
+            }
+        }
+
+        static std::uint64_t pack(std::uint32_t p, std::uint32_t next, std::uint32_t end)
+        {
+            return (static_cast<std::uint64_t>(p) << 32) | (static_cast<std::uint64_t>(next) << 16) | end;
+        }
+
+        // The next job position in q for period p, or -1 once q is empty or
+        // belongs to another period.
+        static int claim(Queue& q, std::uint32_t p)
+        {
+            std::uint64_t cursor = q.cursor.load(std::memory_order_acquire);
+            for (;;)
+            {
+                const auto next = static_cast<std::uint32_t>(cursor >> 16) & 0xffffu;
+                if (static_cast<std::uint32_t>(cursor >> 32) != p || next >= (cursor & 0xffffu))
+                    return -1;
+                if (q.cursor.compare_exchange_weak(cursor, cursor + (1u << 16), std::memory_order_acquire, std::memory_order_acquire))
+                    return static_cast<int>(next);
+            }
+        }
+
+        // The epoch store and the sleepers load are both sequentially
+        // consistent, as are their counterparts in waitForPeriod(): either
+        // this sees the sleeper, or the sleeper sees the new epoch.
+        void wakeWorkers()
+        {
+            if (threadCount == 1)
+                return;
+            wakeEpoch.store(period, std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_seq_cst) > 0)
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                wakeUp.notify_all();
+            }
+        }
+
+        // Own queue first, then steal from the next workers round.
+        void runJobs(int worker, std::uint32_t p)
+        {
+            for (int k = 0; k < threadCount; ++k)
+            {
+                Queue& q = queues[static_cast<size_t>((worker + k) % threadCount)];
+                for (int position = claim(q, p); position >= 0; position = claim(q, p))
+                    runJob(jobs[static_cast<size_t>(position)], k != 0);
+            }
+        }
+
+        // Asleep with silent input the stream is skipped, even past the
+        // deadline: its silence is then the right output, not a drop. Past the
+        // deadline anything else is dropped. Otherwise it is processed.
+        void runJob(int i, bool stolen)
+        {
+            const int numSamples = periodSamples.load(std::memory_order_relaxed);
+            float* left = getLeft(i);
+            float* right = getRight(i);
+            Reverb& reverb = *instances[static_cast<size_t>(i)];
+            const bool idle = reverb.canSkipBlock(TailTracker::getPeak(left, right, numSamples));
+            if (idle || toTicks(Clock::now()) > deadlineTicks.load(std::memory_order_relaxed))
+            {
+                std::fill(left, left + numSamples, 0.f);
+                std::fill(right, right + numSamples, 0.f);
+                (idle ? skippedCount : missedCount).fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                reverb.process(left, right, numSamples);
+            }
+            if (stolen)
+                stolenCount.fetch_add(1, std::memory_order_relaxed);
+            remaining.fetch_sub(1, std::memory_order_release);
+        }
+
+        // Spins for spinSeconds, then sleeps, until a period after `seen`
+        // starts. Returns its number, or `seen` when the pool is stopping.
+        std::uint32_t waitForPeriod(std::uint32_t seen)
+        {
+            const auto spinUntil = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(spinSeconds));
+            for (int spins = 0;; ++spins)
+            {
+                const std::uint32_t e = wakeEpoch.load(std::memory_order_acquire);
+                if (e != seen || quit.load(std::memory_order_relaxed))
+                    return e;
+                if ((spins & 63) == 63 && Clock::now() > spinUntil)
+                    break;
+                cpuRelax(spins);
+            }
+
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            sleepers.fetch_add(1, std::memory_order_seq_cst);
+            wakeUp.wait(lock, [&] {
+                return wakeEpoch.load(std::memory_order_seq_cst) != seen || quit.load(std::memory_order_relaxed);
+            });
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            return wakeEpoch.load(std::memory_order_acquire);
+        }
+
+        void workerLoop(int worker)
+        {
+            std::uint32_t seen = 0;
+            for (;;)
+            {
+                seen = waitForPeriod(seen);
+                if (quit.load(std::memory_order_relaxed))
+                    return;
+                runJobs(worker, seen);
+            }
+        }
+
+        void stopWorkers()
+        {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                quit.store(true, std::memory_order_relaxed);
+            }
+            wakeUp.notify_all();
+            for (auto& w : workers)
+                w.join();
+            workers.clear();
+        }
+
+        std::vector<std::unique_ptr<Reverb>> instances;
+        DelayArena buffers;
+        size_t channelStride = 0;
+        std::vector<char> active;
+        double sampleRate = 48000.0;
+        int maxPeriodSamples = 0;
+
+        // Job scheduling. jobs holds the active streams grouped by home
+        // worker; homeCounts is scratch for laying them out.
+        int threadCount = 1;
+        std::vector<char> pending;
+        std::vector<int> jobs;
+        std::vector<int> homeCounts;
+        std::unique_ptr<Queue[]> queues;
+        std::uint32_t period = 0;
+        std::atomic<int> periodSamples{ 0 };
+        std::atomic<std::int64_t> deadlineTicks{ 0 };
+        std::atomic<int> remaining{ 0 };
+        std::atomic<int> missedCount{ 0 };
+        std::atomic<int> skippedCount{ 0 };
+        std::atomic<int> stolenCount{ 0 };
+        double deadlineFraction = 1.0;
+
+        // The pool.
+        std::vector<std::thread> workers;
+        bool pinThreads = true;
+        int pinFirstCore = 0;
+        double spinSeconds = 100.0e-6;
+        std::atomic<std::uint32_t> wakeEpoch{ 0 };
+        std::atomic<int> sleepers{ 0 };
+        std::atomic<bool> quit{ false };
+        std::mutex wakeMutex;
+        std::condition_variable wakeUp;
+
+        // Period wall times, a ring of the last latencyCapacity periods.
+        size_t latencyCapacity = 8192;
+        std::vector<double> latencies;
+        std::vector<double> latencyScratch;
+        size_t latencyCount = 0;
+        size_t latencyWrite = 0;
+    };
+
+} // namespace project
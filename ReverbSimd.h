@@ -0,0 +1,355 @@
+#pragma once
+#include <cstdint>
+#include "Denormals.h"
+
+#ifndef JUCE_FORCEINLINE
+#if defined(_MSC_VER)
+#define JUCE_FORCEINLINE __forceinline
+#else
+#define JUCE_FORCEINLINE inline __attribute__((always_inline))
+#endif
+#endif
+
+// Minimal float/int vector wrapper for the block kernels.
+// Picks AVX2 (8 lanes), SSE2 (4 lanes) or NEON (4 lanes) from the compiler's
+// target flags and falls back to a plain 4-lane array, which the compiler is
+// free to auto-vectorize. Only the handful of operations the kernels need.
+#if defined(__AVX2__)
+#define GRIFFIN_SIMD_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRIFFIN_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GRIFFIN_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define GRIFFIN_SIMD_SCALAR 1
+#endif
+
+namespace project {
+    namespace simd {
+
+#if GRIFFIN_SIMD_AVX2
+        struct FloatVec {
+            static constexpr int width = 8;
+            __m256 v;
+
+            static JUCE_FORCEINLINE FloatVec load(const float* p) { return { _mm256_loadu_ps(p) }; }
+            static JUCE_FORCEINLINE FloatVec broadcast(float x) { return { _mm256_set1_ps(x) }; }
+            JUCE_FORCEINLINE void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+            friend JUCE_FORCEINLINE FloatVec operator+(FloatVec a, FloatVec b) { return { _mm256_add_ps(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE FloatVec operator-(FloatVec a, FloatVec b) { return { _mm256_sub_ps(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE FloatVec operator*(FloatVec a, FloatVec b) { return { _mm256_mul_ps(a.v, b.v) }; }
+            static JUCE_FORCEINLINE FloatVec max(FloatVec a, FloatVec b) { return { _mm256_max_ps(a.v, b.v) }; }
+            static JUCE_FORCEINLINE FloatVec abs(FloatVec a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v) }; }
+            // x where a >= b, 0 elsewhere.
+            static JUCE_FORCEINLINE FloatVec whereGE(FloatVec a, FloatVec b, FloatVec x) { return { _mm256_and_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ), x.v) }; }
+        };
+
+        struct IntVec {
+            __m256i v;
+
+            static JUCE_FORCEINLINE IntVec broadcast(int x) { return { _mm256_set1_epi32(x) }; }
+            static JUCE_FORCEINLINE IntVec ramp(int start) { return { _mm256_add_epi32(_mm256_set1_epi32(start), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)) }; }
+            // Truncation toward zero, like static_cast<int>.
+            static JUCE_FORCEINLINE IntVec truncate(FloatVec f) { return { _mm256_cvttps_epi32(f.v) }; }
+            JUCE_FORCEINLINE FloatVec toFloat() const { return { _mm256_cvtepi32_ps(v) }; }
+
+            friend JUCE_FORCEINLINE IntVec operator+(IntVec a, IntVec b) { return { _mm256_add_epi32(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE IntVec operator-(IntVec a, IntVec b) { return { _mm256_sub_epi32(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE IntVec operator&(IntVec a, IntVec b) { return { _mm256_and_si256(a.v, b.v) }; }
+            JUCE_FORCEINLINE IntVec shiftLeft(int bits) const { return { _mm256_sll_epi32(v, _mm_cvtsi32_si128(bits)) }; }
+            JUCE_FORCEINLINE void store(int32_t* p) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+        };
+
+        static JUCE_FORCEINLINE FloatVec gather(const float* base, IntVec idx) { return { _mm256_i32gather_ps(base, idx.v, 4) }; }
+
+#elif GRIFFIN_SIMD_SSE2
+        struct FloatVec {
+            static constexpr int width = 4;
+            __m128 v;
+
+            static JUCE_FORCEINLINE FloatVec load(const float* p) { return { _mm_loadu_ps(p) }; }
+            static JUCE_FORCEINLINE FloatVec broadcast(float x) { return { _mm_set1_ps(x) }; }
+            JUCE_FORCEINLINE void store(float* p) const { _mm_storeu_ps(p, v); }
+
+            friend JUCE_FORCEINLINE FloatVec operator+(FloatVec a, FloatVec b) { return { _mm_add_ps(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE FloatVec operator-(FloatVec a, FloatVec b) { return { _mm_sub_ps(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE FloatVec operator*(FloatVec a, FloatVec b) { return { _mm_mul_ps(a.v, b.v) }; }
+            static JUCE_FORCEINLINE FloatVec max(FloatVec a, FloatVec b) { return { _mm_max_ps(a.v, b.v) }; }
+            static JUCE_FORCEINLINE FloatVec abs(FloatVec a) { return { _mm_andnot_ps(_mm_set1_ps(-0.f), a.v) }; }
+            static JUCE_FORCEINLINE FloatVec whereGE(FloatVec a, FloatVec b, FloatVec x) { return { _mm_and_ps(_mm_cmpge_ps(a.v, b.v), x.v) }; }
+        };
+
+        struct IntVec {
+            __m128i v;
+
+            static JUCE_FORCEINLINE IntVec broadcast(int x) { return { _mm_set1_epi32(x) }; }
+            static JUCE_FORCEINLINE IntVec ramp(int start) { return { _mm_add_epi32(_mm_set1_epi32(start), _mm_setr_epi32(0, 1, 2, 3)) }; }
+            static JUCE_FORCEINLINE IntVec truncate(FloatVec f) { return { _mm_cvttps_epi32(f.v) }; }
+            JUCE_FORCEINLINE FloatVec toFloat() const { return { _mm_cvtepi32_ps(v) }; }
+
+            friend JUCE_FORCEINLINE IntVec operator+(IntVec a, IntVec b) { return { _mm_add_epi32(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE IntVec operator-(IntVec a, IntVec b) { return { _mm_sub_epi32(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE IntVec operator&(IntVec a, IntVec b) { return { _mm_and_si128(a.v, b.v) }; }
+            JUCE_FORCEINLINE IntVec shiftLeft(int bits) const { return { _mm_sll_epi32(v, _mm_cvtsi32_si128(bits)) }; }
+            JUCE_FORCEINLINE void store(int32_t* p) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+        };
+
+        // No hardware gather before AVX2: spill the indices and load lane by lane.
+        static JUCE_FORCEINLINE FloatVec gather(const float* base, IntVec idx)
+        {
+            alignas(16) int32_t i[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(i), idx.v);
+            return { _mm_setr_ps(base[i[0]], base[i[1]], base[i[2]], base[i[3]]) };
+        }
+
+#elif GRIFFIN_SIMD_NEON
+        struct FloatVec {
+            static constexpr int width = 4;
+            float32x4_t v;
+
+            static JUCE_FORCEINLINE FloatVec load(const float* p) { return { vld1q_f32(p) }; }
+            static JUCE_FORCEINLINE FloatVec broadcast(float x) { return { vdupq_n_f32(x) }; }
+            JUCE_FORCEINLINE void store(float* p) const { vst1q_f32(p, v); }
+
+            friend JUCE_FORCEINLINE FloatVec operator+(FloatVec a, FloatVec b) { return { vaddq_f32(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE FloatVec operator-(FloatVec a, FloatVec b) { return { vsubq_f32(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE FloatVec operator*(FloatVec a, FloatVec b) { return { vmulq_f32(a.v, b.v) }; }
+            static JUCE_FORCEINLINE FloatVec max(FloatVec a, FloatVec b) { return { vmaxq_f32(a.v, b.v) }; }
+            static JUCE_FORCEINLINE FloatVec abs(FloatVec a) { return { vabsq_f32(a.v) }; }
+            static JUCE_FORCEINLINE FloatVec whereGE(FloatVec a, FloatVec b, FloatVec x)
+            {
+                return { vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(a.v, b.v), vreinterpretq_u32_f32(x.v))) };
+            }
+        };
+
+        struct IntVec {
+            int32x4_t v;
+
+            static JUCE_FORCEINLINE IntVec broadcast(int x) { return { vdupq_n_s32(x) }; }
+            static JUCE_FORCEINLINE IntVec ramp(int start)
+            {
+                const int32_t r[4] = { 0, 1, 2, 3 };
+                return { vaddq_s32(vdupq_n_s32(start), vld1q_s32(r)) };
+            }
+            static JUCE_FORCEINLINE IntVec truncate(FloatVec f) { return { vcvtq_s32_f32(f.v) }; }
+            JUCE_FORCEINLINE FloatVec toFloat() const { return { vcvtq_f32_s32(v) }; }
+
+            friend JUCE_FORCEINLINE IntVec operator+(IntVec a, IntVec b) { return { vaddq_s32(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE IntVec operator-(IntVec a, IntVec b) { return { vsubq_s32(a.v, b.v) }; }
+            friend JUCE_FORCEINLINE IntVec operator&(IntVec a, IntVec b) { return { vandq_s32(a.v, b.v) }; }
+            JUCE_FORCEINLINE IntVec shiftLeft(int bits) const { return { vshlq_s32(v, vdupq_n_s32(bits)) }; }
+            JUCE_FORCEINLINE void store(int32_t* p) const { vst1q_s32(p, v); }
+        };
+
+        static JUCE_FORCEINLINE FloatVec gather(const float* base, IntVec idx)
+        {
+            int32_t i[4];
+            vst1q_s32(i, idx.v);
+            const float g[4] = { base[i[0]], base[i[1]], base[i[2]], base[i[3]] };
+            return { vld1q_f32(g) };
+        }
+
+#else
+        struct FloatVec {
+            static constexpr int width = 4;
+            float v[4];
+
+            static JUCE_FORCEINLINE FloatVec load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+            static JUCE_FORCEINLINE FloatVec broadcast(float x) { return { { x, x, x, x } }; }
+            JUCE_FORCEINLINE void store(float* p) const { for (int k = 0; k < 4; ++k) p[k] = v[k]; }
+
+            friend JUCE_FORCEINLINE FloatVec operator+(FloatVec a, FloatVec b) { for (int k = 0; k < 4; ++k) a.v[k] += b.v[k]; return a; }
+            friend JUCE_FORCEINLINE FloatVec operator-(FloatVec a, FloatVec b) { for (int k = 0; k < 4; ++k) a.v[k] -= b.v[k]; return a; }
+            friend JUCE_FORCEINLINE FloatVec operator*(FloatVec a, FloatVec b) { for (int k = 0; k < 4; ++k) a.v[k] *= b.v[k]; return a; }
+            static JUCE_FORCEINLINE FloatVec max(FloatVec a, FloatVec b) { for (int k = 0; k < 4; ++k) a.v[k] = (a.v[k] < b.v[k]) ? b.v[k] : a.v[k]; return a; }
+            static JUCE_FORCEINLINE FloatVec abs(FloatVec a) { for (int k = 0; k < 4; ++k) a.v[k] = (a.v[k] < 0.f) ? -a.v[k] : a.v[k]; return a; }
+            static JUCE_FORCEINLINE FloatVec whereGE(FloatVec a, FloatVec b, FloatVec x) { for (int k = 0; k < 4; ++k) x.v[k] = (a.v[k] >= b.v[k]) ? x.v[k] : 0.f; return x; }
+        };
+
+        struct IntVec {
+            int32_t v[4];
+
+            static JUCE_FORCEINLINE IntVec broadcast(int x) { return { { x, x, x, x } }; }
+            static JUCE_FORCEINLINE IntVec ramp(int start) { return { { start, start + 1, start + 2, start + 3 } }; }
+            static JUCE_FORCEINLINE IntVec truncate(FloatVec f) { IntVec r; for (int k = 0; k < 4; ++k) r.v[k] = static_cast<int32_t>(f.v[k]); return r; }
+            JUCE_FORCEINLINE FloatVec toFloat() const { FloatVec r; for (int k = 0; k < 4; ++k) r.v[k] = static_cast<float>(v[k]); return r; }
+
+            friend JUCE_FORCEINLINE IntVec operator+(IntVec a, IntVec b) { for (int k = 0; k < 4; ++k) a.v[k] += b.v[k]; return a; }
+            friend JUCE_FORCEINLINE IntVec operator-(IntVec a, IntVec b) { for (int k = 0; k < 4; ++k) a.v[k] -= b.v[k]; return a; }
+            friend JUCE_FORCEINLINE IntVec operator&(IntVec a, IntVec b) { for (int k = 0; k < 4; ++k) a.v[k] &= b.v[k]; return a; }
+            JUCE_FORCEINLINE IntVec shiftLeft(int bits) const { IntVec r; for (int k = 0; k < 4; ++k) r.v[k] = v[k] << bits; return r; }
+            JUCE_FORCEINLINE void store(int32_t* p) const { for (int k = 0; k < 4; ++k) p[k] = v[k]; }
+        };
+
+        static JUCE_FORCEINLINE FloatVec gather(const float* base, IntVec idx)
+        {
+            return { { base[idx.v[0]], base[idx.v[1]], base[idx.v[2]], base[idx.v[3]] } };
+        }
+#endif
+
+        // Vector flushDenormal (see Denormals.h).
+        static JUCE_FORCEINLINE FloatVec flushDenormal(FloatVec x)
+        {
+#if GRIFFIN_SOFTWARE_DENORMAL_FLUSH
+            return FloatVec::whereGE(FloatVec::abs(x), FloatVec::broadcast(denormalFlushLevel), x);
+#else
+            return x;
+#endif
+        }
+
+        //==============================================================
+        // Allpass block kernel for delays longer than the block.
+        //
+        // Precondition: every delay read in the block is at least numSamples
+        // samples long, i.e. the newest sample Interp reads for the shortest
+        // delay, baseDelay + min(lfo) - Interp::readAhead, is numSamples old.
+        // Then no read in the block can see a sample written in the same block,
+        // so each output depends only on the input and on history, and W samples
+        // at a time can be produced with Interp::readVec's gathered reads.
+        //
+        // readVec and the scalar read of the same policy do the same arithmetic
+        // in the same order, so results are bit-identical to the per-sample path.
+        //
+        // buffer is a power-of-two ring (mask = size - 1) in the format of the
+        // Storage policy (see DelayStorage.h); dither is the policy's random
+        // state. Interp must be vectorizable (see DelayInterpolation.h).
+        // lfoValues may be null. Works in place. Returns the new write index.
+        //==============================================================
+        template <typename Storage, typename Interp>
+        static inline int allpassBlockLongDelay(typename Storage::Sample* buffer, int mask, int writeIndex,
+            float baseDelay, float coefficient,
+            const float* in, float* out, const float* lfoValues, int numSamples, std::uint32_t& dither)
+        {
+            static_assert(Interp::vectorizable, "allpassBlockLongDelay needs a non-recursive interpolation");
+            constexpr int W = FloatVec::width;
+            const FloatVec g = FloatVec::broadcast(coefficient);
+            const FloatVec base = FloatVec::broadcast(baseDelay);
+            const FloatVec minDelay = FloatVec::broadcast(Interp::minDelay);
+            const IntVec maskV = IntVec::broadcast(mask);
+
+            int i = 0;
+            for (; i + W <= numSamples; i += W)
+            {
+                FloatVec target = (lfoValues != nullptr) ? base + FloatVec::load(lfoValues + i) : base;
+                target = FloatVec::max(target, minDelay);
+
+                const FloatVec delayedV = Interp::template readVec<Storage>(buffer, maskV, IntVec::ramp(writeIndex + i), target);
+
+                const FloatVec v = flushDenormal(FloatVec::load(in + i) - g * delayedV);
+                (g * v + delayedV).store(out + i);
+
+                const int w = (writeIndex + i) & mask;
+                if (w + W <= mask + 1)
+                {
+                    Storage::storeVec(buffer + w, v, dither);
+                }
+                else
+                {
+                    alignas(32) float tmp[W];
+                    v.store(tmp);
+                    for (int k = 0; k < W; ++k)
+                        Storage::store(buffer, (w + k) & mask, tmp[k], dither);
+                }
+            }
+
+            // Scalar tail, same maths.
+            typename Interp::State noState{};
+            for (; i < numSamples; ++i)
+            {
+                float target = baseDelay + ((lfoValues != nullptr) ? lfoValues[i] : 0.f);
+                if (target < Interp::minDelay)
+                    target = Interp::minDelay;
+                const int w = (writeIndex + i) & mask;
+                const float delayedV = Interp::template read<Storage>(buffer, mask, w, target, noState);
+                const float v = project::flushDenormal(in[i] - coefficient * delayedV);
+                out[i] = coefficient * v + delayedV;
+                Storage::store(buffer, w, v, dither);
+            }
+
+            return (writeIndex + numSamples) & mask;
+        }
+
+        //==============================================================
+        // allpassBlockLongDelay split in two, for allpasses that process the
+        // delay line's output before it is fed back (nested allpasses):
+        //   delayReadBlock    the delay line's output for the block into
+        //                     delayed, reading nothing it has not written yet,
+        //   allpassWriteBlock the allpass output from in and the (processed)
+        //                     delayed block, writing the line.
+        // Same preconditions and the same maths as allpassBlockLongDelay, so
+        // the results match the per-sample allpassRead / allpassWrite. The
+        // write index only moves in allpassWriteBlock, which returns it.
+        //==============================================================
+        template <typename Storage, typename Interp>
+        static inline void delayReadBlock(const typename Storage::Sample* buffer, int mask, int writeIndex,
+            float baseDelay, const float* lfoValues, float* delayed, int numSamples)
+        {
+            static_assert(Interp::vectorizable, "delayReadBlock needs a non-recursive interpolation");
+            constexpr int W = FloatVec::width;
+            const FloatVec base = FloatVec::broadcast(baseDelay);
+            const FloatVec minDelay = FloatVec::broadcast(Interp::minDelay);
+            const IntVec maskV = IntVec::broadcast(mask);
+
+            int i = 0;
+            for (; i + W <= numSamples; i += W)
+            {
+                FloatVec target = (lfoValues != nullptr) ? base + FloatVec::load(lfoValues + i) : base;
+                target = FloatVec::max(target, minDelay);
+                Interp::template readVec<Storage>(buffer, maskV, IntVec::ramp(writeIndex + i), target).store(delayed + i);
+            }
+
+            typename Interp::State noState{};
+            for (; i < numSamples; ++i)
+            {
+                float target = baseDelay + ((lfoValues != nullptr) ? lfoValues[i] : 0.f);
+                if (target < Interp::minDelay)
+                    target = Interp::minDelay;
+                delayed[i] = Interp::template read<Storage>(buffer, mask, (writeIndex + i) & mask, target, noState);
+            }
+        }
+
+        template <typename Storage>
+        static inline int allpassWriteBlock(typename Storage::Sample* buffer, int mask, int writeIndex, float coefficient,
+            const float* in, const float* delayed, float* out, int numSamples, std::uint32_t& dither)
+        {
+            constexpr int W = FloatVec::width;
+            const FloatVec g = FloatVec::broadcast(coefficient);
+
+            int i = 0;
+            for (; i + W <= numSamples; i += W)
+            {
+                const FloatVec delayedV = FloatVec::load(delayed + i);
+                const FloatVec v = flushDenormal(FloatVec::load(in + i) - g * delayedV);
+                (g * v + delayedV).store(out + i);
+
+                const int w = (writeIndex + i) & mask;
+                if (w + W <= mask + 1)
+                {
+                    Storage::storeVec(buffer + w, v, dither);
+                }
+                else
+                {
+                    alignas(32) float tmp[W];
+                    v.store(tmp);
+                    for (int k = 0; k < W; ++k)
+                        Storage::store(buffer, (w + k) & mask, tmp[k], dither);
+                }
+            }
+
+            for (; i < numSamples; ++i)
+            {
+                const int w = (writeIndex + i) & mask;
+                const float v = project::flushDenormal(in[i] - coefficient * delayed[i]);
+                out[i] = coefficient * v + delayed[i];
+                Storage::store(buffer, w, v, dither);
+            }
+
+            return (writeIndex + numSamples) & mask;
+        }
+
+    } // namespace simd
+} // namespace project
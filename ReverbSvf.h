@@ -1,91 +1,129 @@
-#pragma once
-#include <cmath>
-#include "ReverbCommon.h"
-
-namespace project {
-    namespace multistage {
-
-        // Fast exponential approximation using (1 + x/256)^256 via exponentiation by squaring.
-        // Approximates exp(x) for small-to-moderate values of x.
-        inline float fastExp(float x) {
-            x = 1.0f + x / 256.0f;
-            x *= x; x *= x; x *= x; x *= x;
-            x *= x; x *= x; x *= x; x *= x;
-            return x;
-        }
-
-        // Fast pow10 approximation.
-        // Computes 10^(x) as exp(x * ln(10)); ln(10) ~ 2.302585093.
-        inline float fastPow10(float x) {
-            return fastExp(x * 2.302585093f);
-        }
-
-        // Inline tan approximation by Michael Massberg.
-        inline float tanA(float x) {
-            float x2 = x * x;
-            return x * (0.999999492001f + x2 * -0.096524608111f) /
-                (1.0f + x2 * (-0.429867256894f + x2 * 0.009981877999f));
-        }
-
-        // One-pole high-shelf filter for high-frequency attenuation.
-        // The filter is designed such that:
-        //   - At DC, H(1) = 1 (0 dB)
-        //   - At high frequencies (z = -1), H(-1) = G = 10^(dBgain/20)
-        // 
-        // The coefficients are computed as:
-        //   float G = 10^(dBgain/20)
-        //   float K = tan(pi * cutoff / sampleRate)
-        //   norm = 1/(1 + G*K)
-        //   b0 = G*(1+K)*norm
-        //   b1 = G*(K-1)*norm
-        //   a1 = (G*K - 1)*norm
-        //
-        // This filter is implemented in direct form I:
-        //   y[n] = b0 * x[n] + b1 * x[n-1] - a1 * y[n-1]
-        //
-        // For example, with dBgain = -6 dB, the high frequencies will be attenuated by 6 dB.
-        class LexiconShelvingFilter {
-        public:
-            LexiconShelvingFilter()
-                : b0(0.0f), b1(0.0f), a1(0.0f), x1(0.0f), y1(0.0f) {
-            }
-
-            // Set filter parameters.
-            // cutoff: shelf cutoff frequency in Hz.
-            // dBgain: desired high-frequency gain in dB (negative for cut, positive for boost).
-            // sampleRate: sampling rate in Hz.
-            void setParameters(float cutoff, float dBgain, float sampleRate) {
-                // Calculate high-frequency gain factor G = 10^(dBgain/20).
-                // For attenuation, dBgain is negative so G < 1.
-                float G = fastPow10(dBgain / 20.0f);
-                // Prewarp the cutoff frequency using our tan approximation.
-                float K = tanA(M_PI * cutoff / sampleRate);
-                // Compute normalization factor.
-                float norm = 1.0f / (1.0f + G * K);
-                // Compute the filter coefficients.
-                b0 = G * (1.0f + K) * norm;
-                b1 = G * (K - 1.0f) * norm;
-                a1 = (G * K - 1.0f) * norm;
-            }
-
-            // Process one sample. Call this per-sample in your audio loop.
-            inline float processSample(float x) {
-                float y = b0 * x + b1 * x1 - a1 * y1;
-                x1 = x;
-                y1 = y;
-                return y;
-            }
-
-            // Reset the filter state (e.g., on initialization or when switching presets).
-            void reset() {
-                x1 = 0.0f;
-                y1 = 0.0f;
-            }
-
-        private:
-            float b0, b1, a1;
-            float x1, y1;
-        };
-
-    } // namespace multistage
-} // namespace project
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "ReverbCommon.h"
+
+namespace project {
+    namespace multistage {
+
+        // Fast exponential approximation using (1 + x/256)^256 via exponentiation by squaring.
+        // Approximates exp(x) for small-to-moderate values of x.
+        inline float fastExp(float x) {
+            x = 1.0f + x / 256.0f;
+            x *= x; x *= x; x *= x; x *= x;
+            x *= x; x *= x; x *= x; x *= x;
+            return x;
+        }
+
+        // Fast pow10 approximation.
+        // Computes 10^(x) as exp(x * ln(10)); ln(10) ~ 2.302585093.
+        inline float fastPow10(float x) {
+            return fastExp(x * 2.302585093f);
+        }
+
+        // Inline tan approximation by Michael Massberg.
+        inline float tanA(float x) {
+            float x2 = x * x;
+            return x * (0.999999492001f + x2 * -0.096524608111f) /
+                (1.0f + x2 * (-0.429867256894f + x2 * 0.009981877999f));
+        }
+
+        // One-pole high-shelf filter for high-frequency attenuation.
+        // The filter is designed such that:
+        //   - At DC, H(1) = 1 (0 dB)
+        //   - At high frequencies (z = -1), H(-1) = G = 10^(dBgain/20)
+        // 
+        // The coefficients are computed as:
+        //   float G = 10^(dBgain/20)
+        //   float K = tan(pi * cutoff / sampleRate)
+        //   norm = 1/(1 + G*K)
+        //   b0 = G*(1+K)*norm
+        //   b1 = G*(K-1)*norm
+        //   a1 = (G*K - 1)*norm
+        //
+        // This filter is implemented in direct form I:
+        //   y[n] = b0 * x[n] + b1 * x[n-1] - a1 * y[n-1]
+        //
+        // For example, with dBgain = -6 dB, the high frequencies will be attenuated by 6 dB.
+        class LexiconShelvingFilter {
+        public:
+            LexiconShelvingFilter()
+                : b0(0.0f), b1(0.0f), a1(0.0f), x1(0.0f), y1(0.0f) {
+            }
+
+            // Set filter parameters.
+            // cutoff: shelf cutoff frequency in Hz.
+            // dBgain: desired high-frequency gain in dB (negative for cut, positive for boost).
+            // sampleRate: sampling rate in Hz.
+            void setParameters(float cutoff, float dBgain, float sampleRate) {
+                // Calculate high-frequency gain factor G = 10^(dBgain/20).
+                // For attenuation, dBgain is negative so G < 1.
+                float G = fastPow10(dBgain / 20.0f);
+                // Past Nyquist the prewarp wraps round (and tanA has a pole just
+                // after pi/2): keep the cutoff below it, where the shelf hardly
+                // acts anyway. Only reverbs run at a reduced rate (eco mode) hit
+                // this: 0.49 of 44.1 kHz is above the 20 kHz a host knob reaches,
+                // so full-rate output is unchanged.
+                cutoff = std::min(cutoff, 0.49f * sampleRate);
+                // Prewarp the cutoff frequency using our tan approximation.
+                float K = tanA(M_PI * cutoff / sampleRate);
+                // Compute normalization factor.
+                float norm = 1.0f / (1.0f + G * K);
+                // Compute the filter coefficients.
+                b0 = G * (1.0f + K) * norm;
+                b1 = G * (K - 1.0f) * norm;
+                a1 = (G * K - 1.0f) * norm;
+            }
+
+            // Current coefficients, for callers that keep their own filter state.
+            void getCoefficients(float& outB0, float& outB1, float& outA1) const {
+                outB0 = b0;
+                outB1 = b1;
+                outA1 = a1;
+            }
+
+            // Process one sample. Call this per-sample in your audio loop.
+            inline float processSample(float x) {
+                float y = flushDenormal(b0 * x + b1 * x1 - a1 * y1);
+                x1 = x;
+                y1 = y;
+                return y;
+            }
+
+            // Process a block (in place is fine). Same recurrence as processSample;
+            // the runtime-dispatched kernel (ReverbDispatch.h) runs it when compiled in.
+            inline void processBlock(const float* in, float* out, int numSamples) {
+#if GRIFFIN_RUNTIME_DISPATCH
+                const float coefficients[3] = { b0, b1, a1 };
+                float state[2] = { x1, y1 };
+                dispatch::kernels().shelf(in, out, numSamples, coefficients, state);
+                x1 = state[0];
+                y1 = state[1];
+#else
+                const float c0 = b0, c1 = b1, c2 = a1;
+                float xm1 = x1, ym1 = y1;
+                for (int i = 0; i < numSamples; ++i) {
+                    float x = in[i];
+                    float y = flushDenormal(c0 * x + c1 * xm1 - c2 * ym1);
+                    xm1 = x;
+                    ym1 = y;
+                    out[i] = y;
+                }
+                x1 = xm1;
+                y1 = ym1;
+#endif
+            }
+
+            // Reset the filter state (e.g., on initialization or when switching presets).
+            void reset() {
+                x1 = 0.0f;
+                y1 = 0.0f;
+            }
+
+        private:
+            float b0, b1, a1;
+            float x1, y1;
+        };
+
+    } // namespace multistage
+} // namespace project
@@ -0,0 +1,101 @@
+#pragma once
+#include <array>
+#include <utility>
+#include "ReverbCommon.h"
+
+namespace project {
+    namespace multistage {
+
+        // Compile-time routing schedule built from Config::connections.
+        //
+        // For every destination node we precompute the list of connection indices
+        // that feed it, in declaration order. Connections with a zero base weight
+        // (they stay zero whatever the feedback parameter does) and connections
+        // into the input node (node 0 is overwritten with the input every sample)
+        // are dropped. gather<Dst>() then expands to straight-line multiply-adds:
+        //     sum = 0; sum += state[src_k] * weights[conn_k]; ...
+        // with no loop over the connection list and no branches.
+        template <typename Config>
+        struct RoutingSchedule
+        {
+            static constexpr size_t NumNodes = Config::NumNodes;
+            static constexpr size_t NumConnections = Config::connections.size();
+            static constexpr size_t OutputNode = NumNodes - 1;
+
+            static constexpr bool isValid(size_t i)
+            {
+                return Config::connections[i].src < NumNodes && Config::connections[i].dst < NumNodes;
+            }
+
+            static constexpr bool allConnectionsValid()
+            {
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    if (!isValid(i))
+                        return false;
+                }
+                return true;
+            }
+
+            static_assert(allConnectionsValid(), "Config::connections refers to a node index >= NumNodes");
+
+            // True if connection i contributes to the output at all.
+            static constexpr bool isLive(size_t i)
+            {
+                return Config::connections[i].baseWeight != 0.f && Config::connections[i].dst != 0;
+            }
+
+            static constexpr size_t numInputs(size_t dst)
+            {
+                size_t count = 0;
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    if (isLive(i) && Config::connections[i].dst == dst)
+                        ++count;
+                }
+                return count;
+            }
+
+            template <size_t Dst>
+            static constexpr auto makeInputList()
+            {
+                std::array<size_t, numInputs(Dst)> list{};
+                size_t k = 0;
+                for (size_t i = 0; i < NumConnections; ++i)
+                {
+                    if (isLive(i) && Config::connections[i].dst == Dst)
+                        list[k++] = i;
+                }
+                return list;
+            }
+
+            // Connection index of the K-th live input of node Dst.
+            template <size_t Dst, size_t K>
+            static constexpr size_t inputConnection = makeInputList<Dst>()[K];
+
+            // Source node of the K-th live input of node Dst.
+            template <size_t Dst, size_t K>
+            static constexpr size_t inputSource = Config::connections[inputConnection<Dst, K>].src;
+
+            // Weighted sum of all live inputs of node Dst.
+            // State and Weights are anything indexable (std::array, raw pointers...).
+            template <size_t Dst, typename State, typename Weights>
+            static JUCE_FORCEINLINE float gather(const State& state, const Weights& weights)
+            {
+                return gatherImpl<Dst>(state, weights, std::make_index_sequence<numInputs(Dst)>{});
+            }
+
+        private:
+            template <size_t Dst, typename State, typename Weights, size_t... Ks>
+            static JUCE_FORCEINLINE float gatherImpl(const State& state, const Weights& weights, std::index_sequence<Ks...>)
+            {
+                (void)state;
+                (void)weights;
+                float sum = 0.f;
+                ((sum += state[inputSource<Dst, Ks>] * weights[inputConnection<Dst, Ks>]), ...);
+                return sum;
+            }
+        };
+
+    } // namespace multistage
+} // namespace project
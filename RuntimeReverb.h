@@ -0,0 +1,728 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ReverbCommon.h"
+#include "ReverbSvf.h"
+#include "LfoBank.h"
+#include "DelayArena.h"
+#include "TopologyPreset.h"
+
+namespace project {
+    namespace multistage {
+
+        //==============================================================
+        // RuntimeReverb: MultiStageReverb for a topology loaded at runtime
+        // (TopologyPreset.h) instead of compiled in from a Config.
+        //
+        // load() allocates, so it belongs on the message thread, and it rebuilds
+        // the arrays processBlock() reads: call it only while this instance is
+        // not processing. To change the topology of a reverb that is playing,
+        // load through HotSwapReverb, which fills an idle engine and crossfades
+        // to it.
+        //
+        // load() validates the topology, repeats GraphAnalysis at runtime (dead
+        // stages, self loops, cycles, pass-through links, the stage-major plan)
+        // and compiles the result into a flat schedule:
+        //   - AP state in packed per-field arrays, each stage's APs contiguous,
+        //     the same split as StageReverb's hot arrays,
+        //   - per-destination source lists as one array of (source, connection)
+        //     pairs with an offset per node, in declaration order,
+        //   - one contiguous block of node sample buffers,
+        //   - a list of steps (Block / SelfLoop / Interleaved) over stage indices.
+        // processBlock() walks the steps with plain loops: no virtual calls, no
+        // allocation. It follows MultiStageReverb::processBlock sample for sample
+        // (same kernels, same summation order), so a topology exported from a
+        // Config with topologyFromConfig() renders the same output.
+        //
+        // Parameters (size, feedback, density, shelf) survive load(), so a
+        // preset change keeps the user's settings. load() keeps the delay arena
+        // and tables of earlier loads when they are big enough, so reloading
+        // an instance does not reallocate its delay memory (see HotSwapReverb).
+        //==============================================================
+        template <typename Storage = FloatDelayStorage, typename Interp = LinearInterpolation>
+        class RuntimeReverb {
+        public:
+            using Sample = typename Storage::Sample;
+
+            // LFO lanes of the bank; presets may use up to this many LFOs.
+            static constexpr size_t maxLfos = 8;
+
+            // Longest AP delay a topology may ask for. A scaleDelay stage
+            // stretches it to 4 s at maxGlobalSize, a 4 MB line at the
+            // highest rate; much longer delays would overflow the int sample
+            // counts in delayBufferSize().
+            static constexpr float maxDelayMs = 2000.f;
+
+            // Message thread, with processBlock() stopped (see above). False (and
+            // `error`) if the topology cannot run; the previously loaded one is
+            // kept in that case.
+            bool load(const Topology& topology, std::string& error)
+            {
+                if (!validate(topology, error))
+                    return false;
+
+                const size_t numStages = topology.stages.size();
+                numNodes = numStages + 2;
+                numLfos = topology.lfos.size();
+                lfoDefs = topology.lfos;
+
+                buildStages(topology);
+                buildRouting(topology);
+                buildPlan();
+
+                blockStride = (static_cast<size_t>(maxBlockSize) + 1 + delayLineAlignment - 1) / delayLineAlignment * delayLineAlignment;
+                nodeBlocks.assign(numNodes * blockStride, 0.f);
+                nodeState.assign(numNodes, 0.f);
+                stageInputs.assign(numStages, 0.f);
+
+                loaded = true;
+                prepare(currentSampleRate);
+                updateFeedbackParameter(feedback);
+                updateGlobalSizeParameter(globalSize);
+                updateGlobalDensityParameter(density);
+                if (svfSet)
+                    updateGlobalSVFParameters(svfCutoff, svfGain);
+                return true;
+            }
+
+            bool isLoaded() const { return loaded; }
+
+            void prepare(float sampleRate)
+            {
+                currentSampleRate = sampleRate;
+                if (!loaded)
+                    return;
+#if GRIFFIN_RUNTIME_DISPATCH
+                dispatch::select();
+#endif
+
+                const float delayRate = std::min(sampleRate, maxSupportedSampleRate);
+                for (size_t i = 0; i < maxLfos; ++i)
+                {
+                    const bool used = i < numLfos;
+                    const float amp = used ? msToSamples(lfoDefs[i].depthMs, delayRate) : 0.f;
+                    lfos.setLfo(i, used ? lfoDefs[i].frequency : 0.f, amp);
+                    lfoDepths[i] = std::fabs(amp);
+                    lfoBlockPtrs[i] = lfoBlocks[i].data();
+                    lfoWritePtrs[i] = lfoBlocks[i].data();
+                }
+                lfos.prepare(sampleRate);
+
+                for (auto& stage : stages)
+                {
+                    if (stage.enableSVF)
+                        stage.shelf.setParameters(stage.svfCutoff, stage.svfGain, sampleRate);
+                    if (stage.attachSVF && svfSet)
+                        stage.shelf.setParameters(svfCutoff, svfGain, sampleRate);
+                }
+                for (size_t a = 0; a < apLfo.size(); ++a)
+                {
+                    apBaseDelay[a] = msToSamples(apDelayMs[a], delayRate);
+                    apDelay[a] = apBaseDelay[a] * apDelayScale[a];
+                    apMask[a] = delayBufferSize(apDelayMs[a], apScalesDelay[a] != 0, sampleRate) - 1;
+                    apModDepth[a] = (apLfo[a] == noLfo) ? 0.f : lfoDepths[apLfo[a]];
+                }
+                reset();
+            }
+
+            void reset()
+            {
+                if (!loaded)
+                    return;
+                lfos.reset();
+                for (auto& stage : stages)
+                {
+                    stage.shelf.reset();
+                    stage.dither = 1;
+                }
+                for (size_t a = 0; a < apLfo.size(); ++a)
+                {
+                    std::fill(apBuffer[a], apBuffer[a] + apMask[a] + 1, Sample(0));
+                    apWriteIndex[a] = 0;
+                    apInterp[a] = {};
+                }
+                std::fill(nodeState.begin(), nodeState.end(), 0.f);
+            }
+
+            // Same contract as MultiStageReverb::processBlock.
+            void processBlock(const float* input, float* output, int numSamples)
+            {
+                const ScopedNoDenormals noDenormals(denormalGuard);
+                if (!loaded)
+                {
+                    std::fill(output, output + numSamples, 0.f);
+                    return;
+                }
+                while (numSamples > 0)
+                {
+                    const int n = std::min(numSamples, maxBlockSize);
+                    lfos.processBlock(lfoWritePtrs.data(), n, numLfos);
+
+                    if (outputFeedsBack)
+                        processChunkInterleaved(input, output, n);
+                    else
+                        processChunkStageMajor(input, output, n);
+
+                    for (size_t i = 0; i < numLfos; ++i)
+                        lfoValues[i] = lfoBlocks[i][n - 1];
+
+                    input += n;
+                    output += n;
+                    numSamples -= n;
+                }
+            }
+
+            void setDenormalGuard(bool enabled) { denormalGuard = enabled; }
+            void setLfoControlRate(int decimation) { lfos.setControlRateDecimation(decimation); }
+
+            void updateFeedbackParameter(float feedbackParam)
+            {
+                feedback = feedbackParam;
+                for (size_t i = 0; i < connections.size(); ++i)
+                    effectiveWeights[i] = connections[i].baseWeight * (connections[i].scaleFeedback ? feedback : 1.f);
+            }
+
+            void updateGlobalSizeParameter(float newSize)
+            {
+                globalSize = newSize;
+                for (size_t a = 0; a < apLfo.size(); ++a)
+                {
+                    if (apScalesDelay[a])
+                    {
+                        apDelayScale[a] = globalSize;
+                        apDelay[a] = apBaseDelay[a] * globalSize;
+                    }
+                }
+            }
+
+            void updateGlobalDensityParameter(float newDensity)
+            {
+                density = newDensity;
+                for (size_t a = 0; a < apLfo.size(); ++a)
+                {
+                    if (apScalesCoeff[a])
+                        apCoeff[a] = apBaseCoeff[a] * density;
+                }
+            }
+
+            void updateGlobalSVFParameters(float cutoff, float dbGain)
+            {
+                svfCutoff = cutoff;
+                svfGain = dbGain;
+                svfSet = true;
+                for (auto& stage : stages)
+                {
+                    if (stage.enableSVF && stage.attachSVF)
+                        stage.shelf.setParameters(cutoff, dbGain, currentSampleRate);
+                }
+            }
+
+            size_t getNumStages() const { return stages.size(); }
+            size_t getNumSteps() const { return steps.size(); }
+            size_t getDelayMemorySize() const { return delayMemoryFloats; }
+
+            // The LFO outputs of the last block, for a stereoizer following this
+            // engine (as MultiStageReverb::globalLfoBlockPtrs etc.).
+            const float* getGlobalLfoValues() const { return lfoValues.data(); }
+            const float* const* getGlobalLfoBlockPointers() const { return lfoBlockPtrs.data(); }
+            const float* getGlobalLfoDepths() const { return lfoDepths.data(); }
+
+        private:
+            enum class StepKind { Block, SelfLoop, Interleaved };
+
+            struct Step {
+                StepKind kind;
+                uint32_t begin;     // First entry in order.
+                uint32_t count;
+            };
+
+            struct Stage {
+                uint32_t apBegin = 0;
+                uint32_t apEnd = 0;
+                bool enableSVF = false;
+                bool attachSVF = false;
+                float svfCutoff = 0.f;
+                float svfGain = 0.f;
+                std::uint32_t dither = 1;
+                LexiconShelvingFilter shelf;
+            };
+
+            struct Input {
+                uint32_t source;
+                uint32_t connection;
+            };
+
+            bool loaded = false;
+            bool denormalGuard = true;
+            float currentSampleRate = 44100.f;
+            size_t numNodes = 0;
+            size_t numLfos = 0;
+
+            // User parameters, kept across load().
+            float feedback = 1.f;
+            float globalSize = 1.f;
+            float density = 1.f;
+            float svfCutoff = 0.f;
+            float svfGain = 0.f;
+            bool svfSet = false;
+
+            // LFOs.
+            std::vector<TopologyLfo> lfoDefs;
+            LfoBank<maxLfos> lfos;
+            std::array<float, maxLfos> lfoValues{};
+            std::array<float, maxLfos> lfoDepths{};
+            std::array<std::array<float, maxBlockSize>, maxLfos> lfoBlocks{};
+            std::array<const float*, maxLfos> lfoBlockPtrs{};
+            std::array<float*, maxLfos> lfoWritePtrs{};
+
+            // Stages and their APs (hot fields first, then cold).
+            std::vector<Stage> stages;
+            std::vector<Sample*> apBuffer;
+            std::vector<int> apWriteIndex;
+            std::vector<int> apMask;
+            std::vector<float> apDelay;
+            std::vector<float> apCoeff;
+            std::vector<size_t> apLfo;
+            std::vector<float> apModDepth;
+            std::vector<typename Interp::State> apInterp;
+            std::vector<float> apDelayMs;
+            std::vector<float> apBaseDelay;
+            std::vector<float> apDelayScale;
+            std::vector<float> apBaseCoeff;
+            std::vector<char> apScalesDelay;
+            std::vector<char> apScalesCoeff;
+            NoInterpolation::State integerReadState;
+            DelayArena delayArena;                  // Grows, never shrinks: see load().
+            size_t delayMemoryFloats = 0;
+
+            // Routing.
+            std::vector<Connection> connections;
+            std::vector<float> effectiveWeights;
+            std::vector<uint32_t> inputOffsets;     // numNodes + 1 entries.
+            std::vector<Input> inputs;
+
+            // Plan.
+            std::vector<uint32_t> order;            // Stage nodes, 1-based like the graph.
+            std::vector<Step> steps;
+            std::vector<int> passThroughSource;     // Per node, -1 if not pass-through.
+            std::vector<char> dead;
+            bool outputFeedsBack = false;
+
+            // Node buffers: slot 0 the value before the chunk, slots 1..n the chunk.
+            size_t blockStride = 0;
+            std::vector<float> nodeBlocks;
+            std::vector<float> nodeState;
+            std::vector<float> stageInputs;
+
+            //----------------------------------------------------------
+            // load()
+
+            // Malformed values - non-finite numbers, delays that would hang or
+            // exhaust memory sizing their lines, unstable AP coefficients, bad
+            // indices - are rejected here, before buildStages() sizes a single
+            // delay line. The graph's stability is not checked: a loop whose gain
+            // reaches 1, such as `connect 1 1 2`, is well formed and grows
+            // without bound.
+            bool validate(const Topology& t, std::string& error) const
+            {
+                auto fail = [&](const std::string& message) {
+                    error = message;
+                    return false;
+                };
+                if (t.stages.empty())
+                    return fail("the topology has no stages");
+                if (t.lfos.size() > maxLfos)
+                    return fail("more than " + std::to_string(maxLfos) + " LFOs");
+                for (const auto& lfo : t.lfos)
+                {
+                    if (!std::isfinite(lfo.frequency) || lfo.frequency < 0.f)
+                        return fail("an LFO frequency must be finite and not negative");
+                    if (!std::isfinite(lfo.depthMs) || std::fabs(lfo.depthMs) > delayHeadroomMs)
+                        return fail("an LFO depth exceeds delayHeadroomMs");
+                }
+                for (size_t s = 0; s < t.stages.size(); ++s)
+                {
+                    const auto& stage = t.stages[s];
+                    const std::string where = "stage " + std::to_string(s + 1) + ": ";
+                    if (!std::isfinite(stage.svfCutoff) || !std::isfinite(stage.svfGain))
+                        return fail(where + "shelf cutoff and gain must be finite");
+                    for (const auto& ap : stage.aps)
+                    {
+                        if (!(ap.delayMs > 0.f && ap.delayMs <= maxDelayMs))
+                            return fail(where + "AP delay must be in (0, " + std::to_string(static_cast<int>(maxDelayMs)) + "] ms");
+                        // A scaleCoeff stage may use +-1: the density parameter
+                        // scales it down (MyReverbConfig's first stage does).
+                        const bool coefficientOk = stage.scaleCoeff ? std::fabs(ap.coefficient) <= 1.f : std::fabs(ap.coefficient) < 1.f;
+                        if (!coefficientOk)
+                            return fail(where + "AP coefficient must be in (-1, 1), or [-1, 1] with scaleCoeff");
+                        if (ap.lfoIndex != noLfo && ap.lfoIndex >= t.lfos.size())
+                            return fail(where + "AP uses an undefined LFO");
+                    }
+                }
+                for (const auto& c : t.connections)
+                {
+                    if (c.src >= t.getNumNodes() || c.dst >= t.getNumNodes())
+                        return fail("a connection refers to a node index >= " + std::to_string(t.getNumNodes()));
+                    if (!std::isfinite(c.baseWeight))
+                        return fail("a connection weight is not finite");
+                }
+                return true;
+            }
+
+            void buildStages(const Topology& t)
+            {
+                size_t numAPs = 0;
+                size_t floats = 0;
+                for (const auto& stage : t.stages)
+                {
+                    numAPs += stage.aps.size();
+                    for (const auto& ap : stage.aps)
+                        floats += delayArenaFloats<Storage>(ap.delayMs, stage.scaleDelay);
+                }
+
+                stages.assign(t.stages.size(), Stage{});
+                apBuffer.assign(numAPs, nullptr);
+                apWriteIndex.assign(numAPs, 0);
+                apMask.assign(numAPs, 0);
+                apDelay.assign(numAPs, 0.f);
+                apCoeff.assign(numAPs, 0.f);
+                apLfo.assign(numAPs, noLfo);
+                apModDepth.assign(numAPs, 0.f);
+                apInterp.assign(numAPs, typename Interp::State{});
+                apDelayMs.assign(numAPs, 0.f);
+                apBaseDelay.assign(numAPs, 0.f);
+                apDelayScale.assign(numAPs, 1.f);
+                apBaseCoeff.assign(numAPs, 0.f);
+                apScalesDelay.assign(numAPs, 0);
+                apScalesCoeff.assign(numAPs, 0);
+                if (delayArena.getSize() < floats)
+                    delayArena.allocate(floats);
+                delayMemoryFloats = floats;
+
+                float* memory = delayArena.data();
+                size_t a = 0;
+                for (size_t s = 0; s < t.stages.size(); ++s)
+                {
+                    const auto& def = t.stages[s];
+                    auto& stage = stages[s];
+                    stage.apBegin = static_cast<uint32_t>(a);
+                    stage.enableSVF = def.enableSVF;
+                    stage.attachSVF = def.attachSVF;
+                    stage.svfCutoff = def.svfCutoff;
+                    stage.svfGain = def.svfGain;
+                    for (const auto& ap : def.aps)
+                    {
+                        apBuffer[a] = reinterpret_cast<Sample*>(memory);
+                        memory += delayArenaFloats<Storage>(ap.delayMs, def.scaleDelay);
+                        apMask[a] = delayBufferSize(ap.delayMs, def.scaleDelay) - 1;
+                        apLfo[a] = ap.lfoIndex;
+                        apDelayMs[a] = ap.delayMs;
+                        apBaseCoeff[a] = ap.coefficient;
+                        apCoeff[a] = ap.coefficient;
+                        apScalesDelay[a] = def.scaleDelay ? 1 : 0;
+                        apScalesCoeff[a] = def.scaleCoeff ? 1 : 0;
+                        ++a;
+                    }
+                    stage.apEnd = static_cast<uint32_t>(a);
+                }
+            }
+
+            // RoutingSchedule::isLive.
+            static bool isLive(const Connection& c) { return c.baseWeight != 0.f && c.dst != 0; }
+
+            void buildRouting(const Topology& t)
+            {
+                connections = t.connections;
+                effectiveWeights.assign(connections.size(), 0.f);
+                inputOffsets.assign(numNodes + 1, 0);
+                inputs.clear();
+                for (size_t dst = 0; dst < numNodes; ++dst)
+                {
+                    inputOffsets[dst] = static_cast<uint32_t>(inputs.size());
+                    for (size_t i = 0; i < connections.size(); ++i)
+                    {
+                        if (isLive(connections[i]) && connections[i].dst == dst)
+                            inputs.push_back({ static_cast<uint32_t>(connections[i].src), static_cast<uint32_t>(i) });
+                    }
+                }
+                inputOffsets[numNodes] = static_cast<uint32_t>(inputs.size());
+            }
+
+            // GraphAnalysis::buildPlan, on vectors.
+            void buildPlan()
+            {
+                const size_t numStages = stages.size();
+                const size_t outputNode = numNodes - 1;
+                std::vector<char> reach(numNodes * numNodes, 0);
+                auto r = [&](size_t a, size_t b) -> char& { return reach[a * numNodes + b]; };
+                for (const auto& c : connections)
+                {
+                    if (isLive(c))
+                        r(c.src, c.dst) = 1;
+                }
+                for (size_t k = 0; k < numNodes; ++k)
+                    for (size_t a = 0; a < numNodes; ++a)
+                        if (r(a, k))
+                            for (size_t b = 0; b < numNodes; ++b)
+                                if (r(k, b))
+                                    r(a, b) = 1;
+
+                auto isStage = [&](size_t n) { return n >= 1 && n <= numStages; };
+                auto sameCycle = [&](size_t a, size_t b) { return a == b || (r(a, b) && r(b, a)); };
+                auto numInputs = [&](size_t n) { return inputOffsets[n + 1] - inputOffsets[n]; };
+                auto numLiveOutputs = [&](size_t n) {
+                    size_t count = 0;
+                    for (const auto& c : connections)
+                        count += (isLive(c) && c.src == n) ? 1 : 0;
+                    return count;
+                };
+
+                dead.assign(numNodes, 0);
+                for (size_t n = 1; n <= numStages; ++n)
+                    dead[n] = r(n, outputNode) ? 0 : 1;
+
+                outputFeedsBack = numLiveOutputs(outputNode) > 0;
+
+                passThroughSource.assign(numNodes, -1);
+                for (size_t n = 1; n <= numStages; ++n)
+                {
+                    if (numInputs(n) != 1)
+                        continue;
+                    const auto& c = connections[inputs[inputOffsets[n]].connection];
+                    if (c.baseWeight == 1.f && !c.scaleFeedback && c.src != n)
+                        passThroughSource[n] = static_cast<int>(c.src);
+                }
+
+                auto hasSelfLoop = [&](size_t n) {
+                    for (const auto& c : connections)
+                    {
+                        if (isLive(c) && c.src == n && c.dst == n)
+                            return true;
+                    }
+                    return false;
+                };
+                auto isInterleaved = [&](size_t n) {
+                    for (size_t m = 1; m <= numStages; ++m)
+                    {
+                        if (m != n && sameCycle(n, m))
+                            return true;
+                    }
+                    return false;
+                };
+                auto isFusableChainLink = [&](size_t n) {
+                    if (passThroughSource[n] < 0 || r(n, n))
+                        return false;
+                    const size_t src = static_cast<size_t>(passThroughSource[n]);
+                    return isStage(src) && !r(src, src) && numLiveOutputs(src) == 1;
+                };
+
+                std::vector<char> done(numNodes, 0);
+                done[0] = 1;
+                for (size_t n = 1; n <= numStages; ++n)
+                    done[n] = dead[n];
+
+                auto isReady = [&](size_t n) {
+                    for (size_t m = 1; m <= numStages; ++m)
+                    {
+                        if (sameCycle(n, m) || done[m])
+                            continue;
+                        for (const auto& c : connections)
+                        {
+                            if (isLive(c) && c.src == m && sameCycle(n, c.dst))
+                                return false;
+                        }
+                    }
+                    return true;
+                };
+
+                order.clear();
+                steps.clear();
+                size_t lastScheduled = 0;
+                for (size_t pass = 0; pass < numStages; ++pass)
+                {
+                    size_t pick = 0;
+                    for (size_t n = 1; n <= numStages && pick == 0; ++n)
+                    {
+                        if (!done[n] && isReady(n) && isFusableChainLink(n) && static_cast<size_t>(passThroughSource[n]) == lastScheduled)
+                            pick = n;
+                    }
+                    for (size_t n = 1; n <= numStages && pick == 0; ++n)
+                    {
+                        if (!done[n] && isReady(n))
+                            pick = n;
+                    }
+                    if (pick == 0)
+                        break;
+
+                    Step step{ StepKind::Block, static_cast<uint32_t>(order.size()), 0 };
+                    if (isInterleaved(pick))
+                    {
+                        step.kind = StepKind::Interleaved;
+                        for (size_t m = 1; m <= numStages; ++m)
+                        {
+                            if (sameCycle(pick, m))
+                            {
+                                order.push_back(static_cast<uint32_t>(m));
+                                done[m] = 1;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        step.kind = hasSelfLoop(pick) ? StepKind::SelfLoop : StepKind::Block;
+                        order.push_back(static_cast<uint32_t>(pick));
+                        done[pick] = 1;
+                    }
+                    step.count = static_cast<uint32_t>(order.size()) - step.begin;
+                    steps.push_back(step);
+                    lastScheduled = pick;
+                }
+            }
+
+            //----------------------------------------------------------
+            // Processing
+
+            float* block(size_t node) { return nodeBlocks.data() + node * blockStride; }
+
+            // Weighted sum of node's live inputs at one slot of the node blocks.
+            JUCE_FORCEINLINE float gather(size_t node, int slot) const
+            {
+                const float* blocks = nodeBlocks.data() + slot;
+                float sum = 0.f;
+                for (uint32_t k = inputOffsets[node]; k < inputOffsets[node + 1]; ++k)
+                    sum += blocks[inputs[k].source * blockStride] * effectiveWeights[inputs[k].connection];
+                return sum;
+            }
+
+            // The same from a per-node state array.
+            JUCE_FORCEINLINE float gatherState(size_t node, const float* state) const
+            {
+                float sum = 0.f;
+                for (uint32_t k = inputOffsets[node]; k < inputOffsets[node + 1]; ++k)
+                    sum += state[inputs[k].source] * effectiveWeights[inputs[k].connection];
+                return sum;
+            }
+
+            // StageReverb::processSampleInBlock.
+            JUCE_FORCEINLINE float processStageSample(Stage& stage, float x, int blockIndex)
+            {
+                if (stage.enableSVF)
+                    x = stage.shelf.processSample(x);
+                for (uint32_t a = stage.apBegin; a < stage.apEnd; ++a)
+                {
+                    const size_t lfo = apLfo[a];
+                    if (lfo == noLfo || apModDepth[a] == 0.f)
+                        x = allpassSample<Storage, NoInterpolation>(apBuffer[a], apMask[a], apWriteIndex[a], apDelay[a], apCoeff[a],
+                            x, 0.f, stage.dither, integerReadState);
+                    else
+                        x = allpassSample<Storage, Interp>(apBuffer[a], apMask[a], apWriteIndex[a], apDelay[a], apCoeff[a],
+                            x, lfoBlocks[lfo][blockIndex], stage.dither, apInterp[a]);
+                }
+                return x;
+            }
+
+            // StageReverb::processBlock.
+            void processStageBlock(Stage& stage, const float* in, float* out, int n)
+            {
+                if (stage.enableSVF)
+                    stage.shelf.processBlock(in, out, n);
+                else if (in != out)
+                    std::copy(in, in + n, out);
+                for (uint32_t a = stage.apBegin; a < stage.apEnd; ++a)
+                {
+                    const size_t lfo = apLfo[a];
+                    if (lfo == noLfo || apModDepth[a] == 0.f)
+                        allpassBlock<Storage, NoInterpolation>(apBuffer[a], apMask[a], apWriteIndex[a], apDelay[a], apCoeff[a],
+                            0.f, out, out, nullptr, n, stage.dither, integerReadState);
+                    else
+                        allpassBlock<Storage, Interp>(apBuffer[a], apMask[a], apWriteIndex[a], apDelay[a], apCoeff[a],
+                            apModDepth[a], out, out, lfoBlockPtrs[lfo], n, stage.dither, apInterp[a]);
+                }
+            }
+
+            void processChunkStageMajor(const float* input, float* output, int n)
+            {
+                for (size_t node = 0; node < numNodes; ++node)
+                    block(node)[0] = nodeState[node];
+                std::copy(input, input + n, block(0) + 1);
+
+                for (const auto& step : steps)
+                {
+                    if (step.kind == StepKind::Interleaved)
+                    {
+                        const uint32_t* members = order.data() + step.begin;
+                        for (int s = 0; s < n; ++s)
+                        {
+                            for (uint32_t k = 0; k < step.count; ++k)
+                                stageInputs[k] = gather(members[k], s);
+                            for (uint32_t k = 0; k < step.count; ++k)
+                                block(members[k])[s + 1] = processStageSample(stages[members[k] - 1], stageInputs[k], s);
+                        }
+                        continue;
+                    }
+
+                    const size_t node = order[step.begin];
+                    Stage& stage = stages[node - 1];
+                    float* out = block(node) + 1;
+                    if (step.kind == StepKind::SelfLoop)
+                    {
+                        for (int s = 0; s < n; ++s)
+                            out[s] = processStageSample(stage, gather(node, s), s);
+                    }
+                    else if (passThroughSource[node] >= 0)
+                    {
+                        processStageBlock(stage, block(static_cast<size_t>(passThroughSource[node])), out, n);
+                    }
+                    else
+                    {
+                        for (int s = 0; s < n; ++s)
+                            out[s] = gather(node, s);
+                        processStageBlock(stage, out, out, n);
+                    }
+                }
+
+                // The output node sums the current sample of its sources.
+                const size_t outputNode = numNodes - 1;
+                for (int s = 0; s < n; ++s)
+                    output[s] = gather(outputNode, s + 1);
+
+                for (size_t node = 0; node < outputNode; ++node)
+                {
+                    if (!dead[node])
+                        nodeState[node] = block(node)[n];
+                }
+                nodeState[outputNode] = output[n - 1];
+            }
+
+            // MultiStageReverb::processChunkInterleaved: the output feeds back, so
+            // the whole graph advances one sample at a time.
+            void processChunkInterleaved(const float* input, float* output, int n)
+            {
+                const size_t numStages = stages.size();
+                const size_t outputNode = numNodes - 1;
+                float* state = nodeState.data();
+                for (int s = 0; s < n; ++s)
+                {
+                    for (size_t i = 0; i < numLfos; ++i)
+                        lfoValues[i] = lfoBlocks[i][s];
+
+                    for (size_t k = 0; k < numStages; ++k)
+                        stageInputs[k] = gatherState(k + 1, state);
+
+                    state[0] = input[s];
+                    for (size_t k = 0; k < numStages; ++k)
+                        state[k + 1] = processStageSample(stages[k], stageInputs[k], s);
+
+                    const float sum = gatherState(outputNode, state);
+                    state[outputNode] = sum;
+                    output[s] = sum;
+                }
+            }
+        };
+
+    } // namespace multistage
+} // namespace project
@@ -0,0 +1,645 @@
+#pragma once
+#include "ReverbCommon.h"
+#include "ReverbSvf.h"
+#include "TailTracker.h"
+#include "StageReverb.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <type_traits>
+
+namespace project {
+    namespace multistage {
+
+        // Feedback matrix of an FDN stage.
+        //   Hadamard      Sylvester Hadamard, normalised; applied as a fast
+        //                 Walsh-Hadamard transform, N log2 N adds.
+        //   Householder   I - (2/N) 1 1^T: one sum and N subtractions.
+        //   General       StageConfig::matrixCoefficients, N x N row-major.
+        //                 Should be orthogonal (or at least not amplify) for
+        //                 the decay time to mean anything.
+        enum class FdnMatrix { Hadamard, Householder, General };
+
+        // Offset of line `index` inside the stage's slice of the arena, in floats
+        // (index == number of lines gives the whole slice). Each line starts one
+        // cache line further into its 4 KB page than the one before: the rings
+        // are powers of two and all write at the same index, so unstaggered
+        // they would all land in the same cache sets.
+        template <typename StageConfig, typename Storage>
+        constexpr size_t fdnLineArenaOffset(size_t index)
+        {
+            size_t offset = 0;
+            for (size_t j = 0; j < index; ++j)
+                offset += delayArenaFloats<Storage>(StageConfig::lines[j].delayMs, StageConfig::scaleDelay) + delayLineAlignment;
+            return offset;
+        }
+
+        // A feedback delay network stage, used in a StageTuple like a StageReverb
+        // by declaring `using StageKind = FdnStageKind;` in its StageConfig:
+        //
+        //   struct MyFdn {
+        //       using StageKind = FdnStageKind;
+        //       static constexpr FdnMatrix matrix = FdnMatrix::Hadamard;
+        //       static constexpr float decaySeconds = 2.f;   // RT60 at size 1, density 1
+        //       static constexpr bool scaleDelay = true;     // Global size scales the lines
+        //       static constexpr bool scaleCoeff = true;     // Global density scales decaySeconds
+        //       static constexpr bool enableSVF = false;     // Shelf on the input, as in StageReverb
+        //       static constexpr float svfCutoff = 0.f;
+        //       static constexpr float svfGain = 0.f;
+        //       static constexpr bool attachSVF = false;
+        //       struct Line { float delayMs; float damping; size_t lfoIndex; };
+        //       inline static constexpr auto lines = ms_make_array(Line{ 29.7f, 0.2f, noLfo }, ...);
+        //   };
+        //
+        // 4, 8 or 16 lines. Each pass a line's output is damped, scaled by the
+        // line's loop gain, mixed with the others through the matrix and written
+        // back with the input added. The loop gain follows the line's nominal
+        // delay, 10^(-3 delayMs / (1000 decaySeconds)), so every line decays at
+        // the same rate, and a larger size gives a longer decay as it does for
+        // the allpass stages. damping (0 to 0.5) is a two-tap lowpass on the
+        // line's output, (1 - damping) x[n] + damping x[n-1]: flat at DC, a
+        // gain of 1 - 2 damping at Nyquist on each pass. Lines with an lfoIndex
+        // are modulated like the APs of a StageReverb and read through Interp;
+        // the others read whole samples.
+        //
+        // processBlock works on vectors of W samples (simd::FloatVec::width): one
+        // register per line, the samples across its lanes, so the matrix is a
+        // handful of whole-register adds (the Hadamard butterflies need no
+        // shuffles) and each line is read and written W samples at a time. That
+        // needs every line to be at least W samples long; the per-sample path
+        // covers the rest and gives the same output (bit for bit unless the
+        // compiler contracts the two paths into FMAs differently). Unmodulated
+        // lines read two plain windows of their ring, with no gather.
+        //
+        // Cost: 8 lines run for less than a six-AP StageReverb, 16 do not. On
+        // AVX2 (bench_fdn, 64-sample blocks, both timed with the 3-LFO bank that
+        // feeds them) a 16-line Hadamard FDN takes about 1.3x the cycles of
+        // MyReverbConfig's six-AP stage, 1.5x with every fourth line modulated.
+        // Per line it is already cheaper than an AP; what is left is the work
+        // every line must do per sample (two reads, the damping tap, log2 N
+        // butterflies, the input and output taps, a write), 16 times over.
+        template <typename StageConfig, typename Storage = FloatDelayStorage, typename Interp = LinearInterpolation>
+        class FdnStage
+        {
+        public:
+            static constexpr size_t numLines = std::tuple_size<decltype(StageConfig::lines)>::value;
+            static_assert(numLines == 4 || numLines == 8 || numLines == 16, "an FDN stage has 4, 8 or 16 lines");
+            static constexpr FdnMatrix matrix = StageConfig::matrix;
+            using Sample = typename Storage::Sample;
+
+            FdnStage() {
+                for (size_t i = 0; i < numLines; ++i) {
+                    cold.baseDelay[i] = msToSamples(StageConfig::lines[i].delayMs, currentSampleRate);
+                    hot.delay[i] = cold.baseDelay[i];
+                }
+                cold.modDepth.fill(unknownModDepth);
+                cold.delayTrim.fill(1.f);
+                cold.matrixGain = matrixNorm();
+                setMasksToCapacity(std::make_index_sequence<numLines>{});
+                updateGains();
+                globalLfoPtr = nullptr;
+                globalLfoBlockPtrs = nullptr;
+            }
+
+            // Converts the delays to samples at this rate and clears the lines.
+            void prepare(float sampleRate) {
+                currentSampleRate = sampleRate;
+                if constexpr (StageConfig::enableSVF) {
+                    svfFilter.setParameters(StageConfig::svfCutoff, StageConfig::svfGain, sampleRate);
+                }
+                const float delayRate = std::min(sampleRate, maxSupportedSampleRate);
+                int longestMask = 0;
+                for (size_t i = 0; i < numLines; ++i) {
+                    cold.baseDelay[i] = msToSamples(StageConfig::lines[i].delayMs, delayRate);
+                    hot.delay[i] = cold.baseDelay[i] * cold.delayScale * cold.delayTrim[i];
+                    hot.mask[i] = delayBufferSize(StageConfig::lines[i].delayMs, StageConfig::scaleDelay, sampleRate) - 1;
+                    longestMask = std::max(longestMask, hot.mask[i]);
+                }
+                hot.writeMask = longestMask;
+                resetLines();
+            }
+
+            void reset() {
+                if constexpr (StageConfig::enableSVF) {
+                    svfFilter.reset();
+                }
+                resetLines();
+            }
+
+            // Total delay memory of all lines, in floats, known at compile time.
+            static constexpr size_t DelayMemorySize = fdnLineArenaOffset<StageConfig, Storage>(numLines);
+
+            static constexpr size_t getDelayMemorySize() {
+                return DelayMemorySize;
+            }
+
+            // Points every line at its slice of memory (getDelayMemorySize() floats
+            // from `memory`), clears it, and returns the first float past this stage's slices.
+            float* attachDelayMemory(float* memory) {
+                for (size_t i = 0; i < numLines; ++i) {
+                    hot.buffer[i] = reinterpret_cast<Sample*>(memory + fdnLineArenaOffset<StageConfig, Storage>(i));
+                }
+                resetLines();
+                return memory + DelayMemorySize;
+            }
+
+            void detachDelayMemory() {
+                hot.buffer.fill(nullptr);
+            }
+
+            void setGlobalLfoOutputsPointer(const float* ptr) {
+                globalLfoPtr = ptr;
+            }
+
+            // Peak output of each global LFO, so the lines know their worst-case delay.
+            void setGlobalLfoDepths(const float* depths) {
+                for (size_t i = 0; i < numLines; ++i) {
+                    const size_t lfo = StageConfig::lines[i].lfoIndex;
+                    cold.modDepth[i] = (lfo == noLfo) ? 0.f : std::fabs(depths[lfo]);
+                }
+            }
+
+            // Per-LFO block buffers used by processBlock (ptrs[lfoIndex][sample]).
+            void setGlobalLfoBlockPointers(const float* const* ptrs) {
+                globalLfoBlockPtrs = ptrs;
+            }
+
+            JUCE_FORCEINLINE float processSample(float inSample)
+            {
+                float input = inSample;
+                if constexpr (StageConfig::enableSVF) {
+                    input = svfFilter.processSample(input);
+                }
+                return processLinesSample(input, lfoValues(globalLfoPtr, std::make_index_sequence<numLines>{}), std::make_index_sequence<numLines>{});
+            }
+
+            // Process one sample inside a block, taking modulation from sample
+            // blockIndex of the LFO block buffers rather than the per-sample outputs.
+            // Used for stages that feed back into themselves.
+            JUCE_FORCEINLINE float processSampleInBlock(float inSample, int blockIndex)
+            {
+                float input = inSample;
+                if constexpr (StageConfig::enableSVF) {
+                    input = svfFilter.processSample(input);
+                }
+                return processLinesSampleInBlock(input, blockIndex, std::make_index_sequence<numLines>{});
+            }
+
+            // Process a block (in place is fine). Whole vectors of samples while
+            // no line can read what the same vector writes, sample by sample after.
+            JUCE_FORCEINLINE void processBlock(const float* in, float* out, int numSamples)
+            {
+                if constexpr (StageConfig::enableSVF) {
+                    svfFilter.processBlock(in, out, numSamples);
+                }
+                else if (in != out) {
+                    std::copy(in, in + numSamples, out);
+                }
+
+                constexpr int W = simd::FloatVec::width;
+                int s = 0;
+                if (vectorReadsAreSafe()) {
+                    for (; s + W <= numSamples; s += W)
+                        processLinesVector(out, s, std::make_index_sequence<numLines>{});
+                }
+                for (; s < numSamples; ++s)
+                    out[s] = processLinesSampleInBlock(out[s], s, std::make_index_sequence<numLines>{});
+            }
+
+            void updateDelayTimes(float globalSize) {
+                if constexpr (StageConfig::scaleDelay) {
+                    cold.delayScale = globalSize;
+                    for (size_t i = 0; i < numLines; ++i) {
+                        hot.delay[i] = cold.baseDelay[i] * cold.delayScale * cold.delayTrim[i];
+                    }
+                }
+            }
+
+            // Shortens every line delay by its own factor in (1 - amount, 1] drawn
+            // from seed, on top of the global size, so two copies of the stage
+            // stop sharing echo times. 0 puts the nominal delays back.
+            void detuneDelays(float amount, std::uint32_t& seed) {
+                for (size_t i = 0; i < numLines; ++i) {
+                    cold.delayTrim[i] = delayDetuneFactor(amount, seed);
+                    hot.delay[i] = cold.baseDelay[i] * cold.delayScale * cold.delayTrim[i];
+                }
+            }
+
+            // Density scales the decay time, as it scales the AP coefficients of a StageReverb.
+            void updateCoefficientScaling(float globalDensity) {
+                if constexpr (StageConfig::scaleCoeff) {
+                    cold.decayScale = globalDensity;
+                    updateGains();
+                }
+            }
+
+            // The longest line plus its deepest modulation: the longest a sound
+            // spends inside the stage before it first comes out.
+            float getTotalDelaySamples() const {
+                float longest = 0.f;
+                for (size_t i = 0; i < numLines; ++i) {
+                    longest = std::max(longest, hot.delay[i] + std::min(cold.modDepth[i], msToSamples(delayHeadroomMs, currentSampleRate)));
+                }
+                return longest;
+            }
+
+            // Samples the network keeps ringing after an impulse, to -60 dB: the
+            // slowest line's decay, with the matrix's largest gain on every pass.
+            float getRingSamples() const {
+                float ring = 0.f;
+                for (size_t i = 0; i < numLines; ++i) {
+                    ring = std::max(ring, loopDecaySamples(hot.delay[i], cold.loopGain[i] * cold.matrixGain, maxRingSeconds * currentSampleRate));
+                }
+                return ring;
+            }
+
+            void updateSVFParameters(float cutoff, float dbGain) {
+                if constexpr (StageConfig::enableSVF && StageConfig::attachSVF) {
+                    svfFilter.setParameters(cutoff, dbGain, currentSampleRate);
+                }
+            }
+
+        private:
+            // Loops that never decay report this much ring.
+            static constexpr float maxRingSeconds = 60.f;
+
+            template <size_t I>
+            static constexpr size_t lineLfo = StageConfig::lines[I].lfoIndex;
+
+            // Unmodulated lines read whole samples.
+            template <size_t I>
+            using LineInterp = std::conditional_t<lineLfo<I> == noLfo, NoInterpolation, Interp>;
+
+            template <size_t I>
+            static constexpr int lineCapacityMask = delayBufferSize(StageConfig::lines[I].delayMs, StageConfig::scaleDelay) - 1;
+
+            // Input and output taps: +-1/sqrt(N), signs chosen so that neither
+            // vector is a row of the Hadamard matrix (an odd number of minus
+            // signs in the first 4, 8 and 16), or the input would reach a single
+            // line after the first pass and the output hear a single line.
+            static constexpr float tapScale = (numLines == 4) ? 0.5f : (numLines == 8) ? 0.35355339f : 0.25f;
+            static constexpr float inputSign[16] = { 1, -1, 1, 1, -1, 1, -1, 1, -1, 1, 1, -1, 1, 1, 1, 1 };
+            static constexpr float outputSign[16] = { 1, 1, -1, 1, 1, -1, -1, 1, 1, -1, 1, 1, -1, 1, 1, 1 };
+
+            // The Hadamard transform is left unnormalised; its 1/sqrt(N) rides
+            // on the loop gains.
+            static constexpr float matrixScale = (matrix == FdnMatrix::Hadamard) ? tapScale : 1.f;
+
+            // Everything the per-sample and per-vector loops touch.
+            struct HotState {
+                std::array<Sample*, numLines> buffer{};
+                std::array<int, numLines> mask{};       // Ring size at the current rate, minus one.
+                std::array<float, numLines> delay{};    // Effective base delay, samples.
+                std::array<float, numLines> direct{};   // Loop gain * (1 - damping) * matrixScale.
+                std::array<float, numLines> previous{}; // Loop gain * damping * matrixScale.
+                int writeIndex = 0;                     // Shared by every line, wrapped at writeMask.
+                int writeMask = 0;                      // Mask of the longest ring.
+                std::uint32_t dither = 1;               // Storage dither state (int16 only).
+                std::array<typename Interp::State, numLines> interp{};      // Empty unless the read is recursive.
+                std::array<typename Interp::State, numLines> interpLate{};  // The same, for the damping tap.
+            };
+
+            // Only read when a parameter or the sample rate changes (modDepth once per block).
+            struct ColdState {
+                std::array<float, numLines> baseDelay{};    // Samples at the current rate, before global size.
+                std::array<float, numLines> modDepth{};     // Largest |lfo| each line sees.
+                std::array<float, numLines> loopGain{};     // Per pass, before damping.
+                std::array<float, numLines> delayTrim{};    // Detune factor per line (detuneDelays), else 1.
+                float delayScale = 1.f;                     // Global size, if scaleDelay.
+                float decayScale = 1.f;                     // Global density, if scaleCoeff.
+                float matrixGain = 1.f;                     // Largest gain of the matrix.
+            };
+
+            alignas(64) HotState hot;
+            const float* globalLfoPtr;
+            const float* const* globalLfoBlockPtrs;
+            LexiconShelvingFilter svfFilter;
+            ColdState cold;
+            NoInterpolation::State integerReadState;
+            float currentSampleRate = 44100.f;
+
+            void updateGains() {
+                const float decayMs = 1000.f * StageConfig::decaySeconds * cold.decayScale;
+                for (size_t i = 0; i < numLines; ++i) {
+                    const float gain = (decayMs > 0.f) ? std::pow(10.f, -3.f * StageConfig::lines[i].delayMs / decayMs) : 0.f;
+                    const float damping = StageConfig::lines[i].damping;
+                    cold.loopGain[i] = gain;
+                    hot.direct[i] = gain * (1.f - damping) * matrixScale;
+                    hot.previous[i] = gain * damping * matrixScale;
+                }
+            }
+
+            // Largest singular value of the (normalised) matrix, for the ring
+            // estimate: 1 for Hadamard and Householder, by power iteration on
+            // M^T M for a general matrix.
+            static float matrixNorm() {
+                if constexpr (matrix != FdnMatrix::General) {
+                    return 1.f;
+                }
+                else {
+                    const auto& m = StageConfig::matrixCoefficients;
+                    static_assert(std::tuple_size<std::decay_t<decltype(m)>>::value == numLines * numLines,
+                        "matrixCoefficients needs numLines * numLines entries");
+                    std::array<double, numLines> v;
+                    v.fill(1.0);
+                    double norm = 0.0;
+                    for (int iteration = 0; iteration < 64; ++iteration) {
+                        std::array<double, numLines> mv{};
+                        std::array<double, numLines> mtmv{};
+                        for (size_t r = 0; r < numLines; ++r)
+                            for (size_t c = 0; c < numLines; ++c)
+                                mv[r] += m[r * numLines + c] * v[c];
+                        for (size_t c = 0; c < numLines; ++c)
+                            for (size_t r = 0; r < numLines; ++r)
+                                mtmv[c] += m[r * numLines + c] * mv[r];
+                        double length = 0.0;
+                        for (double x : mtmv)
+                            length += x * x;
+                        length = std::sqrt(length);
+                        if (length == 0.0)
+                            return 0.f;
+                        for (size_t c = 0; c < numLines; ++c)
+                            v[c] = mtmv[c] / length;
+                        norm = std::sqrt(length);
+                    }
+                    return static_cast<float>(norm);
+                }
+            }
+
+            void resetLines() {
+                for (size_t i = 0; i < numLines; ++i) {
+                    if (hot.buffer[i] != nullptr)
+                        std::fill(hot.buffer[i], hot.buffer[i] + hot.mask[i] + 1, Sample(0));
+                }
+                hot.writeIndex = 0;
+                hot.interp.fill({});
+                hot.interpLate.fill({});
+            }
+
+            template <size_t... Is>
+            void setMasksToCapacity(std::index_sequence<Is...>)
+            {
+                ((hot.mask[Is] = lineCapacityMask<Is>), ...);
+                hot.writeMask = std::max({ lineCapacityMask<Is>... });
+            }
+
+            // True if the newest sample any line reads is at least one vector old.
+            bool vectorReadsAreSafe() const {
+                constexpr bool vectorizable = allVectorizable(std::make_index_sequence<numLines>{});
+                if constexpr (!vectorizable) {
+                    return false;
+                }
+                else {
+                    return newestRead(std::make_index_sequence<numLines>{}) >= static_cast<float>(simd::FloatVec::width);
+                }
+            }
+
+            template <size_t... Is>
+            static constexpr bool allVectorizable(std::index_sequence<Is...>)
+            {
+                return (LineInterp<Is>::vectorizable && ...);
+            }
+
+            template <size_t... Is>
+            float newestRead(std::index_sequence<Is...>) const
+            {
+                return std::min({ (std::floor(std::max(hot.delay[Is] - cold.modDepth[Is], LineInterp<Is>::minDelay))
+                    - static_cast<float>(LineInterp<Is>::readAhead))... });
+            }
+
+            template <size_t I>
+            JUCE_FORCEINLINE auto& interpState()
+            {
+                if constexpr (lineLfo<I> == noLfo)
+                    return integerReadState;
+                else
+                    return hot.interp[I];
+            }
+
+            template <size_t I>
+            JUCE_FORCEINLINE auto& interpLateState()
+            {
+                if constexpr (lineLfo<I> == noLfo)
+                    return integerReadState;
+                else
+                    return hot.interpLate[I];
+            }
+
+            // LFO value of line I from one value per LFO (or none).
+            template <size_t I>
+            JUCE_FORCEINLINE float lfoValue(const float* lfo) const
+            {
+                if constexpr (lineLfo<I> == noLfo)
+                    return 0.f;
+                else
+                    return (lfo != nullptr) ? lfo[lineLfo<I>] : 0.f;
+            }
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE std::array<float, numLines> lfoValues(const float* lfo, std::index_sequence<Is...>) const
+            {
+                return { { lfoValue<Is>(lfo)... } };
+            }
+
+            // Block of LFO values for line I, or nullptr.
+            template <size_t I>
+            JUCE_FORCEINLINE const float* lfoBlock() const
+            {
+                if constexpr (lineLfo<I> == noLfo)
+                    return nullptr;
+                else
+                    return (globalLfoBlockPtrs != nullptr) ? globalLfoBlockPtrs[lineLfo<I>] : nullptr;
+            }
+
+            //==============================================================
+            // The maths, written once for T = float (one sample) and
+            // T = simd::FloatVec (W consecutive samples). Both run the same
+            // operations in the same order, so the two paths agree exactly.
+            //==============================================================
+            template <typename T>
+            static JUCE_FORCEINLINE T splat(float x)
+            {
+                if constexpr (std::is_same_v<T, float>)
+                    return x;
+                else
+                    return T::broadcast(x);
+            }
+
+            // Pairwise sum of x[Lo..Hi).
+            template <size_t Lo, size_t Hi, typename T>
+            static JUCE_FORCEINLINE T treeSum(const std::array<T, numLines>& x)
+            {
+                if constexpr (Hi - Lo == 1)
+                    return x[Lo];
+                else
+                    return treeSum<Lo, (Lo + Hi) / 2>(x) + treeSum<(Lo + Hi) / 2, Hi>(x);
+            }
+
+            template <size_t I, size_t H, typename T>
+            static JUCE_FORCEINLINE void butterfly(std::array<T, numLines>& x)
+            {
+                if constexpr ((I & H) == 0) {
+                    const T a = x[I];
+                    const T b = x[I + H];
+                    x[I] = a + b;
+                    x[I + H] = a - b;
+                }
+            }
+
+            template <size_t H, typename T, size_t... Is>
+            static JUCE_FORCEINLINE void hadamardStage(std::array<T, numLines>& x, std::index_sequence<Is...>)
+            {
+                (butterfly<Is, H>(x), ...);
+            }
+
+            template <size_t H, typename T>
+            static JUCE_FORCEINLINE void hadamard(std::array<T, numLines>& x)
+            {
+                if constexpr (H > 0) {
+                    hadamardStage<H>(x, std::make_index_sequence<numLines - H>{});
+                    hadamard<H / 2>(x);
+                }
+            }
+
+            template <size_t Row, typename T, size_t... Cs>
+            static JUCE_FORCEINLINE T matrixRow(const std::array<T, numLines>& x, std::index_sequence<Cs...>)
+            {
+                T sum = splat<T>(0.f);
+                ((sum = sum + splat<T>(StageConfig::matrixCoefficients[Row * numLines + Cs]) * x[Cs]), ...);
+                return sum;
+            }
+
+            template <typename T, size_t... Is>
+            static JUCE_FORCEINLINE void mix(std::array<T, numLines>& x, std::index_sequence<Is...> lines)
+            {
+                if constexpr (matrix == FdnMatrix::Hadamard) {
+                    hadamard<numLines / 2>(x);
+                }
+                else if constexpr (matrix == FdnMatrix::Householder) {
+                    const T reflect = splat<T>(-2.f / static_cast<float>(numLines)) * treeSum<0, numLines>(x);
+                    ((x[Is] = x[Is] + reflect), ...);
+                }
+                else {
+                    const std::array<T, numLines> y{ { matrixRow<Is>(x, lines)... } };
+                    x = y;
+                }
+            }
+
+            // One step of the network on T: `late[i]` is line i read one sample
+            // further back (the damping tap), returns the output and leaves the
+            // values to write in `late`.
+            template <typename T, size_t... Is>
+            JUCE_FORCEINLINE T runNetwork(T input, const std::array<T, numLines>& now, std::array<T, numLines>& late, std::index_sequence<Is...> lines) const
+            {
+                const std::array<T, numLines> taps{ { (splat<T>(outputSign[Is] * tapScale) * now[Is])... } };
+                ((late[Is] = splat<T>(hot.direct[Is]) * now[Is] + splat<T>(hot.previous[Is]) * late[Is]), ...);
+                mix(late, lines);
+                ((late[Is] = late[Is] + splat<T>(inputSign[Is] * tapScale) * input), ...);
+                return treeSum<0, numLines>(taps);
+            }
+
+            //==============================================================
+            // Per sample.
+            //==============================================================
+            template <size_t I>
+            JUCE_FORCEINLINE void readLine(float lfo, float& now, float& late)
+            {
+                const float target = std::max(hot.delay[I] + lfo, LineInterp<I>::minDelay);
+                now = LineInterp<I>::template read<Storage>(hot.buffer[I], hot.mask[I], hot.writeIndex, target, interpState<I>());
+                late = LineInterp<I>::template read<Storage>(hot.buffer[I], hot.mask[I], hot.writeIndex, target + 1.f, interpLateState<I>());
+            }
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE float processLinesSample(float input, const std::array<float, numLines>& lfo, std::index_sequence<Is...> lines)
+            {
+                std::array<float, numLines> now, late;
+                (readLine<Is>(lfo[Is], now[Is], late[Is]), ...);
+                const float output = runNetwork(input, now, late, lines);
+                (Storage::store(hot.buffer[Is], hot.writeIndex & hot.mask[Is], project::flushDenormal(late[Is]), hot.dither), ...);
+                hot.writeIndex = (hot.writeIndex + 1) & hot.writeMask;
+                return output;
+            }
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE float processLinesSampleInBlock(float input, int blockIndex, std::index_sequence<Is...> lines)
+            {
+                const std::array<float, numLines> lfo{ { ((lfoBlock<Is>() != nullptr) ? lfoBlock<Is>()[blockIndex] : 0.f)... } };
+                return processLinesSample(input, lfo, lines);
+            }
+
+            //==============================================================
+            // Per vector: samples [offset, offset + W) of `data`, in place.
+            //==============================================================
+            // W consecutive samples of line I from ring index `start` on.
+            template <size_t I>
+            JUCE_FORCEINLINE simd::FloatVec readWindow(int start) const
+            {
+                constexpr int W = simd::FloatVec::width;
+                start &= hot.mask[I];
+                if constexpr (std::is_same_v<Storage, FloatDelayStorage>) {
+                    if (start + W <= hot.mask[I] + 1)
+                        return simd::FloatVec::load(hot.buffer[I] + start);
+                }
+                return Storage::gather(hot.buffer[I], simd::IntVec::ramp(start) & simd::IntVec::broadcast(hot.mask[I]));
+            }
+
+            template <size_t I>
+            JUCE_FORCEINLINE void readLineVector(simd::IntVec writeIndices, int offset, simd::FloatVec& now, simd::FloatVec& late) const
+            {
+                using simd::FloatVec;
+                if constexpr (lineLfo<I> == noLfo) {
+                    // An unmodulated line has one whole delay for the vector: its
+                    // samples are two overlapping windows of the ring, no gather.
+                    // The delays are rounded as NoInterpolation::read rounds them.
+                    const float target = std::max(hot.delay[I], LineInterp<I>::minDelay);
+                    now = readWindow<I>(hot.writeIndex - static_cast<int>(target + 0.5f));
+                    late = readWindow<I>(hot.writeIndex - static_cast<int>(target + 1.f + 0.5f));
+                    return;
+                }
+                FloatVec target = FloatVec::broadcast(hot.delay[I]);
+                if (lfoBlock<I>() != nullptr)
+                    target = target + FloatVec::load(lfoBlock<I>() + offset);
+                target = FloatVec::max(target, FloatVec::broadcast(LineInterp<I>::minDelay));
+                const simd::IntVec mask = simd::IntVec::broadcast(hot.mask[I]);
+                now = LineInterp<I>::template readVec<Storage>(hot.buffer[I], mask, writeIndices, target);
+                late = LineInterp<I>::template readVec<Storage>(hot.buffer[I], mask, writeIndices, target + FloatVec::broadcast(1.f));
+            }
+
+            template <size_t I>
+            JUCE_FORCEINLINE void writeLineVector(simd::FloatVec v)
+            {
+                constexpr int W = simd::FloatVec::width;
+                const int w = hot.writeIndex & hot.mask[I];
+                v = simd::flushDenormal(v);
+                if (w + W <= hot.mask[I] + 1) {
+                    Storage::storeVec(hot.buffer[I] + w, v, hot.dither);
+                }
+                else {
+                    alignas(32) float tmp[W];
+                    v.store(tmp);
+                    for (int k = 0; k < W; ++k)
+                        Storage::store(hot.buffer[I], (w + k) & hot.mask[I], tmp[k], hot.dither);
+                }
+            }
+
+            template <size_t... Is>
+            JUCE_FORCEINLINE void processLinesVector(float* data, int offset, std::index_sequence<Is...> lines)
+            {
+                using simd::FloatVec;
+                const simd::IntVec writeIndices = simd::IntVec::ramp(hot.writeIndex);
+                std::array<FloatVec, numLines> now, late;
+                (readLineVector<Is>(writeIndices, offset, now[Is], late[Is]), ...);
+                const FloatVec output = runNetwork(FloatVec::load(data + offset), now, late, lines);
+                (writeLineVector<Is>(late[Is]), ...);
+                output.store(data + offset);
+                hot.writeIndex = (hot.writeIndex + simd::FloatVec::width) & hot.writeMask;
+            }
+        };
+
+        struct FdnStageKind {
+            template <typename StageConfig, typename Storage, typename Interp>
+            using Stage = FdnStage<StageConfig, Storage, Interp>;
+        };
+
+    } // namespace multistage
+} // namespace project
@@ -1,65 +1,145 @@
-#pragma once
-#include "ReverbCommon.h"
-
-namespace project {
-    namespace multistage {
-
-        class StageStereoizer {
-        public:
-            // Construct left/right allpasses with both delay scaling and coefficient scaling enabled.
-            StageStereoizer()
-                : leftAP(2200.f, 0.5f, 0, true, true),  // base=2200, coeff=0.5, lfoIndex=0, scaleDelay=true, scaleCoefficient=true
-                rightAP(2000.f, 0.5f, 1, true, true),   // base=2000, coeff=0.5, lfoIndex=1, scaleDelay=true, scaleCoefficient=true
-                globalLfoPtr(nullptr)
-            {
-            }
-
-            void prepare(float sampleRate) {
-                leftAP.prepare(sampleRate);
-                rightAP.prepare(sampleRate);
-            }
-
-            void reset() {
-                leftAP.reset();
-                rightAP.reset();
-            }
-
-            // Sets the pointer to the global LFO outputs.
-            void setGlobalLfoOutputsPointer(const float* ptr) {
-                globalLfoPtr = ptr;
-            }
-
-            // Processes a sample to produce stereo output.
-            inline void processSample(float monoIn, float& leftOut, float& rightOut) {
-                float lVal = 0.f;
-                float rVal = 0.f;
-                if (globalLfoPtr) {
-                    size_t lIdx = leftAP.getLfoIndex();
-                    size_t rIdx = rightAP.getLfoIndex();
-                    lVal = globalLfoPtr[lIdx];
-                    rVal = globalLfoPtr[rIdx];
-                }
-                leftOut = leftAP.processSample(monoIn, lVal);
-                rightOut = rightAP.processSample(monoIn, rVal);
-            }
-
-            // Update delay times for both channels based on the global size parameter.
-            void updateDelayTimes(float globalSize) {
-                leftAP.updateDelayTime(globalSize);
-                rightAP.updateDelayTime(globalSize);
-            }
-
-            // Update coefficient scaling (density) for both channels based on the global density parameter.
-            void updateCoefficientScaling(float globalDensity) {
-                leftAP.updateCoefficientScaling(globalDensity);
-                rightAP.updateCoefficientScaling(globalDensity);
-            }
-
-        private:
-            project::SimpleAP leftAP;
-            project::SimpleAP rightAP;
-            const float* globalLfoPtr;
-        };
-
-    } // namespace multistage
-} // namespace project
+#pragma once
+#include "ReverbCommon.h"
+#include "DelayArena.h"
+#include "TailTracker.h"
+
+namespace project {
+    namespace multistage {
+
+        template <typename Storage = FloatDelayStorage, typename Interp = LinearInterpolation>
+        class StageStereoizer {
+        public:
+            static constexpr float leftDelayMs = 45.8333f;
+            static constexpr float rightDelayMs = 41.6667f;
+            static constexpr size_t leftMemorySize = delayArenaFloats<Storage>(leftDelayMs, true);
+            static constexpr size_t DelayMemorySize = leftMemorySize + delayArenaFloats<Storage>(rightDelayMs, true);
+
+            // Construct left/right allpasses with both delay scaling and coefficient scaling enabled,
+            // running on the stereoizer's own arena until attachDelayMemory() says otherwise.
+            explicit StageStereoizer(bool ownDelayMemory = true)
+                : leftAP(leftDelayMs, 0.5f, 0, true, true),   // coeff=0.5, lfoIndex=0, scaleDelay=true, scaleCoefficient=true
+                rightAP(rightDelayMs, 0.5f, 1, true, true),   // coeff=0.5, lfoIndex=1, scaleDelay=true, scaleCoefficient=true
+                globalLfoPtr(nullptr),
+                globalLfoBlockPtrs(nullptr)
+            {
+                if (ownDelayMemory) {
+                    arena.allocate(DelayMemorySize);
+                    useDelayMemory(arena.data());
+                }
+            }
+
+            void prepare(float sampleRate) {
+                leftAP.prepare(sampleRate);
+                rightAP.prepare(sampleRate);
+            }
+
+            void reset() {
+                leftAP.reset();
+                rightAP.reset();
+            }
+
+            // Delay memory of both allpasses, in floats.
+            static constexpr size_t getDelayMemorySize() {
+                return DelayMemorySize;
+            }
+
+            // Runs both allpasses on caller-owned memory (the own arena is freed);
+            // returns the first float past it.
+            float* attachDelayMemory(float* memory) {
+                arena.release();
+                useDelayMemory(memory);
+                return memory + DelayMemorySize;
+            }
+
+            void detachDelayMemory() {
+                arena.release();
+                leftAP.detachBuffer();
+                rightAP.detachBuffer();
+            }
+
+            // Sets the pointer to the global LFO outputs.
+            void setGlobalLfoOutputsPointer(const float* ptr) {
+                globalLfoPtr = ptr;
+            }
+
+            // Sets the peak output of each global LFO (see SimpleAP::setModulationDepth).
+            void setGlobalLfoDepths(const float* depths) {
+                leftAP.setModulationDepth(depths[leftAP.getLfoIndex()]);
+                rightAP.setModulationDepth(depths[rightAP.getLfoIndex()]);
+            }
+
+            // Sets the per-LFO block buffers used by processBlock.
+            void setGlobalLfoBlockPointers(const float* const* ptrs) {
+                globalLfoBlockPtrs = ptrs;
+            }
+
+            // Processes a sample to produce stereo output.
+            inline void processSample(float monoIn, float& leftOut, float& rightOut) {
+                float lVal = 0.f;
+                float rVal = 0.f;
+                if (globalLfoPtr) {
+                    size_t lIdx = leftAP.getLfoIndex();
+                    size_t rIdx = rightAP.getLfoIndex();
+                    lVal = globalLfoPtr[lIdx];
+                    rVal = globalLfoPtr[rIdx];
+                }
+                leftOut = leftAP.processSample(monoIn, lVal);
+                rightOut = rightAP.processSample(monoIn, rVal);
+            }
+
+            // Processes a block to produce stereo output. outL/outR may alias monoIn.
+            inline void processBlock(const float* monoIn, float* outL, float* outR, int numSamples) {
+                const float* lLfo = nullptr;
+                const float* rLfo = nullptr;
+                if (globalLfoBlockPtrs) {
+                    lLfo = globalLfoBlockPtrs[leftAP.getLfoIndex()];
+                    rLfo = globalLfoBlockPtrs[rightAP.getLfoIndex()];
+                }
+                // Right first when writing over the input in place through the left channel.
+                if (outL == monoIn) {
+                    rightAP.processBlock(monoIn, outR, rLfo, numSamples);
+                    leftAP.processBlock(monoIn, outL, lLfo, numSamples);
+                }
+                else {
+                    leftAP.processBlock(monoIn, outL, lLfo, numSamples);
+                    rightAP.processBlock(monoIn, outR, rLfo, numSamples);
+                }
+            }
+
+            // Longest delay and ring time of the two channels, in samples (see StageReverb).
+            float getTotalDelaySamples() const {
+                return std::max(leftAP.getDelaySamples(), rightAP.getDelaySamples());
+            }
+
+            float getRingSamples() const {
+                return std::max(allpassRingSamples(leftAP.getDelaySamples(), leftAP.getCoefficient()),
+                    allpassRingSamples(rightAP.getDelaySamples(), rightAP.getCoefficient()));
+            }
+
+            // Update delay times for both channels based on the global size parameter.
+            void updateDelayTimes(float globalSize) {
+                leftAP.updateDelayTime(globalSize);
+                rightAP.updateDelayTime(globalSize);
+            }
+
+            // Update coefficient scaling (density) for both channels based on the global density parameter.
+            void updateCoefficientScaling(float globalDensity) {
+                leftAP.updateCoefficientScaling(globalDensity);
+                rightAP.updateCoefficientScaling(globalDensity);
+            }
+
+        private:
+            project::SimpleAP<Storage, Interp> leftAP;
+            project::SimpleAP<Storage, Interp> rightAP;
+            const float* globalLfoPtr;
+            const float* const* globalLfoBlockPtrs;
+            DelayArena arena;
+
+            void useDelayMemory(float* memory) {
+                leftAP.attachBuffer(memory);
+                rightAP.attachBuffer(memory + leftMemorySize);
+            }
+        };
+
+    } // namespace multistage
+} // namespace project
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+namespace project {
+
+    //==============================================================
+    // Tail length estimates. All times are in samples.
+    //==============================================================
+
+    // Samples until an allpass (delay d, coefficient c) has answered an impulse
+    // to within -60 dB. Its echoes are (1 - c^2) (-c)^(k-1) at k * d, so the
+    // closer |c| gets to 1 the longer it rings but the quieter each echo is;
+    // at |c| >= 1 the output is the input and there is no tail at all.
+    inline float allpassRingSamples(float delay, float coefficient)
+    {
+        const float c = std::fabs(coefficient);
+        if (c >= 1.f)
+            return 0.f;
+        if (c < 1.0e-3f)
+            return delay;
+        const float echoes = 1.f + std::max(0.f, (-3.f - std::log10(1.f - c * c)) / std::log10(c));
+        return delay * echoes;
+    }
+
+    // Samples until a loop with gain `gain` per pass of `passSamples` has decayed
+    // by 60 dB. Loops that do not decay report maxSamples.
+    inline float loopDecaySamples(float passSamples, float gain, float maxSamples)
+    {
+        const float g = std::fabs(gain);
+        if (g >= 1.f)
+            return maxSamples;
+        if (g < 1.0e-3f)
+            return passSamples;
+        return std::min(maxSamples, passSamples * (-3.f / std::log10(g)));
+    }
+
+    //==============================================================
+    // TailTracker: decides when a reverb can stop processing.
+    //
+    // The owner reports each block's input and output peak. Once both have
+    // stayed at or below the threshold for holdSamples - the longest time a
+    // sound can travel through the graph without reaching the output - the
+    // delay lines hold nothing audible and the tracker goes to sleep. While
+    // asleep, blocks with silent input are skipped (the owner writes zeros);
+    // the first block above the threshold wakes it.
+    //
+    // setTail() takes the graph's 60 dB decay time. getTailSamples() is what
+    // a host is told: how long a full-scale output takes to fall below the
+    // threshold once the input stops. getRemainingTailSamples() does the same
+    // from the level of the last block.
+    //==============================================================
+    class TailTracker {
+    public:
+        static constexpr float defaultThreshold = 1.0e-5f;  // About -100 dB.
+
+        void setThreshold(float newThreshold) { threshold = newThreshold; }
+        float getThreshold() const { return threshold; }
+
+        void setTail(float decay60Samples, float newHoldSamples)
+        {
+            decay60 = decay60Samples;
+            holdSamples = newHoldSamples;
+        }
+
+        float getDecay60Samples() const { return decay60; }
+
+        float getTailSamples() const
+        {
+            return std::max(decay60 * levelAboveThresholdDb(1.f) / 60.f, holdSamples);
+        }
+        float getHoldSamples() const { return holdSamples; }
+
+        // Start counting from scratch (new memory, reset, a note-on...).
+        void wake()
+        {
+            sleeping = false;
+            inputSounding = false;
+            silentSamples = 0.f;
+            lastOutputPeak = 0.f;
+        }
+
+        bool isSleeping() const { return sleeping; }
+
+        // False if the block can be skipped: asleep and the input is silent.
+        // A non-silent block wakes the tracker.
+        bool wantsBlock(float inputPeak)
+        {
+            if (!sleeping)
+                return true;
+            if (inputPeak <= threshold)
+                return false;
+            wake();
+            return true;
+        }
+
+        // After processing a block. Returns true when this block put the
+        // tracker to sleep; the owner should then clear its state.
+        bool blockProcessed(float inputPeak, float outputPeak, int numSamples)
+        {
+            lastOutputPeak = outputPeak;
+            inputSounding = inputPeak > threshold;
+            if (inputSounding || outputPeak > threshold)
+            {
+                silentSamples = 0.f;
+                return false;
+            }
+            silentSamples += static_cast<float>(numSamples);
+            if (silentSamples < holdSamples)
+                return false;
+            sleeping = true;
+            return true;
+        }
+
+        // How much longer the output will ring if the input stays silent.
+        float getRemainingTailSamples() const
+        {
+            if (sleeping)
+                return 0.f;
+            if (inputSounding)
+                return getTailSamples();
+            return std::max(decay60 * levelAboveThresholdDb(lastOutputPeak) / 60.f, holdSamples - silentSamples);
+        }
+
+        static float getPeak(const float* left, const float* right, int numSamples)
+        {
+            float peak = 0.f;
+            for (int i = 0; i < numSamples; ++i)
+                peak = std::max(peak, std::max(std::fabs(left[i]), std::fabs(right[i])));
+            return peak;
+        }
+
+    private:
+        float threshold = defaultThreshold;
+        float decay60 = 0.f;
+        float holdSamples = 0.f;
+        float silentSamples = 0.f;      // Input and output both at or below the threshold.
+        float lastOutputPeak = 0.f;
+        bool inputSounding = false;
+        bool sleeping = false;
+
+        float levelAboveThresholdDb(float level) const
+        {
+            return 20.f * std::log10(std::max(level, threshold) / std::max(threshold, 1.0e-30f));
+        }
+    };
+
+} // namespace project
@@ -0,0 +1,285 @@
+#pragma once
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "ReverbCommon.h"
+#include "MyReverbConfig.h"
+#include "StageReverb.h"
+
+namespace project {
+    namespace multistage {
+
+        //==============================================================
+        // A reverb topology as data: what a compile-time Config spells out in
+        // types (LFOs, stages with their APs and shelf, connections), loaded
+        // at runtime by RuntimeReverb. Node numbering is the Config's: 0 is
+        // the input, 1..stages.size() the stages, stages.size() + 1 the output.
+        //==============================================================
+        struct TopologyLfo {
+            float frequency;    // Hz
+            float depthMs;      // Peak delay deviation, at most delayHeadroomMs.
+        };
+
+        struct TopologyAP {
+            float delayMs;
+            float coefficient;
+            size_t lfoIndex;    // noLfo for an unmodulated AP.
+        };
+
+        struct TopologyStage {
+            bool scaleDelay = false;
+            bool scaleCoeff = false;
+            bool enableSVF = false;
+            float svfCutoff = 0.f;
+            float svfGain = 0.f;
+            bool attachSVF = false;
+            std::vector<TopologyAP> aps;
+        };
+
+        struct Topology {
+            std::vector<TopologyLfo> lfos;
+            std::vector<TopologyStage> stages;
+            std::vector<Connection> connections;
+
+            size_t getNumNodes() const { return stages.size() + 2; }
+            size_t getOutputNode() const { return stages.size() + 1; }
+        };
+
+        //==============================================================
+        // Text presets. One statement per line, '#' starts a comment:
+        //
+        //   lfo <frequency Hz> <depth ms>
+        //   stage [scaleDelay] [scaleCoeff] [svf <cutoff Hz> <gain dB> [attach]]
+        //   ap <delay ms> <coefficient> <lfo index | none>
+        //   connect <src> <dst> <weight> [feedback]
+        //
+        // ap lines belong to the stage above them. Nodes are numbers or the
+        // words `in` and `out`. The matching writer is formatTopology().
+        //==============================================================
+        namespace detail {
+            // Finite numbers only: `nan` and `inf` are syntax errors.
+            inline bool parseFloat(const std::string& token, float& value)
+            {
+                if (token.empty())
+                    return false;
+                char* end = nullptr;
+                value = std::strtof(token.c_str(), &end);
+                return end != nullptr && *end == '\0' && std::isfinite(value);
+            }
+
+            // Out of range is a syntax error too: strtoul would saturate to
+            // ULONG_MAX, which is noLfo where size_t is unsigned long.
+            inline bool parseIndex(const std::string& token, size_t& value)
+            {
+                if (token.empty() || token[0] == '-')
+                    return false;
+                char* end = nullptr;
+                errno = 0;
+                const unsigned long parsed = std::strtoul(token.c_str(), &end, 10);
+                if (errno == ERANGE)
+                    return false;
+                value = static_cast<size_t>(parsed);
+                return end != nullptr && *end == '\0' && value != noLfo;
+            }
+
+            // `out` is only known once every stage is read: parseNode() flags it
+            // in `isOutput` and parseTopology() fills the index in at the end.
+            inline bool parseNode(const std::string& token, size_t& node, bool& isOutput)
+            {
+                isOutput = token == "out";
+                if (isOutput || token == "in") { node = 0; return true; }
+                return parseIndex(token, node);
+            }
+
+            inline std::string formatFloat(float value)
+            {
+                char text[32];
+                std::snprintf(text, sizeof(text), "%.9g", value);
+                return text;
+            }
+        }
+
+        // Parses `text` into `topology`. On failure returns false and leaves a
+        // message naming the line in `error`; `topology` is then unspecified.
+        // This checks the syntax only: value ranges are RuntimeReverb::load()'s
+        // job.
+        inline bool parseTopology(const std::string& text, Topology& topology, std::string& error)
+        {
+            topology = Topology{};
+            std::istringstream lines(text);
+            std::string line;
+            int lineNumber = 0;
+            std::vector<std::pair<bool, bool>> outputEnds;     // Per connection: src, dst given as `out`.
+
+            auto fail = [&](const std::string& message) {
+                error = "line " + std::to_string(lineNumber) + ": " + message;
+                return false;
+            };
+
+            while (std::getline(lines, line))
+            {
+                ++lineNumber;
+                const size_t hash = line.find('#');
+                if (hash != std::string::npos)
+                    line.erase(hash);
+
+                std::istringstream words(line);
+                std::vector<std::string> tokens;
+                for (std::string token; words >> token;)
+                    tokens.push_back(token);
+                if (tokens.empty())
+                    continue;
+
+                const std::string& keyword = tokens[0];
+                if (keyword == "lfo")
+                {
+                    TopologyLfo lfo{};
+                    if (tokens.size() != 3 || !detail::parseFloat(tokens[1], lfo.frequency) || !detail::parseFloat(tokens[2], lfo.depthMs))
+                        return fail("expected: lfo <frequency> <depth ms>");
+                    topology.lfos.push_back(lfo);
+                }
+                else if (keyword == "stage")
+                {
+                    TopologyStage stage;
+                    for (size_t t = 1; t < tokens.size(); ++t)
+                    {
+                        if (tokens[t] == "scaleDelay")
+                            stage.scaleDelay = true;
+                        else if (tokens[t] == "scaleCoeff")
+                            stage.scaleCoeff = true;
+                        else if (tokens[t] == "attach")
+                            stage.attachSVF = true;
+                        else if (tokens[t] == "svf" && t + 2 < tokens.size()
+                            && detail::parseFloat(tokens[t + 1], stage.svfCutoff) && detail::parseFloat(tokens[t + 2], stage.svfGain))
+                        {
+                            stage.enableSVF = true;
+                            t += 2;
+                        }
+                        else
+                            return fail("unknown stage option '" + tokens[t] + "'");
+                    }
+                    if (stage.attachSVF && !stage.enableSVF)
+                        return fail("'attach' needs 'svf <cutoff> <gain>'");
+                    topology.stages.push_back(stage);
+                }
+                else if (keyword == "ap")
+                {
+                    if (topology.stages.empty())
+                        return fail("ap before the first stage");
+                    TopologyAP ap{};
+                    const bool lfoOk = tokens.size() == 4 && (tokens[3] == "none" ? (ap.lfoIndex = noLfo, true) : detail::parseIndex(tokens[3], ap.lfoIndex));
+                    if (!lfoOk || !detail::parseFloat(tokens[1], ap.delayMs) || !detail::parseFloat(tokens[2], ap.coefficient))
+                        return fail("expected: ap <delay ms> <coefficient> <lfo | none>");
+                    topology.stages.back().aps.push_back(ap);
+                }
+                else if (keyword == "connect")
+                {
+                    Connection c{};
+                    std::pair<bool, bool> ends{};
+                    const bool feedback = tokens.size() == 5 && tokens[4] == "feedback";
+                    if ((tokens.size() != 4 && !feedback) || !detail::parseNode(tokens[1], c.src, ends.first)
+                        || !detail::parseNode(tokens[2], c.dst, ends.second) || !detail::parseFloat(tokens[3], c.baseWeight))
+                        return fail("expected: connect <src> <dst> <weight> [feedback]");
+                    c.scaleFeedback = feedback;
+                    topology.connections.push_back(c);
+                    outputEnds.push_back(ends);
+                }
+                else
+                    return fail("unknown statement '" + keyword + "'");
+            }
+
+            for (size_t i = 0; i < topology.connections.size(); ++i)
+            {
+                if (outputEnds[i].first) topology.connections[i].src = topology.getOutputNode();
+                if (outputEnds[i].second) topology.connections[i].dst = topology.getOutputNode();
+            }
+            return true;
+        }
+
+        inline bool loadTopologyFile(const std::string& path, Topology& topology, std::string& error)
+        {
+            std::ifstream file(path);
+            if (!file)
+            {
+                error = "cannot open " + path;
+                return false;
+            }
+            std::stringstream text;
+            text << file.rdbuf();
+            return parseTopology(text.str(), topology, error);
+        }
+
+        // The preset text for `topology`; parseTopology() reads it back exactly.
+        inline std::string formatTopology(const Topology& topology)
+        {
+            using detail::formatFloat;
+            std::string text;
+            for (const auto& lfo : topology.lfos)
+                text += "lfo " + formatFloat(lfo.frequency) + " " + formatFloat(lfo.depthMs) + "\n";
+            for (const auto& stage : topology.stages)
+            {
+                text += "\nstage";
+                if (stage.scaleDelay) text += " scaleDelay";
+                if (stage.scaleCoeff) text += " scaleCoeff";
+                if (stage.enableSVF) text += " svf " + formatFloat(stage.svfCutoff) + " " + formatFloat(stage.svfGain);
+                if (stage.attachSVF) text += " attach";
+                text += "\n";
+                for (const auto& ap : stage.aps)
+                {
+                    text += "ap " + formatFloat(ap.delayMs) + " " + formatFloat(ap.coefficient) + " "
+                        + (ap.lfoIndex == noLfo ? std::string("none") : std::to_string(ap.lfoIndex)) + "\n";
+                }
+            }
+            text += "\n";
+            for (const auto& c : topology.connections)
+            {
+                text += "connect " + std::to_string(c.src) + " " + std::to_string(c.dst) + " " + formatFloat(c.baseWeight)
+                    + (c.scaleFeedback ? " feedback\n" : "\n");
+            }
+            return text;
+        }
+
+        // The topology of a compile-time Config, e.g. to export MyReverbConfig
+        // as a preset or to compare RuntimeReverb with MultiStageReverb.
+        template <typename StageConfig>
+        TopologyStage topologyStageFromConfig()
+        {
+            static_assert(isFlatAllpassStage<StageConfig>(), "topologies hold allpass stages without nesting only");
+            TopologyStage stage;
+            stage.scaleDelay = StageConfig::scaleDelay;
+            stage.scaleCoeff = StageConfig::scaleCoeff;
+            stage.enableSVF = StageConfig::enableSVF;
+            stage.svfCutoff = StageConfig::svfCutoff;
+            stage.svfGain = StageConfig::svfGain;
+            stage.attachSVF = StageConfig::attachSVF;
+            for (const auto& ap : StageConfig::aps)
+                stage.aps.push_back({ ap.delayMs, ap.coefficient, ap.lfoIndex });
+            return stage;
+        }
+
+        template <typename Config, size_t... Is>
+        Topology topologyFromConfig(std::index_sequence<Is...>)
+        {
+            Topology topology;
+            for (size_t i = 0; i < Config::NumGlobalLFOs; ++i)
+                topology.lfos.push_back({ Config::lfoFrequencies[i], Config::lfoDepthsMs[i] });
+            (topology.stages.push_back(topologyStageFromConfig<std::tuple_element_t<Is, typename Config::StageTuple>>()), ...);
+            topology.connections.assign(Config::connections.begin(), Config::connections.end());
+            return topology;
+        }
+
+        template <typename Config>
+        Topology topologyFromConfig()
+        {
+            return topologyFromConfig<Config>(std::make_index_sequence<Config::NumStages>{});
+        }
+
+    } // namespace multistage
+} // namespace project
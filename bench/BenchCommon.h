@@ -0,0 +1,57 @@
+#pragma once
+// Helpers shared by the benchmarks: a tick counter, seeded noise and
+// best-of-N timing.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC 1
+#else
+#define BENCH_HAS_TSC 0
+#endif
+
+// Time-stamp counter ticks where the target has one (x86), else nanoseconds.
+inline std::uint64_t ticks()
+{
+#if BENCH_HAS_TSC
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// What ticks() counts, for column headers.
+inline const char* tickUnit()
+{
+    return BENCH_HAS_TSC ? "cycles" : "ns";
+}
+
+// Uniform noise in [-amplitude, amplitude); the same seed gives the same noise.
+inline std::vector<float> makeNoise(int numSamples, unsigned seed = 1, float amplitude = 0.25f)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(-amplitude, amplitude);
+    std::vector<float> v(static_cast<size_t>(numSamples));
+    for (auto& x : v)
+        x = u(rng);
+    return v;
+}
+
+// Runs `run` `runs` times and returns the fastest, in ticks per sample.
+template <typename Run>
+double bestOfN(int runs, double numSamples, Run&& run)
+{
+    double best = 1.0e30;
+    for (int k = 0; k < runs; ++k)
+    {
+        const std::uint64_t start = ticks();
+        run();
+        best = std::min(best, static_cast<double>(ticks() - start) / numSamples);
+    }
+    return best;
+}
@@ -0,0 +1,163 @@
+// Denormal benchmark: cost of a long silent tail.
+//
+// Feeds one burst of noise, then silence, and reports ns/sample for each
+// window of the tail. Without protection the recirculating state decays
+// into subnormal floats after a while (how long depends on size, feedback
+// and density) and the cost per sample jumps; with protection it must stay
+// flat. Modes:
+//   off       MultiStageReverb::processBlock with the FTZ/DAZ guard switched off
+//   ftz       the same with the guard on (the default)
+//   sleep     AudioReverb::process, which also sleeps once the tail is inaudible
+// The software flush (GRIFFIN_SOFTWARE_DENORMAL_FLUSH) is a compile-time
+// switch and applies to every mode; build with -DGRIFFIN_SOFTWARE_DENORMAL_FLUSH=1
+// to measure it on a machine that has FTZ.
+//
+//   g++ -std=c++17 -O2 -mavx2 -mfma -I.. bench_denormals.cpp -o bench_denormals
+//   ./bench_denormals [tailSeconds] [windowSeconds] [size] [feedback] [density] [--csv]
+
+#include "MyReverbConfig.h"
+#include "AudioReverb.h"
+#include "BenchCommon.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+static constexpr float sampleRate = 48000.f;
+static constexpr int blockSize = 64;
+
+struct Settings {
+    double tailSeconds = 40.0;
+    double windowSeconds = 2.0;
+    float size = 0.5f;
+    float feedback = 0.f;
+    float density = 0.5f;
+    bool csv = false;
+};
+
+template <typename Reverb>
+static void setUp(Reverb& r, const Settings& s)
+{
+    r.prepare(sampleRate);
+    r.updateGlobalSizeParameter(s.size);
+    r.updateFeedbackParameter(s.feedback);
+    r.updateGlobalDensityParameter(s.density);
+    r.updateGlobalSVFParameters(8000.f, -6.f);
+}
+
+// Smallest nonzero |x| in the block, to show when the tail goes subnormal.
+static float smallestMagnitude(const float* x, int n, float current)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        const float a = std::fabs(x[i]);
+        if (a > 0.f && a < current)
+            current = a;
+    }
+    return current;
+}
+
+// Runs the burst and the tail; fills ns/sample and the smallest output per window.
+template <typename Process>
+static void runTail(const Settings& s, Process&& process, std::vector<double>& nsPerSample, std::vector<float>& smallest)
+{
+    std::vector<float> left(blockSize), right(blockSize);
+
+    const int burst = static_cast<int>(0.1 * sampleRate) / blockSize;
+    const auto noise = makeNoise(burst * blockSize, 7, 0.5f);
+    for (int b = 0; b < burst; ++b)
+    {
+        std::copy(noise.begin() + b * blockSize, noise.begin() + (b + 1) * blockSize, left.begin());
+        std::copy(left.begin(), left.end(), right.begin());
+        process(left.data(), right.data());
+    }
+
+    const int blocksPerWindow = static_cast<int>(s.windowSeconds * sampleRate) / blockSize;
+    const int numWindows = static_cast<int>(s.tailSeconds / s.windowSeconds);
+    for (int w = 0; w < numWindows; ++w)
+    {
+        double ns = 0.0;
+        float low = 1.f;
+        for (int b = 0; b < blocksPerWindow; ++b)
+        {
+            std::fill(left.begin(), left.end(), 0.f);
+            std::fill(right.begin(), right.end(), 0.f);
+            const auto start = std::chrono::steady_clock::now();
+            process(left.data(), right.data());
+            ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            low = smallestMagnitude(left.data(), blockSize, low);
+        }
+        nsPerSample.push_back(ns / (static_cast<double>(blocksPerWindow) * blockSize));
+        smallest.push_back(low < 1.f ? low : 0.f);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings s;
+    std::vector<const char*> args;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            s.csv = true;
+        else
+            args.push_back(argv[i]);
+    }
+    if (args.size() > 0) s.tailSeconds = std::atof(args[0]);
+    if (args.size() > 1) s.windowSeconds = std::atof(args[1]);
+    if (args.size() > 2) s.size = static_cast<float>(std::atof(args[2]));
+    if (args.size() > 3) s.feedback = static_cast<float>(std::atof(args[3]));
+    if (args.size() > 4) s.density = static_cast<float>(std::atof(args[4]));
+
+    std::vector<double> offNs, ftzNs, sleepNs;
+    std::vector<float> offLow, ftzLow, sleepLow;
+    std::vector<float> mono(blockSize);
+
+    {
+        auto engine = std::make_unique<MultiStageReverb<MyReverbConfig>>();
+        setUp(*engine, s);
+        engine->setDenormalGuard(false);
+        runTail(s, [&](float* l, float* r) {
+            for (int i = 0; i < blockSize; ++i)
+                mono[i] = 0.5f * (l[i] + r[i]);
+            engine->processBlock(mono.data(), l, blockSize);
+        }, offNs, offLow);
+    }
+    {
+        auto engine = std::make_unique<MultiStageReverb<MyReverbConfig>>();
+        setUp(*engine, s);
+        runTail(s, [&](float* l, float* r) {
+            for (int i = 0; i < blockSize; ++i)
+                mono[i] = 0.5f * (l[i] + r[i]);
+            engine->processBlock(mono.data(), l, blockSize);
+        }, ftzNs, ftzLow);
+    }
+    {
+        auto reverb = std::make_unique<AudioReverb<MyReverbConfig>>();
+        setUp(*reverb, s);
+        runTail(s, [&](float* l, float* r) { reverb->process(l, r, blockSize); }, sleepNs, sleepLow);
+    }
+
+    if (s.csv)
+    {
+        std::printf("tail_s,off_ns,ftz_ns,sleep_ns,off_smallest,ftz_smallest\n");
+        for (size_t w = 0; w < offNs.size(); ++w)
+            std::printf("%.1f,%.2f,%.2f,%.2f,%.3g,%.3g\n", (w + 1) * s.windowSeconds, offNs[w], ftzNs[w], sleepNs[w], offLow[w], ftzLow[w]);
+        return 0;
+    }
+
+    std::printf("size %.2f  feedback %.2f  density %.2f  software flush %s  FTZ control %s\n",
+        s.size, s.feedback, s.density, GRIFFIN_SOFTWARE_DENORMAL_FLUSH ? "on" : "off",
+        ScopedNoDenormals::isSupported() ? "yes" : "no");
+    std::printf("tail (s)   off ns/smp   ftz ns/smp   sleep ns/smp   smallest |out| off / ftz\n");
+    for (size_t w = 0; w < offNs.size(); ++w)
+        std::printf("%7.1f %12.2f %12.2f %14.2f   %10.3g / %-10.3g\n", (w + 1) * s.windowSeconds,
+            offNs[w], ftzNs[w], sleepNs[w], offLow[w], ftzLow[w]);
+    return 0;
+}
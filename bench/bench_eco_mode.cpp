@@ -0,0 +1,248 @@
+// Eco mode benchmark: AudioReverb at full, half and quarter processing rate.
+//
+// For host rates of 48 and 96 kHz it reports, per processing rate,
+//   - cycles per host sample of AudioReverb::processBlock (stereo out,
+//     64-sample blocks, MyReverbConfig), and the ratio to the full rate,
+//   - the resampling latency in host samples,
+//   - the output's octave-band levels on white noise relative to the full
+//     rate (Welch spectrum of the left channel), 125 Hz to 16 kHz: 0 dB
+//     where eco mode changes nothing, falling off above ~0.2 of the
+//     processing rate,
+//   - the RT60 of the impulse response (Schroeder integral, -5 to -35 dB)
+//     next to the full-rate one,
+//   - the output level of a sine at 0.4 of the host rate relative to the
+//     input sine: at full rate what the reverb itself passes (its
+//     interpolated delay reads already damp that high up), at reduced rates
+//     what the half-band filters let through or alias.
+// Cycles are time-stamp counter ticks where the target has one (x86), else
+// nanoseconds.
+//
+//   g++ -std=c++17 -O2 -mavx2 -mfma -I.. bench_eco_mode.cpp -o bench_eco_mode
+//   ./bench_eco_mode [seconds] [--csv]
+
+#include "MyReverbConfig.h"
+#include "AudioReverb.h"
+#include "BenchCommon.h"
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+using Reverb = AudioReverb<MyReverbConfig>;
+
+static constexpr int blockSize = 64;
+static constexpr double pi = 3.14159265358979323846;
+static constexpr int numBands = 8;      // Octaves from 125 Hz.
+
+static std::unique_ptr<Reverb> makeReverb(double sampleRate, ReverbRate rate)
+{
+    auto reverb = std::make_unique<Reverb>();
+    reverb->setProcessingRate(rate);
+    reverb->prepare(sampleRate);
+    reverb->updateGlobalSizeParameter(1.5f);
+    reverb->updateFeedbackParameter(0.7f);
+    reverb->updateGlobalDensityParameter(0.6f);
+    reverb->updateGlobalSVFParameters(8000.f, -6.f);
+    return reverb;
+}
+
+static void render(Reverb& reverb, const std::vector<float>& input, std::vector<float>& left, std::vector<float>& right)
+{
+    const int numSamples = static_cast<int>(input.size());
+    left.resize(input.size());
+    right.resize(input.size());
+    for (int pos = 0; pos < numSamples; pos += blockSize)
+        reverb.processBlock(input.data() + pos, left.data() + pos, right.data() + pos, std::min(blockSize, numSamples - pos));
+}
+
+// In-place radix-2 FFT.
+static void fft(std::vector<std::complex<double>>& x)
+{
+    const size_t n = x.size();
+    for (size_t i = 1, j = 0; i < n; ++i)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(x[i], x[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        const std::complex<double> step = std::polar(1.0, -2.0 * pi / static_cast<double>(len));
+        for (size_t i = 0; i < n; i += len)
+        {
+            std::complex<double> w = 1.0;
+            for (size_t k = 0; k < len / 2; ++k, w *= step)
+            {
+                const auto a = x[i + k];
+                const auto b = x[i + k + len / 2] * w;
+                x[i + k] = a + b;
+                x[i + k + len / 2] = a - b;
+            }
+        }
+    }
+}
+
+// Octave-band power (Welch, Hann, 50 % overlap) of signal[start..], bands
+// centred on 125 Hz * 2^b, cut off at Nyquist.
+static std::array<double, numBands> bandPowers(const std::vector<float>& signal, size_t start, double sampleRate)
+{
+    constexpr size_t frame = 8192;
+    std::array<double, numBands> bands{};
+    std::vector<std::complex<double>> buffer(frame);
+    for (size_t pos = start; pos + frame <= signal.size(); pos += frame / 2)
+    {
+        for (size_t i = 0; i < frame; ++i)
+            buffer[i] = signal[pos + i] * (0.5 - 0.5 * std::cos(2.0 * pi * i / frame));
+        fft(buffer);
+        for (size_t k = 1; k < frame / 2; ++k)
+        {
+            const double f = k * sampleRate / frame;
+            const int b = static_cast<int>(std::floor(std::log2(f / 125.0) + 0.5));
+            if (b >= 0 && b < numBands)
+                bands[static_cast<size_t>(b)] += std::norm(buffer[k]);
+        }
+    }
+    return bands;
+}
+
+// Seconds for the Schroeder-integrated energy of left + right to fall from
+// -5 to -35 dB, times two.
+static double rt60(const std::vector<float>& left, const std::vector<float>& right, double sampleRate)
+{
+    std::vector<double> energy(left.size());
+    double sum = 0.0;
+    for (size_t i = left.size(); i-- > 0;)
+    {
+        sum += static_cast<double>(left[i]) * left[i] + static_cast<double>(right[i]) * right[i];
+        energy[i] = sum;
+    }
+    size_t at5 = 0, at35 = 0;
+    for (size_t i = 0; i < energy.size(); ++i)
+    {
+        const double db = 10.0 * std::log10(energy[i] / energy[0] + 1.0e-30);
+        if (at5 == 0 && db <= -5.0)
+            at5 = i;
+        if (db <= -35.0)
+        {
+            at35 = i;
+            break;
+        }
+    }
+    return (at35 > at5) ? 2.0 * static_cast<double>(at35 - at5) / sampleRate : 0.0;
+}
+
+static double power(const std::vector<float>& signal, size_t start)
+{
+    double sum = 0.0;
+    for (size_t i = start; i < signal.size(); ++i)
+        sum += static_cast<double>(signal[i]) * signal[i];
+    return sum / static_cast<double>(signal.size() - start);
+}
+
+struct Measurement {
+    double cycles = 0.0;
+    std::array<double, numBands> bands{};
+    double rt60 = 0.0;
+    double sinePower = 0.0;
+    int latency = 0;
+};
+
+static Measurement measure(double sampleRate, ReverbRate rate, double seconds)
+{
+    Measurement m;
+    const auto noise = makeNoise(static_cast<int>(seconds * sampleRate));
+    std::vector<float> left, right;
+
+    auto reverb = makeReverb(sampleRate, rate);
+    m.latency = reverb->getLatencySamples();
+    m.cycles = bestOfN(5, static_cast<double>(noise.size()), [&] { render(*reverb, noise, left, right); });
+    // The last run started warm: the whole output is steady state.
+    m.bands = bandPowers(left, 0, sampleRate);
+
+    std::vector<float> impulse(static_cast<size_t>(8.0 * sampleRate), 0.f);
+    impulse[0] = 1.f;
+    reverb = makeReverb(sampleRate, rate);
+    render(*reverb, impulse, left, right);
+    m.rt60 = rt60(left, right, sampleRate);
+
+    // Faded in over a quarter second: a hard onset is a click whose low
+    // frequencies would still be ringing in the tail when measured.
+    std::vector<float> sine(static_cast<size_t>(sampleRate));
+    for (size_t i = 0; i < sine.size(); ++i)
+    {
+        const double fade = std::min(1.0, static_cast<double>(i) / (0.25 * sampleRate));
+        sine[i] = static_cast<float>(0.25 * fade * std::sin(2.0 * pi * 0.4 * static_cast<double>(i)));
+    }
+    reverb = makeReverb(sampleRate, rate);
+    render(*reverb, sine, left, right);
+    m.sinePower = power(left, sine.size() / 2);
+    return m;
+}
+
+static const char* rateName(ReverbRate rate)
+{
+    return rate == ReverbRate::Full ? "full" : rate == ReverbRate::Half ? "half" : "quarter";
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 4.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else
+            seconds = std::atof(argv[i]);
+    }
+
+    const char* unit = tickUnit();
+    if (csv)
+    {
+        std::printf("host_rate,rate,%s_per_sample,cpu_ratio,latency,rt60_s,sine_0.4fs_db", unit);
+        for (int b = 0; b < numBands; ++b)
+            std::printf(",band_%d_db", 125 << b);
+        std::printf("\n");
+    }
+
+    for (double sampleRate : { 48000.0, 96000.0 })
+    {
+        if (!csv)
+        {
+            std::printf("\n%.0f kHz host      %6s/smp  ratio latency  RT60 s  sine .4fs   band levels vs full, dB:", sampleRate / 1000.0, unit);
+            for (int b = 0; b < numBands; ++b)
+                std::printf(" %6d", 125 << b);
+            std::printf("\n");
+        }
+
+        Measurement full;
+        for (ReverbRate rate : { ReverbRate::Full, ReverbRate::Half, ReverbRate::Quarter })
+        {
+            const Measurement m = measure(sampleRate, rate, seconds);
+            if (rate == ReverbRate::Full)
+                full = m;
+            // The input sine has amplitude 1/4: power 1/32.
+            const double sineDb = 10.0 * std::log10(m.sinePower * 32.0 + 1.0e-30);
+            if (csv)
+                std::printf("%.0f,%s,%.2f,%.3f,%d,%.2f,%.1f", sampleRate, rateName(rate), m.cycles, m.cycles / full.cycles, m.latency, m.rt60, sineDb);
+            else
+                std::printf("  %-14s %10.1f %6.2f %7d %7.2f %9.1f   %26s", rateName(rate), m.cycles, m.cycles / full.cycles, m.latency, m.rt60, sineDb, "");
+            for (int b = 0; b < numBands; ++b)
+            {
+                const double db = 10.0 * std::log10(m.bands[static_cast<size_t>(b)] / full.bands[static_cast<size_t>(b)] + 1.0e-30);
+                std::printf(csv ? ",%.2f" : " %6.1f", db);
+            }
+            std::printf("\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+// FDN stage benchmark: FdnStage at 4, 8 and 16 lines vs a six-AP StageReverb.
+//
+// For every line count and matrix (Hadamard, Householder, general N x N) it
+// reports cycles per sample of the stage alone, unmodulated and with every
+// fourth line modulated, 64-sample blocks, next to MyReverbConfig's six-AP
+// StageConfig1. It also runs each FDN inside a MultiStageReverb, through
+// processSample and through processBlock, and prints the largest difference
+// between the two (0 unless FMA contraction differs) and the RT60 the stage
+// reports. Cycles are time-stamp counter ticks where the target has one
+// (x86), else nanoseconds.
+//
+//   g++ -std=c++17 -O2 -mavx2 -mfma -I.. bench_fdn.cpp -o bench_fdn
+//   ./bench_fdn [seconds] [--csv]
+
+#include "MyReverbConfig.h"
+#include "MultistageReverb.h"
+#include "BenchCommon.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+static constexpr float sampleRate = 48000.f;
+static constexpr int blockSize = 64;
+
+// Mutually prime-ish delays from 21 to 67 ms; N lines take every (16 / N)th.
+template <size_t N, FdnMatrix Matrix, bool Modulated>
+struct BenchFdn {
+    using StageKind = FdnStageKind;
+    static constexpr FdnMatrix matrix = Matrix;
+    static constexpr float decaySeconds = 2.f;
+    static constexpr bool scaleDelay = true;
+    static constexpr bool scaleCoeff = true;
+    static constexpr bool enableSVF = false;
+    static constexpr float svfCutoff = 0.f;
+    static constexpr float svfGain = 0.f;
+    static constexpr bool attachSVF = false;
+    struct Line { float delayMs; float damping; size_t lfoIndex; };
+
+    static constexpr std::array<Line, N> makeLines()
+    {
+        constexpr float delays[16] = { 21.5f, 23.9f, 27.1f, 29.7f, 31.3f, 33.7f, 37.1f, 39.9f,
+                                       41.3f, 43.7f, 47.3f, 51.1f, 53.9f, 57.7f, 61.3f, 67.1f };
+        std::array<Line, N> lines{};
+        for (size_t i = 0; i < N; ++i)
+            lines[i] = Line{ delays[i * 16 / N], 0.2f, Modulated && i % 4 == 0 ? i % 3 : noLfo };
+        return lines;
+    }
+    inline static constexpr auto lines = makeLines();
+
+    // The Hadamard matrix again, as plain coefficients, so the General path
+    // is timed on a matrix with no zeros.
+    static constexpr std::array<float, N * N> makeMatrix()
+    {
+        const float scale = N == 4 ? 0.5f : N == 8 ? 0.35355339f : 0.25f;
+        std::array<float, N * N> m{};
+        for (size_t r = 0; r < N; ++r)
+            for (size_t c = 0; c < N; ++c)
+            {
+                size_t bits = r & c, parity = 0;
+                for (; bits != 0; bits &= bits - 1)
+                    parity ^= 1;
+                m[r * N + c] = parity ? -scale : scale;
+            }
+        return m;
+    }
+    inline static constexpr auto matrixCoefficients = makeMatrix();
+};
+
+// MyReverbConfig's first stage into the FDN, both to the output.
+template <typename FdnConfig>
+struct BenchConfig {
+    static constexpr size_t NumGlobalLFOs = MyReverbConfig::NumGlobalLFOs;
+    inline static constexpr auto lfoFrequencies = MyReverbConfig::lfoFrequencies;
+    inline static constexpr auto lfoDepthsMs = MyReverbConfig::lfoDepthsMs;
+    using StageTuple = std::tuple<MyReverbConfig::StageConfig0, FdnConfig>;
+    static constexpr size_t NumStages = 2;
+    static constexpr size_t NumNodes = 4;
+    inline static constexpr std::array<Connection, 4> connections = { {
+        { 0, 1, 1.f, false },
+        { 1, 2, 1.f, false },
+        { 2, 3, 1.f, false },
+        { 1, 3, 0.5f, false },
+    } };
+};
+
+template <typename Config>
+static void setUp(MultiStageReverb<Config>& engine)
+{
+    engine.prepare(sampleRate);
+    engine.updateGlobalSizeParameter(1.3f);
+    engine.updateFeedbackParameter(0.7f);
+    engine.updateGlobalDensityParameter(0.8f);
+}
+
+// Largest |processSample - processBlock| over the input.
+template <typename FdnConfig>
+static float blockError(const std::vector<float>& input)
+{
+    auto bySample = std::make_unique<MultiStageReverb<BenchConfig<FdnConfig>>>();
+    auto byBlock = std::make_unique<MultiStageReverb<BenchConfig<FdnConfig>>>();
+    setUp(*bySample);
+    setUp(*byBlock);
+    std::vector<float> a(input.size()), b(input.size());
+    for (size_t i = 0; i < input.size(); ++i)
+        a[i] = bySample->processSample(input[i]);
+    const int numSamples = static_cast<int>(input.size());
+    for (int pos = 0; pos < numSamples; pos += 100)
+        byBlock->processBlock(input.data() + pos, b.data() + pos, std::min(100, numSamples - pos));
+    float maxDiff = 0.f;
+    for (size_t i = 0; i < a.size(); ++i)
+        maxDiff = std::max(maxDiff, std::fabs(a[i] - b[i]));
+    return maxDiff;
+}
+
+// Best of five, ticks per sample, for one stage fed by MyReverbConfig's LFOs.
+template <typename Stage>
+static double timeStage(const std::vector<float>& input, double& rt60)
+{
+    auto stage = std::make_unique<Stage>();
+    DelayArena arena;
+    arena.allocate(Stage::DelayMemorySize);
+    stage->attachDelayMemory(arena.data());
+    stage->prepare(sampleRate);
+    stage->updateDelayTimes(1.3f);
+    stage->updateCoefficientScaling(0.8f);
+
+    constexpr size_t numLfos = MyReverbConfig::NumGlobalLFOs;
+    LfoBank<numLfos> lfos;
+    std::array<float, numLfos> depths{};
+    for (size_t i = 0; i < numLfos; ++i)
+    {
+        depths[i] = msToSamples(MyReverbConfig::lfoDepthsMs[i], sampleRate);
+        lfos.setLfo(i, MyReverbConfig::lfoFrequencies[i], depths[i]);
+    }
+    lfos.prepare(sampleRate);
+    std::array<std::array<float, blockSize>, numLfos> lfoBlocks{};
+    std::array<float*, numLfos> writePtrs{};
+    std::array<const float*, numLfos> readPtrs{};
+    for (size_t i = 0; i < numLfos; ++i)
+    {
+        writePtrs[i] = lfoBlocks[i].data();
+        readPtrs[i] = lfoBlocks[i].data();
+    }
+    stage->setGlobalLfoDepths(depths.data());
+    stage->setGlobalLfoBlockPointers(readPtrs.data());
+
+    std::vector<float> output(input.size());
+    const int numSamples = static_cast<int>(input.size());
+    const double best = bestOfN(5, static_cast<double>(input.size()), [&] {
+        for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+        {
+            lfos.processBlock(writePtrs.data(), blockSize);
+            stage->processBlock(input.data() + pos, output.data() + pos, blockSize);
+        }
+    });
+    rt60 = static_cast<double>(stage->getRingSamples()) / sampleRate;
+    return best;
+}
+
+static const char* matrixName(FdnMatrix m)
+{
+    return m == FdnMatrix::Hadamard ? "hadamard" : m == FdnMatrix::Householder ? "householder" : "general";
+}
+
+template <size_t N, FdnMatrix Matrix, bool Modulated>
+static void runFdn(const std::vector<float>& input, const std::vector<float>& shortInput, double reference, bool csv)
+{
+    using Config = BenchFdn<N, Matrix, Modulated>;
+    double rt60 = 0.0;
+    const double t = timeStage<StageOf<Config>>(input, rt60);
+    const float diff = blockError<Config>(shortInput);
+    if (csv)
+        std::printf("fdn,%zu,%s,%d,%.2f,%.3f,%g,%.2f\n", N, matrixName(Matrix), Modulated ? 1 : 0, t, t / reference, diff, rt60);
+    else
+        std::printf("fdn %-3zu %-12s %-4s %10.1f %9.2f %13g %8.2f\n", N, matrixName(Matrix), Modulated ? "yes" : "no", t, t / reference, diff, rt60);
+}
+
+template <size_t N>
+static void runLineCount(const std::vector<float>& input, const std::vector<float>& shortInput, double reference, bool csv)
+{
+    runFdn<N, FdnMatrix::Hadamard, false>(input, shortInput, reference, csv);
+    runFdn<N, FdnMatrix::Hadamard, true>(input, shortInput, reference, csv);
+    runFdn<N, FdnMatrix::Householder, false>(input, shortInput, reference, csv);
+    runFdn<N, FdnMatrix::General, false>(input, shortInput, reference, csv);
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 2.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else
+            seconds = std::atof(argv[i]);
+    }
+
+    const auto input = makeNoise(static_cast<int>(seconds * sampleRate));
+    const auto shortInput = makeNoise(static_cast<int>(sampleRate));
+
+    const char* unit = tickUnit();
+    double rt60 = 0.0;
+    const double reference = timeStage<StageReverb<MyReverbConfig::StageConfig1>>(input, rt60);
+    if (csv)
+    {
+        std::printf("stage,lines,matrix,modulated,%s_per_sample,ratio_to_ap,block_error,rt60_s\n", unit);
+        std::printf("allpass,6,,1,%.2f,1.000,,%.2f\n", reference, rt60);
+    }
+    else
+    {
+        std::printf("stage lines matrix     mod %6s/smp  vs 6-AP  block error   RT60 s\n", unit);
+        std::printf("6-AP StageReverb       yes  %10.1f %9.2f %13s %8.2f\n", reference, 1.0, "-", rt60);
+    }
+
+    runLineCount<4>(input, shortInput, reference, csv);
+    runLineCount<8>(input, shortInput, reference, csv);
+    runLineCount<16>(input, shortInput, reference, csv);
+    return 0;
+}
@@ -0,0 +1,166 @@
+// Interpolation policy benchmark: none vs linear vs allpass vs cubic reads.
+//
+// For every policy it reports
+//   - cycles per sample of one modulated SimpleAP, through the per-sample
+//     path and the block path (the block path is what StageReverb runs for
+//     stages without a self-loop),
+//   - cycles per sample of a whole AudioReverb (MyReverbConfig with the
+//     policy set engine-wide), 64-sample blocks,
+//   - the read error of the policy on a sine at a modulated fractional delay,
+//     relative to the exact delayed sine, at a few frequencies.
+// Cycles are time-stamp counter ticks where the target has one (x86), else
+// nanoseconds.
+//
+//   g++ -std=c++17 -O2 -mavx2 -mfma -I.. bench_interpolation.cpp -o bench_interpolation
+//   ./bench_interpolation [seconds] [--csv]
+
+#include "MyReverbConfig.h"
+#include "AudioReverb.h"
+#include "BenchCommon.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+template <typename Interp>
+struct InterpConfig : MyReverbConfig { using Interpolation = Interp; };
+
+static constexpr float sampleRate = 48000.f;
+static constexpr int blockSize = 64;
+static constexpr double pi = 3.14159265358979323846;
+
+// A ~1 Hz modulation 8 samples deep, the kind the engine's LFOs produce.
+static std::vector<float> makeModulation(int numSamples, float depth)
+{
+    std::vector<float> v(static_cast<size_t>(numSamples));
+    for (int i = 0; i < numSamples; ++i)
+        v[static_cast<size_t>(i)] = depth * static_cast<float>(std::sin(2.0 * pi * 0.9 * i / sampleRate));
+    return v;
+}
+
+template <typename Interp>
+static void timeAllpass(const std::vector<float>& input, const std::vector<float>& lfo, double& perSample, double& perBlock)
+{
+    const float depth = 8.f;
+    SimpleAP<FloatDelayStorage, Interp> ap(10.f, 0.6f, 0, false, false);
+    DelayArena memory(delayArenaFloats<>(10.f, false));
+    ap.attachBuffer(memory.data());
+    ap.prepare(sampleRate);
+    ap.setModulationDepth(depth);
+
+    const int numSamples = static_cast<int>(input.size());
+    std::vector<float> out(input.size());
+    volatile float sink = 0.f;
+
+    perSample = bestOfN(3, numSamples, [&] {
+        for (int i = 0; i < numSamples; ++i)
+            out[static_cast<size_t>(i)] = ap.processSample(input[static_cast<size_t>(i)], lfo[static_cast<size_t>(i)]);
+        sink = out[static_cast<size_t>(numSamples - 1)];
+    });
+    perBlock = bestOfN(3, numSamples, [&] {
+        for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+            ap.processBlock(input.data() + pos, out.data() + pos, lfo.data() + pos, blockSize);
+        sink = out[static_cast<size_t>(numSamples - 1)];
+    });
+    (void)sink;
+}
+
+template <typename Interp>
+static double timeEngine(const std::vector<float>& input)
+{
+    auto reverb = std::make_unique<AudioReverb<InterpConfig<Interp>>>();
+    reverb->prepare(sampleRate);
+    reverb->updateGlobalSizeParameter(1.5f);
+    reverb->updateFeedbackParameter(0.7f);
+    reverb->updateGlobalDensityParameter(0.6f);
+    reverb->updateGlobalSVFParameters(8000.f, -6.f);
+
+    const int numSamples = static_cast<int>(input.size());
+    std::vector<float> left(blockSize), right(blockSize);
+    return bestOfN(3, numSamples, [&] {
+        for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+        {
+            std::memcpy(left.data(), input.data() + pos, sizeof(float) * blockSize);
+            std::memcpy(right.data(), input.data() + pos, sizeof(float) * blockSize);
+            reverb->process(left.data(), right.data(), blockSize);
+        }
+    });
+}
+
+// RMS error of reading a sine through the policy at 20 +- 8 samples of delay,
+// in dB relative to the sine.
+template <typename Interp>
+static double readErrorDb(double frequency)
+{
+    constexpr int size = 64;
+    constexpr int numSamples = 48000;
+    constexpr int settle = 256;
+    float buffer[size] = {};
+    typename Interp::State state{};
+    const double w = 2.0 * pi * frequency / sampleRate;
+
+    double err = 0.0, ref = 0.0;
+    for (int n = 0; n < numSamples; ++n)
+    {
+        const float delay = 20.f + 8.f * static_cast<float>(std::sin(2.0 * pi * 3.0 * n / sampleRate));
+        const int writeIndex = n & (size - 1);
+        const float value = Interp::template read<FloatDelayStorage>(buffer, size - 1, writeIndex, std::max(delay, Interp::minDelay), state);
+        buffer[writeIndex] = static_cast<float>(std::sin(w * n));
+        if (n >= settle)
+        {
+            const double exact = std::sin(w * (n - static_cast<double>(delay)));
+            err += (value - exact) * (value - exact);
+            ref += exact * exact;
+        }
+    }
+    return 10.0 * std::log10(std::max(err / ref, 1.0e-30));
+}
+
+template <typename Interp>
+static void report(const char* name, const std::vector<float>& input, const std::vector<float>& lfo, bool csv)
+{
+    double apSample = 0.0, apBlock = 0.0;
+    timeAllpass<Interp>(input, lfo, apSample, apBlock);
+    const double engine = timeEngine<Interp>(input);
+    const double e1k = readErrorDb<Interp>(1000.0);
+    const double e5k = readErrorDb<Interp>(5000.0);
+    const double e12k = readErrorDb<Interp>(12000.0);
+    if (csv)
+        std::printf("%s,%.2f,%.2f,%.1f,%.1f,%.1f,%.1f\n", name, apSample, apBlock, engine, e1k, e5k, e12k);
+    else
+        std::printf("%-8s %11.2f %10.2f %12.1f %10.1f %9.1f %9.1f\n", name, apSample, apBlock, engine, e1k, e5k, e12k);
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 1.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else
+            seconds = std::atof(argv[i]);
+    }
+
+    const int numSamples = static_cast<int>(seconds * sampleRate) / blockSize * blockSize;
+    const auto input = makeNoise(numSamples);
+    const auto lfo = makeModulation(numSamples, 8.f);
+
+    const char* unit = tickUnit();
+    if (csv)
+        std::printf("policy,ap_sample_%s,ap_block_%s,engine_%s,error_db_1k,error_db_5k,error_db_12k\n", unit, unit, unit);
+    else
+        std::printf("policy   AP sample/smp  block/smp  engine/smp   err 1 kHz  err 5 kHz  err 12 kHz   (%s, dB rel.)\n", unit);
+
+    report<NoInterpolation>("none", input, lfo, csv);
+    report<LinearInterpolation>("linear", input, lfo, csv);
+    report<AllpassInterpolation>("allpass", input, lfo, csv);
+    report<CubicInterpolation>("cubic", input, lfo, csv);
+    return 0;
+}
@@ -0,0 +1,240 @@
+// Runtime ISA dispatch benchmark (ReverbDispatch.h).
+//
+// For every instruction set the CPU supports (scalar, SSE4.1, AVX2, AVX-512)
+// it reports cycles per sample, 64-sample blocks, of that ISA's variant of
+//   allpass      one modulated long-delay allpass, linear read
+//   allpass nn   the same with the nearest-sample read
+//   lfo 3 / 16   the LFO kernel on MyReverbConfig's 3 LFOs, and on 16
+//   shelf        the shelf kernel (LexiconShelvingFilter's recurrence)
+//   mix 4        a four-input mix-down, MultiStageReverb's routing sum
+// and of
+//   engine       MultiStageReverb<MyReverbConfig>::processBlock
+// with that ISA forced, so with select()'s per-kernel choice: the shelf and
+// the 3-LFO bank run at most the SSE4.1 variant. Each with the speedup over
+// scalar, and whether the engine's output is bit-identical to the scalar
+// run's. The kernel columns are what the caps in ReverbDispatch.h rest on.
+// Cycles are time-stamp counter ticks where the target has one (x86), else
+// nanoseconds.
+//
+// Build it for the baseline target, as a shipped binary is (CMake does; no
+// -march=native), or the "scalar" variant is compiled for the build machine
+// too and the inline paths may differ from the kernels by FMA contraction.
+//
+//   g++ -std=c++17 -O2 -I.. bench_isa_dispatch.cpp -o bench_isa_dispatch
+//   ./bench_isa_dispatch [seconds] [--csv]
+
+#include "MyReverbConfig.h"
+#include "MultistageReverb.h"
+#include "BenchCommon.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+static constexpr float sampleRate = 48000.f;
+static constexpr int blockSize = 64;
+
+#if GRIFFIN_RUNTIME_DISPATCH
+
+struct Input {
+    std::vector<float> signal;
+    std::vector<float> lfo;      // +-8 samples.
+    std::vector<float> sources;  // Four blocks' worth per block, for the mix.
+};
+
+static double timeAllpass(const dispatch::DspKernels& kernels, const Input& in, bool linear)
+{
+    constexpr int size = 8192;
+    std::vector<float> buffer(size, 0.f), out(blockSize);
+    const auto kernel = linear ? kernels.allpassLinear : kernels.allpassNearest;
+    const int numSamples = static_cast<int>(in.signal.size());
+    int writeIndex = 0;
+    volatile float sink = 0.f;
+    const double t = bestOfN(5, numSamples, [&] {
+        for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+            writeIndex = kernel(buffer.data(), size - 1, writeIndex, 1000.3f, 0.6f, in.signal.data() + pos, out.data(),
+                in.lfo.data() + pos, blockSize);
+        sink = out[blockSize - 1];
+    });
+    (void)sink;
+    return t;
+}
+
+// The kernel as LfoBank drives it at full rate: phases in [0, 1), per-sample
+// increments, every LFO written out.
+template <int NumLFOs>
+static double timeLfo(const dispatch::DspKernels& kernels, int numSamples)
+{
+    std::array<float, NumLFOs> phases{}, increments, amplitudes;
+    for (int i = 0; i < NumLFOs; ++i)
+    {
+        increments[i] = (0.2f + 0.13f * static_cast<float>(i)) / sampleRate;
+        amplitudes[i] = 8.f;
+    }
+    std::vector<float> blocks(NumLFOs * blockSize);
+    std::array<float*, NumLFOs> ptrs;
+    for (int i = 0; i < NumLFOs; ++i)
+        ptrs[i] = blocks.data() + i * blockSize;
+    volatile float sink = 0.f;
+    const double t = bestOfN(5, numSamples, [&] {
+        for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+            kernels.lfoFullRate(phases.data(), increments.data(), amplitudes.data(), NumLFOs, ptrs.data(), NumLFOs, blockSize);
+        sink = blocks[0];
+    });
+    (void)sink;
+    return t;
+}
+
+static double timeShelf(const dispatch::DspKernels& kernels, const Input& in)
+{
+    LexiconShelvingFilter shelf;
+    shelf.setParameters(8000.f, -6.f, sampleRate);
+    float coefficients[3];
+    shelf.getCoefficients(coefficients[0], coefficients[1], coefficients[2]);
+    float state[2] = { 0.f, 0.f };
+    std::vector<float> out(blockSize);
+    const int numSamples = static_cast<int>(in.signal.size());
+    volatile float sink = 0.f;
+    const double t = bestOfN(5, numSamples, [&] {
+        for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+            kernels.shelf(in.signal.data() + pos, out.data(), blockSize, coefficients, state);
+        sink = out[blockSize - 1];
+    });
+    (void)sink;
+    return t;
+}
+
+static double timeMix(const dispatch::DspKernels& kernels, const Input& in)
+{
+    const float weights[4] = { 0.7f, -0.35f, 0.5f, 0.25f };
+    std::vector<float> out(blockSize);
+    const int numSamples = static_cast<int>(in.signal.size());
+    volatile float sink = 0.f;
+    const double t = bestOfN(5, numSamples, [&] {
+        for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+        {
+            const float* base = in.sources.data() + 4 * pos;
+            const float* const sources[4] = { base, base + blockSize, base + 2 * blockSize, base + 3 * blockSize };
+            kernels.mix(out.data(), sources, weights, 4, blockSize);
+        }
+        sink = out[blockSize - 1];
+    });
+    (void)sink;
+    return t;
+}
+
+// Also leaves the engine's output of the last run in output.
+static double timeEngine(const Input& in, std::vector<float>& output)
+{
+    auto engine = std::make_unique<MultiStageReverb<MyReverbConfig>>();
+    const int numSamples = static_cast<int>(in.signal.size());
+    output.assign(in.signal.size(), 0.f);
+    return bestOfN(5, numSamples, [&] {
+        engine->prepare(sampleRate);
+        engine->updateGlobalSizeParameter(1.5f);
+        engine->updateFeedbackParameter(0.7f);
+        engine->updateGlobalDensityParameter(0.6f);
+        engine->updateGlobalSVFParameters(8000.f, -6.f);
+        for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+            engine->processBlock(in.signal.data() + pos, output.data() + pos, blockSize);
+    });
+}
+
+static constexpr int numKernels = 7;
+static const char* const kernelNames[numKernels] = { "allpass", "allpass nn", "lfo 3", "lfo 16", "shelf", "mix 4", "engine" };
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 2.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else
+            seconds = std::atof(argv[i]);
+    }
+
+    const int numSamples = std::max(blockSize, static_cast<int>(seconds * sampleRate) / blockSize * blockSize);
+    Input in;
+    in.signal = makeNoise(numSamples, 1, 0.25f);
+    in.lfo = makeNoise(numSamples, 2, 8.f);
+    in.sources = makeNoise(4 * numSamples, 3, 0.5f);
+
+    const int best = static_cast<int>(dispatch::detectIsa());
+    std::vector<std::array<double, numKernels>> results;
+    std::vector<float> reference, output;
+    std::vector<double> engineDiff;
+    for (int isa = 0; isa <= best; ++isa)
+    {
+        const dispatch::DspKernels& kernels = dispatch::kernelsFor(static_cast<dispatch::Isa>(isa));
+        std::array<double, numKernels> r{};
+        r[0] = timeAllpass(kernels, in, true);
+        r[1] = timeAllpass(kernels, in, false);
+        r[2] = timeLfo<static_cast<int>(MyReverbConfig::NumGlobalLFOs)>(kernels, numSamples);
+        r[3] = timeLfo<16>(kernels, numSamples);
+        r[4] = timeShelf(kernels, in);
+        r[5] = timeMix(kernels, in);
+        dispatch::forceIsa(static_cast<dispatch::Isa>(isa));
+        dispatch::select();
+        r[6] = timeEngine(in, isa == 0 ? reference : output);
+        results.push_back(r);
+        double diff = 0.0;
+        if (isa > 0)
+        {
+            for (size_t i = 0; i < output.size(); ++i)
+                diff = std::max(diff, std::fabs(static_cast<double>(output[i]) - reference[i]));
+        }
+        engineDiff.push_back(diff);
+    }
+    dispatch::clearForcedIsa();
+    dispatch::select();
+
+    const char* unit = tickUnit();
+    if (csv)
+    {
+        std::printf("isa,kernel,%s_per_sample,speedup\n", unit);
+        for (size_t isa = 0; isa < results.size(); ++isa)
+        {
+            for (int k = 0; k < numKernels; ++k)
+                std::printf("%s,%s,%.4f,%.3f\n", dispatch::isaName(static_cast<dispatch::Isa>(isa)), kernelNames[k],
+                    results[isa][k], results[0][k] / results[isa][k]);
+        }
+        return 0;
+    }
+
+    std::printf("%d-sample blocks, %s/sample (speedup over scalar)\n\n%-8s", blockSize, unit, "isa");
+    for (int k = 0; k < numKernels; ++k)
+        std::printf(" %17s", kernelNames[k]);
+    std::printf("  engine output\n");
+    for (size_t isa = 0; isa < results.size(); ++isa)
+    {
+        std::printf("%-8s", dispatch::isaName(static_cast<dispatch::Isa>(isa)));
+        for (int k = 0; k < numKernels; ++k)
+            std::printf(" %9.2f (%4.2fx)", results[isa][k], results[0][k] / results[isa][k]);
+        if (isa == 0)
+            std::printf("  reference\n");
+        else if (engineDiff[isa] == 0.0)
+            std::printf("  bit-identical\n");
+        else
+            std::printf("  max diff %.3g\n", engineDiff[isa]);
+    }
+    return 0;
+}
+
+#else
+
+int main()
+{
+    std::printf("runtime ISA dispatch is not compiled in (GRIFFIN_RUNTIME_DISPATCH 0)\n");
+    return 0;
+}
+
+#endif
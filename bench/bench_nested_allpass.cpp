@@ -0,0 +1,258 @@
+// Nested allpass benchmark: echo density per cycle, nested vs flat chains.
+//
+// Every configuration is one StageReverb built from the delays of
+// MyReverbConfig::StageConfig1 (coefficient 0.7), either in series (flat) or
+// nested with the `nested` AP field. For each it reports
+//   - echoes: samples of the impulse response above -60 dB in the first
+//     100 ms and 1 s, with the APs unmodulated so every echo is one sample,
+//   - the impulse response energy, which is 1 for anything allpass,
+//   - cycles per sample of processBlock with the APs modulated as in the
+//     presets, 64-sample blocks, and the largest difference between
+//     processBlock and processSampleInBlock (0 unless FMA contraction differs),
+//   - echoes in 1 s per cycle per sample, the figure of merit: how much
+//     density each cycle spent buys.
+// With the same delays, nesting moves energy between echoes but cannot add
+// echo times: every echo still lands on a sum of the AP delays. Compare
+// layouts at equal cost, or nested layouts against longer flat chains.
+// Cycles are time-stamp counter ticks where the target has one (x86), else
+// nanoseconds.
+//
+//   g++ -std=c++17 -O2 -mavx2 -mfma -I.. bench_nested_allpass.cpp -o bench_nested_allpass
+//   ./bench_nested_allpass [seconds] [--csv]
+
+#include "MyReverbConfig.h"
+#include "StageReverb.h"
+#include "DelayArena.h"
+#include "LfoBank.h"
+#include "BenchCommon.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+static constexpr float sampleRate = 48000.f;
+static constexpr int blockSize = 64;
+
+struct NestedAP {
+    float delayMs;
+    float coefficient;
+    size_t lfoIndex;
+    size_t nested = 0;
+};
+
+// The stage settings every configuration shares; Layout supplies the APs.
+// Unmodulated layouts drop the LFOs so each echo lands on one sample.
+template <typename Layout, bool Modulated>
+struct BenchStage {
+    static constexpr bool scaleDelay = true;
+    static constexpr bool scaleCoeff = true;
+    static constexpr bool enableSVF = false;
+    static constexpr float svfCutoff = 0.f;
+    static constexpr float svfGain = 0.f;
+    static constexpr bool attachSVF = false;
+
+    static constexpr auto makeAPs()
+    {
+        auto aps = Layout::aps;
+        for (auto& ap : aps)
+            ap.lfoIndex = Modulated ? ap.lfoIndex : noLfo;
+        return aps;
+    }
+    inline static constexpr auto aps = makeAPs();
+};
+
+// StageConfig1's delays, 6.25 to 60.42 ms.
+struct Flat6 {
+    static constexpr const char* name = "flat 6";
+    inline static constexpr auto aps = ms_make_array(
+        NestedAP{ 6.25f, 0.7f, 0 },
+        NestedAP{ 14.5833f, 0.7f, 1 },
+        NestedAP{ 22.9167f, 0.7f, 2 },
+        NestedAP{ 39.5833f, 0.7f, 0 },
+        NestedAP{ 47.9167f, 0.7f, 1 },
+        NestedAP{ 60.4167f, 0.7f, 2 });
+};
+
+struct Flat4 {
+    static constexpr const char* name = "flat 4";
+    inline static constexpr auto aps = ms_make_array(
+        NestedAP{ 6.25f, 0.7f, 0 },
+        NestedAP{ 14.5833f, 0.7f, 1 },
+        NestedAP{ 39.5833f, 0.7f, 0 },
+        NestedAP{ 60.4167f, 0.7f, 2 });
+};
+
+// Two outer APs, one inner each.
+struct Nested4 {
+    static constexpr const char* name = "nested 2x(1+1)";
+    inline static constexpr auto aps = ms_make_array(
+        NestedAP{ 39.5833f, 0.7f, 0, 1 },
+        NestedAP{ 6.25f, 0.7f, 0 },
+        NestedAP{ 60.4167f, 0.7f, 2, 1 },
+        NestedAP{ 14.5833f, 0.7f, 1 });
+};
+
+// Two outer APs, a chain of two inside each.
+struct Nested6 {
+    static constexpr const char* name = "nested 2x(1+2)";
+    inline static constexpr auto aps = ms_make_array(
+        NestedAP{ 47.9167f, 0.7f, 1, 2 },
+        NestedAP{ 6.25f, 0.7f, 0 },
+        NestedAP{ 22.9167f, 0.7f, 2 },
+        NestedAP{ 60.4167f, 0.7f, 2, 2 },
+        NestedAP{ 14.5833f, 0.7f, 1 },
+        NestedAP{ 39.5833f, 0.7f, 0 });
+};
+
+// Two levels: outer, middle, inner, twice.
+struct Nested6Deep {
+    static constexpr const char* name = "nested 2x(1+1+1)";
+    inline static constexpr auto aps = ms_make_array(
+        NestedAP{ 60.4167f, 0.7f, 2, 2 },
+        NestedAP{ 22.9167f, 0.7f, 2, 1 },
+        NestedAP{ 6.25f, 0.7f, 0 },
+        NestedAP{ 47.9167f, 0.7f, 1, 2 },
+        NestedAP{ 39.5833f, 0.7f, 0, 1 },
+        NestedAP{ 14.5833f, 0.7f, 1 });
+};
+
+template <typename Stage>
+struct StageRig {
+    std::unique_ptr<Stage> stage = std::make_unique<Stage>();
+    DelayArena arena;
+    LfoBank<MyReverbConfig::NumGlobalLFOs> lfos;
+    std::array<std::array<float, blockSize>, MyReverbConfig::NumGlobalLFOs> lfoBlocks{};
+    std::array<float*, MyReverbConfig::NumGlobalLFOs> writePtrs{};
+    std::array<const float*, MyReverbConfig::NumGlobalLFOs> readPtrs{};
+
+    StageRig()
+    {
+        arena.allocate(Stage::DelayMemorySize);
+        stage->attachDelayMemory(arena.data());
+        stage->prepare(sampleRate);
+        stage->updateDelayTimes(1.f);
+        stage->updateCoefficientScaling(1.f);
+
+        std::array<float, MyReverbConfig::NumGlobalLFOs> depths{};
+        for (size_t i = 0; i < depths.size(); ++i)
+        {
+            depths[i] = msToSamples(MyReverbConfig::lfoDepthsMs[i], sampleRate);
+            lfos.setLfo(i, MyReverbConfig::lfoFrequencies[i], depths[i]);
+            writePtrs[i] = lfoBlocks[i].data();
+            readPtrs[i] = lfoBlocks[i].data();
+        }
+        lfos.prepare(sampleRate);
+        stage->setGlobalLfoDepths(depths.data());
+        stage->setGlobalLfoBlockPointers(readPtrs.data());
+    }
+
+    void render(const float* in, float* out, int numSamples, bool perSample)
+    {
+        for (int pos = 0; pos + blockSize <= numSamples; pos += blockSize)
+        {
+            lfos.processBlock(writePtrs.data(), blockSize);
+            if (perSample)
+            {
+                for (int i = 0; i < blockSize; ++i)
+                    out[pos + i] = stage->processSampleInBlock(in[pos + i], i);
+            }
+            else
+                stage->processBlock(in + pos, out + pos, blockSize);
+        }
+    }
+};
+
+struct Result {
+    int echoes100 = 0;
+    int echoes1000 = 0;
+    double energy = 0.0;
+    double cycles = 0.0;
+    float blockError = 0.f;
+};
+
+template <typename Layout>
+static Result measure(const std::vector<float>& input)
+{
+    Result result;
+
+    // Impulse response of the unmodulated layout.
+    {
+        StageRig<StageReverb<BenchStage<Layout, false>>> rig;
+        const int length = static_cast<int>(4.f * sampleRate);
+        const int at100 = static_cast<int>(0.1f * sampleRate);
+        const int at1000 = static_cast<int>(sampleRate);
+        for (int i = 0; i < length; ++i)
+        {
+            const float h = rig.stage->processSample(i == 0 ? 1.f : 0.f);
+            result.energy += static_cast<double>(h) * h;
+            if (std::fabs(h) >= 1.0e-3f)
+            {
+                result.echoes100 += i < at100 ? 1 : 0;
+                result.echoes1000 += i < at1000 ? 1 : 0;
+            }
+        }
+    }
+
+    using Modulated = StageReverb<BenchStage<Layout, true>>;
+    const int numSamples = static_cast<int>(input.size());
+    std::vector<float> a(input.size()), b(input.size());
+    {
+        StageRig<Modulated> bySample, byBlock;
+        bySample.render(input.data(), a.data(), numSamples, true);
+        byBlock.render(input.data(), b.data(), numSamples, false);
+        for (size_t i = 0; i < a.size(); ++i)
+            result.blockError = std::max(result.blockError, std::fabs(a[i] - b[i]));
+    }
+
+    // Best of five.
+    StageRig<Modulated> rig;
+    result.cycles = bestOfN(5, numSamples, [&] { rig.render(input.data(), b.data(), numSamples, false); });
+    return result;
+}
+
+template <typename Layout>
+static void run(const std::vector<float>& input, bool csv)
+{
+    const Result r = measure<Layout>(input);
+    const size_t numAPs = Layout::aps.size();
+    if (csv)
+        std::printf("%s,%zu,%d,%d,%.4f,%.2f,%g,%.1f\n", Layout::name, numAPs, r.echoes100, r.echoes1000, r.energy,
+            r.cycles, r.blockError, r.echoes1000 / r.cycles);
+    else
+        std::printf("%-18s %3zu %8d %9d %8.4f %10.1f %12g %12.1f\n", Layout::name, numAPs, r.echoes100, r.echoes1000, r.energy,
+            r.cycles, r.blockError, r.echoes1000 / r.cycles);
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 2.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else
+            seconds = std::atof(argv[i]);
+    }
+
+    const auto input = makeNoise(static_cast<int>(seconds * sampleRate));
+
+    const char* unit = tickUnit();
+    if (csv)
+        std::printf("layout,aps,echoes_100ms,echoes_1s,energy,%s_per_sample,block_error,echoes_1s_per_%s\n", unit, unit);
+    else
+        std::printf("layout             APs  echoes   echoes    energy %6s/smp  block error  echoes/%s\n"
+                    "                        <100ms      <1s\n", unit, unit);
+
+    run<Flat4>(input, csv);
+    run<Flat6>(input, csv);
+    run<Nested4>(input, csv);
+    run<Nested6>(input, csv);
+    run<Nested6Deep>(input, csv);
+    return 0;
+}
@@ -0,0 +1,148 @@
+// Runtime topology benchmark: RuntimeReverb vs the compile-time engine.
+//
+// MyReverbConfig is exported with topologyFromConfig(), written out as preset
+// text and parsed back, so the runtime engine runs exactly the compiled
+// topology. Both engines get the same parameters and the same noise; the
+// benchmark checks that the outputs agree and reports cycles per sample of
+// each at a few block sizes, plus the runtime/compile-time ratio.
+// With --preset <file> it also times the runtime engine on that preset.
+// --export prints MyReverbConfig as preset text and exits.
+//
+//   g++ -std=c++17 -O2 -mavx2 -mfma -I.. bench_runtime_topology.cpp -o bench_runtime_topology
+//   ./bench_runtime_topology [seconds] [--preset file] [--export] [--csv]
+
+#include "MyReverbConfig.h"
+#include "MultistageReverb.h"
+#include "RuntimeReverb.h"
+#include "BenchCommon.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+static constexpr float sampleRate = 48000.f;
+
+template <typename Engine>
+static void setUp(Engine& engine)
+{
+    engine.prepare(sampleRate);
+    engine.updateGlobalSizeParameter(1.5f);
+    engine.updateFeedbackParameter(0.7f);
+    engine.updateGlobalDensityParameter(0.6f);
+    engine.updateGlobalSVFParameters(8000.f, -6.f);
+}
+
+template <typename Engine>
+static void render(Engine& engine, const std::vector<float>& input, std::vector<float>& output, int blockSize)
+{
+    const int numSamples = static_cast<int>(input.size());
+    for (int pos = 0; pos < numSamples; pos += blockSize)
+        engine.processBlock(input.data() + pos, output.data() + pos, std::min(blockSize, numSamples - pos));
+}
+
+// Best of five, ticks per sample.
+template <typename Engine>
+static double timeEngine(Engine& engine, const std::vector<float>& input, int blockSize)
+{
+    std::vector<float> output(input.size());
+    return bestOfN(5, static_cast<double>(input.size()), [&] { render(engine, input, output, blockSize); });
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 2.0;
+    const char* presetPath = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (std::strcmp(argv[i], "--export") == 0)
+        {
+            std::printf("%s", formatTopology(topologyFromConfig<MyReverbConfig>()).c_str());
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--preset") == 0 && i + 1 < argc)
+            presetPath = argv[++i];
+        else
+            seconds = std::atof(argv[i]);
+    }
+
+    // Round trip through the preset text, as a plugin would load it.
+    Topology topology;
+    std::string error;
+    if (!parseTopology(formatTopology(topologyFromConfig<MyReverbConfig>()), topology, error))
+    {
+        std::fprintf(stderr, "preset round trip failed: %s\n", error.c_str());
+        return 1;
+    }
+
+    auto compiled = std::make_unique<MultiStageReverb<MyReverbConfig>>();
+    auto runtime = std::make_unique<RuntimeReverb<>>();
+    if (!runtime->load(topology, error))
+    {
+        std::fprintf(stderr, "load failed: %s\n", error.c_str());
+        return 1;
+    }
+
+    const int numSamples = static_cast<int>(seconds * sampleRate);
+    const auto input = makeNoise(numSamples);
+
+    // Same output?
+    setUp(*compiled);
+    setUp(*runtime);
+    std::vector<float> a(input.size()), b(input.size());
+    render(*compiled, input, a, 100);
+    render(*runtime, input, b, 100);
+    float maxDiff = 0.f, peak = 0.f;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        maxDiff = std::max(maxDiff, std::fabs(a[i] - b[i]));
+        peak = std::max(peak, std::fabs(a[i]));
+    }
+
+    const char* unit = tickUnit();
+    if (csv)
+        std::printf("engine,block,%s_per_sample,ratio\n", unit);
+    else
+        std::printf("max |runtime - compiled| = %g (peak %g), %zu steps\n\nblock   compiled %s/smp   runtime %s/smp   ratio\n",
+            maxDiff, peak, runtime->getNumSteps(), unit, unit);
+
+    for (int blockSize : { 32, 64, 128, 512 })
+    {
+        setUp(*compiled);
+        setUp(*runtime);
+        const double c = timeEngine(*compiled, input, blockSize);
+        const double r = timeEngine(*runtime, input, blockSize);
+        if (csv)
+        {
+            std::printf("compiled,%d,%.2f,1.000\n", blockSize, c);
+            std::printf("runtime,%d,%.2f,%.3f\n", blockSize, r, r / c);
+        }
+        else
+            std::printf("%5d %17.1f %16.1f %8.3f\n", blockSize, c, r, r / c);
+    }
+
+    if (presetPath != nullptr)
+    {
+        auto custom = std::make_unique<RuntimeReverb<>>();
+        if (!loadTopologyFile(presetPath, topology, error) || !custom->load(topology, error))
+        {
+            std::fprintf(stderr, "%s: %s\n", presetPath, error.c_str());
+            return 1;
+        }
+        setUp(*custom);
+        const double r = timeEngine(*custom, input, 64);
+        if (csv)
+            std::printf("preset,64,%.2f,\n", r);
+        else
+            std::printf("\n%s: %zu stages, %zu steps, %.1f %s/smp at 64\n", presetPath, custom->getNumStages(), custom->getNumSteps(), r, unit);
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+// Multi-stream scheduler benchmark (ReverbScheduler.h).
+//
+// Runs --streams AudioReverb<MyReverbConfig, MyReverbCrossFeed> streams (256
+// by default) through a ReverbScheduler at 48 kHz, periods of --block samples
+// (64) back to back, on 1, 2, 4, ... threads up to the hardware's (or
+// --threads), and reports per thread count
+//   - throughput: stream-samples processed per second (skipped and dropped
+//     streams do not count) and the speedup over one thread,
+//   - realtime: how many times faster than real time the whole set runs,
+//   - the period wall time: p50, p90, p99, p99.9 and max, in microseconds,
+//     against the period's own length,
+//   - jobs per period, streams skipped per period, streams dropped at the
+//     deadline (one period long) and the share of jobs stolen.
+// --active (0.5) is the share of streams fed noise; the others get silence,
+// fall asleep during the warm-up and are skipped from then on.
+//
+//   g++ -std=c++17 -O2 -march=native -pthread -I.. bench_scheduler.cpp -o bench_scheduler
+//   ./bench_scheduler [seconds] [--streams n] [--block n] [--threads n] [--active f] [--csv]
+
+#include "MyReverbConfig.h"
+#include "AudioReverb.h"
+#include "ReverbScheduler.h"
+#include "BenchCommon.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+using Reverb = AudioReverb<MyReverbConfig, MyReverbCrossFeed>;
+using Scheduler = ReverbScheduler<Reverb>;
+
+static constexpr double sampleRate = 48000.0;
+static constexpr double warmUpSeconds = 2.0;
+
+struct Settings {
+    double seconds = 1.0;
+    int streams = 256;
+    int block = 64;
+    int maxThreads = 0;
+    double active = 0.5;
+    bool csv = false;
+};
+
+struct Result {
+    int threads = 0;
+    double throughput = 0.0;  // Stream-samples per second.
+    double realtime = 0.0;
+    Scheduler::LatencyStats latency;
+    double jobs = 0.0;        // Per period.
+    double skipped = 0.0;     // Per period.
+    long long missed = 0;     // In total.
+    double stolen = 0.0;      // Share of jobs.
+};
+
+// Fills the inputs: noise for the first `sounding` streams, each from its
+// own place in the noise, silence for the rest.
+static void fillInputs(Scheduler& scheduler, const std::vector<float>& noise, int sounding, int block, long long periodIndex)
+{
+    const size_t span = noise.size() - static_cast<size_t>(block);
+    for (int i = 0; i < scheduler.getNumInstances(); ++i)
+    {
+        float* left = scheduler.getLeft(i);
+        float* right = scheduler.getRight(i);
+        if (i < sounding)
+        {
+            const size_t offset = (static_cast<size_t>(periodIndex) * static_cast<size_t>(block) + 7919u * static_cast<size_t>(i)) % span;
+            std::copy(noise.begin() + static_cast<std::ptrdiff_t>(offset), noise.begin() + static_cast<std::ptrdiff_t>(offset) + block, left);
+            std::copy(noise.rbegin() + static_cast<std::ptrdiff_t>(offset), noise.rbegin() + static_cast<std::ptrdiff_t>(offset) + block, right);
+        }
+        else
+        {
+            std::fill(left, left + block, 0.f);
+            std::fill(right, right + block, 0.f);
+        }
+    }
+}
+
+static Result run(const Settings& settings, int threads, const std::vector<float>& noise)
+{
+    const long long periods = std::max(1LL, static_cast<long long>(settings.seconds * sampleRate) / settings.block);
+    Scheduler scheduler;
+    scheduler.setLatencyHistory(static_cast<int>(periods));
+    scheduler.prepare(settings.streams, threads, sampleRate, settings.block);
+    for (int i = 0; i < scheduler.getNumInstances(); ++i)
+    {
+        scheduler.getInstance(i).setParameter(ReverbParameter::Size, 1.5f);
+        scheduler.getInstance(i).setParameter(ReverbParameter::Feedback, 0.7f);
+    }
+    const int sounding = static_cast<int>(settings.active * settings.streams + 0.5);
+
+    long long periodIndex = 0;
+    const long long warmUpPeriods = static_cast<long long>(warmUpSeconds * sampleRate) / settings.block;
+    for (; periodIndex < warmUpPeriods; ++periodIndex)
+    {
+        fillInputs(scheduler, noise, sounding, settings.block, periodIndex);
+        scheduler.processPeriod(settings.block);
+    }
+
+    scheduler.resetLatencyStats();
+    Result result;
+    result.threads = scheduler.getNumThreads();
+    double busySeconds = 0.0;
+    long long processed = 0, jobs = 0, skipped = 0, stolen = 0;
+    for (long long p = 0; p < periods; ++p, ++periodIndex)
+    {
+        fillInputs(scheduler, noise, sounding, settings.block, periodIndex);
+        const Scheduler::PeriodStats stats = scheduler.processPeriod(settings.block);
+        busySeconds += stats.seconds;
+        processed += stats.jobs - stats.missed;
+        jobs += stats.jobs;
+        skipped += stats.skipped;
+        result.missed += stats.missed;
+        stolen += stats.stolen;
+    }
+
+    result.throughput = static_cast<double>(processed) * settings.block / busySeconds;
+    result.realtime = static_cast<double>(periods) * settings.block / sampleRate / busySeconds;
+    result.latency = scheduler.getLatencyStats();
+    result.jobs = static_cast<double>(jobs) / static_cast<double>(periods);
+    result.skipped = static_cast<double>(skipped) / static_cast<double>(periods);
+    result.stolen = jobs > 0 ? static_cast<double>(stolen) / static_cast<double>(jobs) : 0.0;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--csv") == 0)
+            settings.csv = true;
+        else if (std::strcmp(argv[i], "--streams") == 0 && hasValue)
+            settings.streams = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--block") == 0 && hasValue)
+            settings.block = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue)
+            settings.maxThreads = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--active") == 0 && hasValue)
+            settings.active = std::min(1.0, std::max(0.0, std::atof(argv[++i])));
+        else
+            settings.seconds = std::atof(argv[i]);
+    }
+    if (settings.maxThreads == 0)
+        settings.maxThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    // The driving thread is worker 0; the pool pins the others to cores 1, 2, ...
+    Scheduler::pinCurrentThread(0);
+    const std::vector<float> noise = makeNoise(1 << 18, 1);
+
+    std::vector<int> threadCounts;
+    for (int t = 1; t < settings.maxThreads; t *= 2)
+        threadCounts.push_back(t);
+    threadCounts.push_back(settings.maxThreads);
+
+    std::vector<Result> results;
+    for (int threads : threadCounts)
+        results.push_back(run(settings, threads, noise));
+
+    const double periodMicroseconds = settings.block / sampleRate * 1.0e6;
+    if (settings.csv)
+    {
+        std::printf("threads,streams,block,throughput_samples_per_s,speedup,realtime,p50_us,p90_us,p99_us,p999_us,max_us,"
+                    "jobs_per_period,skipped_per_period,missed,stolen_share\n");
+        for (const auto& r : results)
+            std::printf("%d,%d,%d,%.0f,%.3f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.1f,%.1f,%lld,%.4f\n", r.threads, settings.streams,
+                settings.block, r.throughput, r.throughput / results[0].throughput, r.realtime, r.latency.p50 * 1.0e6,
+                r.latency.p90 * 1.0e6, r.latency.p99 * 1.0e6, r.latency.p999 * 1.0e6, r.latency.max * 1.0e6, r.jobs,
+                r.skipped, r.missed, r.stolen);
+        return 0;
+    }
+
+    std::printf("%d streams (%d fed noise), %d-sample periods (%.1f us), %u hardware threads\n\n", settings.streams,
+        static_cast<int>(settings.active * settings.streams + 0.5), settings.block, periodMicroseconds,
+        std::thread::hardware_concurrency());
+    std::printf("%7s %14s %8s %8s %9s %9s %9s %9s %9s %6s %7s %7s %7s\n", "threads", "samples/s", "speedup", "realtime",
+        "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "jobs", "skipped", "missed", "stolen");
+    for (const auto& r : results)
+        std::printf("%7d %14.0f %7.2fx %7.2fx %9.1f %9.1f %9.1f %9.1f %9.1f %6.1f %7.1f %7lld %6.1f%%\n", r.threads,
+            r.throughput, r.throughput / results[0].throughput, r.realtime, r.latency.p50 * 1.0e6, r.latency.p90 * 1.0e6,
+            r.latency.p99 * 1.0e6, r.latency.p999 * 1.0e6, r.latency.max * 1.0e6, r.jobs, r.skipped, r.missed,
+            100.0 * r.stolen);
+    return 0;
+}
@@ -0,0 +1,290 @@
+// Benchmark suite: nanoseconds per sample of the DSP building blocks, swept
+// over the settings that change their cost, in a form to diff across commits.
+//
+// Components:
+//   ap      one SimpleAP (23 ms, modulated by a SimpleLFO block)
+//   lfo     one SimpleLFO, processBlock
+//   shelf   LexiconShelvingFilter, processBlock
+//   stage   StageReverb<MyReverbConfig::StageConfig1> (shelf and six APs),
+//           with its LFOs from an LfoBank
+//   engine  MultiStageReverb<MyReverbConfig>, processBlock
+// swept over sample rates (44.1 to 192 kHz), block sizes (16 to 512) and,
+// for those that have them, global size and density (size moves the delays
+// through memory, density only the coefficients). Every case runs `seconds`
+// of noise `runs` times; the minimum and median are reported. Times are
+// wall-clock nanoseconds rather than cycles, so results from machines with
+// different clocks stay comparable.
+//
+// Output is a table, CSV (--csv) or JSON (--json), the latter two with the
+// commit (BENCH_REVISION, set by bench/CMakeLists.txt), compiler and SIMD
+// width; --out writes to a file instead of stdout. --filter runs only the
+// components whose name contains the argument.
+//
+//   g++ -std=c++17 -O2 -mavx2 -mfma -I.. bench_suite.cpp -o bench_suite
+//   ./bench_suite [seconds] [--runs n] [--filter name] [--csv | --json] [--out file]
+
+#include "MyReverbConfig.h"
+#include "MultistageReverb.h"
+#include "StageReverb.h"
+#include "ReverbSvf.h"
+#include "LfoBank.h"
+#include "DelayArena.h"
+#include "BenchCommon.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+using namespace project;
+using namespace project::multistage;
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr float sampleRates[] = { 44100.f, 48000.f, 96000.f, 192000.f };
+static constexpr int blockSizes[] = { 16, 64, 256, 512 };
+
+struct Setting {
+    float size;
+    float density;
+};
+static constexpr Setting settings[] = { { 0.5f, 0.5f }, { 1.f, 1.f }, { 2.f, 1.f } };
+
+struct Case {
+    const char* component;
+    float sampleRate;
+    int blockSize;
+    Setting setting;        // Size 0: the component has no such parameters.
+    double minNs = 0.0;
+    double medianNs = 0.0;
+};
+
+// Runs process(pos, n) over the input in blocks, `runs` times (after one
+// untimed pass), and fills in the per-sample minimum and median.
+static void time(Case& c, size_t numSamples, int runs, const std::function<void(size_t, int)>& process)
+{
+    const auto pass = [&] {
+        for (size_t pos = 0; pos < numSamples; pos += static_cast<size_t>(c.blockSize))
+            process(pos, static_cast<int>(std::min(numSamples - pos, static_cast<size_t>(c.blockSize))));
+    };
+    pass();
+    std::vector<double> ns;
+    for (int k = 0; k < runs; ++k)
+    {
+        const auto start = Clock::now();
+        pass();
+        ns.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(numSamples));
+    }
+    std::sort(ns.begin(), ns.end());
+    c.minNs = ns.front();
+    c.medianNs = ns[ns.size() / 2];
+}
+
+static void runAP(Case& c, const std::vector<float>& in, std::vector<float>& out, int runs)
+{
+    constexpr float delayMs = 23.f;
+    auto ap = std::make_unique<SimpleAP<>>(delayMs, 0.7f, 0, true, true);
+    DelayArena arena(delayArenaFloats(delayMs, true));
+    ap->attachBuffer(arena.data());
+    ap->prepare(c.sampleRate);
+    ap->updateDelayTime(c.setting.size);
+    ap->updateCoefficientScaling(c.setting.density);
+    SimpleLFO lfo(MyReverbConfig::lfoFrequencies[0], msToSamples(MyReverbConfig::lfoDepthsMs[0], c.sampleRate));
+    lfo.prepare(c.sampleRate);
+    ap->setModulationDepth(msToSamples(MyReverbConfig::lfoDepthsMs[0], c.sampleRate));
+    std::array<float, maxBlockSize> lfoBlock{};
+    time(c, in.size(), runs, [&](size_t pos, int n) {
+        lfo.processBlock(lfoBlock.data(), n);
+        ap->processBlock(in.data() + pos, out.data() + pos, lfoBlock.data(), n);
+    });
+}
+
+static void runLFO(Case& c, std::vector<float>& out, int runs)
+{
+    SimpleLFO lfo(MyReverbConfig::lfoFrequencies[0], 1.f);
+    lfo.prepare(c.sampleRate);
+    time(c, out.size(), runs, [&](size_t pos, int n) { lfo.processBlock(out.data() + pos, n); });
+}
+
+static void runShelf(Case& c, const std::vector<float>& in, std::vector<float>& out, int runs)
+{
+    LexiconShelvingFilter shelf;
+    shelf.setParameters(6000.f, -6.f, c.sampleRate);
+    time(c, in.size(), runs, [&](size_t pos, int n) { shelf.processBlock(in.data() + pos, out.data() + pos, n); });
+}
+
+static void runStage(Case& c, const std::vector<float>& in, std::vector<float>& out, int runs)
+{
+    using Stage = StageReverb<MyReverbConfig::StageConfig1>;
+    constexpr size_t numLfos = MyReverbConfig::NumGlobalLFOs;
+    auto stage = std::make_unique<Stage>();
+    DelayArena arena(Stage::DelayMemorySize);
+    stage->attachDelayMemory(arena.data());
+    stage->prepare(c.sampleRate);
+    stage->updateDelayTimes(c.setting.size);
+    stage->updateCoefficientScaling(c.setting.density);
+    stage->updateSVFParameters(6000.f, -6.f);
+
+    LfoBank<numLfos> lfos;
+    std::array<std::array<float, maxBlockSize>, numLfos> lfoBlocks{};
+    std::array<float*, numLfos> writePtrs{};
+    std::array<const float*, numLfos> readPtrs{};
+    std::array<float, numLfos> depths{};
+    for (size_t i = 0; i < numLfos; ++i)
+    {
+        depths[i] = msToSamples(MyReverbConfig::lfoDepthsMs[i], c.sampleRate);
+        lfos.setLfo(i, MyReverbConfig::lfoFrequencies[i], depths[i]);
+        writePtrs[i] = lfoBlocks[i].data();
+        readPtrs[i] = lfoBlocks[i].data();
+    }
+    lfos.prepare(c.sampleRate);
+    stage->setGlobalLfoDepths(depths.data());
+    stage->setGlobalLfoBlockPointers(readPtrs.data());
+    time(c, in.size(), runs, [&](size_t pos, int n) {
+        lfos.processBlock(writePtrs.data(), n);
+        stage->processBlock(in.data() + pos, out.data() + pos, n);
+    });
+}
+
+static void runEngine(Case& c, const std::vector<float>& in, std::vector<float>& out, int runs)
+{
+    auto engine = std::make_unique<MultiStageReverb<MyReverbConfig>>();
+    engine->prepare(c.sampleRate);
+    engine->updateGlobalSizeParameter(c.setting.size);
+    engine->updateGlobalDensityParameter(c.setting.density);
+    engine->updateFeedbackParameter(0.7f);
+    engine->updateGlobalSVFParameters(6000.f, -6.f);
+    time(c, in.size(), runs, [&](size_t pos, int n) { engine->processBlock(in.data() + pos, out.data() + pos, n); });
+}
+
+static std::string settingText(const Setting& s, const char* separator, const char* none)
+{
+    if (s.size == 0.f)
+        return std::string(none) + separator + none;
+    char text[64];
+    std::snprintf(text, sizeof(text), "%g%s%g", s.size, separator, s.density);
+    return text;
+}
+
+int main(int argc, char** argv)
+{
+    enum class Format { Table, Csv, Json } format = Format::Table;
+    double seconds = 0.5;
+    int runs = 5;
+    std::string filter;
+    const char* outPath = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            format = Format::Csv;
+        else if (std::strcmp(argv[i], "--json") == 0)
+            format = Format::Json;
+        else if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            outPath = argv[++i];
+        else
+            seconds = std::atof(argv[i]);
+    }
+    FILE* out = outPath != nullptr ? std::fopen(outPath, "w") : stdout;
+    if (out == nullptr)
+    {
+        std::fprintf(stderr, "cannot write %s\n", outPath);
+        return 1;
+    }
+
+    const auto wanted = [&](const char* component) { return filter.empty() || std::strstr(component, filter.c_str()) != nullptr; };
+    const Setting noSetting{ 0.f, 0.f };
+
+    std::vector<Case> cases;
+    for (float sampleRate : sampleRates)
+    {
+        const auto in = makeNoise(static_cast<int>(seconds * sampleRate));
+        std::vector<float> buffer(in.size());
+        for (int blockSize : blockSizes)
+        {
+            if (wanted("lfo"))
+            {
+                cases.push_back({ "lfo", sampleRate, blockSize, noSetting });
+                runLFO(cases.back(), buffer, runs);
+            }
+            if (wanted("shelf"))
+            {
+                cases.push_back({ "shelf", sampleRate, blockSize, noSetting });
+                runShelf(cases.back(), in, buffer, runs);
+            }
+            for (const Setting& setting : settings)
+            {
+                if (wanted("ap"))
+                {
+                    cases.push_back({ "ap", sampleRate, blockSize, setting });
+                    runAP(cases.back(), in, buffer, runs);
+                }
+                if (wanted("stage"))
+                {
+                    cases.push_back({ "stage", sampleRate, blockSize, setting });
+                    runStage(cases.back(), in, buffer, runs);
+                }
+                if (wanted("engine"))
+                {
+                    cases.push_back({ "engine", sampleRate, blockSize, setting });
+                    runEngine(cases.back(), in, buffer, runs);
+                }
+            }
+        }
+    }
+
+#if defined(__clang__)
+    const char* compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    const char* compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    const char* compiler = "MSVC " _CRT_STRINGIZE(_MSC_VER);
+#else
+    const char* compiler = "unknown";
+#endif
+    const int simdWidth = simd::FloatVec::width;
+
+    switch (format)
+    {
+    case Format::Table:
+        std::fprintf(out, "revision %s, %s, %d-float vectors, %d runs of %.2f s\n\n", BENCH_REVISION, compiler, simdWidth, runs, seconds);
+        std::fprintf(out, "%-8s %8s %6s %11s %10s %10s\n", "", "rate", "block", "size/dens", "min ns", "median ns");
+        for (const Case& c : cases)
+            std::fprintf(out, "%-8s %8.0f %6d %11s %10.2f %10.2f\n", c.component, c.sampleRate, c.blockSize,
+                settingText(c.setting, "/", "-").c_str(), c.minNs, c.medianNs);
+        break;
+    case Format::Csv:
+        std::fprintf(out, "revision,compiler,simd_width,component,sample_rate,block_size,size,density,min_ns_per_sample,median_ns_per_sample\n");
+        for (const Case& c : cases)
+            std::fprintf(out, "%s,\"%s\",%d,%s,%.0f,%d,%s,%.3f,%.3f\n", BENCH_REVISION, compiler, simdWidth, c.component, c.sampleRate,
+                c.blockSize, settingText(c.setting, ",", "").c_str(), c.minNs, c.medianNs);
+        break;
+    case Format::Json:
+        std::fprintf(out, "{\n  \"revision\": \"%s\",\n  \"compiler\": \"%s\",\n  \"simd_width\": %d,\n  \"runs\": %d,\n  \"seconds\": %g,\n  \"results\": [\n",
+            BENCH_REVISION, compiler, simdWidth, runs, seconds);
+        for (size_t i = 0; i < cases.size(); ++i)
+        {
+            const Case& c = cases[i];
+            std::fprintf(out, "    { \"component\": \"%s\", \"sample_rate\": %.0f, \"block_size\": %d, \"size\": %s, "
+                "\"min_ns_per_sample\": %.3f, \"median_ns_per_sample\": %.3f }%s\n",
+                c.component, c.sampleRate, c.blockSize, settingText(c.setting, ", \"density\": ", "null").c_str(),
+                c.minNs, c.medianNs, i + 1 < cases.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+        break;
+    }
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
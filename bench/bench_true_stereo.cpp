@@ -0,0 +1,198 @@
+// True-stereo benchmark: AudioReverb's channel modes against the stereoizer.
+//
+// At 48 kHz, for MyReverbConfig, it reports per mode
+//   - cycles per sample of AudioReverb::processBlock (stereo in and out,
+//     64-sample blocks), and the ratio to the stereoizer mode,
+//   - the same for two independent MultiStageReverbs (one per channel),
+//     what the pair has to beat,
+//   - the correlation of the left and right outputs on mono noise (the
+//     same signal in both channels), once the reverb is full,
+//   - the level of the right output relative to the left for noise in the
+//     left channel only: 0 dB where the reverb forgets where sound came from,
+// and the largest difference between MultiStageReverbPair::processBlock and
+// processSample on the same input (0 unless the compiler contracts the two
+// differently, e.g. with -mfma).
+// Cycles are time-stamp counter ticks where the target has one (x86), else
+// nanoseconds.
+//
+//   g++ -std=c++17 -O2 -mavx2 -mfma -I.. bench_true_stereo.cpp -o bench_true_stereo
+//   ./bench_true_stereo [seconds] [--csv]
+
+#include "MyReverbConfig.h"
+#include "AudioReverb.h"
+#include "BenchCommon.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+using Reverb = AudioReverb<MyReverbConfig, MyReverbCrossFeed>;
+using Engine = MultiStageReverb<MyReverbConfig>;
+using Pair = MultiStageReverbPair<MyReverbConfig, MyReverbCrossFeed>;
+
+static constexpr int blockSize = 64;
+static constexpr double sampleRate = 48000.0;
+
+template <typename Target>
+static void setParameters(Target& target)
+{
+    target.updateGlobalSizeParameter(1.5f);
+    target.updateFeedbackParameter(0.7f);
+    target.updateGlobalDensityParameter(0.6f);
+    target.updateGlobalSVFParameters(8000.f, -6.f);
+}
+
+static std::unique_ptr<Reverb> makeReverb(ReverbChannels channels)
+{
+    auto reverb = std::make_unique<Reverb>();
+    reverb->setChannels(channels);
+    reverb->prepare(sampleRate);
+    setParameters(*reverb);
+    return reverb;
+}
+
+static void render(Reverb& reverb, const std::vector<float>& inL, const std::vector<float>& inR,
+    std::vector<float>& left, std::vector<float>& right)
+{
+    const int numSamples = static_cast<int>(inL.size());
+    left.resize(inL.size());
+    right.resize(inL.size());
+    for (int pos = 0; pos < numSamples; pos += blockSize)
+        reverb.processBlock(inL.data() + pos, inR.data() + pos, left.data() + pos, right.data() + pos,
+            std::min(blockSize, numSamples - pos));
+}
+
+static double correlation(const std::vector<float>& a, const std::vector<float>& b, size_t start)
+{
+    double ab = 0.0, aa = 0.0, bb = 0.0;
+    for (size_t i = start; i < a.size(); ++i)
+    {
+        ab += static_cast<double>(a[i]) * b[i];
+        aa += static_cast<double>(a[i]) * a[i];
+        bb += static_cast<double>(b[i]) * b[i];
+    }
+    return ab / std::sqrt(aa * bb + 1.0e-30);
+}
+
+static double levelDb(const std::vector<float>& of, const std::vector<float>& against, size_t start)
+{
+    double p = 0.0, q = 0.0;
+    for (size_t i = start; i < of.size(); ++i)
+    {
+        p += static_cast<double>(of[i]) * of[i];
+        q += static_cast<double>(against[i]) * against[i];
+    }
+    return 10.0 * std::log10(p / (q + 1.0e-30) + 1.0e-30);
+}
+
+struct Measurement {
+    const char* name;
+    double cycles;
+    double monoCorrelation;     // NaN where it does not apply.
+    double leftOnlyDb;
+};
+
+static Measurement measure(const char* name, ReverbChannels channels, const std::vector<float>& noiseL, const std::vector<float>& noiseR)
+{
+    Measurement m{ name, 0.0, 0.0, 0.0 };
+    std::vector<float> left, right;
+    auto reverb = makeReverb(channels);
+    m.cycles = bestOfN(5, static_cast<double>(noiseL.size()), [&] { render(*reverb, noiseL, noiseR, left, right); });
+
+    const size_t settled = noiseL.size() / 2;
+    reverb = makeReverb(channels);
+    render(*reverb, noiseL, noiseL, left, right);
+    m.monoCorrelation = correlation(left, right, settled);
+
+    const std::vector<float> silence(noiseL.size(), 0.f);
+    reverb = makeReverb(channels);
+    render(*reverb, noiseL, silence, left, right);
+    m.leftOnlyDb = levelDb(right, left, settled);
+    return m;
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 4.0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else
+            seconds = std::atof(argv[i]);
+    }
+
+    const char* unit = tickUnit();
+    const int numSamples = static_cast<int>(seconds * sampleRate);
+    const auto noiseL = makeNoise(numSamples, 1);
+    const auto noiseR = makeNoise(numSamples, 2);
+
+    std::vector<Measurement> results;
+    results.push_back(measure("stereoizer", ReverbChannels::Stereoizer, noiseL, noiseR));
+
+    // Two plain engines, one per channel.
+    {
+        auto engineL = std::make_unique<Engine>(), engineR = std::make_unique<Engine>();
+        for (Engine* e : { engineL.get(), engineR.get() })
+        {
+            e->prepare(static_cast<float>(sampleRate));
+            setParameters(*e);
+        }
+        std::vector<float> left(noiseL.size()), right(noiseL.size());
+        const double cycles = bestOfN(5, static_cast<double>(noiseL.size()), [&] {
+            for (int pos = 0; pos < numSamples; pos += blockSize)
+            {
+                const int n = std::min(blockSize, numSamples - pos);
+                engineL->processBlock(noiseL.data() + pos, left.data() + pos, n);
+                engineR->processBlock(noiseR.data() + pos, right.data() + pos, n);
+            }
+        });
+        results.push_back({ "two engines", cycles, std::nan(""), std::nan("") });
+    }
+
+    results.push_back(measure("dual mono", ReverbChannels::DualMono, noiseL, noiseR));
+    results.push_back(measure("true stereo", ReverbChannels::TrueStereo, noiseL, noiseR));
+
+    // processBlock against processSample, a second of noise.
+    double maxDiff = 0.0;
+    {
+        auto bySample = std::make_unique<Pair>(), byBlock = std::make_unique<Pair>();
+        for (Pair* p : { bySample.get(), byBlock.get() })
+        {
+            p->prepare(static_cast<float>(sampleRate));
+            setParameters(*p);
+        }
+        const int n = std::min(numSamples, static_cast<int>(sampleRate));
+        std::vector<float> sl(static_cast<size_t>(n)), sr(sl.size()), bl(sl.size()), br(sl.size());
+        for (int i = 0; i < n; ++i)
+            bySample->processSample(noiseL[static_cast<size_t>(i)], noiseR[static_cast<size_t>(i)], sl[static_cast<size_t>(i)], sr[static_cast<size_t>(i)]);
+        for (int pos = 0; pos < n; pos += blockSize)
+            byBlock->processBlock(noiseL.data() + pos, noiseR.data() + pos, bl.data() + pos, br.data() + pos, std::min(blockSize, n - pos));
+        for (size_t i = 0; i < sl.size(); ++i)
+            maxDiff = std::max(maxDiff, static_cast<double>(std::max(std::fabs(sl[i] - bl[i]), std::fabs(sr[i] - br[i]))));
+    }
+
+    const double base = results.front().cycles;
+    if (csv)
+        std::printf("mode,%s_per_sample,cpu_ratio,mono_in_lr_correlation,left_only_right_db\n", unit);
+    else
+        std::printf("\n48 kHz            %6s/smp  ratio  L/R corr, mono in  R vs L, left in (dB)\n", unit);
+    for (const Measurement& m : results)
+    {
+        if (csv)
+            std::printf("%s,%.2f,%.3f,%.3f,%.1f\n", m.name, m.cycles, m.cycles / base, m.monoCorrelation, m.leftOnlyDb);
+        else
+            std::printf("  %-14s %10.1f %6.2f %18.3f %21.1f\n", m.name, m.cycles, m.cycles / base, m.monoCorrelation, m.leftOnlyDb);
+    }
+    if (csv)
+        std::printf("block_vs_sample_max_diff,%g\n", maxDiff);
+    else
+        std::printf("\n  pair processBlock vs processSample, max difference: %g\n", maxDiff);
+    return 0;
+}
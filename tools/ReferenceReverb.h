@@ -0,0 +1,326 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "MultistageReverb.h"
+
+namespace project {
+    namespace reference {
+
+        //==============================================================
+        // ReferenceReverb: a frozen, deliberately plain copy of what
+        // MultiStageReverb<Config>::processSample computes, to check faster
+        // paths against (tools/reference_diff.cpp).
+        //
+        // It shares no DSP code with the engine: no SIMD, no LfoBank, no
+        // routing schedule or execution plan, no arena. Every LFO is a phase
+        // and a parabola, every allpass a std::vector ring, every node the
+        // sum of its connections in declaration order, and the whole graph
+        // advances one sample at a time from the previous sample's node
+        // values. The float expressions are written in the engine's order, so
+        // on a build without FMA contraction the engine matches it exactly.
+        //
+        // Do not optimise this file. Change it only where the engine's
+        // output is meant to change, in a commit of its own, so the diff
+        // shows what changed on purpose.
+        //
+        // It covers what MyReverbConfig uses: StageReverb stages with flat
+        // chains of allpasses, float delay lines and linear interpolation.
+        // Anything else does not compile (see supports(), the one place the
+        // engine's headers are used: for its types, not its values).
+        //
+        // The constants it needs from ReverbCommon.h are copied below, so a
+        // change there shows up as a diff instead of moving the reference too.
+        //==============================================================
+        template <typename Config>
+        class ReferenceReverb
+        {
+        public:
+            static constexpr size_t NumStages = Config::NumStages;
+            static constexpr size_t NumNodes = Config::NumNodes;
+            static constexpr size_t NumLFOs = Config::NumGlobalLFOs;
+            static constexpr size_t OutputNode = NumNodes - 1;
+
+            // Frozen copies of ReverbCommon.h's values.
+            static constexpr float maxSupportedSampleRate = 192000.f;
+            static constexpr float maxGlobalSize = 2.f;
+            static constexpr float delayHeadroomMs = 1.f;
+            static constexpr size_t noLfo = ~size_t(0);    // What a Config writes for an unmodulated AP.
+
+            template <size_t I>
+            using StageConfig = std::tuple_element_t<I, typename Config::StageTuple>;
+
+            template <size_t... Is>
+            static constexpr bool supports(std::index_sequence<Is...>)
+            {
+                using Engine = multistage::MultiStageReverb<Config>;
+                return std::is_same_v<typename Engine::Storage, FloatDelayStorage>
+                    && (std::is_same_v<typename Engine::template SingleStage<Is>,
+                            multistage::StageReverb<StageConfig<Is>, FloatDelayStorage, LinearInterpolation>> && ...)
+                    && (!multistage::hasNestedAPs<StageConfig<Is>>() && ...);
+            }
+
+            static_assert(supports(std::make_index_sequence<NumStages>{}),
+                "the reference covers flat StageReverb chains with float storage and linear interpolation only");
+
+            ReferenceReverb()
+            {
+                for (size_t s = 0; s < NumStages; ++s)
+                    stages[s].stageIndex = s;
+                weights.resize(Config::connections.size());
+                updateFeedbackParameter(1.f);
+            }
+
+            void prepare(float sampleRate)
+            {
+                rate = sampleRate;
+                const float delayRate = std::min(sampleRate, maxSupportedSampleRate);
+                for (size_t i = 0; i < NumLFOs; ++i)
+                {
+                    lfos[i].increment = Config::lfoFrequencies[i] / sampleRate;
+                    lfos[i].amplitude = Config::lfoDepthsMs[i] * 0.001f * delayRate;
+                }
+                prepareStages(delayRate, std::make_index_sequence<NumStages>{});
+                reset();
+            }
+
+            void reset()
+            {
+                for (auto& lfo : lfos)
+                    lfo.phase = 0.f;
+                for (auto& stage : stages)
+                {
+                    stage.shelfX1 = stage.shelfY1 = 0.f;
+                    for (auto& ap : stage.aps)
+                    {
+                        std::fill(ap.line.begin(), ap.line.end(), 0.f);
+                        ap.writeIndex = 0;
+                    }
+                }
+                nodes.fill(0.f);
+            }
+
+            void updateFeedbackParameter(float feedback)
+            {
+                for (size_t i = 0; i < Config::connections.size(); ++i)
+                {
+                    const auto& c = Config::connections[i];
+                    weights[i] = c.scaleFeedback ? c.baseWeight * feedback : c.baseWeight;
+                }
+            }
+
+            void updateGlobalSizeParameter(float size) { forEachStage([&](auto scaled, Stage& stage) {
+                if (scaled.delay)
+                {
+                    stage.size = size;
+                    for (auto& ap : stage.aps)
+                        ap.delay = ap.baseDelay * size;
+                }
+            }); }
+
+            void updateGlobalDensityParameter(float density) { forEachStage([&](auto scaled, Stage& stage) {
+                if (scaled.coefficient)
+                    for (auto& ap : stage.aps)
+                        ap.coefficient = ap.baseCoefficient * density;
+            }); }
+
+            void updateGlobalSVFParameters(float cutoff, float dbGain) { forEachStage([&](auto scaled, Stage& stage) {
+                if (scaled.shelf && scaled.attachedShelf)
+                    setShelf(stage, cutoff, dbGain);
+            }); }
+
+            float processSample(float input)
+            {
+                std::array<float, NumLFOs> lfoValues;
+                for (size_t i = 0; i < NumLFOs; ++i)
+                {
+                    Lfo& lfo = lfos[i];
+                    lfo.phase += lfo.increment;
+                    if (lfo.phase >= 1.f)
+                        lfo.phase -= 1.f;
+                    const float shifted = 0.5f - lfo.phase;
+                    lfoValues[i] = lfo.amplitude * (shifted * (8.f - 16.f * std::fabs(shifted)));
+                }
+
+                // Every stage reads the previous sample's nodes; the output node
+                // sums this sample's.
+                std::array<float, NumNodes> next = nodes;
+                next[0] = input;
+                for (size_t s = 0; s < NumStages; ++s)
+                    next[s + 1] = processStage(stages[s], sumInto(s + 1, nodes), lfoValues);
+                next[OutputNode] = sumInto(OutputNode, next);
+                nodes = next;
+                return nodes[OutputNode];
+            }
+
+            // Node values after the last processSample: 0 the input, 1..NumStages
+            // the stages, NumNodes - 1 the output.
+            const std::array<float, NumNodes>& getNodeValues() const { return nodes; }
+
+        private:
+            struct Lfo {
+                float phase = 0.f;
+                float increment = 0.f;
+                float amplitude = 0.f;
+            };
+
+            struct Allpass {
+                std::vector<float> line;
+                int writeIndex = 0;
+                float baseDelay = 0.f;          // Samples, before global size.
+                float delay = 0.f;
+                float baseCoefficient = 0.f;
+                float coefficient = 0.f;
+                size_t lfo = noLfo;
+            };
+
+            struct Stage {
+                size_t stageIndex = 0;
+                float size = 1.f;
+                bool hasShelf = false;
+                float b0 = 0.f, b1 = 0.f, a1 = 0.f;
+                float shelfX1 = 0.f, shelfY1 = 0.f;
+                std::vector<Allpass> aps;
+            };
+
+            // What the parameters reach in a stage, from its StageConfig.
+            struct Scaled {
+                bool delay;
+                bool coefficient;
+                bool shelf;
+                bool attachedShelf;
+            };
+
+            float rate = 44100.f;
+            std::array<Lfo, NumLFOs> lfos{};
+            std::array<Stage, NumStages> stages{};
+            std::vector<float> weights;
+            std::array<float, NumNodes> nodes{};
+
+            template <size_t I>
+            static constexpr Scaled scaledOf()
+            {
+                using C = StageConfig<I>;
+                return { C::scaleDelay, C::scaleCoeff, C::enableSVF, C::attachSVF };
+            }
+
+            template <typename F, size_t... Is>
+            void forEachStage(F&& f, std::index_sequence<Is...>)
+            {
+                (f(scaledOf<Is>(), stages[Is]), ...);
+            }
+
+            template <typename F>
+            void forEachStage(F&& f)
+            {
+                forEachStage(std::forward<F>(f), std::make_index_sequence<NumStages>{});
+            }
+
+            template <size_t... Is>
+            void prepareStages(float delayRate, std::index_sequence<Is...>)
+            {
+                (prepareStage<Is>(delayRate), ...);
+            }
+
+            template <size_t I>
+            void prepareStage(float delayRate)
+            {
+                using C = StageConfig<I>;
+                Stage& stage = stages[I];
+                stage.hasShelf = C::enableSVF;
+                if (C::enableSVF)
+                    setShelf(stage, C::svfCutoff, C::svfGain);
+                const size_t numAPs = C::aps.size();
+                const bool keepParameters = stage.aps.size() == numAPs;
+                stage.aps.resize(numAPs);
+                for (size_t i = 0; i < numAPs; ++i)
+                {
+                    Allpass& ap = stage.aps[i];
+                    const float longest = C::aps[i].delayMs * (C::scaleDelay ? maxGlobalSize : 1.f) + delayHeadroomMs;
+                    size_t length = 1;
+                    while (static_cast<float>(length) < longest * 0.001f * delayRate + 2.f)
+                        length *= 2;
+                    ap.line.assign(length, 0.f);
+                    ap.baseDelay = C::aps[i].delayMs * 0.001f * delayRate;
+                    ap.delay = ap.baseDelay * stage.size;
+                    ap.baseCoefficient = C::aps[i].coefficient;
+                    if (!keepParameters)
+                        ap.coefficient = ap.baseCoefficient;
+                    ap.lfo = C::aps[i].lfoIndex;
+                }
+            }
+
+            // One-pole high shelf: 0 dB at DC, dbGain at Nyquist, the cutoff
+            // prewarped. The exponential and the tangent are the engine's
+            // approximations (ReverbSvf.h), spelt out.
+            void setShelf(Stage& stage, float cutoff, float dbGain) const
+            {
+                float x = 1.f + dbGain / 20.f * 2.302585093f / 256.f;
+                for (int i = 0; i < 8; ++i)
+                    x *= x;
+                const float g = x;
+                cutoff = std::min(cutoff, 0.45f * rate);
+                const float w = static_cast<float>(3.14159265358979323846 * cutoff / rate);
+                const float w2 = w * w;
+                const float k = w * (0.999999492001f + w2 * -0.096524608111f) / (1.f + w2 * (-0.429867256894f + w2 * 0.009981877999f));
+                const float norm = 1.f / (1.f + g * k);
+                stage.b0 = g * (1.f + k) * norm;
+                stage.b1 = g * (k - 1.f) * norm;
+                stage.a1 = (g * k - 1.f) * norm;
+            }
+
+            float sumInto(size_t node, const std::array<float, NumNodes>& values) const
+            {
+                float sum = 0.f;
+                if (node == 0)
+                    return sum;
+                for (size_t i = 0; i < Config::connections.size(); ++i)
+                {
+                    const auto& c = Config::connections[i];
+                    if (c.dst == node && c.baseWeight != 0.f)
+                        sum += values[c.src] * weights[i];
+                }
+                return sum;
+            }
+
+            static float processStage(Stage& stage, float x, const std::array<float, NumLFOs>& lfoValues)
+            {
+                if (stage.hasShelf)
+                {
+                    const float y = stage.b0 * x + stage.b1 * stage.shelfX1 - stage.a1 * stage.shelfY1;
+                    stage.shelfX1 = x;
+                    stage.shelfY1 = y;
+                    x = y;
+                }
+                for (Allpass& ap : stage.aps)
+                {
+                    const int mask = static_cast<int>(ap.line.size()) - 1;
+                    float delayed;
+                    if (ap.lfo == noLfo)
+                    {
+                        // Unmodulated lines read the nearest whole sample.
+                        delayed = ap.line[static_cast<size_t>((ap.writeIndex - static_cast<int>(ap.delay + 0.5f)) & mask)];
+                    }
+                    else
+                    {
+                        // Linear interpolation between the samples d and d + 1 old.
+                        const float delay = std::max(ap.delay + lfoValues[ap.lfo], 0.f);
+                        const int whole = static_cast<int>(delay);
+                        const float frac = 1.f - (delay - static_cast<float>(whole));
+                        const int older = (ap.writeIndex - whole - 1) & mask;
+                        delayed = (1.f - frac) * ap.line[static_cast<size_t>(older)] + frac * ap.line[static_cast<size_t>((older + 1) & mask)];
+                    }
+                    const float v = x - ap.coefficient * delayed;
+                    x = ap.coefficient * v + delayed;
+                    ap.line[static_cast<size_t>(ap.writeIndex)] = v;
+                    ap.writeIndex = (ap.writeIndex + 1) & mask;
+                }
+                return x;
+            }
+        };
+
+    } // namespace reference
+} // namespace project
@@ -0,0 +1,229 @@
+// Profile report: where AudioReverb<MyReverbConfig, MyReverbCrossFeed> spends
+// its time, from the GRIFFIN_PROFILING hooks (ReverbProfiler.h).
+//
+// Noise goes through process() in host-sized blocks, as fast as it will run,
+// while a second thread drains the profiler's frames the way a UI or logger
+// would. At the end it prints
+//   - per span (the LFO bank, each stage, the stereoizer, the eco-mode
+//     resampler, and "other": routing, copies and the profiler itself) its
+//     share of the block time and ticks per host sample,
+//   - the mean and the slowest block, and the frames the reader missed,
+//   - the peak and RMS level of every node over the run (dBFS).
+// Ticks are time-stamp counter ticks where the target has one (x86), else
+// nanoseconds.
+//
+//   g++ -std=c++17 -O2 -pthread -I.. profile_report.cpp -o profile_report
+//   ./profile_report [seconds] [--block n] [--rate hz] [--eco 1|2|4]
+//                    [--channels stereoizer|dual|true] [--frame n] [--csv]
+
+#ifndef GRIFFIN_PROFILING
+#define GRIFFIN_PROFILING 1
+#endif
+#include "MyReverbConfig.h"
+#include "AudioReverb.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static_assert(GRIFFIN_PROFILING, "profile_report needs GRIFFIN_PROFILING=1");
+
+using namespace project;
+using namespace project::multistage;
+
+using Reverb = AudioReverb<MyReverbConfig, MyReverbCrossFeed>;
+using Frame = Reverb::Engine::Profiler::Frame;
+
+static constexpr size_t NumStages = MyReverbConfig::NumStages;
+static constexpr size_t NumNodes = MyReverbConfig::NumNodes;
+static constexpr size_t NumSpans = Frame::NumSpans;
+
+// What the reader adds up from the frames it gets.
+struct Totals {
+    std::uint64_t frames = 0;
+    std::uint64_t lastSequence = 0;
+    std::uint64_t samples = 0;
+    std::uint64_t blocks = 0;
+    std::uint64_t ticks = 0;
+    std::uint64_t maxBlockTicks = 0;
+    std::array<std::uint64_t, NumSpans> spanTicks{};
+    std::array<float, NumNodes> peak{};
+    std::array<double, NumNodes> sumSquares{};
+
+    void add(const Frame& f)
+    {
+        ++frames;
+        lastSequence = f.sequence;
+        samples += f.numSamples;
+        blocks += f.numBlocks;
+        ticks += f.totalTicks;
+        maxBlockTicks = std::max(maxBlockTicks, f.maxBlockTicks);
+        for (size_t i = 0; i < NumSpans; ++i)
+            spanTicks[i] += f.spanTicks[i];
+        for (size_t n = 0; n < NumNodes; ++n)
+        {
+            peak[n] = std::max(peak[n], f.peak[n]);
+            sumSquares[n] += static_cast<double>(f.rms[n]) * f.rms[n] * f.numSamples;
+        }
+    }
+};
+
+static std::string spanName(size_t span)
+{
+    switch (span)
+    {
+    case ProfileSpan::Lfo: return "lfo";
+    case ProfileSpan::Stereoizer: return "stereoizer";
+    case ProfileSpan::Resampler: return "resampler";
+    default: return "stage " + std::to_string(span - ProfileSpan::FirstStage + 1);
+    }
+}
+
+static std::string nodeName(size_t node)
+{
+    if (node == 0)
+        return "input";
+    if (node == NumNodes - 1)
+        return "output";
+    return "stage " + std::to_string(node);
+}
+
+static double toDb(double x)
+{
+    return x > 0.0 ? 20.0 * std::log10(x) : -200.0;
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 5.0;
+    double sampleRate = 48000.0;
+    int blockSize = 64;
+    int frameLength = 4096;
+    int eco = 1;
+    ReverbChannels channels = ReverbChannels::Stereoizer;
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (std::strcmp(argv[i], "--block") == 0 && hasValue)
+            blockSize = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--rate") == 0 && hasValue)
+            sampleRate = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--eco") == 0 && hasValue)
+            eco = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--frame") == 0 && hasValue)
+            frameLength = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--channels") == 0 && hasValue)
+        {
+            const std::string c = argv[++i];
+            channels = c == "dual" ? ReverbChannels::DualMono : c == "true" ? ReverbChannels::TrueStereo : ReverbChannels::Stereoizer;
+        }
+        else
+            seconds = std::atof(argv[i]);
+    }
+    blockSize = std::clamp(blockSize, 1, project::maxBlockSize);
+
+    auto reverb = std::make_unique<Reverb>();
+    reverb->setChannels(channels);
+    reverb->setProcessingRate(eco == 4 ? ReverbRate::Quarter : eco == 2 ? ReverbRate::Half : ReverbRate::Full);
+    reverb->prepare(sampleRate);
+    reverb->updateGlobalSizeParameter(1.5f);
+    reverb->updateFeedbackParameter(0.7f);
+    reverb->updateGlobalDensityParameter(0.6f);
+    reverb->updateGlobalSVFParameters(8000.f, -6.f);
+    auto& profiler = reverb->getProfiler();
+    profiler.setFrameLength(frameLength);
+
+    Totals totals;
+    std::atomic<bool> done{ false };
+    std::thread reader([&] {
+        Frame frame;
+        for (;;)
+        {
+            const bool finished = done.load(std::memory_order_acquire);
+            while (profiler.pop(frame))
+                totals.add(frame);
+            if (finished)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> u(-0.25f, 0.25f);
+    std::vector<float> noiseL(static_cast<size_t>(sampleRate)), noiseR(noiseL.size());
+    for (size_t i = 0; i < noiseL.size(); ++i)
+    {
+        noiseL[i] = u(rng);
+        noiseR[i] = u(rng);
+    }
+    std::vector<float> left(static_cast<size_t>(blockSize)), right(left.size());
+    const size_t total = static_cast<size_t>(seconds * sampleRate);
+    for (size_t pos = 0; pos < total; pos += static_cast<size_t>(blockSize))
+    {
+        const size_t offset = pos % (noiseL.size() - static_cast<size_t>(blockSize));
+        std::copy(noiseL.begin() + offset, noiseL.begin() + offset + blockSize, left.begin());
+        std::copy(noiseR.begin() + offset, noiseR.begin() + offset + blockSize, right.begin());
+        reverb->process(left.data(), right.data(), blockSize);
+    }
+    done.store(true, std::memory_order_release);
+    reader.join();
+
+    if (totals.samples == 0)
+    {
+        std::printf("no frames received\n");
+        return 1;
+    }
+
+    const char* unit = ProfileClock::countsCycles ? "cycles" : "ns";
+    const double perSample = 1.0 / static_cast<double>(totals.samples);
+    std::uint64_t spanned = 0;
+    for (auto t : totals.spanTicks)
+        spanned += t;
+    const std::uint64_t other = totals.ticks > spanned ? totals.ticks - spanned : 0;
+
+    if (csv)
+    {
+        std::printf("kind,name,share,%s_per_sample,peak_db,rms_db\n", unit);
+        for (size_t i = 0; i < NumSpans; ++i)
+            std::printf("span,%s,%.4f,%.3f,,\n", spanName(i).c_str(), static_cast<double>(totals.spanTicks[i]) / totals.ticks,
+                totals.spanTicks[i] * perSample);
+        std::printf("span,other,%.4f,%.3f,,\n", static_cast<double>(other) / totals.ticks, other * perSample);
+        std::printf("block,mean,,%.3f,,\n", static_cast<double>(totals.ticks) / totals.blocks / blockSize);
+        std::printf("block,max,,%.3f,,\n", static_cast<double>(totals.maxBlockTicks) / blockSize);
+        for (size_t n = 0; n < NumNodes; ++n)
+            std::printf("node,%s,,,%.2f,%.2f\n", nodeName(n).c_str(), toDb(totals.peak[n]),
+                toDb(std::sqrt(totals.sumSquares[n] * perSample)));
+        return 0;
+    }
+
+    std::printf("%.0f Hz, %d-sample blocks, eco 1/%d, %zu stages: %llu frames (%llu dropped), %llu samples\n\n",
+        sampleRate, blockSize, eco, NumStages, static_cast<unsigned long long>(totals.frames),
+        static_cast<unsigned long long>(profiler.getDroppedFrames()), static_cast<unsigned long long>(totals.samples));
+    std::printf("%-12s %8s %12s\n", "span", "share", (std::string(unit) + "/sample").c_str());
+    for (size_t i = 0; i < NumSpans; ++i)
+    {
+        if (totals.spanTicks[i] == 0)
+            continue;
+        std::printf("%-12s %7.1f%% %12.2f\n", spanName(i).c_str(), 100.0 * totals.spanTicks[i] / totals.ticks,
+            totals.spanTicks[i] * perSample);
+    }
+    std::printf("%-12s %7.1f%% %12.2f\n", "other", 100.0 * other / totals.ticks, other * perSample);
+    std::printf("\nblock (%s/sample): mean %.2f, slowest %.2f\n\n", unit,
+        static_cast<double>(totals.ticks) / totals.blocks / blockSize, static_cast<double>(totals.maxBlockTicks) / blockSize);
+    std::printf("%-12s %10s %10s\n", "node", "peak dB", "rms dB");
+    for (size_t n = 0; n < NumNodes; ++n)
+        std::printf("%-12s %10.2f %10.2f\n", nodeName(n).c_str(), toDb(totals.peak[n]),
+            toDb(std::sqrt(totals.sumSquares[n] * perSample)));
+    return 0;
+}
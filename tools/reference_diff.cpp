@@ -0,0 +1,430 @@
+// Differential runner: the engines built on MyReverbConfig against the
+// frozen ReferenceReverb (tools/ReferenceReverb.h).
+//
+// Every signal goes through the reference and through each engine path:
+//   sample      MultiStageReverb::processSample, every node compared on every
+//               sample
+//   block N     MultiStageReverb::processBlock in blocks of N (1, 37, 64,
+//               512): the output on every sample, the other nodes at the end
+//               of each block (where processBlock leaves them in nodeState;
+//               dead nodes are skipped)
+//   pair 64     MultiStageReverbPair in dual mono with the right tank's
+//               detune and LFO phase offset at 0, so both tanks compute the
+//               reference: both outputs
+//   batch 64    MultiStageReverbBatch, 8 lanes on the same input: every lane
+//   runtime 37  RuntimeReverb loaded with topologyFromConfig(): the output
+// The last three compare outputs only. What none of them covers: the pair's
+// decorrelated right tank and cross-feed, batch lanes with different
+// parameters, and topologies other than MyReverbConfig's.
+// The signals:
+//   impulse     one sample of 1, then silence
+//   noise       half a second of white noise, then silence
+//   sweep       a one-second exponential sine sweep, 20 Hz to 0.45 fs
+//   automation  noise throughout while size, density, feedback and the
+//               shelf move, updated at the start of every block (every 64
+//               samples on the sample path), identically for both
+// For each node it reports the largest and the RMS difference and the tail
+// energy drift: the energy from 1.5 s on against the reference's, in dB.
+// A path fails when a node exceeds a tolerance; the exit code is the number
+// of failing signal/path pairs (0: all within tolerance).
+//
+// Built without FMA contraction the engine matches the reference exactly;
+// with it (-mfma, -march=native) differences up to a few 1e-7 are expected. New
+// fast paths should keep to the default tolerances.
+//
+//   g++ -std=c++17 -O2 -I.. -I. reference_diff.cpp -o reference_diff
+//   ./reference_diff [seconds] [--rate hz] [--max-error x] [--rms-error x]
+//                    [--tail-drift-db x] [--csv]
+
+#include "MyReverbConfig.h"
+#include "MultistageReverb.h"
+#include "MultiStageReverbPair.h"
+#include "MultiStageReverbBatch.h"
+#include "RuntimeReverb.h"
+#include "Denormals.h"
+#include "ReferenceReverb.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace project;
+using namespace project::multistage;
+
+using Config = MyReverbConfig;
+using Engine = MultiStageReverb<Config>;
+using Reference = reference::ReferenceReverb<Config>;
+
+static constexpr size_t NumNodes = Config::NumNodes;
+static constexpr double pi = 3.14159265358979323846;
+static constexpr double tailStartSeconds = 1.5;
+
+struct Tolerances {
+    double maxError = 1.0e-4;
+    double rmsError = 1.0e-6;
+    double tailDriftDb = 0.01;
+};
+
+struct NodeStats {
+    double maxError = 0.0;
+    double sumSquaredError = 0.0;
+    size_t count = 0;
+    double tailEnergy = 0.0;
+    double referenceTailEnergy = 0.0;
+
+    void add(float value, float expected, bool inTail)
+    {
+        const double e = static_cast<double>(value) - expected;
+        maxError = std::max(maxError, std::fabs(e));
+        sumSquaredError += e * e;
+        ++count;
+        if (inTail)
+        {
+            tailEnergy += static_cast<double>(value) * value;
+            referenceTailEnergy += static_cast<double>(expected) * expected;
+        }
+    }
+
+    double rmsError() const { return count > 0 ? std::sqrt(sumSquaredError / static_cast<double>(count)) : 0.0; }
+
+    // 0 where both tails are silent.
+    double tailDriftDb() const
+    {
+        if (tailEnergy == referenceTailEnergy)
+            return 0.0;
+        return 10.0 * std::log10((tailEnergy + 1.0e-30) / (referenceTailEnergy + 1.0e-30));
+    }
+};
+
+// Parameter values at time t (seconds) of the automation signal; the other
+// signals run at fixed settings.
+struct Parameters {
+    float size, density, feedback, cutoff, gain;
+};
+
+static Parameters automationAt(double t)
+{
+    const auto wave = [t](double hz, double phase) { return 0.5 + 0.5 * std::sin(2.0 * pi * hz * t + phase); };
+    return { static_cast<float>(0.5 + 1.5 * wave(0.37, 0.0)),
+        static_cast<float>(0.4 + 0.6 * wave(0.53, 1.0)),
+        static_cast<float>(0.3 + 0.65 * wave(0.29, 2.0)),
+        static_cast<float>(2000.0 + 14000.0 * wave(0.71, 3.0)),
+        static_cast<float>(-12.0 + 12.0 * wave(0.43, 4.0)) };
+}
+
+template <typename Target>
+static void apply(Target& target, const Parameters& p)
+{
+    target.updateGlobalSizeParameter(p.size);
+    target.updateGlobalDensityParameter(p.density);
+    target.updateFeedbackParameter(p.feedback);
+    target.updateGlobalSVFParameters(p.cutoff, p.gain);
+}
+
+struct Signal {
+    std::string name;
+    std::vector<float> samples;
+    bool automated;
+};
+
+static std::vector<Signal> makeSignals(double sampleRate, double seconds)
+{
+    const size_t length = static_cast<size_t>(seconds * sampleRate);
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> u(-0.5f, 0.5f);
+    std::vector<Signal> signals;
+
+    signals.push_back({ "impulse", std::vector<float>(length, 0.f), false });
+    signals.back().samples[0] = 1.f;
+
+    signals.push_back({ "noise", std::vector<float>(length, 0.f), false });
+    for (size_t i = 0; i < std::min(length, static_cast<size_t>(0.5 * sampleRate)); ++i)
+        signals.back().samples[i] = u(rng);
+
+    signals.push_back({ "sweep", std::vector<float>(length, 0.f), false });
+    {
+        const double f0 = 20.0, f1 = 0.45 * sampleRate, duration = 1.0;
+        const double k = std::log(f1 / f0);
+        for (size_t i = 0; i < std::min(length, static_cast<size_t>(duration * sampleRate)); ++i)
+        {
+            const double t = static_cast<double>(i) / sampleRate;
+            signals.back().samples[i] = static_cast<float>(0.5 * std::sin(2.0 * pi * f0 * duration / k * (std::exp(t / duration * k) - 1.0)));
+        }
+    }
+
+    signals.push_back({ "automation", std::vector<float>(length), true });
+    for (auto& x : signals.back().samples)
+        x = u(rng);
+    return signals;
+}
+
+struct Run {
+    std::string signal;
+    std::string path;
+    std::array<NodeStats, NumNodes> nodes{};
+};
+
+// The settings of every signal but automation.
+static const Parameters fixedParameters{ 1.3f, 0.8f, 0.85f, 9000.f, -4.f };
+
+// blockSize 0: processSample.
+static Run run(const Signal& signal, double sampleRate, int blockSize)
+{
+    Run result{ signal.name, blockSize == 0 ? "sample" : "block " + std::to_string(blockSize) };
+    auto engine = std::make_unique<Engine>();
+    auto reference = std::make_unique<Reference>();
+    engine->prepare(static_cast<float>(sampleRate));
+    reference->prepare(static_cast<float>(sampleRate));
+    apply(*engine, fixedParameters);
+    apply(*reference, fixedParameters);
+
+    const ScopedNoDenormals noDenormals;
+    const size_t length = signal.samples.size();
+    const size_t tailStart = static_cast<size_t>(tailStartSeconds * sampleRate);
+    const size_t step = static_cast<size_t>(blockSize == 0 ? 64 : blockSize);
+    std::vector<float> output(step), expected(step);
+    for (size_t pos = 0; pos < length; pos += step)
+    {
+        const size_t n = std::min(step, length - pos);
+        if (signal.automated)
+        {
+            const Parameters p = automationAt(static_cast<double>(pos) / sampleRate);
+            apply(*engine, p);
+            apply(*reference, p);
+        }
+        const float* in = signal.samples.data() + pos;
+        for (size_t i = 0; i < n; ++i)
+        {
+            expected[i] = reference->processSample(in[i]);
+            if (blockSize == 0)
+            {
+                engine->processSample(in[i]);
+                const auto& values = reference->getNodeValues();
+                for (size_t node = 0; node < NumNodes; ++node)
+                    result.nodes[node].add(engine->nodeState[node], values[node], pos + i >= tailStart);
+            }
+        }
+        if (blockSize != 0)
+        {
+            engine->processBlock(in, output.data(), static_cast<int>(n));
+            for (size_t i = 0; i < n; ++i)
+                result.nodes[NumNodes - 1].add(output[i], expected[i], pos + i >= tailStart);
+            const auto& values = reference->getNodeValues();
+            for (size_t node = 0; node + 1 < NumNodes; ++node)
+            {
+                if (!Engine::Graph::isDead(node))
+                    result.nodes[node].add(engine->nodeState[node], values[node], pos + n >= tailStart);
+            }
+        }
+    }
+    return result;
+}
+
+//--------------------------------------------------------------
+// The other engines on Config, output only. Each path takes blocks of
+// samples and writes numOutputs channels, all expected to equal the
+// reference's output.
+
+struct PairPath {
+    static constexpr int numOutputs = 2;
+    MultiStageReverbPair<Config> engine;
+
+    bool prepare(float sampleRate)
+    {
+        engine.setDetune(0.f);
+        engine.setLfoPhaseOffset(0.f);
+        engine.prepare(sampleRate);
+        return true;
+    }
+    void set(const Parameters& p) { apply(engine, p); }
+    void process(const float* in, float* const* out, int n) { engine.processBlock(in, in, out[0], out[1], n); }
+};
+
+struct BatchPath {
+    static constexpr int numOutputs = 8;
+    MultiStageReverbBatch<Config, numOutputs> engine;
+
+    bool prepare(float sampleRate)
+    {
+        engine.prepare(sampleRate);
+        return true;
+    }
+    void set(const Parameters& p)
+    {
+        for (int lane = 0; lane < numOutputs; ++lane)
+        {
+            engine.updateGlobalSizeParameter(lane, p.size);
+            engine.updateGlobalDensityParameter(lane, p.density);
+            engine.updateFeedbackParameter(lane, p.feedback);
+            engine.updateGlobalSVFParameters(lane, p.cutoff, p.gain);
+        }
+    }
+    void process(const float* in, float* const* out, int n)
+    {
+        std::array<const float*, numOutputs> inputs;
+        inputs.fill(in);
+        engine.processBlock(inputs.data(), out, n);
+    }
+};
+
+struct RuntimePath {
+    static constexpr int numOutputs = 1;
+    RuntimeReverb<> engine;
+
+    bool prepare(float sampleRate)
+    {
+        std::string error;
+        engine.prepare(sampleRate);
+        if (engine.load(topologyFromConfig<Config>(), error))
+            return true;
+        std::fprintf(stderr, "runtime: %s\n", error.c_str());
+        return false;
+    }
+    void set(const Parameters& p) { apply(engine, p); }
+    void process(const float* in, float* const* out, int n) { engine.processBlock(in, out[0], n); }
+};
+
+// Every output of the path goes into the output node's statistics.
+template <typename Path>
+static Run runOutputs(const Signal& signal, double sampleRate, const char* name, int blockSize)
+{
+    Run result{ signal.name, std::string(name) + " " + std::to_string(blockSize) };
+    auto path = std::make_unique<Path>();
+    auto reference = std::make_unique<Reference>();
+    if (!path->prepare(static_cast<float>(sampleRate)))
+    {
+        result.nodes[NumNodes - 1].add(1.f, 0.f, false);
+        return result;
+    }
+    reference->prepare(static_cast<float>(sampleRate));
+    path->set(fixedParameters);
+    apply(*reference, fixedParameters);
+
+    const ScopedNoDenormals noDenormals;
+    const size_t length = signal.samples.size();
+    const size_t tailStart = static_cast<size_t>(tailStartSeconds * sampleRate);
+    const size_t step = static_cast<size_t>(blockSize);
+    std::vector<std::vector<float>> outputs(Path::numOutputs, std::vector<float>(step));
+    std::vector<float*> outputPtrs;
+    for (auto& o : outputs)
+        outputPtrs.push_back(o.data());
+    std::vector<float> expected(step);
+    for (size_t pos = 0; pos < length; pos += step)
+    {
+        const size_t n = std::min(step, length - pos);
+        if (signal.automated)
+        {
+            const Parameters p = automationAt(static_cast<double>(pos) / sampleRate);
+            path->set(p);
+            apply(*reference, p);
+        }
+        const float* in = signal.samples.data() + pos;
+        for (size_t i = 0; i < n; ++i)
+            expected[i] = reference->processSample(in[i]);
+        path->process(in, outputPtrs.data(), static_cast<int>(n));
+        for (const auto& o : outputs)
+        {
+            for (size_t i = 0; i < n; ++i)
+                result.nodes[NumNodes - 1].add(o[i], expected[i], pos + i >= tailStart);
+        }
+    }
+    return result;
+}
+
+static bool within(const NodeStats& s, const Tolerances& t)
+{
+    return s.maxError <= t.maxError && s.rmsError() <= t.rmsError && std::fabs(s.tailDriftDb()) <= t.tailDriftDb;
+}
+
+static const char* nodeName(size_t node, char* buffer, size_t size)
+{
+    if (node == 0)
+        return "input";
+    if (node == NumNodes - 1)
+        return "output";
+    std::snprintf(buffer, size, "stage %zu", node);
+    return buffer;
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 3.0;
+    double sampleRate = 48000.0;
+    Tolerances tolerances;
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--csv") == 0)
+            csv = true;
+        else if (std::strcmp(argv[i], "--rate") == 0 && hasValue)
+            sampleRate = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--max-error") == 0 && hasValue)
+            tolerances.maxError = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--rms-error") == 0 && hasValue)
+            tolerances.rmsError = std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--tail-drift-db") == 0 && hasValue)
+            tolerances.tailDriftDb = std::atof(argv[++i]);
+        else
+            seconds = std::atof(argv[i]);
+    }
+    seconds = std::max(seconds, tailStartSeconds + 0.5);
+
+    if (csv)
+        std::printf("signal,path,node,max_error,rms_error,tail_drift_db,pass\n");
+    else
+        std::printf("%.0f Hz, %.1f s; tolerances: max %g, rms %g, tail drift %g dB\n\n"
+            "%-11s %-10s %-8s %12s %12s %14s\n", sampleRate, seconds,
+            tolerances.maxError, tolerances.rmsError, tolerances.tailDriftDb,
+            "signal", "path", "node", "max error", "rms error", "tail drift dB");
+
+    int failures = 0;
+    for (const Signal& signal : makeSignals(sampleRate, seconds))
+    {
+        std::vector<Run> runs;
+        for (int blockSize : { 0, 1, 37, 64, 512 })
+            runs.push_back(run(signal, sampleRate, blockSize));
+        runs.push_back(runOutputs<PairPath>(signal, sampleRate, "pair", 64));
+        runs.push_back(runOutputs<BatchPath>(signal, sampleRate, "batch", 64));
+        runs.push_back(runOutputs<RuntimePath>(signal, sampleRate, "runtime", 37));
+        for (const Run& r : runs)
+        {
+            bool pass = true;
+            size_t worst = NumNodes - 1;
+            for (size_t node = 0; node < NumNodes; ++node)
+            {
+                const NodeStats& s = r.nodes[node];
+                pass = pass && within(s, tolerances);
+                if (s.maxError > r.nodes[worst].maxError)
+                    worst = node;
+                char buffer[32];
+                if (csv && s.count > 0)
+                    std::printf("%s,%s,%s,%g,%g,%g,%d\n", r.signal.c_str(), r.path.c_str(), nodeName(node, buffer, sizeof(buffer)),
+                        s.maxError, s.rmsError(), s.tailDriftDb(), within(s, tolerances) ? 1 : 0);
+            }
+            if (!csv)
+            {
+                // The output, and the node furthest off if that is another one.
+                for (size_t node : { NumNodes - 1, worst })
+                {
+                    const NodeStats& s = r.nodes[node];
+                    char buffer[32];
+                    std::printf("%-11s %-10s %-8s %12.3g %12.3g %14.3g%s\n", r.signal.c_str(), r.path.c_str(),
+                        nodeName(node, buffer, sizeof(buffer)), s.maxError, s.rmsError(), s.tailDriftDb(),
+                        within(s, tolerances) ? "" : "   FAIL");
+                    if (worst == NumNodes - 1)
+                        break;
+                }
+            }
+            failures += pass ? 0 : 1;
+        }
+    }
+    if (!csv)
+        std::printf("\n%s\n", failures == 0 ? "all paths within tolerance" : "some paths out of tolerance");
+    return failures;
+}